@@ -56,12 +56,16 @@ extern "C" {
   NSString *_name;
   /** The mapping from names to objects in this cache. */
   NSMutableDictionary *_objects;
-  /** LRU ordering of all potentially-evictable objects in this cache. */
+  /** Unused, kept for binary compatibility. */
   NSMutableArray *_accesses;
-  /** Total number of accesses to objects */
+  /** Unused, kept for binary compatibility. */
   int64_t _totalAccesses;
 #endif
 #if     GS_NONFRAGILE
+#  if	defined(GS_NSCache_IVARS)
+@public
+GS_NSCache_IVARS;
+#  endif
 #else
   /* Pointer to private additional data used to avoid breaking ABI
    * when we don't have the non-fragile ABI available.
@@ -152,6 +156,31 @@ extern "C" {
 - (void) setTotalCostLimit: (NSUInteger)lim;
 @end
 
+#if OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+@interface NSCache (GNUstepExtensions)
+/**
+ * Returns the number of objects whose content has been discarded (and
+ * which may have been removed) to keep the cache within its limits.
+ */
+- (NSUInteger) evictionCount;
+
+/**
+ * Returns the number of times -objectForKey: found an object.
+ */
+- (NSUInteger) hitCount;
+
+/**
+ * Returns the number of times -objectForKey: found no object.
+ */
+- (NSUInteger) missCount;
+
+/**
+ * Sets the hit, miss and eviction counts back to zero.
+ */
+- (void) resetStatistics;
+@end
+#endif
+
 /**
  * Protocol implemented by NSCache delegate objects.
  */
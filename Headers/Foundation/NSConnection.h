@@ -160,6 +160,17 @@ GS_NSConnection_IVARS;
 - (NSDictionary*) statistics;
 @end
 
+#if	OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+@interface	NSConnection (GNUstepExtensions)
+- (BOOL) allowsCompactCoding;
+- (BOOL) coalescesOnewayMessages;
+- (void) forwardInvocations: (NSArray*)invocations;
+- (void) setAllowsCompactCoding: (BOOL)flag;
+- (void) setCoalescesOnewayMessages: (BOOL)flag;
+- (BOOL) usesCompactCoding;
+@end
+#endif
+
 
 /**
  * This category represents an informal protocol to which NSConnection
@@ -206,10 +206,18 @@ GS_EXPORT NSString * const NSFileHandleOperationException;
 - (NSString*) socketLocalService;
 - (NSString*) socketService;
 - (NSString*) socketProtocol;
+- (void) transferInBackgroundAndNotifyFrom: (NSFileHandle*)handle
+				    offset: (unsigned long long)offset
+				    length: (unsigned long long)length;
+- (void) transferInBackgroundAndNotifyFrom: (NSFileHandle*)handle
+				    offset: (unsigned long long)offset
+				    length: (unsigned long long)length
+				  forModes: (NSArray*)modes;
 - (BOOL) useCompression;
 - (void) writeInBackgroundAndNotify: (NSData*)item forModes: (NSArray*)modes;
 - (void) writeInBackgroundAndNotify: (NSData*)item;
 - (BOOL) writeInProgress;
+- (NSDictionary*) writeStatistics;
 @end
 
 /**
@@ -343,6 +343,22 @@ typedef	uint32_t	OSType;
  * </p>
  */
 - (NSDirectoryEnumerator*) enumeratorAtPath: (NSString*)path;
+
+#if OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+/**
+ * <p>Returns an enumerator like that returned by -enumeratorAtPath:
+ * but which reads the directory tree using count threads at once,
+ * which may be much faster for a large tree.
+ * </p>
+ * <p>The paths are returned in no particular order, and the
+ * -skipDescendents method has no effect.  If count is less than two
+ * this is the same as -enumeratorAtPath:
+ * </p>
+ */
+- (NSDirectoryEnumerator*) enumeratorAtPath: (NSString*)path
+				    threads: (NSUInteger)count;
+#endif
+
 - (NSDictionary*) fileAttributesAtPath: (NSString*)path
 			  traverseLink: (BOOL)flag;
 
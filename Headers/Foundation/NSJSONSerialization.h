@@ -61,3 +61,90 @@ typedef NSUInteger NSJSONReadingOptions;
                      options:(NSJSONWritingOptions)opt
                        error:(NSError **)error;
 @end
+
+#if OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+@class NSMutableArray;
+@class NSMutableData;
+
+/**
+ * GSJSONReader is an incremental JSON parser.  You push data to it as it
+ * arrives (for instance in chunks read from an NSInputStream) and take
+ * the completed values from it with -nextObject.<br />
+ * The reader parses a sequence of JSON values separated by whitespace
+ * (as in newline delimited JSON), or, if -setReadsArrayElements: has
+ * been used, the elements of a single top level array.  Either way,
+ * each value is returned as soon as it is complete and the data it was
+ * parsed from is discarded, so memory use is bounded by the size of
+ * the largest value rather than the size of the input.<br />
+ * The input must be UTF-8 encoded.
+ */
+@interface GSJSONReader : NSObject
+{
+@private
+  NSMutableData		*_data;
+  NSUInteger		_offset;
+  NSUInteger		_scan;
+  NSUInteger		_depth;
+  NSMutableArray	*_objects;
+  NSError		*_error;
+  NSJSONReadingOptions	_options;
+  int			_state;
+  BOOL			_elements;
+  BOOL			_finished;
+  BOOL			_pending;
+  BOOL			_inString;
+  BOOL			_escape;
+}
+
+/**
+ * Initialises the receiver to parse values using the specified options.
+ */
+- (id) initWithOptions: (NSJSONReadingOptions)opt;
+
+/**
+ * Adds length bytes to the data to be parsed, and parses any values
+ * which are now complete.<br />
+ * Returns NO if the data could not be parsed (see -error).
+ */
+- (BOOL) appendBytes: (const void*)bytes length: (NSUInteger)length;
+
+/**
+ * Calls -appendBytes:length: with the content of data.
+ */
+- (BOOL) appendData: (NSData*)data;
+
+/**
+ * Returns the error which stopped parsing, or nil if there is none.
+ */
+- (NSError*) error;
+
+/**
+ * Tells the receiver that there is no more data, so any value at the end
+ * of the data is complete.<br />
+ * Returns NO if the data ended part way through a value (or before the
+ * end of the top level array when reading array elements).
+ */
+- (BOOL) finish;
+
+/**
+ * Returns the next value which has been parsed, or nil if there are no
+ * values waiting to be taken.
+ */
+- (id) nextObject;
+
+/**
+ * Reads the bytes available from stream and appends them.<br />
+ * Returns the number of bytes read, zero at the end of the stream, or -1
+ * if there was an error reading from the stream or parsing the data.
+ */
+- (NSInteger) readFromStream: (NSInputStream*)stream;
+
+/**
+ * Sets whether the receiver expects the data to contain a single top
+ * level array and returns its elements as separate values (rather than
+ * returning the whole array once it is complete).<br />
+ * This must be set before any data is appended.
+ */
+- (void) setReadsArrayElements: (BOOL)flag;
+@end
+#endif
@@ -141,6 +141,9 @@ GS_EXPORT NSLog_printf_handler	*_NSLog_printf_handler;
 GS_EXPORT int	_NSLogDescriptor;
 @class NSRecursiveLock;
 GS_EXPORT NSRecursiveLock	*GSLogLock(void);
+GS_EXPORT void	GSLogFlush(void);
+GS_EXPORT void	GSLogFlushFromSignal(void);
+GS_EXPORT void	GSLogSetAsynchronous(BOOL flag);
 #endif
 
 GS_EXPORT void	NSLog(NSString *format, ...) NS_FORMAT_FUNCTION(1,2);
@@ -95,6 +95,10 @@ extern "C" {
   NSZone		*_zone;		/* Zone for allocating objs.	*/
 #endif
 #if     GS_NONFRAGILE
+#  if	defined(GS_NSPortCoder_IVARS)
+@public
+GS_NSPortCoder_IVARS;
+#  endif
 #else
   /* Pointer to private additional data used to avoid breaking ABI
    * when we don't have the non-fragile ABI available.
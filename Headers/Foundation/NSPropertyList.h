@@ -71,6 +71,22 @@ typedef NSUInteger NSPropertyListReadOptions;
 @class NSError;
 #endif
 
+#if OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+/**
+ * A GNUstep extension which may be combined with
+ * NSPropertyListImmutable in the read options of
+ * +propertyListWithData:options:format:error: so that the arrays and
+ * dictionaries of a binary property list are decoded as they are used
+ * rather than all at once, and data objects share the bytes of the
+ * property list.  Useful for large property lists (which may be mapped
+ * from a file) of which little is used.  Ignored for other formats and
+ * for mutable results.
+ */
+enum {
+  GSPropertyListReadLazily = 0x10000
+};
+#endif
+
 /**
  * Specifies the serialisation format for a serialised property list.
  * <list>
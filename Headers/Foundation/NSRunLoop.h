@@ -48,7 +48,7 @@ GS_EXPORT NSString * const NSDefaultRunLoopMode;
   NSString		*_currentMode;
   NSMapTable		*_contextMap;
   NSMutableArray	*_contextStack;
-  NSMutableArray	*_timedPerformers;
+  NSMapTable		*_timedPerformers;
   void			*_extra;
 #endif
 }
@@ -37,6 +37,7 @@ extern "C" {
 #import	<Foundation/NSURLCache.h>
 
 @class NSCachedURLResponse;
+@class NSDictionary;
 @class NSError;
 @class NSMutableURLRequest;
 @class NSURLAuthenticationChallenge;
@@ -224,6 +225,38 @@ extern "C" {
 
 @end
 
+#if OS_API_VERSION(GS_API_NONE, GS_API_NONE)
+/**
+ * GNUstep extensions for controlling the pool of idle connections
+ * which the HTTP and HTTPS protocols keep so that further requests to
+ * the same server do not need to connect again.
+ */
+@interface	NSURLProtocol (GNUstepExtensions)
+
+/**
+ * Returns a dictionary of counters describing the use of the connection
+ * pool: 'Hits' (requests sent on a pooled connection), 'Misses' (requests
+ * needing a new connection), 'Expired' (idle connections dropped because
+ * they timed out or were closed by the server), 'Discarded' (connections
+ * closed because the pool for their server was full), 'Idle' (connections
+ * currently in the pool), 'Hosts' (servers with pooled connections) and
+ * 'Pipelined' (requests sent on a connection which was still waiting for
+ * earlier responses, see -[NSURLRequest HTTPShouldUsePipelining]).
+ */
++ (NSDictionary*) connectionPoolStatistics;
+
+/**
+ * Sets the maximum number of idle connections kept for each server
+ * (host, port and whether TLS is used; default 8) and the maximum time
+ * an idle connection is kept (default 120 seconds).<br />
+ * A maximum of zero disables pooling.
+ */
++ (void) setConnectionPoolMaximumIdle: (NSUInteger)max
+			      timeout: (NSTimeInterval)timeout;
+
+@end
+#endif
+
 #if	defined(__cplusplus)
 }
 #endif
@@ -215,6 +215,15 @@ typedef NSUInteger NSURLRequestCachePolicy;
  */
 - (BOOL) HTTPShouldHandleCookies;
 
+#if OS_API_VERSION(MAC_OS_X_VERSION_10_7,GS_API_LATEST)
+/**
+ * Returns a flag indicating whether the request may be sent on a
+ * connection to the server before the responses to earlier requests
+ * on that connection have been received (HTTP pipelining).
+ */
+- (BOOL) HTTPShouldUsePipelining;
+#endif
+
 /**
  * Returns the value for a particular HTTP header field (by case
  * insensitive comparison) or nil if no such header is set.
@@ -270,6 +279,16 @@ typedef NSUInteger NSURLRequestCachePolicy;
  */
 - (void) setHTTPShouldHandleCookies: (BOOL)should;
 
+#if OS_API_VERSION(MAC_OS_X_VERSION_10_7,GS_API_LATEST)
+/**
+ * Sets a flag to say whether the request may be pipelined (sent on a
+ * connection which is still waiting for the responses to earlier
+ * requests).  The default is NO.<br />
+ * Only GET requests are pipelined.
+ */
+- (void) setHTTPShouldUsePipelining: (BOOL)should;
+#endif
+
 /**
  * Sets the value for the sapecified header field, replacing any
  * previously set value.
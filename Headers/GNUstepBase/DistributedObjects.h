@@ -60,7 +60,8 @@ enum {
  METHODTYPE_REPLY,
  PROXY_RELEASE,
  PROXY_RETAIN,
- RETAIN_REPLY
+ RETAIN_REPLY,
+ METHOD_BATCH
 };
 
 
@@ -112,6 +112,14 @@ extern "C" {
  *      GSI_MAP_ZEROED()
  *              Define this macro to check whether a map uses keys which may
  *              be zeroed weak pointers.  
+ *
+ *	GSI_MAP_POW2
+ *		Define this to a non-zero integer value to keep the number of
+ *		buckets at a power of two.  The bucket for a key is then found
+ *		by masking a scrambled hash rather than by an integer division,
+ *		which is considerably cheaper for tables where lookups dominate.
+ *		The scrambling step spreads poorly distributed hash values
+ *		(eg. aligned pointers) across the low order bits.
  */
 
 #ifndef	GSI_MAP_HAS_VALUE
@@ -143,6 +151,9 @@ extern "C" {
 #ifndef GSI_MAP_ZEROED
 #define GSI_MAP_ZEROED(M)		0
 #endif
+#ifndef GSI_MAP_POW2
+#define GSI_MAP_POW2			0
+#endif
 #ifndef GSI_MAP_READ_KEY
 #  define GSI_MAP_READ_KEY(M, x) (*(x))
 #endif
@@ -392,7 +403,17 @@ typedef GSIMapEnumerator_t	*GSIMapEnumerator;
 static INLINE GSIMapBucket
 GSIMapPickBucket(unsigned hash, GSIMapBucket buckets, uintptr_t bucketCount)
 {
+#if	GSI_MAP_POW2
+  /* Scramble the hash so that all of its bits contribute to the low order
+   * bits we use as the index, then mask with the (power of two) size.
+   */
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3bU;
+  hash ^= hash >> 16;
+  return buckets + (hash & (bucketCount - 1));
+#else
   return buckets + hash % bucketCount;
+#endif
 }
 
 static INLINE GSIMapBucket
@@ -734,7 +755,8 @@ GSIMapNodeForSimpleKey(GSIMapTable map, GSIMapKey key)
     {
       return 0;
     }
-  bucket = map->buckets + ((unsigned)key.addr) % map->bucketCount;
+  bucket = GSIMapPickBucket((unsigned)(uintptr_t)key.addr,
+    map->buckets, map->bucketCount);
   node = bucket->firstNode;
   if (GSI_MAP_ZEROED(map))
     {
@@ -764,6 +786,17 @@ GSIMapResize(GSIMapTable map, uintptr_t new_capacity)
 {
   GSIMapBucket	new_buckets;
   uintptr_t	size = 1;
+
+#if	GSI_MAP_POW2
+  /*
+   *	Find next power of two ... GSIMapPickBucket() scrambles the hash
+   *	so we don't suffer from the poor distribution of the low bits.
+   */
+  while (size < new_capacity)
+    {
+      size <<= 1;
+    }
+#else
   uintptr_t	old = 1;
 
   /*
@@ -785,6 +818,7 @@ GSIMapResize(GSIMapTable map, uintptr_t new_capacity)
     {
       size++;
     }
+#endif
 
 #if     GS_WITH_GC
   /* We don't need to use scanned memory because the nodes are not 'owned'
@@ -406,7 +406,12 @@ GSGetMethod(Class cls, SEL sel,
 	    BOOL searchSuperClasses);
 
 /**
- * Deprecated .. does nothing.
+ * Discards any information the base library has cached about the
+ * methods implemented by cls (currently the key-value coding accessor
+ * cache, which is discarded for all classes).<br />
+ * Call this after adding methods to a class using the runtime functions
+ * directly (methods added using GSObjCAddMethods() are dealt with
+ * automatically).
  */
 GS_EXPORT void
 GSFlushMethodCacheForClass (Class cls);
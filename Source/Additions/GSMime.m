@@ -1091,11 +1091,14 @@ wordData(NSString *word)
       beg = 0;
 
       /* Make sure buffer is big enough, and set up output pointers.
-       * ctxt->size is the amount of data laready decoded, so if we
-       * add the size of the chunked source data we are guaranteed
-       * to have enough space for the unchunked data.
+       * The unchunked data can't be larger than the chunked source, so
+       * adding the source length to the existing data size guarantees
+       * that we have enough space.  We use the current size of the
+       * destination rather than the total decoded so far, so that a
+       * caller may empty the destination between calls when it wants
+       * to handle a large body piece by piece.
        */
-      [dData setLength: ctxt->size + [sData length]];
+      [dData setLength: size + aRange.length];
       buf = (unsigned char*)[dData mutableBytes];
       dst = buf + size;
       beg = dst;
@@ -1272,6 +1275,21 @@ wordData(NSString *word)
 	      bytes = (unsigned char*)[data mutableBytes];
 	      dataEnd = [data length];
 	      flags.inBody = 1;
+
+	      /* Anything after the final newline is not part of this
+	       * document (eg. the next response on an HTTP connection)
+	       * and is made available as excess data.
+	       */
+	      if (src < end && '\n' == *src)
+		{
+		  src++;
+		}
+	      if (src < end && nil == boundary)
+		{
+		  boundary = [[NSData alloc] initWithBytes: src
+						    length: end - src];
+		  flags.excessData = 1;
+		}
 	    }
 	}
 
@@ -222,7 +222,9 @@ GSTypesFromSelector(SEL sel)
 void
 GSFlushMethodCacheForClass (Class cls)
 {
-  return;
+#ifndef NeXT_Foundation_LIBRARY
+  GSPrivateKVCFlush();
+#endif
 }
 int
 GSObjCVersion(Class cls)
@@ -564,6 +566,7 @@ GSObjCAddMethods(Class cls, Method *list, BOOL replace)
           BDBGPrintf("    skipped %c%s\n", c, sel_getName(n));
 	}
     }
+  GSFlushMethodCacheForClass(cls);
 }
 
 GSMethod
@@ -997,6 +1000,9 @@ GSObjCAddClassOverride(Class receiver, Class override)
  * value from an object either via an accessor method (if sel is
  * supplied), or via direct access (if type, size, and offset are
  * supplied).<br />
+ * If both sel and type are supplied, type must be the return type of
+ * the method (as previously obtained from its signature), and the
+ * method signature is not looked up again.<br />
  * Automatic conversion between NSNumber and C scalar types is performed.<br />
  * If type is null and can't be determined from the selector, the
  * [NSObject-handleQueryWithUnboundKey:] method is called to try
@@ -1008,7 +1014,7 @@ GSObjCGetVal(NSObject *self, const char *key, SEL sel,
 {
   NSMethodSignature	*sig = nil;
 
-  if (sel != 0)
+  if (sel != 0 && type == NULL)
     {
       sig = [self methodSignatureForSelector: sel];
       if ([sig numberOfArguments] != 2)
@@ -1376,6 +1382,10 @@ GSObjCGetVal(NSObject *self, const char *key, SEL sel,
 		    NSInvocation	*inv;
 		    size_t		retSize;
 
+		    if (sig == nil)
+		      {
+			sig = [self methodSignatureForSelector: sel];
+		      }
 		    inv = [NSInvocation invocationWithMethodSignature: sig];
 		    [inv setSelector: sel];
 		    [inv invokeWithTarget: self];
@@ -1430,6 +1440,9 @@ GSObjCGetValue(NSObject *self, NSString *key, SEL sel,
  * value in an object either via an accessor method (if sel is
  * supplied), or via direct access (if type, size, and offset are
  * supplied).<br />
+ * If both sel and type are supplied, type must be the argument type of
+ * the method (as previously obtained from its signature), and the
+ * method signature is not looked up again.<br />
  * Automatic conversion between NSNumber and C scalar types is performed.<br />
  * If type is null and can't be determined from the selector, the
  * [NSObject-handleTakeValue:forUnboundKey:] method is called to try
@@ -1446,7 +1459,7 @@ GSObjCSetVal(NSObject *self, const char *key, id val, SEL sel,
     {
       null = [NSNull new];
     }
-  if (sel != 0)
+  if (sel != 0 && type == NULL)
     {
       sig = [self methodSignatureForSelector: sel];
       if ([sig numberOfArguments] != 3)
@@ -1829,6 +1842,10 @@ GSObjCSetVal(NSObject *self, const char *key, id val, SEL sel,
 		    char		buf[size];
 
 		    [val getValue: buf];
+		    if (sig == nil)
+		      {
+			sig = [self methodSignatureForSelector: sel];
+		      }
 		    inv = [NSInvocation invocationWithMethodSignature: sig];
 		    [inv setSelector: sel];
 		    [inv setArgument: buf atIndex: 2];
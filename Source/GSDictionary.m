@@ -40,6 +40,7 @@
  */
 #define	GSI_MAP_KTYPES		GSUNION_OBJ
 #define	GSI_MAP_VTYPES		GSUNION_OBJ
+#define	GSI_MAP_POW2		1
 #define	GSI_MAP_HASH(M, X)		[X.obj hash]
 #define	GSI_MAP_EQUAL(M, X,Y)		[X.obj isEqual: Y.obj]
 #define	GSI_MAP_RETAIN_KEY(M, X)	((X).obj) = \
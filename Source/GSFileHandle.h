@@ -60,6 +60,9 @@ struct sockaddr_in;
   int			readMax;
   NSMutableArray	*writeInfo;
   int			writePos;
+  NSUInteger		writeQueueMax;	// Most writes queued at once.
+  unsigned long long	bytesWritten;
+  unsigned long long	writeCalls;	// System calls used to write.
   NSString		*address;
   NSString		*service;
   NSString		*protocol;
@@ -38,6 +38,7 @@
 #import "Foundation/NSByteOrder.h"
 #import "Foundation/NSProcessInfo.h"
 #import "Foundation/NSUserDefaults.h"
+#import "Foundation/NSValue.h"
 #import "GSPrivate.h"
 #import "GSNetwork.h"
 #import "GSFileHandle.h"
@@ -70,6 +71,12 @@
 #  endif
 #endif
 #include <netdb.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#if	defined(__linux__)
+#include <sys/sendfile.h>
+#endif
 
 /*
  *	Stuff for setting the sockets into non-blocking mode.
@@ -97,6 +104,18 @@
 // Maximum data in single I/O operation
 #define	NETBUF_SIZE	4096
 #define	READ_SIZE	NETBUF_SIZE*10
+#define	READ_MAX	(1024 * 1024)	// Most read at once when reads are large.
+#define	SEND_MAX	(1024 * 1024)	// Most sent from a file at once.
+#define	WRITE_MAX	(1024 * 1024)	// Most written at once.
+
+// Most queued writes gathered into one system call.
+#if	defined(IOV_MAX) && IOV_MAX < 1024
+#define	WRITE_IOV	IOV_MAX
+#elif	defined(IOV_MAX)
+#define	WRITE_IOV	1024
+#else
+#define	WRITE_IOV	16
+#endif
 
 static GSFileHandle*	fh_stdin = nil;
 static GSFileHandle*	fh_stdout = nil;
@@ -105,7 +124,15 @@ static GSFileHandle*	fh_stderr = nil;
 // Key to info dictionary for operation mode.
 static NSString*	NotificationKey = @"NSFileHandleNotificationKey";
 
+// Keys to info dictionary for the part of a file still to be transferred.
+static NSString*	TransferOffsetKey = @"GSFileHandleTransferOffset";
+static NSString*	TransferLengthKey = @"GSFileHandleTransferLength";
+
 @interface GSFileHandle(private)
+- (NSInteger) _read: (NSMutableData*)d length: (NSUInteger)len;
+- (void) _transfer: (NSMutableDictionary*)info;
+- (BOOL) _writesDirectly;
+- (void) _writeQueued;
 - (void) receivedEventRead;
 - (void) receivedEventWrite;
 @end
@@ -142,6 +169,20 @@ static NSString*	NotificationKey = @"NSFileHandleNotificationKey";
   return result;
 }
 
+/* Reads up to len bytes directly into the storage of d, following the
+ * bytes it already contains, so the data does not need to be copied.
+ */
+- (NSInteger) _read: (NSMutableData*)d length: (NSUInteger)len
+{
+  NSUInteger	old = [d length];
+  NSInteger	got;
+
+  [d _setLengthUncleared: old + len];
+  got = [self read: (char*)[d mutableBytes] + old length: len];
+  [d setLength: old + (got > 0 ? got : 0)];
+  return got;
+}
+
 /**
  * Encapsulates low level write operation to send data to the operating
  * system.
@@ -167,8 +208,13 @@ static NSString*	NotificationKey = @"NSFileHandleNotificationKey";
 	{
 	  result = write(descriptor, buf, len);
 	}
+      writeCalls++;
     }
   while (result < 0 && EINTR == errno);
+  if (result > 0)
+    {
+      bytesWritten += result;
+    }
   return result;
 }
 
@@ -1210,30 +1256,22 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
 
 - (NSData*) availableData
 {
-  char			buf[READ_SIZE];
   NSMutableData*	d;
   int			len;
 
   [self checkRead];
-  d = [NSMutableData dataWithCapacity: 0];
   if (isStandardFile)
     {
-      if (isNonBlocking == YES)
-	{
-	  [self setNonBlocking: NO];
-	}
-      while ((len = [self read: buf length: sizeof(buf)]) > 0)
-        {
-	  [d appendBytes: buf length: len];
-        }
+      return [self readDataToEndOfFile];
     }
   else
     {
+      d = [NSMutableData dataWithCapacity: 0];
       if (isNonBlocking == NO)
 	{
 	  [self setNonBlocking: YES];
 	}
-      len = [self read: buf length: sizeof(buf)];
+      len = [self _read: d length: READ_SIZE];
 
       if (len <= 0)
 	{
@@ -1246,11 +1284,11 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
 	       * This ensures that we block for *some* data as we should.
 	       */
 	      [self setNonBlocking: NO];
-	      len = [self read: buf length: 1];
+	      len = [self _read: d length: 1];
 	      [self setNonBlocking: YES];
 	      if (len == 1)
 		{
-		  len = [self read: &buf[1] length: sizeof(buf) - 1];
+		  len = [self _read: d length: READ_SIZE - 1];
 		  if (len <= 0)
 		    {
 		      len = 1;
@@ -1262,11 +1300,6 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
 		}
 	    }
 	}
-
-      if (len > 0)
-	{
-	  [d appendBytes: buf length: len];
-	}
     }
   if (len < 0)
     {
@@ -1279,8 +1312,8 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
 
 - (NSData*) readDataToEndOfFile
 {
-  char			buf[READ_SIZE];
   NSMutableData*	d;
+  NSUInteger		size = READ_SIZE;
   int			len;
 
   [self checkRead];
@@ -1288,11 +1321,39 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
     {
       [self setNonBlocking: NO];
     }
-  d = [NSMutableData dataWithCapacity: 0];
-  while ((len = [self read: buf length: sizeof(buf)]) > 0)
+#if	USE_ZLIB
+  if (gzDescriptor == 0)
+#endif
+  if (isStandardFile && descriptor >= 0)
     {
-      [d appendBytes: buf length: len];
+      struct stat	sbuf;
+      off_t		pos = lseek(descriptor, 0, SEEK_CUR);
+
+      /* For a regular file we can make room for the rest of it at once,
+       * plus a byte so the read which finds the end needs no more.
+       */
+      if (pos >= 0 && fstat(descriptor, &sbuf) == 0
+	&& S_ISREG(sbuf.st_mode) && sbuf.st_size > pos
+	&& sbuf.st_size - pos < (off_t)(NSUIntegerMax / 2))
+	{
+	  size = (NSUInteger)(sbuf.st_size - pos) + 1;
+	}
+    }
+  d = [NSMutableData dataWithCapacity: size];
+  do
+    {
+      size = [d capacity] - [d length];
+      if (size == 0)
+	{
+	  /* Out of room, so read more at once as the data grows.
+	   */
+	  size = [d length];
+	  size = (size < READ_SIZE) ? READ_SIZE
+	    : ((size > READ_MAX) ? READ_MAX : size);
+	}
+      len = [self _read: d length: size];
     }
+  while (len > 0);
   if (len < 0)
     {
       [NSException raise: NSFileHandleOperationException
@@ -1306,7 +1367,7 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
 {
   NSMutableData	*d;
   int		got;
-  char		buf[READ_SIZE];
+  unsigned	size = READ_SIZE;
 
   [self checkRead];
   if (isNonBlocking == YES)
@@ -1317,13 +1378,16 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
   d = [NSMutableData dataWithCapacity: len < READ_SIZE ? len : READ_SIZE];
   do
     {
-      int	chunk = len > sizeof(buf) ? sizeof(buf) : len;
+      unsigned	chunk = len > size ? size : len;
 
-      got = [self read: buf length: chunk];
+      got = [self _read: d length: chunk];
       if (got > 0)
 	{
-	  [d appendBytes: buf length: got];
 	  len -= got;
+	  if ((unsigned)got == size && size < READ_MAX)
+	    {
+	      size *= 2;
+	    }
 	}
       else if (got < 0)
 	{
@@ -1353,9 +1417,9 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
     {
       int	toWrite = len - pos;
 
-      if (toWrite > NETBUF_SIZE)
+      if (toWrite > WRITE_MAX)
 	{
-	  toWrite = NETBUF_SIZE;
+	  toWrite = WRITE_MAX;
 	}
       rval = [self write: (char*)ptr+pos length: toWrite];
       if (rval < 0)
@@ -1616,6 +1680,10 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
     }
   [writeInfo addObject: info];
   RELEASE(info);
+  if ([writeInfo count] > writeQueueMax)
+    {
+      writeQueueMax = [writeInfo count];
+    }
   [self watchWriteDescriptor];
 }
 
@@ -1624,6 +1692,151 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
   [self writeInBackgroundAndNotify: item forModes: nil];
 }
 
+- (void) transferInBackgroundAndNotifyFrom: (NSFileHandle*)handle
+				    offset: (unsigned long long)offset
+				    length: (unsigned long long)length
+				  forModes: (NSArray*)modes
+{
+  NSMutableDictionary*	info;
+  struct stat		sbuf;
+
+  [self checkWrite];
+  if (fstat([handle fileDescriptor], &sbuf) != 0 || !S_ISREG(sbuf.st_mode))
+    {
+      [NSException raise: NSInvalidArgumentException
+                  format: @"transfer source is not a regular file"];
+    }
+
+  info = [[NSMutableDictionary alloc] initWithCapacity: 5];
+  [info setObject: handle forKey: NSFileHandleNotificationFileHandleItem];
+  [info setObject: [NSNumber numberWithUnsignedLongLong: offset]
+	   forKey: TransferOffsetKey];
+  [info setObject: [NSNumber numberWithUnsignedLongLong: length]
+	   forKey: TransferLengthKey];
+  [info setObject: GSFileHandleWriteCompletionNotification
+	   forKey: NotificationKey];
+  if (modes != nil)
+    {
+      [info setObject: modes forKey: NSFileHandleNotificationMonitorModes];
+    }
+  [writeInfo addObject: info];
+  RELEASE(info);
+  if ([writeInfo count] > writeQueueMax)
+    {
+      writeQueueMax = [writeInfo count];
+    }
+  [self watchWriteDescriptor];
+}
+
+/* Sends the next part of a file for a background transfer, letting the
+ * kernel copy it to the descriptor where possible, and posts the
+ * notification when the transfer is complete or has failed.
+ */
+- (void) _transfer: (NSMutableDictionary*)info
+{
+  NSFileHandle		*source;
+  unsigned long long	offset;
+  unsigned long long	length;
+  size_t		chunk;
+  ssize_t		sent = -1;
+  BOOL			direct = [self _writesDirectly];
+  NSString		*error = nil;
+
+  source = [info objectForKey: NSFileHandleNotificationFileHandleItem];
+  offset = [[info objectForKey: TransferOffsetKey] unsignedLongLongValue];
+  length = [[info objectForKey: TransferLengthKey] unsignedLongLongValue];
+  if (length == 0)
+    {
+      [self postWriteNotification];
+      return;
+    }
+  chunk = (length > SEND_MAX) ? SEND_MAX : (size_t)length;
+
+#if	defined(__linux__)
+  if (direct == YES)
+    {
+      off_t	pos = (off_t)offset;
+
+      do
+	{
+	  sent = sendfile(descriptor, [source fileDescriptor], &pos, chunk);
+	  writeCalls++;
+	}
+      while (sent < 0 && errno == EINTR);
+      if (sent > 0)
+	{
+	  bytesWritten += sent;
+	}
+      if (sent < 0 && (errno == EINVAL || errno == ENOSYS))
+	{
+	  direct = NO;	// Not supported for these descriptors.
+	}
+    }
+#else
+  direct = NO;
+#endif
+
+  if (direct == NO)
+    {
+      char	buf[READ_SIZE];
+      ssize_t	got;
+
+      if (chunk > sizeof(buf))
+	{
+	  chunk = sizeof(buf);
+	}
+      do
+	{
+	  got = pread([source fileDescriptor], buf, chunk, (off_t)offset);
+	}
+      while (got < 0 && errno == EINTR);
+      if (got < 0)
+	{
+	  error = [NSString stringWithFormat:
+	    @"Transfer read attempt failed - %@", [NSError _last]];
+	}
+      else
+	{
+	  sent = (got == 0) ? 0 : [self write: buf length: got];
+	}
+    }
+
+  if (error == nil)
+    {
+      if (sent == 0)
+	{
+	  error = @"Transfer source ended early";
+	}
+      else if (sent < 0)
+	{
+	  if (errno == EAGAIN || errno == EINTR)
+	    {
+	      return;	// Wait until the descriptor is writable again.
+	    }
+	  error = [NSString stringWithFormat:
+	    @"Write attempt failed - %@", [NSError _last]];
+	}
+    }
+  if (error != nil)
+    {
+      [info setObject: error forKey: GSFileHandleNotificationError];
+      [self postWriteNotification];
+    }
+  else if ((unsigned long long)sent == length)
+    {
+      [info setObject: [NSNumber numberWithUnsignedLongLong: 0]
+	       forKey: TransferLengthKey];
+      [self postWriteNotification];
+    }
+  else
+    {
+      [info setObject: [NSNumber numberWithUnsignedLongLong: offset + sent]
+	       forKey: TransferOffsetKey];
+      [info setObject: [NSNumber numberWithUnsignedLongLong: length - sent]
+	       forKey: TransferLengthKey];
+    }
+}
+
 - (void) postReadNotification
 {
   NSMutableDictionary	*info = readInfo;
@@ -1900,28 +2113,28 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
   else
     {
       NSMutableData	*item;
-      int		length;
+      NSUInteger	length;
       int		received = 0;
-      char		buf[READ_SIZE];
 
       item = [readInfo objectForKey: NSFileHandleNotificationDataItem];
+      /*
+       * When reading to the end of file, read more at once as the data
+       * grows ... otherwise we want a single chunk of data.
+       */
+      length = READ_SIZE;
+      if (readMax == 0 && [item length] > READ_SIZE)
+	{
+	  length = ([item length] > READ_MAX) ? READ_MAX : [item length];
+	}
       /*
        * We may have a maximum data size set...
        */
-      if (readMax > 0)
+      if (readMax > 0 && (unsigned int)readMax - [item length] < length)
         {
           length = (unsigned int)readMax - [item length];
-          if (length > (int)sizeof(buf))
-            {
-	      length = sizeof(buf);
-	    }
-	}
-      else
-	{
-	  length = sizeof(buf);
 	}
 
-      received = [self read: buf length: length];
+      received = [self _read: item length: length];
       if (received == 0)
         { // Read up to end of file.
           [self postReadNotification];
@@ -1940,7 +2153,6 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
 	}
       else
 	{
-	  [item appendBytes: buf length: received];
 	  if (readMax < 0 || (readMax > 0 && (int)[item length] == readMax))
 	    {
 	      // Read a single chunk of data
@@ -1950,6 +2162,116 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
     }
 }
 
+/* Returns YES if data may be written straight to the descriptor, with
+ * no need to compress or encrypt it.
+ */
+- (BOOL) _writesDirectly
+{
+#if	USE_ZLIB
+  if (gzDescriptor != 0)
+    {
+      return NO;
+    }
+#endif
+  if ([self methodForSelector: @selector(write:length:)]
+    != [GSFileHandle instanceMethodForSelector: @selector(write:length:)])
+    {
+      return NO;
+    }
+  return YES;
+}
+
+/* Writes as many of the queued data items as we can in one system call,
+ * and posts a notification for each one completely written.
+ */
+- (void) _writeQueued
+{
+  struct iovec	iov[WRITE_IOV];
+  NSUInteger	count = [writeInfo count];
+  NSUInteger	items = 0;
+  size_t	total = 0;
+  ssize_t	written = 0;
+
+  while (items < count && items < WRITE_IOV && total < WRITE_MAX)
+    {
+      NSDictionary	*info = [writeInfo objectAtIndex: items];
+      NSData		*item;
+      int		pos = (items == 0) ? writePos : 0;
+
+      if ([info objectForKey: NotificationKey]
+	!= GSFileHandleWriteCompletionNotification
+	|| [info objectForKey: TransferLengthKey] != nil)
+	{
+	  break;	// Not a write of data.
+	}
+      item = [info objectForKey: NSFileHandleNotificationDataItem];
+      iov[items].iov_base = (char*)[item bytes] + pos;
+      iov[items].iov_len = [item length] - pos;
+      total += iov[items].iov_len;
+      items++;
+    }
+
+  if (total > 0)
+    {
+      do
+	{
+#if	defined(MSG_MORE)
+	  /* Tell the kernel if we have more to send straight away, so it
+	   * can fill packets rather than sending a short one now.
+	   */
+	  if (isSocket)
+	    {
+	      struct msghdr	msg;
+
+	      memset(&msg, '\0', sizeof(msg));
+	      msg.msg_iov = iov;
+	      msg.msg_iovlen = items;
+	      written = sendmsg(descriptor, &msg,
+		(items < count) ? MSG_MORE : 0);
+	    }
+	  else
+#endif
+	    {
+	      written = writev(descriptor, iov, items);
+	    }
+	  writeCalls++;
+	}
+      while (written < 0 && errno == EINTR);
+      if (written < 0)
+	{
+	  if (errno != EAGAIN)
+	    {
+	      NSString	*s;
+
+	      s = [NSString stringWithFormat:
+		@"Write attempt failed - %@", [NSError _last]];
+	      [[writeInfo objectAtIndex: 0] setObject: s
+		forKey: GSFileHandleNotificationError];
+	      [self postWriteNotification];
+	    }
+	  return;
+	}
+      bytesWritten += written;
+    }
+
+  while (items-- > 0)
+    {
+      NSDictionary	*info = [writeInfo objectAtIndex: 0];
+      NSData		*item;
+      NSUInteger	left;
+
+      item = [info objectForKey: NSFileHandleNotificationDataItem];
+      left = [item length] - writePos;
+      if ((NSUInteger)written < left)
+	{
+	  writePos += written;
+	  break;
+	}
+      written -= left;
+      [self postWriteNotification];	// Write operation completed.
+    }
+}
+
 - (void) receivedEventWrite
 {
   NSString	*operation;
@@ -1989,6 +2311,14 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
       connectOK = NO;
       [self postWriteNotification];
     }
+  else if ([info objectForKey: TransferLengthKey] != nil)
+    {
+      [self _transfer: info];
+    }
+  else if ([self _writesDirectly] == YES)
+    {
+      [self _writeQueued];
+    }
   else
     {
       NSData	*item;
@@ -2154,6 +2484,16 @@ NSString * const GSSOCKSRecvAddr = @"GSSOCKSRecvAddr";
   return service;
 }
 
+- (NSDictionary*) writeStatistics
+{
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedLongLong: bytesWritten], @"BytesWritten",
+    [NSNumber numberWithUnsignedLongLong: writeCalls], @"WriteCalls",
+    [NSNumber numberWithUnsignedInteger: [writeInfo count]], @"WriteQueue",
+    [NSNumber numberWithUnsignedInteger: writeQueueMax], @"WriteQueueMax",
+    nil];
+}
+
 - (BOOL) useCompression
 {
 #if	USE_ZLIB
@@ -63,5 +63,40 @@
 - (void) removeHandle: (GSTcpHandle*)handle;
 @end
 
+@class	NSLock;
+@class	NSMapTable;
+
+/*
+ * Dictionaries of the classes, selectors and short strings sent over a
+ * connection in the compact NSPortCoder format.  Each end numbers the
+ * items it sends and includes an item's definition in its messages until
+ * a message containing that definition has been sent.  The definitions
+ * received from the other end are kept in a separate map.
+ */
+@interface	GSCodingTable : NSObject
+{
+@public
+  NSLock	*lock;
+  NSMapTable	*classes;	/* Class -> number	*/
+  NSMapTable	*selectors;	/* SEL -> number	*/
+  NSMapTable	*strings;	/* NSString -> number	*/
+  NSMapTable	*received;	/* number -> item	*/
+  uint8_t	*sent;		/* Flags for numbers sent	*/
+  unsigned	size;		/* Size of sent flags	*/
+  unsigned	next;		/* Last number used	*/
+}
+- (unsigned) numberForClass: (Class)c known: (BOOL*)known;
+- (unsigned) numberForSelector: (SEL)s known: (BOOL*)known;
+- (unsigned) numberForString: (NSString*)s known: (BOOL*)known;
+- (id) itemForNumber: (unsigned)n;
+- (void) markSent: (const unsigned*)numbers count: (unsigned)count;
+- (void) setItem: (id)item forNumber: (unsigned)n;
+@end
+
+@interface	NSConnection (GSCoding)
+- (GSCodingTable*) _codingTable;
+- (GSCodingTable*) _compactCodingTable;
+@end
+
 #endif
 
@@ -269,6 +269,15 @@ typedef enum {
 + (NSError*) _systemError: (long)number;
 @end
 
+/* Lets data be read directly into the storage of a mutable data object.
+ */
+@interface	NSMutableData (GSPrivate)
+/* Like -setLength: except that any bytes added are not cleared, as the
+ * caller is about to overwrite them.
+ */
+- (void) _setLengthUncleared: (NSUInteger)size;
+@end
+
 @class  NSRunLoop;
 @class  NSLock;
 @class  NSThread;
@@ -280,7 +289,7 @@ typedef enum {
   @public
   NSRunLoop             *loop;
   NSLock                *lock;
-  NSMutableArray        *performers;
+  id                    performers;     // List of pending GSPerformHolder
 #ifdef __MINGW__
   HANDLE	        event;
 #else
@@ -330,6 +339,20 @@ GSPrivateBuildStrings(void) GS_ATTRIB_PRIVATE;
 BOOL
 GSPrivateCheckTasks(void) GS_ATTRIB_PRIVATE;
 
+/* Called by the ports in the base library when they close a descriptor
+ * they have given to the run loop, so that run loops using epoll know
+ * they must register the descriptors of ports afresh (a new descriptor
+ * may have the same number as one which was closed).
+ */
+void
+GSPrivatePortClosedDescriptor(void) GS_ATTRIB_PRIVATE;
+
+/* Returns a count which changes when GSPrivatePortClosedDescriptor()
+ * is called.
+ */
+unsigned
+GSPrivatePortClosedDescriptors(void) GS_ATTRIB_PRIVATE;
+
 /* get the default C-string encoding.
  */
 NSStringEncoding
@@ -418,6 +441,13 @@ GSPrivateRangeOfString(NSString *receiver, NSString *target) GS_ATTRIB_PRIVATE;
 NSMutableArray *
 GSPrivateStackAddresses(void) GS_ATTRIB_PRIVATE;
 
+/* Function to return a counter which is incremented whenever the fire
+ * date of a timer is moved earlier (used by NSRunLoop to know when the
+ * ordering of its timer heaps may have become invalid).
+ */
+unsigned
+GSPrivateTimerEpoch(void) GS_ATTRIB_PRIVATE;
+
 /* Function to return the hash value for a small integer (used by NSNumber).
  */
 unsigned
@@ -517,28 +547,62 @@ GSPrivateIsCollectable(const void *ptr) GS_ATTRIB_PRIVATE;
 NSZone*
 GSAtomicMallocZone (void);
 
+/* State for building a hash incrementally.
+ */
+typedef struct {
+  uint64_t      h1;
+  uint64_t      h2;
+  uint32_t      length;         /* Total number of bytes so far. */
+  uint8_t       carry[16];      /* Bytes not yet incorporated.  */
+} GSPrivateHashState;
+
+/* Set up the per-process random hash seed if the GNUSTEP_RANDOM_HASH
+ * environment variable is set.  Must be called before any hashing.
+ */
+void
+GSPrivateHashInit(void) GS_ATTRIB_PRIVATE;
+
 /* Generate a 32bit hash from supplied byte data.
  */
 uint32_t
 GSPrivateHash(uint32_t seed, const void *bytes, int length)
   GS_ATTRIB_PRIVATE;
 
+/* Generate a 32bit hash from count 8-bit characters.  The result is the
+ * same as for GSPrivateHash() applied to the characters as unichars.
+ */
+uint32_t
+GSPrivateHashLatin1(uint32_t seed, const uint8_t *bytes, int count)
+  GS_ATTRIB_PRIVATE;
+
+/* Initialise the hash state pointed to by s, using the specified seed.
+ */
+void
+GSPrivateStartHash(GSPrivateHashState *s, uint32_t seed)
+  GS_ATTRIB_PRIVATE;
+
 /* Incorporate 'l' bytes of data from the buffer pointed to by 'b' into
- * the hash state information pointed to by p0 and p1.
- * The hash state variables should have been initialised to zero before
- * the first call to this function, and the result should be produced
- * by calling the GSPrivateFinishHash() function.
+ * the hash state pointed to by s, which must have been initialised by
+ * GSPrivateStartHash().  The result should be produced by calling the
+ * GSPrivateFinishHash() function, and is the same as GSPrivateHash()
+ * would produce for all the data at once.
  */
 void
-GSPrivateIncrementalHash(uint32_t *p0, uint32_t *p1, const void *b, int l)
+GSPrivateIncrementalHash(GSPrivateHashState *s, const void *b, int l)
   GS_ATTRIB_PRIVATE;
 
-/* Generate a 32bit hash from supplied state variables resulting from
- * calls to the GSPrivateIncrementalHash() function.
+/* Generate a 32bit hash from the state resulting from calls to the
+ * GSPrivateIncrementalHash() function.
  */
 uint32_t
-GSPrivateFinishHash(uint32_t s0, uint32_t s1, uint32_t totalLength)
+GSPrivateFinishHash(GSPrivateHashState *s)
   GS_ATTRIB_PRIVATE;
 
+/* Discard the cached results of key-value coding accessor lookups.
+ * Must be called when methods are added to a class.
+ */
+void
+GSPrivateKVCFlush(void) GS_ATTRIB_PRIVATE;
+
 #endif /* _GSPrivate_h_ */
 
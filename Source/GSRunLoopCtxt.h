@@ -27,9 +27,16 @@
 
 #import "common.h"
 #import "Foundation/NSException.h"
+#import "Foundation/NSHashTable.h"
 #import "Foundation/NSMapTable.h"
 #import "Foundation/NSRunLoop.h"
 
+/* We only use epoll as a replacement for a real poll() implementation.
+ */
+#if	defined(HAVE_EPOLL) && !defined(HAVE_POLL_F)
+#undef	HAVE_EPOLL
+#endif
+
 /*
  *      Setup for inline operation of arrays.
  */
@@ -54,8 +61,24 @@ typedef struct{
 #endif
 
 @class NSString;
+@class NSTimer;
 @class GSRunLoopWatcher;
 
+/*
+ *	An entry in the heap of timers for a run loop mode.  The heap is
+ *	ordered by the 'when' field (the fire date the timer had when the
+ *	entry was last examined) and, for equal dates, by the order in
+ *	which timers were added.  A timer may be in several modes and have
+ *	its fire date advanced when it fires in one of them, so the 'when'
+ *	field may be earlier than the real fire date; NSRunLoop corrects
+ *	such entries lazily when they reach the top of the heap.
+ */
+typedef struct {
+  NSTimeInterval	when;
+  unsigned long		seq;
+  NSTimer		*timer;
+} GSRunLoopTimer;
+
 @interface	GSRunLoopCtxt : NSObject
 {
 @public
@@ -63,8 +86,14 @@ typedef struct{
   NSString	*mode;		/** The mode for this context.		*/
   GSIArray	performers;	/** The actions to perform regularly.	*/
   unsigned	maxPerformers;
-  GSIArray	timers;		/** The timers set for the runloop mode */
+  GSRunLoopTimer *timers;	/** Heap of timers set for the runloop mode */
+  unsigned	timerCount;	/** Number of entries in the heap	*/
+  unsigned	timerCapacity;	/** Allocated size of the heap		*/
   unsigned	maxTimers;
+  unsigned	timerEpoch;	/** Timer date epoch when heap was built */
+  unsigned long	timerSeq;	/** Count of entries added to the heap	*/
+  unsigned long	timerSwept;	/** Value of timerSeq when heap was built */
+  NSHashTable	*timerSet;	/** Timers present in the heap		*/
   GSIArray	watchers;	/** The inputs set for the runloop mode */
   unsigned	maxWatchers;
   NSTimer	*housekeeper;	/** Housekeeping timer for loop.	*/
@@ -84,6 +113,17 @@ typedef struct{
   unsigned int	pollfds_capacity;
   unsigned int	pollfds_count;
   struct pollfd	*pollfds;
+#ifdef	HAVE_EPOLL
+  int		epfd;		// Descriptor for epoll (or -1 if unused)
+  unsigned int	epoll_limit;	// Size of epoll_reg array
+  int		*epoll_reg;	// Events registered for each descriptor
+  unsigned int	epoll_count;	// Number of registered descriptors
+  int		*epoll_fds;	// The registered descriptors
+  unsigned int	epoll_capacity;	// Size of epoll_fds/events/readyfds
+  struct epoll_event	*epoll_events;
+  struct pollfd	*readyfds;	// Descriptors reported ready by epoll
+  unsigned int	epoll_closed;	// Port descriptors closed when last polled
+#endif
 #endif
 }
 /* Check to see of the thread has been awakened, blocking until it
@@ -95,6 +135,13 @@ typedef struct{
 - (void) endEvent: (void*)data
               for: (GSRunLoopWatcher*)watcher;
 - (void) endPoll;
+#ifdef	HAVE_EPOLL
+/* Called when a watcher for a descriptor is added or removed, so that
+ * the descriptor will be registered with epoll afresh if it is needed
+ * again (the descriptor may have been closed and reused).
+ */
+- (void) forgetDescriptor: (int)fd;
+#endif
 - (id) initWithMode: (NSString*)theMode extra: (void*)e;
 - (BOOL) pollUntil: (int)milliseconds within: (NSArray*)contexts;
 @end
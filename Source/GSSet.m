@@ -37,6 +37,7 @@
 
 #define	GSI_MAP_HAS_VALUE	0
 #define	GSI_MAP_KTYPES		GSUNION_OBJ
+#define	GSI_MAP_POW2		1
 #if	GS_WITH_GC
 #include	<gc/gc_typed.h>
 static GC_descr	nodeDesc;	// Type descriptor for map node.
@@ -75,6 +75,34 @@ static BOOL isByteEncoding(NSStringEncoding enc)
 struct objc_class _NSConstantStringClassReference;
 #endif
 
+/* Return YES if all l bytes at p are ASCII, checking a word at a time.
+ */
+static BOOL
+isASCII(const uint8_t *p, unsigned l)
+{
+  const uint8_t	*e = p + l;
+
+  while (e - p >= (int)sizeof(uint64_t))
+    {
+      uint64_t	w;
+
+      memcpy(&w, p, sizeof(w));
+      if (w & 0x8080808080808080ULL)
+	{
+	  return NO;
+	}
+      p += sizeof(w);
+    }
+  while (p < e)
+    {
+      if (*p++ & 0x80)
+	{
+	  return NO;
+	}
+    }
+  return YES;
+}
+
 /* Determine the length of the UTF-8 string as a unicode (UTF-16) string.
  * sets the ascii flag according to the content found.
  */
@@ -3379,37 +3407,20 @@ transmute(GSStr self, NSString *aString)
 
               ret = GSPrivateHash(0, p, len * sizeof(unichar));
 	    }
-	  else if (len > 64)
-            {
-              return (self->_flags.hash = [super hash]);
-            }
           else
 	    {
-              unichar                   buf[64];
-              unsigned	                index;
 	      const unsigned char	*p = self->_contents.c;
 
-	      if (internalEncoding == NSISOLatin1StringEncoding)
-		{
-                  for (index = 0; index < len; index++)
-                    {
-                      buf[index] = p[index];
-                    }
-                }
-	      else
+	      /* Latin-1 characters are the same as the first 256 unicode
+	       * characters and ASCII ones are the same in any internal
+	       * encoding, so these can be hashed without conversion.
+	       */
+	      if (internalEncoding != NSISOLatin1StringEncoding
+		&& NO == isASCII(p, len))
 		{
-                  for (index = 0; index < len; index++)
-                    {
-		      unichar	u = p[index];
-
-                      if (u > 127)
-                        {
-                          return (self->_flags.hash = [super hash]);
-                        }
-                      buf[index] = u;
-                    }
+		  return (self->_flags.hash = [super hash]);
 		}
-              ret = GSPrivateHash(0, buf, len * sizeof(unichar));
+              ret = GSPrivateHashLatin1(0, p, len);
 	    }
 
 	  /*
@@ -5548,35 +5559,40 @@ literalIsEqual(NXConstantString *self, id anObject)
 {
   if (nxcslen > 0)
     {
-      uint32_t  s0 = 0;
-      uint32_t  s1 = 0;
-      unichar   chunk[64];
       uint32_t	ret;
-      unichar	n = 0;
-      unsigned	i = 0;
-      int       l = 0;
-      uint32_t  t = 0;
 
-      while (i < nxcslen)
+      if (YES == isASCII((const uint8_t*)nxcsptr, nxcslen))
 	{
-	  chunk[l++] = nextUTF8((const uint8_t *)nxcsptr, nxcslen, &i, &n);
-	  if (64 == l)
-            {
-              GSPrivateIncrementalHash(&s0, &s1, chunk, l * sizeof(unichar));
-              t += l;
-              l = 0;
-            }
+	  ret = GSPrivateHashLatin1(0, (const uint8_t*)nxcsptr, nxcslen);
 	}
-      if (0 != n)
+      else
 	{
-	  chunk[l++] = n;	// Add final character
+	  GSPrivateHashState	state;
+	  unichar   		chunk[64];
+	  unichar		n = 0;
+	  unsigned		i = 0;
+	  int       		l = 0;
+
+	  GSPrivateStartHash(&state, 0);
+	  while (i < nxcslen)
+	    {
+	      chunk[l++] = nextUTF8((const uint8_t *)nxcsptr, nxcslen, &i, &n);
+	      if (64 == l)
+		{
+		  GSPrivateIncrementalHash(&state, chunk, l * sizeof(unichar));
+		  l = 0;
+		}
+	    }
+	  if (0 != n)
+	    {
+	      chunk[l++] = n;	// Add final character
+	    }
+	  if (l > 0)
+	    {
+	      GSPrivateIncrementalHash(&state, chunk, l * sizeof(unichar));
+	    }
+	  ret = GSPrivateFinishHash(&state);
 	}
-      if (l > 0)
-        {
-          GSPrivateIncrementalHash(&s0, &s1, chunk, l * sizeof(unichar));
-          t += l;
-        }
-      ret = GSPrivateFinishHash(s0, s1, t * sizeof(unichar));
       ret &= 0x0fffffff;
       if (ret == 0)
 	{
@@ -2058,6 +2058,10 @@ IF_NO_GC(
 	  return NO;
 	}
 
+      /* Categories in the loaded code may have added methods to existing
+	 classes, so cached information about methods is out of date. */
+      GSFlushMethodCacheForClass(Nil);
+
       /* We now construct the list of bundles from frameworks linked with
 	 this one */
       classEnumerator = [_loadingFrameworks objectEnumerator];
@@ -24,30 +24,86 @@
 
 #import "common.h"
 
+#define	GS_NSCache_IVARS \
+  NSRecursiveLock	*lock; \
+  id			lru; \
+  NSUInteger		hits; \
+  NSUInteger		misses; \
+  NSUInteger		evictions; \
+  NSUInteger		evictable
+
 #define	EXPOSE_NSCache_IVARS	1
 
-#import "Foundation/NSArray.h"
 #import "Foundation/NSCache.h"
 #import "Foundation/NSDictionary.h"
 #import "Foundation/NSEnumerator.h"
+#import "Foundation/NSLock.h"
+
+#define	GSInternal		NSCacheInternal
+#include	"GSInternal.h"
+GS_PRIVATE_INTERNAL(NSCache)
 
 /**
  * _GSCachedObject is effectively used as a structure containing the various
  * things that need to be associated with objects stored in an NSCache.  It is
  * an NSObject subclass so that it can be used with OpenStep collection
- * classes.
+ * classes.  Evictable objects are also linked into a circular list in
+ * least recently used order (the links are not retained).
  */
 @interface _GSCachedObject : NSObject
 {
   @public
   id object;
   NSString *key;
-  int accessCount;
   NSUInteger cost;
   BOOL isEvictable;
+  _GSCachedObject *prev;
+  _GSCachedObject *next;
 }
 @end
 
+/* Add an object at the most recently used end of the list.
+ */
+static inline void
+lruAppend(id *head, _GSCachedObject *obj)
+{
+  _GSCachedObject	*h = *head;
+
+  if (nil == h)
+    {
+      obj->prev = obj->next = obj;
+      *head = obj;
+    }
+  else
+    {
+      obj->next = h;
+      obj->prev = h->prev;
+      h->prev->next = obj;
+      h->prev = obj;
+    }
+}
+
+/* Remove an object from the list.
+ */
+static inline void
+lruRemove(id *head, _GSCachedObject *obj)
+{
+  if (obj->next == obj)
+    {
+      *head = nil;
+    }
+  else
+    {
+      obj->prev->next = obj->next;
+      obj->next->prev = obj->prev;
+      if (*head == obj)
+	{
+	  *head = obj->next;
+	}
+    }
+  obj->prev = obj->next = nil;
+}
+
 @interface NSCache (EvictionPolicy)
 /** The method controlling eviction policy in an NSCache. */
 - (void) _evictObjectsToMakeSpaceForObjectWithCost: (NSUInteger)cost;
@@ -60,8 +116,9 @@
     {
       return nil;
     }
+  GS_CREATE_INTERNAL(NSCache)
+  internal->lock = [NSRecursiveLock new];
   _objects = [NSMutableDictionary new];
-  _accesses = [NSMutableArray new];
   return self;
 }
 
@@ -87,48 +144,68 @@
 
 - (id) objectForKey: (id)key
 {
-  _GSCachedObject *obj = [_objects objectForKey: key];
+  _GSCachedObject *obj;
+  id result;
 
+  [internal->lock lock];
+  obj = [_objects objectForKey: key];
   if (nil == obj)
     {
+      internal->misses++;
+      [internal->lock unlock];
       return nil;
     }
+  internal->hits++;
   if (obj->isEvictable)
     {
       // Move the object to the end of the access list.
-      [_accesses removeObjectIdenticalTo: obj];
-      [_accesses addObject: obj];
+      lruRemove(&internal->lru, obj);
+      lruAppend(&internal->lru, obj);
     }
-  obj->accessCount++;
-  _totalAccesses++;
-  return obj->object;
+  result = [[obj->object retain] autorelease];
+  [internal->lock unlock];
+  return result;
 }
 
 - (void) removeAllObjects
 {
-  NSEnumerator *e = [_objects objectEnumerator];
+  NSEnumerator *e;
   _GSCachedObject *obj;
 
+  [internal->lock lock];
+  e = [_objects objectEnumerator];
   while (nil != (obj = [e nextObject]))
     {
       [_delegate cache: self willEvictObject: obj->object];
     }
+  while (nil != internal->lru)
+    {
+      lruRemove(&internal->lru, internal->lru);
+    }
+  internal->evictable = 0;
   [_objects removeAllObjects];
-  [_accesses removeAllObjects];
-  _totalAccesses = 0;
+  _totalCost = 0;
+  [internal->lock unlock];
 }
 
 - (void) removeObjectForKey: (id)key
 {
-  _GSCachedObject *obj = [_objects objectForKey: key];
+  _GSCachedObject *obj;
 
+  [internal->lock lock];
+  obj = [_objects objectForKey: key];
   if (nil != obj)
     {
       [_delegate cache: self willEvictObject: obj->object];
-      _totalAccesses -= obj->accessCount;
+      if (obj->isEvictable)
+	{
+	  lruRemove(&internal->lru, obj);
+	  internal->evictable--;
+	}
+      _totalCost -= obj->cost;
       [_objects removeObjectForKey: key];
-      [_accesses removeObjectIdenticalTo: obj];
     }
+  [internal->lock unlock];
 }
 
 - (void) setCountLimit: (NSUInteger)lim
@@ -148,14 +225,18 @@
 
 - (void) setName: (NSString*)cacheName
 {
+  [internal->lock lock];
   ASSIGN(_name, cacheName);
+  [internal->lock unlock];
 }
 
 - (void) setObject: (id)obj forKey: (id)key cost: (NSUInteger)num
 {
-  _GSCachedObject *oldObject = [_objects objectForKey: key];
+  _GSCachedObject *oldObject;
   _GSCachedObject *newObject;
 
+  [internal->lock lock];
+  oldObject = [_objects objectForKey: key];
   if (nil != oldObject)
     {
       [self removeObjectForKey: oldObject->key];
@@ -169,11 +250,13 @@
   if ([obj conformsToProtocol: @protocol(NSDiscardableContent)])
     {
       newObject->isEvictable = YES;
-      [_accesses addObject: newObject];
+      lruAppend(&internal->lru, newObject);
+      internal->evictable++;
     }
   [_objects setObject: newObject forKey: key];
   RELEASE(newObject);
   _totalCost += num;
+  [internal->lock unlock];
 }
 
 - (void) setObject: (id)obj forKey: (id)key
@@ -193,87 +276,106 @@
 
 /**
  * This method is the one that handles the eviction policy.  This
- * implementation uses a relatively simple LRU/LFU hybrid.  The NSCache
- * documentation from Apple makes it clear that the policy may change, so we
- * could in future have a class cluster with pluggable policies for different
+ * implementation discards the contents of the least recently used
+ * evictable objects until there is enough space, giving objects whose
+ * content cannot currently be discarded a second chance by moving them
+ * to the most recently used end of the list.  The NSCache documentation
+ * from Apple makes it clear that the policy may change, so we could in
+ * future have a class cluster with pluggable policies for different
  * caches or some other mechanism.
  */
 - (void)_evictObjectsToMakeSpaceForObjectWithCost: (NSUInteger)cost
 {
   NSUInteger spaceNeeded = 0;
+  NSUInteger countNeeded = 0;
   NSUInteger count = [_objects count];
+  NSUInteger tries = internal->evictable;
 
   if (_costLimit > 0 && _totalCost + cost > _costLimit)
     {
       spaceNeeded = _totalCost + cost - _costLimit;
     }
+  if (_countLimit > 0 && count >= _countLimit)
+    {
+      countNeeded = count - _countLimit + 1;
+    }
 
-  // Only evict if we need the space.
-  if (count > 0 && (spaceNeeded > 0 || count >= _countLimit))
+  // Only evict if we need the space, and try each object at most once.
+  while ((spaceNeeded > 0 || countNeeded > 0) && tries-- > 0)
     {
-      NSMutableArray *evictedKeys = nil;
-      // Round up slightly.
-      NSUInteger averageAccesses = (_totalAccesses / count * 0.2) + 1;
-      NSEnumerator *e = [_accesses objectEnumerator];
-      _GSCachedObject *obj;
+      _GSCachedObject *obj = internal->lru;
 
-      if (_evictsObjectsWithDiscardedContent)
+      lruRemove(&internal->lru, obj);
+      [obj->object discardContentIfPossible];
+      if ([obj->object isContentDiscarded])
 	{
-	  evictedKeys = [[NSMutableArray alloc] init];
-	}
-      while (nil != (obj = [e nextObject]))
-	{
-	  // Don't evict frequently accessed objects.
-	  if (obj->accessCount < averageAccesses && obj->isEvictable)
+	  NSUInteger cost = obj->cost;
+
+	  // Evicted objects have no cost.
+	  obj->cost = 0;
+	  // Don't try evicting this again in future; it's gone already.
+	  obj->isEvictable = NO;
+	  internal->evictable--;
+	  internal->evictions++;
+	  _totalCost -= cost;
+	  spaceNeeded = (cost > spaceNeeded) ? 0 : spaceNeeded - cost;
+	  if (countNeeded > 0)
 	    {
-	      [obj->object discardContentIfPossible];
-	      if ([obj->object isContentDiscarded])
-		{
-		  NSUInteger cost = obj->cost;
-
-		  // Evicted objects have no cost.
-		  obj->cost = 0;
-		  // Don't try evicting this again in future; it's gone already.
-		  obj->isEvictable = NO;
-		  // Remove this object as well as its contents if required
-		  if (_evictsObjectsWithDiscardedContent)
-		    {
-		      [evictedKeys addObject: obj->key];
-		    }
-		  _totalCost -= cost;
-		  // If we've freed enough space, give up
-		  if (cost > spaceNeeded)
-		    {
-		      break;
-		    }
-		  spaceNeeded -= cost;
-		}
+	      countNeeded--;
 	    }
-	}
-      // Evict all of the objects whose content we have discarded if required
-      if (_evictsObjectsWithDiscardedContent)
-	{
-	  NSString *key;
-
-	  e = [evictedKeys objectEnumerator];
-	  while (nil != (key = [e nextObject]))
+	  // Remove this object as well as its contents if required
+	  if (_evictsObjectsWithDiscardedContent)
 	    {
-	      [self removeObjectForKey: key];
+	      [self removeObjectForKey: obj->key];
 	    }
 	}
-    [evictedKeys release];
+      else
+	{
+	  lruAppend(&internal->lru, obj);
+	}
     }
 }
 
 - (void) dealloc
 {
+  while (nil != internal->lru)
+    {
+      lruRemove(&internal->lru, internal->lru);
+    }
   [_name release];
   [_objects release];
-  [_accesses release];
+  [internal->lock release];
+  GS_DESTROY_INTERNAL(NSCache)
   [super dealloc];
 }
 @end
 
+@implementation NSCache (GNUstepExtensions)
+- (NSUInteger) evictionCount
+{
+  return internal->evictions;
+}
+
+- (NSUInteger) hitCount
+{
+  return internal->hits;
+}
+
+- (NSUInteger) missCount
+{
+  return internal->misses;
+}
+
+- (void) resetStatistics
+{
+  [internal->lock lock];
+  internal->hits = 0;
+  internal->misses = 0;
+  internal->evictions = 0;
+  [internal->lock unlock];
+}
+@end
+
 @implementation _GSCachedObject
 - (void)dealloc
 {
@@ -68,7 +68,17 @@
   NSString		*_remoteName; \
   NSString		*_registeredName; \
   NSPortNameServer	*_nameServer; \
-  int			_lastKeepalive
+  int			_lastKeepalive; \
+  BOOL			_coalesceOneway; \
+  unsigned		_roundTrips; \
+  unsigned		_batchesOut; \
+  unsigned		_batchedOut; \
+  NSMutableArray	*_batch; \
+  NSMutableData		*_batchDefs; \
+  BOOL			_compactOut; \
+  BOOL			_compactRefused; \
+  unsigned		_bytesOut; \
+  id			_codingTable
 
 #define	EXPOSE_NSDistantObject_IVARS	1
 
@@ -131,6 +141,7 @@ static GC_descr	nodeDesc;	// Type descriptor for map node.
 #import "Foundation/NSData.h"
 #import "Foundation/NSRunLoop.h"
 #import "Foundation/NSArray.h"
+#import "Foundation/NSByteOrder.h"
 #import "Foundation/NSDictionary.h"
 #import "Foundation/NSValue.h"
 #import "Foundation/NSDate.h"
@@ -165,6 +176,9 @@ GSRunLoopForThread(NSThread *aThread)
 
 @interface	NSPortCoder (Private)
 - (NSMutableArray*) _components;
+- (void) _addDefinitionsTo: (NSMutableData*)d;
+- (void) _definitionsSent;
+- (BOOL) _hasMoreData;
 @end
 @interface	NSPortMessage (Private)
 - (NSMutableArray*) _components;
@@ -206,6 +220,33 @@ static Class	sendCoderClass;
 static Class	recvCoderClass;
 static Class	runLoopClass;
 
+/*
+ * Capabilities offered at the end of a root proxy request, and accepted
+ * at the end of the reply.  Older versions ignore them.
+ */
+#define	CAP_COMPACT	0x01	/* Compact NSPortCoder format.	*/
+
+/*
+ * The number of bytes of data in the components of a message.
+ */
+static unsigned
+bytesInComponents(NSArray *components)
+{
+  NSUInteger	count = [components count];
+  unsigned	total = 0;
+
+  while (count-- > 0)
+    {
+      id	o = [components objectAtIndex: count];
+
+      if ([o isKindOfClass: [NSData class]] == YES)
+	{
+	  total += [o length];
+	}
+    }
+  return total;
+}
+
 static NSString*
 stringFromMsgType(int type)
 {
@@ -231,6 +272,8 @@ stringFromMsgType(int type)
 	return @"proxy retain";
       case RETAIN_REPLY:
 	return @"retain replay";
+      case METHOD_BATCH:
+	return @"method batch";
       default:
 	return @"unknown operation type!";
     }
@@ -326,6 +369,16 @@ GS_PRIVATE_INTERNAL(NSConnection)
 #define	IregisteredName		(internal->_registeredName)
 #define	InameServer		(internal->_nameServer)
 #define	IlastKeepalive		(internal->_lastKeepalive)
+#define	IcoalesceOneway		(internal->_coalesceOneway)
+#define	IroundTrips		(internal->_roundTrips)
+#define	IbatchesOut		(internal->_batchesOut)
+#define	IbatchedOut		(internal->_batchedOut)
+#define	Ibatch			(internal->_batch)
+#define	IbatchDefs		(internal->_batchDefs)
+#define	IcompactOut		(internal->_compactOut)
+#define	IcompactRefused		(internal->_compactRefused)
+#define	IbytesOut		(internal->_bytesOut)
+#define	IcodingTable		(internal->_codingTable)
 
 /** </ignore> */
 
@@ -339,14 +392,23 @@ GS_PRIVATE_INTERNAL(NSConnection)
 - (void) addLocalObject: (NSDistantObject*)anObj;
 - (void) removeLocalObject: (NSDistantObject*)anObj;
 
+- (void) _discardReply: (unsigned)seq forInvocation: (NSInvocation*)inv;
 - (void) _doneInReply: (NSPortCoder*)c;
 - (void) _doneInRmc: (NSPortCoder*)c;
 - (void) _failInRmc: (NSPortCoder*)c;
 - (void) _failOutRmc: (NSPortCoder*)c;
+- (BOOL) _flushBatch;
+- (NSPortCoder*) _encodeInvocation: (NSInvocation*)inv
+			  forProxy: (NSDistantObject*)object
+			  sequence: (unsigned*)seq
+			      type: (const char**)type
+			 outParams: (BOOL*)outParams
+		     needsResponse: (BOOL*)needsResponse;
 - (NSPortCoder*) _getReplyRmc: (int)sn;
 - (NSPortCoder*) _makeInRmc: (NSMutableArray*)components;
 - (NSPortCoder*) _makeOutRmc: (int)sequence generate: (int*)sno reply: (BOOL)f;
 - (void) _portIsInvalid: (NSNotification*)notification;
+- (void) _queueOutRmc: (NSPortCoder*)c;
 - (void) _sendOutRmc: (NSPortCoder*)c type: (int)msgid;
 
 - (void) _service_forwardForProxy: (NSPortCoder*)rmc;
@@ -356,6 +418,10 @@ GS_PRIVATE_INTERNAL(NSConnection)
 - (void) _service_shutdown: (NSPortCoder*)rmc;
 - (void) _service_typeForSelector: (NSPortCoder*)rmc;
 - (void) _shutdown;
+- (id) _takeReply: (unsigned)seq
+    forInvocation: (NSInvocation*)inv
+	     type: (const char*)type
+	outParams: (BOOL)outParams;
 + (void) _threadWillExit: (NSNotification*)notification;
 @end
 
@@ -367,6 +433,11 @@ static NSTimer		*timer = nil;
 static BOOL cacheCoders = NO;
 static int debug_connection = 0;
 
+/*
+ * The largest number of messages sent together as one METHOD_BATCH.
+ */
+#define	MAX_BATCH	64
+
 static NSHashTable	*connection_table;
 static GSLazyRecursiveLock		*connection_table_gate = nil;
 
@@ -1252,6 +1323,10 @@ static NSLock	*cached_proxies_gate = nil;
  */
 - (void) invalidate
 {
+  /* Send any batched messages while we still can.
+   */
+  [self _flushBatch];
+
   GS_M_LOCK(IrefGate);
   if (IisValid == NO)
     {
@@ -1680,10 +1755,27 @@ static NSLock	*cached_proxies_gate = nil;
       return [self rootObject];
     }
   op = [self _makeOutRmc: 0 generate: &seq_num reply: YES];
+  if (IcompactRefused == NO)
+    {
+      unsigned	caps = CAP_COMPACT;
+
+      [op encodeValueOfObjCType: @encode(unsigned) at: &caps];
+    }
   [self _sendOutRmc: op type: ROOTPROXY_REQUEST];
 
+  IroundTrips++;
   ip = [self _getReplyRmc: seq_num];
   [ip decodeValueOfObjCType: @encode(id) at: &newProxy];
+  if ([ip _hasMoreData] == YES)
+    {
+      unsigned	caps;
+
+      [ip decodeValueOfObjCType: @encode(unsigned) at: &caps];
+      if ((caps & CAP_COMPACT) && IcompactRefused == NO)
+	{
+	  IcompactOut = YES;
+	}
+    }
   [self _doneInRmc: ip];
   return AUTORELEASE(newProxy);
 }
@@ -1831,6 +1923,25 @@ static NSLock	*cached_proxies_gate = nil;
  *   <desc>
  *     The number of remote objects currently in use.
  *   </desc>
+ *   <term>NSConnectionRoundTrips</term>
+ *   <desc>
+ *     The number of times the NSConnection has sent requests and waited
+ *     for the replies.  Requests sent together by -forwardInvocations:
+ *     count as a single round trip.
+ *   </desc>
+ *   <term>NSConnectionBatchesSent</term>
+ *   <desc>
+ *     The number of port messages sent containing more than one request.
+ *   </desc>
+ *   <term>NSConnectionBatchedRequests</term>
+ *   <desc>
+ *     The number of requests sent in those port messages.
+ *   </desc>
+ *   <term>NSConnectionBytesSent</term>
+ *   <desc>
+ *     The number of bytes of data sent in port messages, not counting
+ *     the headers added by the ports.
+ *   </desc>
  * </deflist>
  */
 - (NSDictionary*) statistics
@@ -1868,6 +1979,14 @@ static NSLock	*cached_proxies_gate = nil;
   [d setObject: o forKey: @"NSConnectionReplyQueue"];
   o = [NSNumber numberWithUnsignedInt: [IrequestQueue count]];
   [d setObject: o forKey: @"NSConnectionRequestQueue"];
+  o = [NSNumber numberWithUnsignedInt: IroundTrips];
+  [d setObject: o forKey: @"NSConnectionRoundTrips"];
+  o = [NSNumber numberWithUnsignedInt: IbatchesOut];
+  [d setObject: o forKey: @"NSConnectionBatchesSent"];
+  o = [NSNumber numberWithUnsignedInt: IbatchedOut];
+  [d setObject: o forKey: @"NSConnectionBatchedRequests"];
+  o = [NSNumber numberWithUnsignedInt: IbytesOut];
+  [d setObject: o forKey: @"NSConnectionBytesSent"];
 
   GSM_UNLOCK(IrefGate);
 
@@ -1936,6 +2055,9 @@ static NSLock	*cached_proxies_gate = nil;
   DESTROY(IsendPort);
 
   DESTROY(IrequestQueue);
+  DESTROY(Ibatch);
+  DESTROY(IbatchDefs);
+  DESTROY(IcodingTable);
   if (IreplyMap != 0)
     {
       GSIMapEnumerator_t	enumerator;
@@ -1979,223 +2101,277 @@ static NSLock	*cached_proxies_gate = nil;
   BOOL		needsResponse;
   const char	*type;
   unsigned	seq;
-  NSRunLoop	*runLoop = GSRunLoopForThread(nil);
+  id		exc;
 
-  if ([IrunLoops indexOfObjectIdenticalTo: runLoop] == NSNotFound)
+  op = [self _encodeInvocation: inv
+		      forProxy: object
+		      sequence: &seq
+			  type: &type
+		     outParams: &outParams
+		 needsResponse: &needsResponse];
+
+  if (needsResponse == NO && IcoalesceOneway == YES)
     {
-      if (ImultipleThreads == NO)
-	{
-	  [NSException raise: NSObjectInaccessibleException
-		      format: @"Forwarding message in wrong thread"];
-	}
-      else
-	{
-	  [self addRunLoop: runLoop];
-	}
+      [self _queueOutRmc: op];
     }
+  else
+    {
+      [self _sendOutRmc: op type: METHOD_REQUEST];
+    }
+  NSDebugMLLog(@"NSConnection", @"Sent message %s RMC %d to 0x%"PRIxPTR,
+    sel_getName([inv selector]), seq, (NSUInteger)self);
 
-  /* Encode the method on an RMC, and send it. */
-
-  NSParameterAssert (IisValid);
-
-  /* get the method types from the selector */
-  type = [[inv methodSignature] methodType];
-  if (type == 0 || *type == '\0')
+  if (needsResponse == NO)
     {
-      type = [[object methodSignatureForSelector: [inv selector]] methodType];
-      if (type)
+      [self _discardReply: seq forInvocation: inv];
+    }
+  else
+    {
+      IroundTrips++;
+      exc = [self _takeReply: seq
+	       forInvocation: inv
+			type: type
+		   outParams: outParams];
+      if (exc != nil)
 	{
-	  GSSelectorFromNameAndTypes(sel_getName([inv selector]), type);
+	  [exc raise];
 	}
     }
-  NSParameterAssert(type);
-  NSParameterAssert(*type);
-
-  op = [self _makeOutRmc: 0 generate: (int*)&seq reply: YES];
+}
 
-  if (debug_connection > 4)
-    NSLog(@"building packet seq %d", seq);
+/**
+ * Returns YES (the default) if the receiver offers to use the compact
+ * message format when it asks for a root proxy, and accepts the offer
+ * of it from the other end, NO if it uses only the original format.
+ */
+- (BOOL) allowsCompactCoding
+{
+  return (IcompactRefused == NO) ? YES : NO;
+}
 
-  [inv setTarget: object];
-  outParams = [inv encodeWithDistantCoder: op passPointers: NO];
+/**
+ * Returns YES if oneway messages sent through the receiver are collected
+ * and sent together, NO (the default) if each is sent as soon as it is
+ * forwarded.
+ */
+- (BOOL) coalescesOnewayMessages
+{
+  return IcoalesceOneway;
+}
 
-  if (outParams == YES)
+/**
+ * Sends all the invocations in the array (each of which must have a
+ * proxy for an object on the receiver's connection as its target)
+ * before waiting for any replies, so the whole array costs a single
+ * round trip rather than one per invocation.<br />
+ * The invocations are delivered to the remote objects in order, and
+ * on return each has its return value and any out parameters set just
+ * as if it had been forwarded on its own.<br />
+ * If the remote end raised exceptions, the first of them is raised
+ * once all the replies have been received.<br />
+ * If the receiver coalesces oneway messages, all the invocations are
+ * sent in a single port message.
+ */
+- (void) forwardInvocations: (NSArray*)invocations
+{
+  NSUInteger		count = [invocations count];
+  NSMutableData		*info;
+  unsigned		*seqs;
+  const char		**types;
+  BOOL			*outParams;
+  BOOL			*needsResponse;
+  BOOL			needsReply = NO;
+  NSUInteger		sent = 0;
+  NSUInteger		i;
+  id			exc = nil;
+
+  if (count == 0)
     {
-      needsResponse = YES;
+      return;
     }
-  else
+  for (i = 0; i < count; i++)
     {
-      int		flags;
+      id	target = [[invocations objectAtIndex: i] target];
 
-      needsResponse = NO;
-      flags = objc_get_type_qualifiers(type);
-      if ((flags & _F_ONEWAY) == 0)
+      if ([target isProxy] == NO
+	|| [target connectionForProxy] != self
+	|| ((NSDistantObject*)target)->_object != nil)
 	{
-	  needsResponse = YES;
+	  [NSException raise: NSInvalidArgumentException
+		      format: @"invocation %"PRIuPTR" is not for a remote"
+	    @" object on %@", i, self];
 	}
-      else
+    }
+
+  /* Keep the per-invocation details in a single autoreleased buffer so
+   * that they are freed even if an exception is raised.
+   */
+  info = [NSMutableData dataWithLength: count
+    * (sizeof(unsigned) + sizeof(const char*) + 2 * sizeof(BOOL))];
+  types = (const char**)[info mutableBytes];
+  seqs = (unsigned*)&types[count];
+  outParams = (BOOL*)&seqs[count];
+  needsResponse = &outParams[count];
+
+  /* Send (or queue) all the requests.
+   */
+  NS_DURING
+    {
+      for (sent = 0; sent < count; sent++)
 	{
-	  const char	*tmptype = objc_skip_type_qualifiers(type);
+	  NSInvocation	*inv = [invocations objectAtIndex: sent];
+	  NSPortCoder	*op;
 
-	  if (*tmptype != _C_VOID)
+	  op = [self _encodeInvocation: inv
+			      forProxy: [inv target]
+			      sequence: &seqs[sent]
+				  type: &types[sent]
+			     outParams: &outParams[sent]
+			 needsResponse: &needsResponse[sent]];
+	  if (needsResponse[sent] == YES)
+	    {
+	      needsReply = YES;
+	    }
+	  if (IcoalesceOneway == YES)
+	    {
+	      [self _queueOutRmc: op];
+	    }
+	  else
 	    {
-	      needsResponse = YES;
+	      [self _sendOutRmc: op type: METHOD_REQUEST];
 	    }
 	}
+      if (IcoalesceOneway == YES && [self _flushBatch] == NO)
+	{
+	  [NSException raise: NSPortTimeoutException
+		      format: @"%@", stringFromMsgType(METHOD_BATCH)];
+	}
     }
-
-  [self _sendOutRmc: op type: METHOD_REQUEST];
-  NSDebugMLLog(@"NSConnection", @"Sent message %s RMC %d to 0x%"PRIxPTR,
-    sel_getName([inv selector]), seq, (NSUInteger)self);
-
-  if (needsResponse == NO)
+  NS_HANDLER
     {
-      GSIMapNode	node;
-
-      /*
-       * Since we don't need a response, we can remove the placeholder from
-       * the IreplyMap.  However, in case the other end has already sent us
-       * a response, we must check for it and scrap it if necessary.
+      /* Nothing will wait for replies to the messages already sent.
        */
       GS_M_LOCK(IrefGate);
-      node = GSIMapNodeForKey(IreplyMap, (GSIMapKey)(NSUInteger)seq);
-      if (node != 0 && node->value.obj != dummyObject)
+      for (i = 0; i < sent; i++)
 	{
-	  BOOL	is_exception = NO;
-	  SEL	sel = [inv selector];
+	  GSIMapNode	node;
 
-	  [node->value.obj decodeValueOfObjCType: @encode(BOOL)
-					      at: &is_exception];
-	  if (is_exception == YES)
-	    NSLog(@"Got exception with %@", NSStringFromSelector(sel));
-	  else
-	    NSLog(@"Got response with %@", NSStringFromSelector(sel));
-	  [self _doneInRmc: node->value.obj];
+	  node = GSIMapNodeForKey(IreplyMap, (GSIMapKey)(NSUInteger)seqs[i]);
+	  if (node != 0)
+	    {
+	      if (node->value.obj != dummyObject)
+		{
+		  [self _doneInRmc: node->value.obj];
+		}
+	      GSIMapRemoveKey(IreplyMap, (GSIMapKey)(NSUInteger)seqs[i]);
+	    }
 	}
-      GSIMapRemoveKey(IreplyMap, (GSIMapKey)(NSUInteger)seq);
       GSM_UNLOCK(IrefGate);
+      [localException raise];
     }
-  else
+  NS_ENDHANDLER
+
+  /* Now collect the replies in order.
+   */
+  if (needsReply == YES)
     {
-      int		argnum;
-      int		flags;
-      const char	*tmptype;
-      void		*datum;
-      NSPortCoder	*aRmc;
-      BOOL		is_exception;
+      IroundTrips++;
+    }
+  for (i = 0; i < count; i++)
+    {
+      NSInvocation	*inv = [invocations objectAtIndex: i];
 
-      if ([self isValid] == NO)
+      if (needsResponse[i] == NO)
 	{
-	  [NSException raise: NSGenericException
-	    format: @"connection waiting for request was shut down"];
+	  [self _discardReply: seqs[i] forInvocation: inv];
 	}
-      aRmc = [self _getReplyRmc: seq];
- 
-      /*
-       * Find out if the server is returning an exception instead
-       * of the return values.
-       */
-      [aRmc decodeValueOfObjCType: @encode(BOOL) at: &is_exception];
-      if (is_exception == YES)
-	{
-	  /* Decode the exception object, and raise it. */
-	  id exc = [aRmc decodeObject];
-
-	  [self _doneInReply: aRmc];
-	  [exc raise];
-	}
-
-      /* Get the return type qualifier flags, and the return type. */
-      flags = objc_get_type_qualifiers(type);
-      tmptype = objc_skip_type_qualifiers(type);
-
-      /* Decode the return value and pass-by-reference values, if there
-	 are any.  OUT_PARAMETERS should be the value returned by
-	 cifframe_dissect_call(). */
-      if (outParams || *tmptype != _C_VOID || (flags & _F_ONEWAY) == 0)
-	/* xxx What happens with method declared "- (oneway) foo: (out int*)ip;" */
-	/* xxx What happens with method declared "- (in char *) bar;" */
-	/* xxx Is this right?  Do we also have to check _F_ONEWAY? */
+      else
 	{
-	  id	obj;
-
-	  /* If there is a return value, decode it, and put it in datum. */
-	  if (*tmptype != _C_VOID || (flags & _F_ONEWAY) == 0)
-	    {	
-	      switch (*tmptype)
-		{
-		  case _C_ID:
-		    datum = &obj;
-		    [aRmc decodeValueOfObjCType: tmptype at: datum];
-		    [obj autorelease];
-		    break;
-		  case _C_PTR:
-		    /* We are returning a pointer to something. */
-		    tmptype++;
-		    datum = alloca (objc_sizeof_type (tmptype));
-		    [aRmc decodeValueOfObjCType: tmptype at: datum];
-		    break;
-
-		  case _C_VOID:
-		    datum = alloca (sizeof (int));
-		    [aRmc decodeValueOfObjCType: @encode(int) at: datum];
-		    break;
+	  id	e = nil;
 
-		  default:
-		    datum = alloca (objc_sizeof_type (tmptype));
-		    [aRmc decodeValueOfObjCType: tmptype at: datum];
-		    break;
-		}
-	    }
-	  else
+	  NS_DURING
 	    {
-	      datum = 0;
+	      e = [self _takeReply: seqs[i]
+		     forInvocation: inv
+			      type: types[i]
+			 outParams: outParams[i]];
 	    }
-	  [inv setReturnValue: datum];
-
-	  /* Decode the values returned by reference.  Note: this logic
-	     must match exactly the code in _service_forwardForProxy:
-	     */
-	  if (outParams)
+	  NS_HANDLER
 	    {
-	      /* Step through all the arguments, finding the ones that were
-		 passed by reference. */
-	      for (tmptype = skip_argspec (tmptype), argnum = 0;
-	        *tmptype != '\0';
-	        tmptype = skip_argspec (tmptype), argnum++)
+	      NSUInteger	j;
+
+	      /* A local failure (timeout or lost connection) means the
+	       * remaining replies will not arrive either.
+	       */
+	      GS_M_LOCK(IrefGate);
+	      for (j = i + 1; j < count; j++)
 		{
-		  /* Get the type qualifiers, like IN, OUT, INOUT, ONEWAY. */
-		  flags = objc_get_type_qualifiers(tmptype);
-		  /* Skip over the type qualifiers, so now TYPE is
-		     pointing directly at the char corresponding to the
-		     argument's type. */
-		  tmptype = objc_skip_type_qualifiers(tmptype);
-
-		  if (*tmptype == _C_PTR
-		    && ((flags & _F_OUT) || !(flags & _F_IN)))
+		  GSIMapNode	node;
+
+		  node = GSIMapNodeForKey(IreplyMap,
+		    (GSIMapKey)(NSUInteger)seqs[j]);
+		  if (node != 0)
 		    {
-		      /* If the arg was byref, we obtain its address
-		       * and decode the data directly to it.
-		       */
-		      tmptype++;
-		      [inv getArgument: &datum atIndex: argnum];
-		      [aRmc decodeValueOfObjCType: tmptype at: datum];
-		      if (*tmptype == _C_ID)
+		      if (node->value.obj != dummyObject)
 			{
-			  [*(id*)datum autorelease];
+			  [self _doneInRmc: node->value.obj];
 			}
-		    }
-		  else if (*tmptype == _C_CHARPTR
-		    && ((flags & _F_OUT) || !(flags & _F_IN)))
-		    {
-		      [aRmc decodeValueOfObjCType: tmptype at: &datum];
-		      [inv setArgument: datum atIndex: argnum];
+		      GSIMapRemoveKey(IreplyMap,
+			(GSIMapKey)(NSUInteger)seqs[j]);
 		    }
 		}
+	      GSM_UNLOCK(IrefGate);
+	      [localException raise];
+	    }
+	  NS_ENDHANDLER
+	  if (e != nil && exc == nil)
+	    {
+	      exc = e;
 	    }
 	}
-      [self _doneInReply: aRmc];
     }
+  if (exc != nil)
+    {
+      [exc raise];
+    }
+}
+
+/**
+ * Sets whether oneway messages sent through the receiver are collected
+ * and sent together.<br />
+ * When this is enabled, consecutive oneway messages are held until
+ * control returns to the run loop (or until another message has to be
+ * sent, or enough have been collected) and are then delivered in a single
+ * port message, greatly reducing the cost of sending many of them.<br />
+ * The remote process must be using a version of GNUstep which
+ * understands batched messages, so this is disabled by default.
+ */
+/**
+ * Sets whether the receiver may use the compact message format with
+ * a peer which supports it.<br />
+ * In that format integers are sent as variable length values, and
+ * classes, selectors and short strings are sent in full only the first
+ * time, then referred to by number.  The format is agreed when a root
+ * proxy is requested, so this should be called before -rootProxy.
+ * Turning it off takes effect at once, since a peer which supports the
+ * compact format also accepts the original one.
+ */
+- (void) setAllowsCompactCoding: (BOOL)flag
+{
+  IcompactRefused = (flag == YES) ? NO : YES;
+  if (flag == NO)
+    {
+      IcompactOut = NO;
+    }
+}
+
+- (void) setCoalescesOnewayMessages: (BOOL)flag
+{
+  if (flag == NO && IcoalesceOneway == YES)
+    {
+      [self _flushBatch];
+    }
+  IcoalesceOneway = flag;
 }
 
 - (const char *) typeForSelector: (SEL)sel remoteTarget: (unsigned)target
@@ -2211,6 +2387,7 @@ static NSLock	*cached_proxies_gate = nil;
   [op encodeValueOfObjCType: ":" at: &sel];
   [op encodeValueOfObjCType: @encode(unsigned) at: &target];
   [self _sendOutRmc: op type: METHODTYPE_REQUEST];
+  IroundTrips++;
   ip = [self _getReplyRmc: seq_num];
   [ip decodeValueOfObjCType: @encode(char*) at: &type];
   data = type ? [NSData dataWithBytes: type length: strlen(type)+1] : nil;
@@ -2218,6 +2395,15 @@ static NSLock	*cached_proxies_gate = nil;
   return (const char*)[data bytes];
 }
 
+/**
+ * Returns YES if the receiver is sending messages in the compact format
+ * agreed with the other end (see -setAllowsCompactCoding:).
+ */
+- (BOOL) usesCompactCoding
+{
+  return IcompactOut;
+}
+
 
 /* Class-wide stats and collections. */
 
@@ -2258,6 +2444,43 @@ static NSLock	*cached_proxies_gate = nil;
 
 
 
+@implementation	NSConnection (GSCoding)
+
+/*
+ * The table for the compact NSPortCoder format, used for decoding
+ * whenever the other end sends in that format.
+ */
+- (GSCodingTable*) _codingTable
+{
+  GSCodingTable	*t;
+
+  GS_M_LOCK(IrefGate);
+  if (IcodingTable == nil)
+    {
+      IcodingTable = [GSCodingTable new];
+    }
+  t = IcodingTable;
+  GSM_UNLOCK(IrefGate);
+  return t;
+}
+
+/*
+ * The table to encode with, or nil if the other end has not agreed to
+ * the compact format.
+ */
+- (GSCodingTable*) _compactCodingTable
+{
+  if (IcompactOut == NO)
+    {
+      return nil;
+    }
+  return [self _codingTable];
+}
+
+@end
+
+
+
 @implementation	NSConnection (Private)
 
 - (void) handlePortMessage: (NSPortMessage*)msg
@@ -2293,6 +2516,54 @@ static NSLock	*cached_proxies_gate = nil;
       NSLog(@"  connection is %@", conn);
     }
 
+  if (type == METHOD_BATCH)
+    {
+      NSData		*header = [components objectAtIndex: 0];
+      const uint8_t	*bytes = [header bytes];
+      NSUInteger	length = [header length];
+      NSUInteger	index = 1;
+      uint32_t		parts = 0;
+      uint32_t		part;
+
+      /* Split the batch into its messages and handle each as if it had
+       * arrived on its own (so each is authenticated separately).
+       */
+      if (length < sizeof(parts))
+	{
+	  [NSException raise: NSGenericException
+		      format: @"bad header in method batch"];
+	}
+      memcpy(&parts, bytes, sizeof(parts));
+      parts = GSSwapBigI32ToHost(parts);
+      if (parts > length / sizeof(parts) - 1)
+	{
+	  [NSException raise: NSGenericException
+		      format: @"bad header in method batch"];
+	}
+      for (part = 0; part < parts; part++)
+	{
+	  NSPortMessage	*m;
+	  uint32_t	n;
+
+	  memcpy(&n, bytes + (part + 1) * sizeof(n), sizeof(n));
+	  n = GSSwapBigI32ToHost(n);
+	  if (n == 0 || n > [components count] - index)
+	    {
+	      [NSException raise: NSGenericException
+			  format: @"bad component count in method batch"];
+	    }
+	  m = [[NSPortMessage alloc] initWithSendPort: sp
+					  receivePort: rp
+					   components: [components
+	    subarrayWithRange: NSMakeRange(index, n)]];
+	  [m setMsgid: METHOD_REQUEST];
+	  index += n;
+	  AUTORELEASE(m);
+	  [self handlePortMessage: m];
+	}
+      return;
+    }
+
   if (GSIVar(conn, _authenticateIn) == YES
     && (type == METHOD_REQUEST || type == METHOD_REPLY))
     {
@@ -2888,6 +3159,8 @@ static NSLock	*cached_proxies_gate = nil;
 {
   id		rootObject = rootObjectForInPort(IreceivePort);
   int		sequence;
+  unsigned	caps = 0;
+  BOOL		offered = NO;
   NSPortCoder	*op;
 
   NSParameterAssert(IreceivePort);
@@ -2895,9 +3168,27 @@ static NSLock	*cached_proxies_gate = nil;
   NSParameterAssert([rmc connection] == self);
 
   [rmc decodeValueOfObjCType: @encode(int) at: &sequence];
+  if ([rmc _hasMoreData] == YES)
+    {
+      [rmc decodeValueOfObjCType: @encode(unsigned) at: &caps];
+      offered = YES;
+    }
   [self _doneInRmc: rmc];
+
+  /* If the other end offered the compact format, we may start using it
+   * at once, since it can decode the format it offered.
+   */
+  if ((caps & CAP_COMPACT) && IcompactRefused == NO)
+    {
+      IcompactOut = YES;
+    }
   op = [self _makeOutRmc: sequence generate: 0 reply: NO];
   [op encodeObject: rootObject];
+  if (offered == YES)
+    {
+      caps = (IcompactRefused == NO) ? CAP_COMPACT : 0;
+      [op encodeValueOfObjCType: @encode(unsigned) at: &caps];
+    }
   [self _sendOutRmc: op type: ROOTPROXY_REPLY];
 }
 
@@ -3241,6 +3532,250 @@ static NSLock	*cached_proxies_gate = nil;
   return rmc;
 }
 
+/*
+ * Encode an invocation to be sent to the remote object represented by
+ * object, returning the coder ready to be sent and information about
+ * the reply expected.
+ */
+- (NSPortCoder*) _encodeInvocation: (NSInvocation*)inv
+			  forProxy: (NSDistantObject*)object
+			  sequence: (unsigned*)seq
+			      type: (const char**)type
+			 outParams: (BOOL*)outParams
+		     needsResponse: (BOOL*)needsResponse
+{
+  NSPortCoder	*op;
+  const char	*t;
+  NSRunLoop	*runLoop = GSRunLoopForThread(nil);
+
+  if ([IrunLoops indexOfObjectIdenticalTo: runLoop] == NSNotFound)
+    {
+      if (ImultipleThreads == NO)
+	{
+	  [NSException raise: NSObjectInaccessibleException
+		      format: @"Forwarding message in wrong thread"];
+	}
+      else
+	{
+	  [self addRunLoop: runLoop];
+	}
+    }
+
+  /* Encode the method on an RMC. */
+
+  NSParameterAssert (IisValid);
+
+  /* get the method types from the selector */
+  t = [[inv methodSignature] methodType];
+  if (t == 0 || *t == '\0')
+    {
+      t = [[object methodSignatureForSelector: [inv selector]] methodType];
+      if (t)
+	{
+	  GSSelectorFromNameAndTypes(sel_getName([inv selector]), t);
+	}
+    }
+  NSParameterAssert(t);
+  NSParameterAssert(*t);
+  *type = t;
+
+  op = [self _makeOutRmc: 0 generate: (int*)seq reply: YES];
+
+  if (debug_connection > 4)
+    NSLog(@"building packet seq %d", *seq);
+
+  [inv setTarget: object];
+  *outParams = [inv encodeWithDistantCoder: op passPointers: NO];
+
+  if (*outParams == YES)
+    {
+      *needsResponse = YES;
+    }
+  else
+    {
+      int		flags;
+
+      *needsResponse = NO;
+      flags = objc_get_type_qualifiers(t);
+      if ((flags & _F_ONEWAY) == 0)
+	{
+	  *needsResponse = YES;
+	}
+      else
+	{
+	  const char	*tmptype = objc_skip_type_qualifiers(t);
+
+	  if (*tmptype != _C_VOID)
+	    {
+	      *needsResponse = YES;
+	    }
+	}
+    }
+  return op;
+}
+
+/*
+ * Tidy up after sending a message which needs no response.
+ */
+- (void) _discardReply: (unsigned)seq forInvocation: (NSInvocation*)inv
+{
+  GSIMapNode	node;
+
+  /*
+   * Since we don't need a response, we can remove the placeholder from
+   * the IreplyMap.  However, in case the other end has already sent us
+   * a response, we must check for it and scrap it if necessary.
+   */
+  GS_M_LOCK(IrefGate);
+  node = GSIMapNodeForKey(IreplyMap, (GSIMapKey)(NSUInteger)seq);
+  if (node != 0 && node->value.obj != dummyObject)
+    {
+      BOOL	is_exception = NO;
+      SEL	sel = [inv selector];
+
+      [node->value.obj decodeValueOfObjCType: @encode(BOOL)
+					  at: &is_exception];
+      if (is_exception == YES)
+	NSLog(@"Got exception with %@", NSStringFromSelector(sel));
+      else
+	NSLog(@"Got response with %@", NSStringFromSelector(sel));
+      [self _doneInRmc: node->value.obj];
+    }
+  GSIMapRemoveKey(IreplyMap, (GSIMapKey)(NSUInteger)seq);
+  GSM_UNLOCK(IrefGate);
+}
+
+/*
+ * Wait for the reply to the message sent with sequence number seq and
+ * decode it into inv.  If the remote end raised an exception, return it
+ * rather than raising it here, so that the caller can decide when to do so.
+ */
+- (id) _takeReply: (unsigned)seq
+    forInvocation: (NSInvocation*)inv
+	     type: (const char*)type
+	outParams: (BOOL)outParams
+{
+  int		argnum;
+  int		flags;
+  const char	*tmptype;
+  void		*datum;
+  NSPortCoder	*aRmc;
+  BOOL		is_exception;
+
+  if ([self isValid] == NO)
+    {
+      [NSException raise: NSGenericException
+	format: @"connection waiting for request was shut down"];
+    }
+  aRmc = [self _getReplyRmc: seq];
+
+  /*
+   * Find out if the server is returning an exception instead
+   * of the return values.
+   */
+  [aRmc decodeValueOfObjCType: @encode(BOOL) at: &is_exception];
+  if (is_exception == YES)
+    {
+      /* Decode the exception object, and return it. */
+      id exc = [aRmc decodeObject];
+
+      [self _doneInReply: aRmc];
+      return exc;
+    }
+
+  /* Get the return type qualifier flags, and the return type. */
+  flags = objc_get_type_qualifiers(type);
+  tmptype = objc_skip_type_qualifiers(type);
+
+  /* Decode the return value and pass-by-reference values, if there
+     are any.  OUT_PARAMETERS should be the value returned by
+     cifframe_dissect_call(). */
+  if (outParams || *tmptype != _C_VOID || (flags & _F_ONEWAY) == 0)
+    /* xxx What happens with method declared "- (oneway) foo: (out int*)ip;" */
+    /* xxx What happens with method declared "- (in char *) bar;" */
+    /* xxx Is this right?  Do we also have to check _F_ONEWAY? */
+    {
+      id	obj;
+
+      /* If there is a return value, decode it, and put it in datum. */
+      if (*tmptype != _C_VOID || (flags & _F_ONEWAY) == 0)
+	{	
+	  switch (*tmptype)
+	    {
+	      case _C_ID:
+		datum = &obj;
+		[aRmc decodeValueOfObjCType: tmptype at: datum];
+		[obj autorelease];
+		break;
+	      case _C_PTR:
+		/* We are returning a pointer to something. */
+		tmptype++;
+		datum = alloca (objc_sizeof_type (tmptype));
+		[aRmc decodeValueOfObjCType: tmptype at: datum];
+		break;
+
+	      case _C_VOID:
+		datum = alloca (sizeof (int));
+		[aRmc decodeValueOfObjCType: @encode(int) at: datum];
+		break;
+
+	      default:
+		datum = alloca (objc_sizeof_type (tmptype));
+		[aRmc decodeValueOfObjCType: tmptype at: datum];
+		break;
+	    }
+	}
+      else
+	{
+	  datum = 0;
+	}
+      [inv setReturnValue: datum];
+
+      /* Decode the values returned by reference.  Note: this logic
+	 must match exactly the code in _service_forwardForProxy:
+	 */
+      if (outParams)
+	{
+	  /* Step through all the arguments, finding the ones that were
+	     passed by reference. */
+	  for (tmptype = skip_argspec (tmptype), argnum = 0;
+	    *tmptype != '\0';
+	    tmptype = skip_argspec (tmptype), argnum++)
+	    {
+	      /* Get the type qualifiers, like IN, OUT, INOUT, ONEWAY. */
+	      flags = objc_get_type_qualifiers(tmptype);
+	      /* Skip over the type qualifiers, so now TYPE is
+		 pointing directly at the char corresponding to the
+		 argument's type. */
+	      tmptype = objc_skip_type_qualifiers(tmptype);
+
+	      if (*tmptype == _C_PTR
+		&& ((flags & _F_OUT) || !(flags & _F_IN)))
+		{
+		  /* If the arg was byref, we obtain its address
+		   * and decode the data directly to it.
+		   */
+		  tmptype++;
+		  [inv getArgument: &datum atIndex: argnum];
+		  [aRmc decodeValueOfObjCType: tmptype at: datum];
+		  if (*tmptype == _C_ID)
+		    {
+		      [*(id*)datum autorelease];
+		    }
+		}
+	      else if (*tmptype == _C_CHARPTR
+		&& ((flags & _F_OUT) || !(flags & _F_IN)))
+		{
+		  [aRmc decodeValueOfObjCType: tmptype at: &datum];
+		  [inv setArgument: datum atIndex: argnum];
+		}
+	    }
+	}
+    }
+  [self _doneInReply: aRmc];
+  return nil;
+}
+
 - (void) _doneInReply: (NSPortCoder*)c
 {
   [self _doneInRmc: c];
@@ -3301,6 +3836,120 @@ static NSLock	*cached_proxies_gate = nil;
   GSM_UNLOCK(IrefGate);
 }
 
+/*
+ * Send any messages collected by -_queueOutRmc: as a single port message.
+ * Returns NO if they could not be sent.
+ */
+- (BOOL) _flushBatch
+{
+  NSMutableArray	*batch;
+  NSMutableData		*defs;
+  NSMutableArray	*components;
+  NSMutableData		*header;
+  NSUInteger		reserved;
+  NSUInteger		count;
+  NSUInteger		index;
+  NSDate		*limit;
+  unsigned		bytes;
+  int			msgid;
+  BOOL			sent;
+
+  GS_M_LOCK(IrefGate);
+  batch = Ibatch;
+  Ibatch = nil;
+  defs = IbatchDefs;
+  IbatchDefs = nil;
+  GSM_UNLOCK(IrefGate);
+  AUTORELEASE(defs);
+  if ((count = [batch count]) == 0 || IisValid == NO)
+    {
+      RELEASE(batch);
+      return YES;
+    }
+
+  /* The port needs space at the start of the first component for its own
+   * header, just as in a coder created by -_makeOutRmc:generate:reply:
+   */
+  reserved = [IsendPort reservedSpaceLength];
+  header = [NSMutableData dataWithLength: reserved];
+  components = [NSMutableArray arrayWithCapacity: count * 2 + 1];
+  if (count == 1)
+    {
+      NSArray	*m = [batch objectAtIndex: 0];
+
+      /* A single message goes as an ordinary request.
+       */
+      msgid = METHOD_REQUEST;
+      [header appendData: [m objectAtIndex: 0]];
+      [components addObject: header];
+      [components addObjectsFromArray:
+	[m subarrayWithRange: NSMakeRange(1, [m count] - 1)]];
+    }
+  else
+    {
+      uint32_t	v;
+
+      /* The batch header gives the number of messages in the batch
+       * followed by the number of components in each message.
+       */
+      msgid = METHOD_BATCH;
+      v = GSSwapHostI32ToBig((uint32_t)count);
+      [header appendBytes: &v length: sizeof(v)];
+      [components addObject: header];
+      for (index = 0; index < count; index++)
+	{
+	  NSArray	*m = [batch objectAtIndex: index];
+
+	  v = GSSwapHostI32ToBig((uint32_t)[m count]);
+	  [header appendBytes: &v length: sizeof(v)];
+	  [components addObjectsFromArray: m];
+	}
+    }
+  RELEASE(batch);
+
+  NSDebugMLLog(@"NSConnection", 
+    @"Sending %@ of %"PRIuPTR" on %@", stringFromMsgType(msgid), count, self);
+
+  bytes = bytesInComponents(components);
+  limit = [dateClass dateWithTimeIntervalSinceNow: IrequestTimeout];
+  sent = [IsendPort sendBeforeDate: limit
+			     msgid: msgid
+			components: components
+			      from: IreceivePort
+			  reserved: reserved];
+  if (sent == NO)
+    {
+      NSString	*text = stringFromMsgType(msgid);
+
+      if ([IsendPort isValid] == NO)
+	{
+	  text = [text stringByAppendingFormat: @" - port was invalidated"];
+	}
+      NSLog(@"Port operation timed out - %@", text);
+    }
+  else
+    {
+      /* Now that the peer has the coding table definitions in the
+       * batch, later messages need not repeat them.
+       */
+      if ([defs length] > 0)
+	{
+	  [[self _codingTable] markSent: [defs bytes]
+				  count: [defs length] / sizeof(unsigned)];
+	}
+      GS_M_LOCK(IrefGate);
+      IbytesOut += bytes;
+      IreqOutCount += count;
+      if (count > 1)
+	{
+	  IbatchesOut++;
+	  IbatchedOut += count;
+	}
+      GSM_UNLOCK(IrefGate);
+    }
+  return sent;
+}
+
 - (NSPortCoder*) _makeInRmc: (NSMutableArray*)components
 {
   NSPortCoder	*coder;
@@ -3384,12 +4033,109 @@ static NSLock	*cached_proxies_gate = nil;
   return coder;
 }
 
+/*
+ * Like -_sendOutRmc:type: for a METHOD_REQUEST, but rather than sending
+ * the message straight away, add it to a batch to be sent when control
+ * returns to the run loop, when another message has to be sent, or when
+ * the batch is full.
+ */
+- (void) _queueOutRmc: (NSPortCoder*)c
+{
+  NSMutableArray	*components = [c _components];
+  NSMutableArray	*copy;
+  NSUInteger		reserved = [IsendPort reservedSpaceLength];
+  NSUInteger		count;
+  NSUInteger		index;
+
+  if (IauthenticateOut == YES)
+    {
+      NSData	*d;
+
+      d = [[self delegate] authenticationDataForComponents: components];
+      if (d == nil)
+	{
+	  RELEASE(c);
+	  [NSException raise: NSGenericException
+		      format: @"Bad authentication data provided by delegate"];
+	}
+      [components addObject: d];
+    }
+
+  /* The coder reuses its data when it is recycled, so we must keep
+   * copies.  The space reserved for the port header at the start of
+   * the first component is dropped, since the batch has its own.
+   */
+  count = [components count];
+  copy = [[NSMutableArray alloc] initWithCapacity: count];
+  for (index = 0; index < count; index++)
+    {
+      id	o = [components objectAtIndex: index];
+
+      if (index == 0)
+	{
+	  o = [o subdataWithRange:
+	    NSMakeRange(reserved, [o length] - reserved)];
+	}
+      else if ([o isKindOfClass: [NSData class]] == YES)
+	{
+	  o = AUTORELEASE([o copy]);
+	}
+      [copy addObject: o];
+    }
+
+  GS_M_LOCK(IrefGate);
+  /* The coding table definitions in the message are only known to the
+   * peer once the batch has been sent, so keep them until then.
+   */
+  if (IbatchDefs == nil)
+    {
+      IbatchDefs = [NSMutableData new];
+    }
+  [c _addDefinitionsTo: IbatchDefs];
+  if (cacheCoders == YES && IcachedEncoders != nil)
+    {
+      [IcachedEncoders addObject: c];
+    }
+  [c dispatch];	/* Tell NSPortCoder to release the connection.	*/
+  RELEASE(c);
+  if (Ibatch == nil)
+    {
+      Ibatch = [NSMutableArray new];
+    }
+  [Ibatch addObject: copy];
+  RELEASE(copy);
+  count = [Ibatch count];
+  GSM_UNLOCK(IrefGate);
+
+  if (count >= MAX_BATCH)
+    {
+      [self _flushBatch];
+    }
+  else if (count == 1)
+    {
+      [GSRunLoopForThread(nil) performSelector: @selector(_flushBatch)
+					target: self
+				      argument: nil
+					 order: 0
+					 modes: IrequestModes];
+    }
+}
+
 - (void) _sendOutRmc: (NSPortCoder*)c type: (int)msgid
 {
   NSDate		*limit;
   BOOL			sent = NO;
   BOOL			raiseException = NO;
   NSMutableArray	*components = [c _components];
+  unsigned		bytes;
+
+  /* Messages must arrive in the order they were sent, so any batched
+   * messages must go first.
+   */
+  if (Ibatch != nil)
+    {
+      [self _flushBatch];
+    }
 
   if (IauthenticateOut == YES
     && (msgid == METHOD_REQUEST || msgid == METHOD_REPLY))
@@ -3429,12 +4175,20 @@ static NSLock	*cached_proxies_gate = nil;
   NSDebugMLLog(@"NSConnection", 
     @"Sending %@ on %@", stringFromMsgType(msgid), self);
 
+  /* The port may rearrange the components as it sends them, so we
+   * count the bytes beforehand.
+   */
+  bytes = bytesInComponents(components);
   limit = [dateClass dateWithTimeIntervalSinceNow: IrequestTimeout];
   sent = [IsendPort sendBeforeDate: limit
 			     msgid: msgid
 			components: components
 			      from: IreceivePort
 			  reserved: [IsendPort reservedSpaceLength]];
+  if (sent == YES)
+    {
+      [c _definitionsSent];
+    }
 
   GS_M_LOCK(IrefGate);
 
@@ -3469,6 +4223,7 @@ static NSLock	*cached_proxies_gate = nil;
     }
   else
     {
+      IbytesOut += bytes;
       switch (msgid)
 	{
 	  case METHOD_REQUEST:
@@ -3809,6 +4564,7 @@ static NSLock	*cached_proxies_gate = nil;
 	      [op encodeValueOfObjCType: @encode(typeof(target)) at: &target];
 	      [self _sendOutRmc: op type: PROXY_RETAIN];
 
+	      IroundTrips++;
 	      ip = [self _getReplyRmc: seq_num];
 	      [ip decodeValueOfObjCType: @encode(id) at: &result];
 	      [self _doneInRmc: ip];
@@ -2414,6 +2414,13 @@ failure:
 
 @end
 
+@implementation	NSMutableData (GSPrivate)
+- (void) _setLengthUncleared: (NSUInteger)size
+{
+  [self setLength: size];
+}
+@end
+
 
 /**
  *  Provides some additional methods to [NSData].
@@ -3822,6 +3829,15 @@ getBytes(void* dst, void* src, unsigned len, unsigned limit, unsigned *pos)
   length = size;
 }
 
+- (void) _setLengthUncleared: (NSUInteger)size
+{
+  if (size > capacity)
+    {
+      [self _grow: size];
+    }
+  length = size;
+}
+
 @end
 
 #if	GS_WITH_GC
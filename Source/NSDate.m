@@ -80,6 +80,72 @@ static Class	calendarClass = nil;
 static id _distantPast = nil;
 static id _distantFuture = nil;
 
+#if defined(OBJC_SMALL_OBJECT_SHIFT) && (OBJC_SMALL_OBJECT_SHIFT == 3)
+#define	GS_SMALL_DATE	1
+/* On 64-bit systems most dates are stored in the object pointer itself
+ * (like the small NSNumber classes in NSNumber.m) so that creating one
+ * allocates no memory.  The pointer holds the sign and the 52 bit
+ * mantissa of the time interval unchanged, with its exponent squeezed
+ * into 8 bits, so the conversion is lossless.  An 8 bit exponent covers
+ * every interval from about 1e-66 seconds to beyond the distant future;
+ * anything else (including zero) and any non-finite interval is kept
+ * in an NSGDate instead.
+ */
+#define	SMALL_DATE_MASK	6
+#define	SMALL_DATE_BIAS	803
+
+union BoxedDate
+{
+  id		obj;
+  uintptr_t	bits;
+  NSTimeInterval	d;
+};
+
+static BOOL	useSmallDate = NO;
+static id	placeholder = nil;
+
+@interface	GSSmallDate : NSDate
+@end
+
+/* Returned by +alloc for NSDate, to make a small date on initialisation.
+ */
+@interface	GSDatePlaceholder : NSDate
+@end
+
+static inline NSTimeInterval
+unboxSmallDate(id date)
+{
+  union BoxedDate	b = {.obj = date};
+  uintptr_t		e = ((b.bits >> 55) & 0xff) + SMALL_DATE_BIAS;
+
+  b.bits = (b.bits & ((uintptr_t)1 << 63)) | (e << 52)
+    | ((b.bits >> 3) & (((uintptr_t)1 << 52) - 1));
+  return b.d;
+}
+
+static inline id
+boxSmallDate(NSTimeInterval secs)
+{
+  union BoxedDate	b = {.d = secs};
+  uintptr_t		e = (b.bits >> 52) & 0x7ff;
+
+  if (e <= SMALL_DATE_BIAS || e > SMALL_DATE_BIAS + 0xff)
+    {
+      return nil;
+    }
+  e -= SMALL_DATE_BIAS;
+  b.bits = (b.bits & ((uintptr_t)1 << 63)) | (e << 55)
+    | ((b.bits & (((uintptr_t)1 << 52) - 1)) << 3) | SMALL_DATE_MASK;
+  return b.obj;
+}
+
+static inline BOOL
+isSmallDate(id date)
+{
+  return (((uintptr_t)date) & OBJC_SMALL_OBJECT_MASK) == SMALL_DATE_MASK;
+}
+#endif
+
 
 static NSString*
 findInArray(NSArray *array, unsigned pos, NSString *str)
@@ -105,6 +171,10 @@ otherTime(NSDate* other)
 
   if (other == nil)
     [NSException raise: NSInvalidArgumentException format: @"other time nil"];
+#ifdef GS_SMALL_DATE
+  if (isSmallDate(other))
+    return unboxSmallDate(other);
+#endif
   if (GSObjCIsInstance(other) == NO)
     [NSException raise: NSInvalidArgumentException format: @"other time bad"];
   c = object_getClass(other);
@@ -132,13 +202,26 @@ otherTime(NSDate* other)
       abstractClass = self;
       concreteClass = [NSGDate class];
       calendarClass = [NSCalendarDate class];
+#ifdef GS_SMALL_DATE
+      if (useSmallDate == YES)
+	{
+	  placeholder = NSAllocateObject([GSDatePlaceholder class], 0,
+	    NSDefaultMallocZone());
+	}
+#endif
     }
 }
 
 + (id) alloc
 {
   if (self == abstractClass)
-    return NSAllocateObject(concreteClass, 0, NSDefaultMallocZone());
+    {
+#ifdef GS_SMALL_DATE
+      if (placeholder != nil)
+	return placeholder;
+#endif
+      return NSAllocateObject(concreteClass, 0, NSDefaultMallocZone());
+    }
   else
     return NSAllocateObject(self, 0, NSDefaultMallocZone());
 }
@@ -146,7 +229,13 @@ otherTime(NSDate* other)
 + (id) allocWithZone: (NSZone*)z
 {
   if (self == abstractClass)
-    return NSAllocateObject(concreteClass, 0, z);
+    {
+#ifdef GS_SMALL_DATE
+      if (placeholder != nil && (z == 0 || z == NSDefaultMallocZone()))
+	return placeholder;
+#endif
+      return NSAllocateObject(concreteClass, 0, z);
+    }
   else
     return NSAllocateObject(self, 0, z);
 }
@@ -1045,7 +1134,7 @@ otherTime(NSDate* other)
     }
   else
     {
-      o = [concreteClass allocWithZone: NSDefaultMallocZone()];
+      o = [abstractClass allocWithZone: NSDefaultMallocZone()];
       o = [o initWithTimeIntervalSinceReferenceDate: interval];
     }
   DESTROY(self);
@@ -1607,3 +1696,171 @@ otherTime(NSDate* other)
 @end
 
 
+
+#ifdef GS_SMALL_DATE
+@implementation GSSmallDate
+
++ (void) load
+{
+  useSmallDate = objc_registerSmallObjectClass_np(self, SMALL_DATE_MASK);
+}
+
+/* Small dates can't be allocated, so methods which make a new date of
+ * the same class as the receiver get the placeholder instead.
+ */
++ (id) alloc
+{
+  return [abstractClass allocWithZone: NSDefaultMallocZone()];
+}
+
++ (id) allocWithZone: (NSZone*)z
+{
+  return [abstractClass allocWithZone: z];
+}
+
+- (id) copy
+{
+  return self;
+}
+
+- (id) copyWithZone: (NSZone*)aZone
+{
+  return self;
+}
+
+- (id) retain
+{
+  return self;
+}
+
+- (NSUInteger) retainCount
+{
+  return UINT_MAX;
+}
+
+- (id) autorelease
+{
+  return self;
+}
+
+- (oneway void) release
+{
+  return;
+}
+
+- (NSComparisonResult) compare: (NSDate*)otherDate
+{
+  NSTimeInterval	a;
+  NSTimeInterval	b;
+
+  if (otherDate == self)
+    {
+      return NSOrderedSame;
+    }
+  if (otherDate == nil)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"nil argument for compare:"];
+    }
+  a = unboxSmallDate(self);
+  b = otherTime(otherDate);
+  if (a > b)
+    {
+      return NSOrderedDescending;
+    }
+  if (a < b)
+    {
+      return NSOrderedAscending;
+    }
+  return NSOrderedSame;
+}
+
+- (NSUInteger) hash
+{
+  return (unsigned)unboxSmallDate(self);
+}
+
+- (BOOL) isEqual: (id)other
+{
+  if (other == nil)
+    return NO;
+  if ([other isKindOfClass: abstractClass]
+    && unboxSmallDate(self) == otherTime(other))
+    return YES;
+  return NO;
+}
+
+- (BOOL) isEqualToDate: (NSDate*)other
+{
+  if (other == nil)
+    return NO;
+  if (unboxSmallDate(self) == otherTime(other))
+    return YES;
+  return NO;
+}
+
+- (NSTimeInterval) timeIntervalSince1970
+{
+  return unboxSmallDate(self) + NSTimeIntervalSince1970;
+}
+
+- (NSTimeInterval) timeIntervalSinceDate: (NSDate*)otherDate
+{
+  if (otherDate == nil)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"nil argument for timeIntervalSinceDate:"];
+    }
+  return unboxSmallDate(self) - otherTime(otherDate);
+}
+
+- (NSTimeInterval) timeIntervalSinceNow
+{
+  return unboxSmallDate(self) - GSPrivateTimeNow();
+}
+
+- (NSTimeInterval) timeIntervalSinceReferenceDate
+{
+  return unboxSmallDate(self);
+}
+
+@end
+
+
+@implementation GSDatePlaceholder
+
+- (id) autorelease
+{
+  NSWarnLog(@"-autorelease sent to uninitialised date");
+  return self;		// placeholders never get released.
+}
+
+- (void) dealloc
+{
+  GSNOSUPERDEALLOC;	// Placeholders never get deallocated.
+}
+
+- (id) initWithTimeIntervalSinceReferenceDate: (NSTimeInterval)secs
+{
+  id	date = boxSmallDate(secs);
+
+  if (nil == date)
+    {
+      date = NSAllocateObject(concreteClass, 0, NSDefaultMallocZone());
+      date = [date initWithTimeIntervalSinceReferenceDate: secs];
+    }
+  return date;
+}
+
+- (oneway void) release
+{
+  return;	// placeholders never get released.
+}
+
+- (id) retain
+{
+  return self;	// placeholders never get retained.
+}
+
+@end
+#endif
@@ -32,6 +32,7 @@
 #import "GNUstepBase/GSObjCRuntime.h"
 #import "Foundation/NSDictionary.h"
 #import "Foundation/NSLock.h"
+#import "Foundation/NSMapTable.h"
 #import "Foundation/NSPort.h"
 #import "Foundation/NSMethodSignature.h"
 #import "Foundation/NSException.h"
@@ -45,6 +46,12 @@
 - (void) finalize;
 @end
 
+@interface NSDistantObject(Private)
+- (void) _cacheSignature: (NSMethodSignature*)sig forSelector: (SEL)aSelector;
+- (NSMethodSignature*) _signatureForSelector: (SEL)aSelector
+				fromProtocol: (Protocol*)aProtocol;
+@end
+
 #define DO_FORWARD_INVOCATION(_SELX, _ARG1) ({			\
   sig = [self methodSignatureForSelector: @selector(_SELX)];	\
   if (sig != nil)						\
@@ -67,6 +74,12 @@ static int	debug_proxy = 0;
 static Class	placeHolder = 0;
 static Class	distantObjectClass = 0;
 
+/* Method signatures built from protocols are shared by all proxies using
+ * the same protocol, so each is only looked up and parsed once.
+ */
+static NSMapTable	*protocolSignatures = 0;
+static NSLock		*protocolSignaturesLock = nil;
+
 #ifndef __GNUSTEP_RUNTIME__
 @interface Object (NSConformsToProtocolNamed)
 - (BOOL) _conformsToProtocolNamed: (const char*)aName;
@@ -402,6 +415,11 @@ GS_ROOT_CLASS @interface	GSDistantObjectPlaceHolder
   if (self == [NSDistantObject class])
     {
       placeHolder = objc_lookUpClass("GSDistantObjectPlaceHolder");
+      protocolSignatures = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+	NSObjectMapValueCallBacks, 0);
+      [[NSObject leakAt: (id*)&protocolSignatures] release];
+      protocolSignaturesLock = [NSLock new];
+      [[NSObject leakAt: &protocolSignaturesLock] release];
     }
 }
 
@@ -670,6 +688,9 @@ GS_ROOT_CLASS @interface	GSDistantObjectPlaceHolder
  * sending a distributed objects message, so you are advised to use the
  * -setProtocolForProxy: method to avoid this occurring.
  * </p>
+ * <p>Signatures are cached by the proxy, so the remote process is only
+ * asked about any one selector once.
+ * </p>
  */
 - (NSMethodSignature*) methodSignatureForSelector: (SEL)aSelector
 {
@@ -710,21 +731,6 @@ GS_ROOT_CLASS @interface	GSDistantObjectPlaceHolder
 	  return sig;
 	}
 
-      if (_protocol != nil)
-	{
-	  struct objc_method_description mth;
-	  mth = GSProtocolGetMethodDescriptionRecursive(_protocol, aSelector, YES, YES);
-
-	  if (mth.name == NULL && mth.types == NULL)
-	    {
-	      // Search for class method
-	      mth = GSProtocolGetMethodDescriptionRecursive(_protocol, aSelector, YES, NO);
-	    }
-
-	  if (mth.types)
-	    return [NSMethodSignature signatureWithObjCTypes: mth.types];
-	}
-
       if (_sigs != 0)
 	{
 	  NSMutableDictionary	*d = (NSMutableDictionary*)_sigs;
@@ -734,6 +740,18 @@ GS_ROOT_CLASS @interface	GSDistantObjectPlaceHolder
 	  if (m != nil) return m;
 	}
 
+      if (_protocol != nil)
+	{
+	  NSMethodSignature	*m;
+
+	  m = [self _signatureForSelector: aSelector fromProtocol: _protocol];
+	  if (m != nil)
+	    {
+	      [self _cacheSignature: m forSelector: aSelector];
+	      return m;
+	    }
+	}
+
 	{
 	  id		m = nil;
 	  id		inv;
@@ -752,15 +770,7 @@ GS_ROOT_CLASS @interface	GSDistantObjectPlaceHolder
 	    }
 	  if (m != nil)
 	    {
-	      NSMutableDictionary	*d = (NSMutableDictionary*)_sigs;
-	      NSString			*s = NSStringFromSelector(aSelector);
-
-	      if (d == nil)
-		{
-		  d = [NSMutableDictionary new];
-		  _sigs = (void*)d;
-		}
-	      [d setObject: m forKey: s];
+	      [self _cacheSignature: m forSelector: aSelector];
 	    }
 	  return m;
 	}
@@ -808,6 +818,13 @@ GS_ROOT_CLASS @interface	GSDistantObjectPlaceHolder
  */
 - (void) setProtocolForProxy: (Protocol*)aProtocol
 {
+  if (aProtocol != _protocol && _sigs != 0)
+    {
+      /* Signatures cached for the old protocol may not be right for
+       * the new one.
+       */
+      [(NSMutableDictionary*)_sigs removeAllObjects];
+    }
   _protocol = aProtocol;
 }
 
@@ -904,6 +921,69 @@ GS_ROOT_CLASS @interface	GSDistantObjectPlaceHolder
 @end
 
 
+@implementation NSDistantObject(Private)
+
+- (void) _cacheSignature: (NSMethodSignature*)sig forSelector: (SEL)aSelector
+{
+  NSMutableDictionary	*d = (NSMutableDictionary*)_sigs;
+
+  if (d == nil)
+    {
+      d = [NSMutableDictionary new];
+      _sigs = (void*)d;
+    }
+  [d setObject: sig forKey: NSStringFromSelector(aSelector)];
+}
+
+/* Look up the signature for aSelector in aProtocol, using (and filling)
+ * the cache shared by all proxies.  Returns nil if the protocol does
+ * not declare the method.
+ */
+- (NSMethodSignature*) _signatureForSelector: (SEL)aSelector
+				fromProtocol: (Protocol*)aProtocol
+{
+  NSMutableDictionary	*d;
+  NSString		*s = NSStringFromSelector(aSelector);
+  NSMethodSignature	*m;
+  struct objc_method_description mth;
+
+  [protocolSignaturesLock lock];
+  d = (NSMutableDictionary*)NSMapGet(protocolSignatures, aProtocol);
+  m = [[d objectForKey: s] retain];
+  [protocolSignaturesLock unlock];
+  if (m != nil)
+    {
+      return [m autorelease];
+    }
+
+  mth = GSProtocolGetMethodDescriptionRecursive(aProtocol, aSelector, YES, YES);
+  if (mth.name == NULL && mth.types == NULL)
+    {
+      // Search for class method
+      mth = GSProtocolGetMethodDescriptionRecursive(aProtocol,
+	aSelector, YES, NO);
+    }
+  if (mth.types == NULL)
+    {
+      return nil;
+    }
+  m = [NSMethodSignature signatureWithObjCTypes: mth.types];
+
+  [protocolSignaturesLock lock];
+  d = (NSMutableDictionary*)NSMapGet(protocolSignatures, aProtocol);
+  if (d == nil)
+    {
+      d = [NSMutableDictionary new];
+      NSMapInsert(protocolSignatures, aProtocol, d);
+      [d release];
+    }
+  [d setObject: m forKey: s];
+  [protocolSignaturesLock unlock];
+  return m;
+}
+
+@end
+
 @implementation Protocol (DistributedObjectsCoding)
 
 - (Class) classForPortCoder
@@ -764,6 +764,7 @@ _NSFoundationUncaughtExceptionHandler (NSException *exception)
 {
   NSAutoreleasePool	*pool = [NSAutoreleasePool new];
 
+  GSLogFlush();		/* Write out any queued log messages first. */
   fprintf(stderr, "%s: Uncaught exception %s, reason: %s\n",
     GSPrivateArgZero(),
     [[exception name] lossyCString], [[exception reason] lossyCString]);
@@ -655,6 +655,38 @@ NSString * const NSFileHandleOperationException
   return nil;
 }
 
+/**
+ * Call -transferInBackgroundAndNotifyFrom:offset:length:forModes:
+ * with nil modes.
+ */
+- (void) transferInBackgroundAndNotifyFrom: (NSFileHandle*)handle
+				    offset: (unsigned long long)offset
+				    length: (unsigned long long)length
+{
+  [self transferInBackgroundAndNotifyFrom: handle
+				   offset: offset
+				   length: length
+				 forModes: nil];
+}
+
+/**
+ * Write length bytes, starting at offset, from the regular file
+ * represented by handle, asynchronously, and notify on completion
+ * in the same way as -writeInBackgroundAndNotify:forModes:
+ * The handle is in the notification's userInfo as the
+ * NSFileHandleNotificationFileHandleItem.<br />
+ * Where the operating system supports it, the data is passed from
+ * the file to the receiver by the kernel without being read into
+ * the process.
+ */
+- (void) transferInBackgroundAndNotifyFrom: (NSFileHandle*)handle
+				    offset: (unsigned long long)offset
+				    length: (unsigned long long)length
+				  forModes: (NSArray*)modes
+{
+  [self subclassResponsibility: _cmd];
+}
+
 /**
  * <p>
  *   Return a flag to indicate whether compression has been turned on for
@@ -707,6 +739,25 @@ NSString * const NSFileHandleOperationException
   return NO;
 }
 
+/**
+ * Returns a dictionary of counts of the data written by the handle, or
+ * nil if the handle does not keep them.  The keys are:
+ * <deflist>
+ *   <term>BytesWritten</term>
+ *   <desc>The number of bytes written.</desc>
+ *   <term>WriteCalls</term>
+ *   <desc>The number of system calls used to write them.</desc>
+ *   <term>WriteQueue</term>
+ *   <desc>The number of background writes waiting to complete.</desc>
+ *   <term>WriteQueueMax</term>
+ *   <desc>The most background writes which have been waiting at once.</desc>
+ * </deflist>
+ */
+- (NSDictionary*) writeStatistics
+{
+  return nil;
+}
+
 @end
 
 @implementation NSFileHandle (GNUstepTLS)
@@ -58,6 +58,7 @@
 #import "Foundation/NSPathUtilities.h"
 #import "Foundation/NSProcessInfo.h"
 #import "Foundation/NSSet.h"
+#import "Foundation/NSThread.h"
 #import "Foundation/NSURL.h"
 #import "Foundation/NSValue.h"
 #import "GSPrivate.h"
@@ -173,6 +174,25 @@
 #define	GSBINIO	0
 #endif
 
+#if	defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+/* Defined here as <linux/fs.h> clashes with <sys/mount.h>
+ */
+#ifndef	FICLONE
+#define	FICLONE	_IOW(0x94, 9, int)
+#endif
+#endif
+
+/* Where directory entries can be opened and examined relative to an
+ * open directory, the directory enumerator uses that rather than
+ * building a full path for each entry.
+ */
+#if	!defined(__MINGW__) && defined(AT_FDCWD) && defined(O_DIRECTORY)
+#define	GS_DIRENT_AT	1
+#endif
+
 @interface NSDirectoryEnumerator (Local)
 - (id) initWithDirectoryPath: (NSString*)path 
    recurseIntoSubdirectories: (BOOL)recurse
@@ -181,6 +201,25 @@
 			 for: (NSFileManager*)mgr;
 @end
 
+#if	defined(GS_DIRENT_AT)
+@class	GSDirectoryWalk;
+
+/* An enumerator which reads a directory tree using several threads.
+ */
+@interface GSThreadedDirectoryEnumerator : NSDirectoryEnumerator
+{
+  GSDirectoryWalk	*walk;
+  NSArray		*batch;		// Paths being returned.
+  NSUInteger		index;		// Next path in batch.
+  NSString		*current;	// Path last returned.
+}
+- (id) initWithDirectoryPath: (NSString*)path
+	      followSymlinks: (BOOL)follow
+		     threads: (NSUInteger)count
+			 for: (NSFileManager*)mgr;
+@end
+#endif
+
 /*
  * Macros to handle unichar filesystem support.
  */
@@ -243,6 +282,11 @@
 }
 + (NSDictionary*) attributesAt: (const _CHAR*)lpath
 		  traverseLink: (BOOL)traverse;
+#if	defined(GS_DIRENT_AT)
++ (NSDictionary*) attributesAt: (const _CHAR*)lpath
+		   inDirectory: (int)fd
+		  traverseLink: (BOOL)traverse;
+#endif
 @end
 
 static Class	GSAttrDictionaryClass = 0;
@@ -273,6 +317,13 @@ static Class	GSAttrDictionaryClass = 0;
 	    toPath: (NSString*)destination
 	   handler: (id)handler;
 
+/* Does the work for -_copyPath:toPath:handler:, passing regular files
+ * to the copier (if not nil) to be copied in parallel.  */
+- (BOOL) _copyPath: (NSString*)source
+	    toPath: (NSString*)destination
+	   handler: (id)handler
+	    copier: (id)copier;
+
 /* Recursively links the contents of source directory to destination. */
 - (BOOL) _linkPath: (NSString*)source
 	    toPath: (NSString*)destination
@@ -1065,7 +1116,10 @@ static NSStringEncoding	defaultEncoding;
 
       [self _sendToHandler: handler willProcessPath: destination];
 
-      if ([self createDirectoryAtPath: destination attributes: attrs] == NO)
+      /* The attributes are set after the contents are copied, so a
+       * read-only directory can still be filled.
+       */
+      if ([self createDirectoryAtPath: destination attributes: nil] == NO)
 	{
           return [self _proceedAccordingToHandler: handler
 					 forError: _lastError
@@ -1078,6 +1132,7 @@ static NSStringEncoding	defaultEncoding;
 	{
 	  return NO;
 	}
+      [self changeFileAttributes: attrs atPath: destination];
     }
   else if ([fileType isEqualToString: NSFileTypeSymbolicLink] == YES)
     {
@@ -2104,6 +2159,22 @@ static NSStringEncoding	defaultEncoding;
 		       for: self]);
 }
 
+- (NSDirectoryEnumerator*) enumeratorAtPath: (NSString*)path
+				    threads: (NSUInteger)count
+{
+#if	defined(GS_DIRENT_AT)
+  if (count > 1)
+    {
+      return AUTORELEASE([[GSThreadedDirectoryEnumerator alloc]
+	initWithDirectoryPath: path
+	       followSymlinks: NO
+		      threads: count
+			  for: self]);
+    }
+#endif
+  return [self enumeratorAtPath: path];
+}
+
 /**
  * Returns an array containing the (relative) paths of all the items
  * in the directory at path.<br />
@@ -2217,6 +2288,73 @@ static NSStringEncoding	defaultEncoding;
 
 @end /* NSFileManager */
 
+#if	defined(GS_DIRENT_AT)
+/* Returns YES if the directory entry is a subdirectory to enumerate.
+ * The type recorded in the entry is used if there is one, so we only
+ * need to stat the entry for a symbolic link we must follow, or if the
+ * filesystem does not record types.
+ */
+static BOOL
+isDirectoryEntry(DIR *dir, struct dirent *entry, BOOL follow)
+{
+  struct stat	statbuf;
+
+#if	defined(DT_DIR) && defined(DT_LNK) && defined(DT_UNKNOWN)
+  if (entry->d_type == DT_DIR)
+    {
+      return YES;
+    }
+  if (entry->d_type == DT_LNK)
+    {
+      if (follow == NO)
+	{
+	  return NO;
+	}
+    }
+  else if (entry->d_type != DT_UNKNOWN)
+    {
+      return NO;
+    }
+#endif
+  if (fstatat(dirfd(dir), entry->d_name, &statbuf,
+    (follow == NO) ? AT_SYMLINK_NOFOLLOW : 0) != 0)
+    {
+      return NO;
+    }
+  return S_ISDIR(statbuf.st_mode) ? YES : NO;
+}
+
+/* Opens a directory found in the directory being read.
+ */
+static DIR *
+openDirectoryEntry(DIR *dir, struct dirent *entry, BOOL follow)
+{
+  int	flags = O_RDONLY | O_DIRECTORY;
+  int	fd;
+  DIR	*d;
+
+#if	defined(O_CLOEXEC)
+  flags |= O_CLOEXEC;
+#endif
+#if	defined(O_NOFOLLOW)
+  if (follow == NO)
+    {
+      flags |= O_NOFOLLOW;
+    }
+#endif
+  fd = openat(dirfd(dir), entry->d_name, flags);
+  if (fd < 0)
+    {
+      return 0;
+    }
+  if ((d = fdopendir(fd)) == 0)
+    {
+      close(fd);
+    }
+  return d;
+}
+#endif
+
 /* A directory to enumerate.  We keep a stack of the directories we
    still have to enumerate.  We start by putting the top-level
    directory into the stack, then we start reading files from it
@@ -2227,7 +2365,10 @@ static NSStringEncoding	defaultEncoding;
    -nextObject is called, it will read from that directory instead of
    the top level one.  Once all the subdirectory is read, it is
    removed from the stack, so the top of the stack if the top
-   directory again, and enumeration continues in there.  */
+   directory again, and enumeration continues in there.
+   Where possible each subdirectory is opened, and the attributes of
+   entries are read, relative to the open directory containing it, so
+   we only need the path of an entry relative to the top directory.  */
 typedef	struct	_GSEnumeratedDirectory {
   NSString *path;
   _DIR *pointer;
@@ -2319,8 +2460,11 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 
 - (void) dealloc
 {
-  GSIArrayEmpty(_stack);
-  NSZoneFree([self zone], _stack);
+  if (_stack != 0)
+    {
+      GSIArrayEmpty(_stack);
+      NSZoneFree([self zone], _stack);
+    }
   DESTROY(_topPath);
   DESTROY(_currentFilePath);
   DESTROY(_mgr);
@@ -2347,8 +2491,35 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
  */
 - (NSDictionary*) fileAttributes
 {
-  return [_mgr fileAttributesAtPath: _currentFilePath
+#if	defined(GS_DIRENT_AT)
+  NSUInteger		count = GSIArrayCount(_stack);
+  GSEnumeratedDirectory	dir;
+
+  if (_currentFilePath == nil || count == 0)
+    {
+      return nil;
+    }
+  /* If we have just started enumerating the current file as a directory
+   * it is in the directory below the top of the stack.
+   */
+  dir = GSIArrayLastItem(_stack).ext;
+  if (dir.path == _currentFilePath)
+    {
+      dir = GSIArrayItemAtIndex(_stack, count - 2).ext;
+    }
+  return [GSAttrDictionaryClass attributesAt:
+    [_mgr fileSystemRepresentationWithPath: [_currentFilePath lastPathComponent]]
+				 inDirectory: dirfd(dir.pointer)
+				traverseLink: _flags.isFollowing];
+#else
+  if (_currentFilePath == nil)
+    {
+      return nil;
+    }
+  return [_mgr fileAttributesAtPath:
+    [_topPath stringByAppendingPathComponent: _currentFilePath]
 		       traverseLink: _flags.isFollowing];
+#endif
 }
 
 /**
@@ -2392,7 +2563,6 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
     {
       GSEnumeratedDirectory dir = GSIArrayLastItem(_stack).ext;
       struct _DIRENT	*dirbuf;
-      struct _STATB	statbuf;
 
       dirbuf = _READDIR(dir.pointer);
 
@@ -2424,13 +2594,41 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 	  returnFileName = RETAIN([dir.path stringByAppendingPathComponent:
 	    returnFileName]);
 
-	  /* TODO - can this one can be removed ? */
-	  if (!_flags.justContents)
-	    _currentFilePath = RETAIN([_topPath stringByAppendingPathComponent:
-	      returnFileName]);
+	  /* The current file path is relative to the top directory, and
+	   * the full path is only built if it is needed.
+	   */
+	  _currentFilePath = RETAIN(returnFileName);
 
 	  if (_flags.isRecursive == YES)
 	    {
+#if	defined(GS_DIRENT_AT)
+	      if (isDirectoryEntry(dir.pointer, dirbuf, _flags.isFollowing))
+		{
+		  _DIR	*dir_pointer;
+
+		  dir_pointer = openDirectoryEntry(dir.pointer, dirbuf,
+		    _flags.isFollowing);
+		  if (dir_pointer)
+		    {
+		      GSIArrayItem item;
+
+		      item.ext.path = RETAIN(returnFileName);
+		      item.ext.pointer = dir_pointer;
+
+		      GSIArrayAddItem(_stack, item);
+		    }
+		  else
+		    {
+		      NSLog(@"Failed to recurse into directory '%@' - %@",
+			[_topPath stringByAppendingPathComponent:
+			returnFileName], [NSError _last]);
+		    }
+		}
+#else
+	      struct _STATB	statbuf;
+	      NSString		*path;
+
+	      path = [_topPath stringByAppendingPathComponent: returnFileName];
 	      // Do not follow links
 #ifdef S_IFLNK
 #ifdef __MINGW__
@@ -2438,8 +2636,8 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 #else
 	      if (!_flags.isFollowing)
 		{
-		  if (lstat([_mgr fileSystemRepresentationWithPath:
-		    _currentFilePath], &statbuf) != 0)
+		  if (lstat([_mgr fileSystemRepresentationWithPath: path],
+		    &statbuf) != 0)
 		    {
 		      break;
 		    }
@@ -2453,8 +2651,8 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 #endif
 #endif
 		{
-		  if (_STAT([_mgr fileSystemRepresentationWithPath:
-		    _currentFilePath], &statbuf) != 0)
+		  if (_STAT([_mgr fileSystemRepresentationWithPath: path],
+		    &statbuf) != 0)
 		    {
 		      break;
 		    }
@@ -2464,8 +2662,7 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 		  _DIR*  dir_pointer;
 
 		  dir_pointer
-		    = _OPENDIR([_mgr fileSystemRepresentationWithPath:
-		    _currentFilePath]);
+		    = _OPENDIR([_mgr fileSystemRepresentationWithPath: path]);
 		  if (dir_pointer)
 		    {
 		      GSIArrayItem item;
@@ -2478,9 +2675,10 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 		  else
 		    {
 		      NSLog(@"Failed to recurse into directory '%@' - %@",
-			_currentFilePath, [NSError _last]);
+			path, [NSError _last]);
 		    }
 		}
+#endif
 	    }
 	  break;	// Got a file name - break out of loop
 	}
@@ -2498,6 +2696,252 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 
 @end /* NSDirectoryEnumerator */
 
+#if	defined(GS_DIRENT_AT)
+
+#define	WALK_BATCH	256		// Paths passed on at once.
+#define	WALK_LIMIT	(64 * 1024)	// Most paths waiting to be returned.
+
+/* The state of a directory tree being read by several threads.  This is
+ * separate from the enumerator so that the enumerator may be deallocated
+ * (stopping the walk) while the threads are still running.
+ */
+@interface	GSDirectoryWalk : NSObject
+{
+@public
+  NSCondition		*condition;
+  NSFileManager		*manager;
+  NSString		*top;		// The directory at the top of the tree.
+  NSMutableArray	*pending;	// Directories still to be read.
+  NSMutableArray	*found;		// Batches of paths to return.
+  NSUInteger		queued;		// Number of paths in found.
+  unsigned		busy;		// Threads reading a directory.
+  BOOL			follow;		// Follow symbolic links.
+  BOOL			cancelled;	// The enumerator has gone.
+}
+- (BOOL) _add: (NSMutableArray*)paths directories: (NSMutableArray*)dirs;
+- (void) _walk: (id)unused;
+@end
+
+@implementation	GSDirectoryWalk
+
+- (void) dealloc
+{
+  RELEASE(condition);
+  RELEASE(manager);
+  RELEASE(top);
+  RELEASE(pending);
+  RELEASE(found);
+  [super dealloc];
+}
+
+/* Passes on the paths found and the directories to read next, waiting if
+ * too many paths are waiting to be returned.  Returns NO if the walk has
+ * been cancelled.  Must be called with the condition locked.
+ */
+- (BOOL) _add: (NSMutableArray*)paths directories: (NSMutableArray*)dirs
+{
+  NSUInteger	count = [paths count];
+
+  while (queued >= WALK_LIMIT && cancelled == NO)
+    {
+      [condition wait];
+    }
+  if (cancelled == YES)
+    {
+      return NO;
+    }
+  if (count > 0)
+    {
+      [found addObject: paths];
+      queued += count;
+    }
+  [pending addObjectsFromArray: dirs];
+  [dirs removeAllObjects];
+  [condition broadcast];
+  return YES;
+}
+
+/* The work done by each thread ... reading directories until there are
+ * none left to read and no other thread may find any more.
+ */
+- (void) _walk: (id)unused
+{
+  NSFileManager	*mgr = manager;
+
+  [condition lock];
+  for (;;)
+    {
+      CREATE_AUTORELEASE_POOL(pool);
+      NSMutableArray	*paths;
+      NSMutableArray	*dirs;
+      NSString		*path;
+      NSString		*name;
+      struct dirent	*entry;
+      DIR		*dir;
+
+      while ([pending count] == 0 && busy > 0 && cancelled == NO)
+	{
+	  [condition wait];
+	}
+      if ([pending count] == 0 || cancelled == YES)
+	{
+	  RELEASE(pool);
+	  break;
+	}
+      path = AUTORELEASE(RETAIN([pending lastObject]));
+      [pending removeLastObject];
+      busy++;
+      [condition unlock];
+
+      dir = opendir([mgr fileSystemRepresentationWithPath:
+	[top stringByAppendingPathComponent: path]]);
+      if (dir == 0)
+	{
+	  NSLog(@"Failed to recurse into directory '%@' - %@",
+	    [top stringByAppendingPathComponent: path], [NSError _last]);
+	}
+      paths = [NSMutableArray arrayWithCapacity: WALK_BATCH];
+      dirs = [NSMutableArray array];
+      while (dir != 0 && (entry = readdir(dir)) != 0)
+	{
+	  if (strcmp(entry->d_name, ".") == 0
+	    || strcmp(entry->d_name, "..") == 0)
+	    {
+	      continue;
+	    }
+	  name = [mgr stringWithFileSystemRepresentation: entry->d_name
+	    length: strlen(entry->d_name)];
+	  name = [path stringByAppendingPathComponent: name];
+	  [paths addObject: name];
+	  if (isDirectoryEntry(dir, entry, follow))
+	    {
+	      [dirs addObject: name];
+	    }
+	  if ([paths count] == WALK_BATCH)
+	    {
+	      BOOL	more;
+
+	      [condition lock];
+	      more = [self _add: paths directories: dirs];
+	      [condition unlock];
+	      if (more == NO)
+		{
+		  break;
+		}
+	      paths = [NSMutableArray arrayWithCapacity: WALK_BATCH];
+	    }
+	}
+      if (dir != 0)
+	{
+	  closedir(dir);
+	}
+      [condition lock];
+      [self _add: paths directories: dirs];
+      busy--;
+      [condition broadcast];
+      RELEASE(pool);
+    }
+  [condition unlock];
+}
+@end
+
+@implementation	GSThreadedDirectoryEnumerator
+
+- (id) initWithDirectoryPath: (NSString*)path
+	      followSymlinks: (BOOL)follow
+		     threads: (NSUInteger)count
+			 for: (NSFileManager*)mgr
+{
+  if (nil != (self = [super init]))
+    {
+      walk = [GSDirectoryWalk new];
+      walk->condition = [NSCondition new];
+      walk->manager = RETAIN(mgr);
+      walk->top = [path copy];
+      walk->pending = [[NSMutableArray alloc] initWithObjects: @"", nil];
+      walk->found = [NSMutableArray new];
+      walk->follow = follow;
+      while (count-- > 0)
+	{
+	  [NSThread detachNewThreadSelector: @selector(_walk:)
+				   toTarget: walk
+				 withObject: nil];
+	}
+    }
+  return self;
+}
+
+- (void) dealloc
+{
+  if (walk != nil)
+    {
+      [walk->condition lock];
+      walk->cancelled = YES;
+      [walk->condition broadcast];
+      [walk->condition unlock];
+      DESTROY(walk);
+    }
+  DESTROY(batch);
+  DESTROY(current);
+  [super dealloc];
+}
+
+- (NSDictionary*) directoryAttributes
+{
+  return [walk->manager fileAttributesAtPath: walk->top
+				traverseLink: walk->follow];
+}
+
+- (NSDictionary*) fileAttributes
+{
+  if (current == nil)
+    {
+      return nil;
+    }
+  return [walk->manager fileAttributesAtPath:
+    [walk->top stringByAppendingPathComponent: current]
+				traverseLink: walk->follow];
+}
+
+- (id) nextObject
+{
+  DESTROY(current);
+  if (batch == nil || index >= [batch count])
+    {
+      DESTROY(batch);
+      index = 0;
+      [walk->condition lock];
+      while ([walk->found count] == 0
+	&& (walk->busy > 0 || [walk->pending count] > 0))
+	{
+	  [walk->condition wait];
+	}
+      if ([walk->found count] > 0)
+	{
+	  batch = RETAIN([walk->found objectAtIndex: 0]);
+	  [walk->found removeObjectAtIndex: 0];
+	  walk->queued -= [batch count];
+	  [walk->condition broadcast];
+	}
+      [walk->condition unlock];
+      if (batch == nil)
+	{
+	  return nil;
+	}
+    }
+  current = RETAIN([batch objectAtIndex: index++]);
+  return AUTORELEASE(RETAIN(current));
+}
+
+/* The walk has usually read beyond the current file, so we can't skip
+ * its descendents.
+ */
+- (void) skipDescendents
+{
+}
+@end
+#endif
+
 /**
  * Convenience methods for accessing named file attributes in a dictionary.
  */
@@ -2662,6 +3106,410 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 }
 @end
 
+#if	!defined(__MINGW__)
+/*
+ * Copying file data.
+ * Where possible we let the kernel do the work: a file system which
+ * supports it can share the data blocks between the two files (making
+ * the copy almost instantaneous), and otherwise copy_file_range() or
+ * sendfile() copy the data without passing it through our memory.
+ * Failing that, we copy through a large buffer.
+ */
+#define	COPY_BUFSIZE	(1024 * 1024)		// Size of buffer for copying.
+#define	COPY_CHUNK	(1024 * 1024 * 1024)	// Most for one system call.
+#define	COPY_SMALL	(1024 * 1024)		// Copied in parallel if less.
+#define	COPY_QUEUE	256			// Most copies waiting.
+
+enum {
+  CopyOK = 0,
+  CopyOpenSourceFailed,
+  CopyOpenDestinationFailed,
+  CopyReadFailed,
+  CopyWriteFailed
+};
+
+/* Copies fileSize bytes from one open file to another.
+ */
+static int
+copyData(int sourceFd, int destFd, unsigned long long fileSize)
+{
+  unsigned long long	done = 0;
+  char			*buffer;
+
+#if	defined(__linux__)
+  if (fileSize > 0 && ioctl(destFd, FICLONE, sourceFd) == 0)
+    {
+      return CopyOK;
+    }
+#if	defined(__NR_copy_file_range)
+  while (done < fileSize)
+    {
+      ssize_t	n = syscall(__NR_copy_file_range, sourceFd, NULL, destFd, NULL,
+	(size_t)MIN(fileSize - done, COPY_CHUNK), 0);
+
+      if (n > 0)
+	{
+	  done += n;
+	}
+      else if (n == 0 && done > 0)
+	{
+	  return CopyOK;	// The file has been truncated.
+	}
+      else if (n == 0 || errno != EINTR)
+	{
+	  break;	// Not supported for these files ... try sendfile()
+	}
+    }
+#endif
+  while (done < fileSize)
+    {
+      ssize_t	n = sendfile(destFd, sourceFd, NULL,
+	(size_t)MIN(fileSize - done, COPY_CHUNK));
+
+      if (n > 0)
+	{
+	  done += n;
+	}
+      else if (n == 0 && done > 0)
+	{
+	  return CopyOK;	// The file has been truncated.
+	}
+      else if (n == 0 || errno != EINTR)
+	{
+	  break;	// Not supported for these files ... use a buffer.
+	}
+    }
+  if (done >= fileSize)
+    {
+      return CopyOK;
+    }
+#endif
+
+#if	defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise(sourceFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  buffer = malloc(COPY_BUFSIZE);
+  if (buffer == 0)
+    {
+      return CopyReadFailed;
+    }
+  while (done < fileSize)
+    {
+      ssize_t	rbytes;
+      ssize_t	wbytes;
+      ssize_t	offset = 0;
+
+      rbytes = read(sourceFd, buffer, (size_t)MIN(fileSize - done, COPY_BUFSIZE));
+      if (rbytes < 0)
+	{
+	  if (errno == EINTR)
+	    {
+	      continue;
+	    }
+	  free(buffer);
+	  return CopyReadFailed;
+	}
+      if (rbytes == 0)
+	{
+	  break;	// The file has been truncated.
+	}
+      while (offset < rbytes)
+	{
+	  wbytes = write(destFd, buffer + offset, rbytes - offset);
+	  if (wbytes < 0)
+	    {
+	      if (errno == EINTR)
+		{
+		  continue;
+		}
+	      free(buffer);
+	      return CopyWriteFailed;
+	    }
+	  offset += wbytes;
+	}
+      done += rbytes;
+    }
+  free(buffer);
+  return CopyOK;
+}
+
+/* Copies a regular file, creating the destination with the given mode.
+ */
+static int
+copyRegularFile(const char *source, const char *destination, int fileMode,
+  unsigned long long fileSize)
+{
+  int	sourceFd;
+  int	destFd;
+  int	result;
+
+  sourceFd = open(source, GSBINIO|O_RDONLY);
+  if (sourceFd < 0)
+    {
+      return CopyOpenSourceFailed;
+    }
+  destFd = open(destination, GSBINIO|O_WRONLY|O_CREAT|O_TRUNC, fileMode);
+  if (destFd < 0)
+    {
+      close(sourceFd);
+      return CopyOpenDestinationFailed;
+    }
+  result = copyData(sourceFd, destFd, fileSize);
+  close(sourceFd);
+  if (close(destFd) < 0 && result == CopyOK)
+    {
+      result = CopyWriteFailed;
+    }
+  return result;
+}
+
+static NSString *
+copyErrorText(int code)
+{
+  switch (code)
+    {
+      case CopyOpenSourceFailed:	return @"cannot open file for reading";
+      case CopyOpenDestinationFailed:	return @"cannot open file for writing";
+      case CopyReadFailed:		return @"cannot read from file";
+      default:				return @"cannot write to file";
+    }
+}
+
+typedef struct CopyJob {
+  struct CopyJob	*next;
+  int			mode;
+  unsigned long long	size;
+  char			*source;
+  char			*destination;
+} CopyJob;
+
+/* Copies small files in several threads at once, for copying a
+ * directory when there is no handler to consult about errors.
+ * Attributes of the items copied are kept to be set once all copies
+ * are complete, so directories get their permissions and dates after
+ * their contents are written.
+ */
+@interface	GSFileCopier : NSObject
+{
+  NSCondition		*condition;
+  CopyJob		*head;
+  CopyJob		*tail;
+  CopyJob		*failure;	// The first copy which failed.
+  int			failureCode;
+  int			failureErrno;
+  unsigned		queued;		// Number of copies waiting.
+  unsigned		limit;		// Most threads to use.
+  unsigned		threads;	// Number of threads running.
+  unsigned		idle;		// Number waiting for a copy.
+  BOOL			closed;		// No more copies will be added.
+  NSMutableArray	*attributes;	// Attributes to set, and paths.
+}
++ (GSFileCopier*) copier;
+- (void) copyFile: (const char*)source
+	   toFile: (const char*)destination
+	     mode: (int)mode
+	     size: (unsigned long long)size;
+- (BOOL) failed;
+- (NSString*) finish;
+- (void) setAttributes: (NSDictionary*)attrs forPath: (NSString*)path;
+- (void) setAttributesWith: (NSFileManager*)mgr;
+@end
+
+@implementation	GSFileCopier
+
+/* Returns a new copier, or nil if there is only one processor to use.
+ */
++ (GSFileCopier*) copier
+{
+  NSUInteger	count = [[NSProcessInfo processInfo] activeProcessorCount];
+  GSFileCopier	*copier;
+
+  if (count < 2)
+    {
+      return nil;
+    }
+  copier = AUTORELEASE([self new]);
+  copier->condition = [NSCondition new];
+  copier->attributes = [NSMutableArray new];
+  copier->limit = (count > 8) ? 8 : count;
+  return copier;
+}
+
+- (void) copyFile: (const char*)source
+	   toFile: (const char*)destination
+	     mode: (int)mode
+	     size: (unsigned long long)size
+{
+  size_t	slen = strlen(source) + 1;
+  size_t	dlen = strlen(destination) + 1;
+  CopyJob	*job = malloc(sizeof(CopyJob) + slen + dlen);
+
+  job->next = 0;
+  job->mode = mode;
+  job->size = size;
+  job->source = (char*)&job[1];
+  job->destination = job->source + slen;
+  memcpy(job->source, source, slen);
+  memcpy(job->destination, destination, dlen);
+
+  [condition lock];
+  while (queued >= COPY_QUEUE)
+    {
+      [condition wait];
+    }
+  if (tail == 0)
+    {
+      head = job;
+    }
+  else
+    {
+      tail->next = job;
+    }
+  tail = job;
+  queued++;
+  if (idle == 0 && threads < limit)
+    {
+      threads++;
+      [NSThread detachNewThreadSelector: @selector(_copy:)
+			       toTarget: self
+			     withObject: nil];
+    }
+  [condition broadcast];
+  [condition unlock];
+}
+
+- (void) dealloc
+{
+  while (head != 0)
+    {
+      CopyJob	*job = head;
+
+      head = job->next;
+      free(job);
+    }
+  if (failure != 0)
+    {
+      free(failure);
+    }
+  RELEASE(condition);
+  RELEASE(attributes);
+  [super dealloc];
+}
+
+- (BOOL) failed
+{
+  return (failure != 0) ? YES : NO;
+}
+
+/* Waits for all the copies to complete, returning a description of the
+ * first one to fail, or nil if all succeeded.
+ */
+- (NSString*) finish
+{
+  NSString	*error = nil;
+
+  [condition lock];
+  closed = YES;
+  [condition broadcast];
+  while (threads > 0)
+    {
+      [condition wait];
+    }
+  if (failure != 0)
+    {
+      char	*path = failure->destination;
+
+      if (failureCode == CopyOpenSourceFailed || failureCode == CopyReadFailed)
+	{
+	  path = failure->source;
+	}
+      error = [NSString stringWithFormat: @"%@ '%s' (%s)",
+	copyErrorText(failureCode), path, strerror(failureErrno)];
+    }
+  [condition unlock];
+  return error;
+}
+
+- (void) setAttributes: (NSDictionary*)attrs forPath: (NSString*)path
+{
+  [attributes addObject: path];
+  [attributes addObject: attrs];
+}
+
+- (void) setAttributesWith: (NSFileManager*)mgr
+{
+  NSUInteger	count = [attributes count];
+  NSUInteger	i;
+
+  for (i = 0; i < count; i += 2)
+    {
+      [mgr changeFileAttributes: [attributes objectAtIndex: i + 1]
+			 atPath: [attributes objectAtIndex: i]];
+    }
+}
+
+/* The work done by each copying thread.
+ */
+- (void) _copy: (id)unused
+{
+  CREATE_AUTORELEASE_POOL(pool);
+
+  [condition lock];
+  for (;;)
+    {
+      CopyJob	*job;
+      int	code;
+      int	err;
+
+      while (head == 0 && closed == NO)
+	{
+	  idle++;
+	  [condition wait];
+	  idle--;
+	}
+      if (head == 0)
+	{
+	  break;
+	}
+      job = head;
+      head = job->next;
+      if (head == 0)
+	{
+	  tail = 0;
+	}
+      queued--;
+      [condition broadcast];
+      if (failure != 0)
+	{
+	  free(job);	// Don't bother once one copy has failed.
+	  continue;
+	}
+      [condition unlock];
+
+      code = copyRegularFile(job->source, job->destination, job->mode,
+	job->size);
+      err = errno;
+
+      [condition lock];
+      if (code != CopyOK && failure == 0)
+	{
+	  failure = job;
+	  failureCode = code;
+	  failureErrno = err;
+	}
+      else
+	{
+	  free(job);
+	}
+    }
+  threads--;
+  [condition broadcast];
+  [condition unlock];
+  RELEASE(pool);
+}
+@end
+#endif	/* __MINGW__ */
+
 @implementation NSFileManager (PrivateMethods)
 
 - (BOOL) _copyFile: (NSString*)source
@@ -2682,16 +3530,10 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 				   toPath: destination];
 
 #else
-  NSDictionary	*attributes;
+  NSDictionary		*attributes;
   unsigned long long	fileSize;
-  unsigned long long	i;
-  int		bufsize = 8096;
-  int		sourceFd;
-  int		destFd;
-  int		fileMode;
-  int		rbytes;
-  int		wbytes;
-  char		buffer[bufsize];
+  int			fileMode;
+  int			code;
 
   /* Assumes source is a file and exists! */
   NSAssert1 ([self fileExistsAtPath: source],
@@ -2704,72 +3546,68 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
   fileSize = [attributes fileSize];
   fileMode = [attributes filePosixPermissions];
 
-  /* Open the source file. In case of error call the handler. */
-  sourceFd = open([self fileSystemRepresentationWithPath: source],
-    GSBINIO|O_RDONLY);
-  if (sourceFd < 0)
+  code = copyRegularFile([self fileSystemRepresentationWithPath: source],
+    [self fileSystemRepresentationWithPath: destination], fileMode, fileSize);
+  if (code == CopyOK)
     {
-      return [self _proceedAccordingToHandler: handler
-				     forError: @"cannot open file for reading"
-				       inPath: source
-				     fromPath: source
-				       toPath: destination];
+      return YES;
     }
+  return [self _proceedAccordingToHandler: handler
+				 forError: copyErrorText(code)
+				   inPath: (code == CopyOpenSourceFailed
+				     || code == CopyReadFailed)
+				     ? source : destination
+				 fromPath: source
+				   toPath: destination];
+#endif
+}
 
-  /* Open the destination file. In case of error call the handler. */
-  destFd = open([self fileSystemRepresentationWithPath: destination],
-    GSBINIO|O_WRONLY|O_CREAT|O_TRUNC, fileMode);
-  if (destFd < 0)
-    {
-      close (sourceFd);
+- (BOOL) _copyPath: (NSString*)source
+	    toPath: (NSString*)destination
+	   handler: handler
+{
+  id	copier = nil;
+  BOOL	result;
 
-      return [self _proceedAccordingToHandler: handler
-				     forError:  @"cannot open file for writing"
-				       inPath: destination
-				     fromPath: source
-				       toPath: destination];
+#if	!defined(__MINGW__)
+  /* Without a handler there is nobody to ask what to do after an error,
+   * so files can be copied in parallel.
+   */
+  if (handler == nil)
+    {
+      copier = [GSFileCopier copier];
     }
-
-  /* Read bufsize bytes from source file and write them into the destination
-     file. In case of errors call the handler and abort the operation. */
-  for (i = 0; i < fileSize; i += rbytes)
+#endif
+  result = [self _copyPath: source
+		    toPath: destination
+		   handler: handler
+		    copier: copier];
+#if	!defined(__MINGW__)
+  if (copier != nil)
     {
-      rbytes = read (sourceFd, buffer, bufsize);
-      if (rbytes < 0)
-	{
-          close (sourceFd);
-          close (destFd);
+      NSString	*error = [copier finish];
 
-          return [self _proceedAccordingToHandler: handler
-					 forError: @"cannot read from file"
-					   inPath: source
-					 fromPath: source
-					   toPath: destination];
+      if (error != nil)
+	{
+	  if (result == YES)
+	    {
+	      ASSIGN(_lastError, error);
+	      result = NO;
+	    }
 	}
-
-      wbytes = write (destFd, buffer, rbytes);
-      if (wbytes != rbytes)
+      else if (result == YES)
 	{
-          close (sourceFd);
-          close (destFd);
-
-          return [self _proceedAccordingToHandler: handler
-					 forError: @"cannot write to file"
-					   inPath: destination
-					 fromPath: source
-					   toPath: destination];
-        }
+	  [copier setAttributesWith: self];
+	}
     }
-  close (sourceFd);
-  close (destFd);
-
-  return YES;
 #endif
+  return result;
 }
 
 - (BOOL) _copyPath: (NSString*)source
 	    toPath: (NSString*)destination
 	   handler: handler
+	    copier: (id)copier
 {
   NSDirectoryEnumerator	*enumerator;
   NSString		*dirEntry;
@@ -2783,6 +3621,13 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
       NSString		*destinationFile;
       NSDictionary	*attributes;
 
+#if	!defined(__MINGW__)
+      if (copier != nil && [copier failed] == YES)
+	{
+	  break;	// The error is reported by -_copyPath:toPath:handler:
+	}
+#endif
+
       attributes = [enumerator fileAttributes];
       fileType = [attributes fileType];
       sourceFile = [source stringByAppendingPathComponent: dirEntry];
@@ -2795,8 +3640,11 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 	{
 	  BOOL	dirOK;
 
+	  /* The attributes are set after the contents are copied, so a
+	   * read-only directory can still be filled.
+	   */
 	  dirOK = [self createDirectoryAtPath: destinationFile
-				   attributes: attributes];
+				   attributes: nil];
 	  if (dirOK == NO)
 	    {
               if (![self _proceedAccordingToHandler: handler
@@ -2822,13 +3670,24 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 	      [enumerator skipDescendents];
 	      if (![self _copyPath: sourceFile
                          toPath: destinationFile
-                         handler: handler])
+                         handler: handler
+			  copier: copier])
                 {
                   RELEASE(pool);
                   return NO;
                 }
 	    }
 	}
+#if	!defined(__MINGW__)
+      else if ([fileType isEqual: NSFileTypeRegular] && copier != nil
+	&& [attributes fileSize] < COPY_SMALL)
+	{
+	  [copier copyFile: [self fileSystemRepresentationWithPath: sourceFile]
+		    toFile: [self fileSystemRepresentationWithPath: destinationFile]
+		      mode: [attributes filePosixPermissions]
+		      size: [attributes fileSize]];
+	}
+#endif
       else if ([fileType isEqual: NSFileTypeRegular])
 	{
 	  if (![self _copyFile: sourceFile
@@ -2868,6 +3727,13 @@ static inline void gsedRelease(GSEnumeratedDirectory X)
 	  NSLog(@"%@: %@", sourceFile, s);
 	  continue;
 	}
+#if	!defined(__MINGW__)
+      if (copier != nil)
+	{
+	  [copier setAttributes: attributes forPath: destinationFile];
+	  continue;
+	}
+#endif
       [self changeFileAttributes: attributes atPath: destinationFile];
     }
   RELEASE(pool);
@@ -3078,6 +3944,17 @@ static NSSet	*fileKeys = nil;
 
 + (NSDictionary*) attributesAt: (const _CHAR*)lpath
 		  traverseLink: (BOOL)traverse
+#if	defined(GS_DIRENT_AT)
+{
+  return [self attributesAt: lpath inDirectory: AT_FDCWD traverseLink: traverse];
+}
+
+/* As above, but with a relative path taken from the open directory fd.
+ */
++ (NSDictionary*) attributesAt: (const _CHAR*)lpath
+		   inDirectory: (int)fd
+		  traverseLink: (BOOL)traverse
+#endif
 {
   GSAttrDictionary	*d;
   unsigned		l = 0;
@@ -3094,6 +3971,13 @@ static NSSet	*fileKeys = nil;
   d = (GSAttrDictionary*)NSAllocateObject(self, (l+1)*sizeof(_CHAR),
     NSDefaultMallocZone());
 
+#if	defined(GS_DIRENT_AT)
+  if (fstatat(fd, lpath, &d->statbuf,
+    (traverse == NO) ? AT_SYMLINK_NOFOLLOW : 0) != 0)
+    {
+      DESTROY(d);
+    }
+#else
 #if defined(S_IFLNK) && !defined(__MINGW__)
   if (traverse == NO)
     {
@@ -3108,6 +3992,7 @@ static NSSet	*fileKeys = nil;
     {
       DESTROY(d);
     }
+#endif
   if (d != nil)
     {
       for (i = 0; i <= l; i++)
@@ -14,6 +14,7 @@
 #import "Foundation/NSData.h"
 #import "Foundation/NSDictionary.h"
 #import "Foundation/NSError.h"
+#import "Foundation/NSException.h"
 #import "Foundation/NSJSONSerialization.h"
 #import "Foundation/NSNull.h"
 #import "Foundation/NSStream.h"
@@ -21,6 +22,8 @@
 #import "Foundation/NSValue.h"
 #import "GSFastEnumeration.h"
 
+#include <locale.h>
+
 /* Boolean constants.
  */
 static id       boolN;
@@ -83,6 +86,30 @@ typedef struct ParserStateStruct
    * Error value, if this parser is currently in an error state, nil otherwise.
    */
   NSError *error;
+  /**
+   * UTF-8 bytes of the source when it is held in memory, NULL otherwise.
+   */
+  const uint8_t *bytes;
+  /**
+   * The number of bytes available in the in-memory source.
+   */
+  NSUInteger bytesLength;
+  /**
+   * The offset in the bytes of the first character in the buffer.
+   */
+  NSUInteger bytesStart;
+  /**
+   * The offset in the bytes after the last character in the buffer.
+   */
+  NSUInteger bytesEnd;
+  /**
+   * Set if more bytes may follow those currently available.
+   */
+  BOOL partial;
+  /**
+   * Set if the parser ran out of bytes when more may follow.
+   */
+  BOOL exhausted;
 } ParserState;
 
 /**
@@ -222,6 +249,172 @@ updateStreamBuffer(ParserState* state)
   state->source = stream;
 }
 
+/**
+ * Sets an error state for bytes which are not valid UTF-8.
+ */
+static void
+encodingError(ParserState *state)
+{
+  NSDictionary *userInfo = [[NSDictionary alloc] initWithObjectsAndKeys:
+    _(@"JSON Parse error"), NSLocalizedDescriptionKey,
+    _(([NSString stringWithFormat: @"Invalid UTF-8 at byte %"PRIuPTR,
+      state->bytesEnd])),
+      NSLocalizedFailureReasonErrorKey,
+    nil];
+  state->error = [NSError errorWithDomain: NSCocoaErrorDomain
+                                     code: 0
+                                 userInfo: userInfo];
+  [userInfo release];
+}
+
+/**
+ * Decodes the next group of characters from UTF-8 bytes in memory.
+ * This avoids creating a string from the whole of the source and allows
+ * the source to be incomplete.  In that case, running out of bytes sets
+ * the exhausted flag so that the caller can try again when more arrive.
+ */
+static inline void
+updateBytesBuffer(ParserState* state)
+{
+  const uint8_t *bytes = state->bytes;
+  NSUInteger pos = state->bytesEnd;
+  NSUInteger end = state->bytesLength;
+  NSUInteger len = 0;
+
+  state->bytesStart = pos;
+  while (len < BUFFER_SIZE && pos < end)
+    {
+      uint8_t c = bytes[pos];
+      NSUInteger n;
+      uint32_t u;
+      NSUInteger i;
+
+      if (c < 0x80)
+        {
+          state->buffer[len++] = c;
+          pos++;
+          continue;
+        }
+      if (c >= 0xc2 && c < 0xe0)
+        {
+          n = 2;
+          u = c & 0x1f;
+        }
+      else if (c >= 0xe0 && c < 0xf0)
+        {
+          n = 3;
+          u = c & 0x0f;
+        }
+      else if (c >= 0xf0 && c < 0xf5)
+        {
+          n = 4;
+          u = c & 0x07;
+        }
+      else
+        {
+          n = 0;
+          u = 0;
+        }
+      if (n > 0 && pos + n > end)
+        {
+          if (state->partial)
+            {
+              break;    // Wait for the rest of the character.
+            }
+          n = 0;
+        }
+      for (i = 1; i < n; i++)
+        {
+          if ((bytes[pos + i] & 0xc0) != 0x80)
+            {
+              n = 0;
+              break;
+            }
+          u = (u << 6) | (bytes[pos + i] & 0x3f);
+        }
+      if (0 == n
+        || (3 == n && u < 0x800)
+        || (4 == n && (u < 0x10000 || u > 0x10ffff))
+        || (u >= 0xd800 && u < 0xe000))
+        {
+          if (0 == len)
+            {
+              state->bytesEnd = pos;
+              encodingError(state);
+            }
+          break;
+        }
+      if (u >= 0x10000)
+        {
+          if (len + 2 > BUFFER_SIZE)
+            {
+              break;
+            }
+          u -= 0x10000;
+          state->buffer[len++] = 0xd800 + (u >> 10);
+          state->buffer[len++] = 0xdc00 + (u & 0x3ff);
+        }
+      else
+        {
+          state->buffer[len++] = u;
+        }
+      pos += n;
+    }
+  state->bytesEnd = pos;
+  state->bufferIndex = 0;
+  state->bufferLength = len;
+  if (0 == len)
+    {
+      state->buffer[0] = 0;
+      if (state->partial && nil == state->error)
+        {
+          state->exhausted = YES;
+        }
+    }
+}
+
+/**
+ * Returns the offset in the bytes of the current character.
+ */
+static NSUInteger
+bytesPosition(ParserState *state)
+{
+  NSUInteger pos = state->bytesStart;
+  NSUInteger count = state->bufferIndex;
+  NSUInteger i = 0;
+
+  if (count > state->bufferLength)
+    {
+      count = state->bufferLength;
+    }
+  while (i < count)
+    {
+      uint8_t c = state->bytes[pos];
+
+      if (c < 0x80)
+        {
+          pos++;
+          i++;
+        }
+      else if (c < 0xe0)
+        {
+          pos += 2;
+          i++;
+        }
+      else if (c < 0xf0)
+        {
+          pos += 3;
+          i++;
+        }
+      else
+        {
+          pos += 4;
+          i += 2;       // Surrogate pair
+        }
+    }
+  return pos;
+}
+
 /**
  * Returns the current character.
  */
@@ -402,6 +595,86 @@ parseString(ParserState *state)
   return val;
 }
 
+/**
+ * Returns the decimal point used by the C library in the current locale,
+ * which snprintf() writes and strtod() expects in place of the '.' that
+ * JSON always uses.
+ */
+static const char *
+decimalPoint(void)
+{
+  struct lconv *l = localeconv();
+
+  if (0 == l->decimal_point || '\0' == *l->decimal_point)
+    {
+      return ".";
+    }
+  return l->decimal_point;
+}
+
+/**
+ * Converts a JSON number to a double whatever the current locale.
+ */
+static double
+numberToDouble(const char *number)
+{
+  const char *point = decimalPoint();
+  const char *dot;
+  char buf[256];
+  char *tmp;
+  size_t before;
+  size_t plen;
+  size_t len;
+  double d;
+
+  if (('.' == point[0] && '\0' == point[1])
+    || 0 == (dot = strchr(number, '.')))
+    {
+      return strtod(number, 0);
+    }
+  before = dot - number;
+  plen = strlen(point);
+  len = strlen(number) - 1 + plen;
+  tmp = (len < sizeof(buf)) ? buf : malloc(len + 1);
+  if (0 == tmp)
+    {
+      return strtod(number, 0);
+    }
+  memcpy(tmp, number, before);
+  memcpy(tmp + before, point, plen);
+  strcpy(tmp + before + plen, dot + 1);
+  d = strtod(tmp, 0);
+  if (tmp != buf)
+    {
+      free(tmp);
+    }
+  return d;
+}
+
+/**
+ * Formats a double as a JSON number whatever the current locale,
+ * returning the length written to buf (which must be large enough).
+ */
+static int
+doubleToNumber(char *buf, size_t size, const char *format, double d)
+{
+  const char *point = decimalPoint();
+  char *pos;
+  int len;
+
+  len = snprintf(buf, size, format, d);
+  if (('.' != point[0] || '\0' != point[1])
+    && 0 != (pos = strstr(buf, point)))
+    {
+      size_t plen = strlen(point);
+
+      *pos = '.';
+      memmove(pos + 1, pos + plen, len - (pos - buf) - plen + 1);
+      len -= plen - 1;
+    }
+  return len;
+}
+
 /**
  * Parses a number, as defined by section 2.4 of the JSON specification.
  */
@@ -470,7 +743,7 @@ parseNumber(ParserState *state)
     }
     // Add a null terminator on the buffer.
     BUFFER(0);
-    num = strtod(number, 0);
+    num = numberToDouble(number);
     if (number != numberBuffer)
       {
         free(number);
@@ -731,171 +1004,422 @@ static Class NSNullClass;
 static Class NSNumberClass;
 static Class NSStringClass;
 
-static NSMutableCharacterSet *escapeSet;
+/**
+ * The number of bytes of output to collect before passing them on.
+ */
+#define OUTPUT_SIZE 8192
+
+/**
+ * Structure for storing the internal state of the writer.  Output is
+ * collected as UTF-8 in a buffer which is appended to an NSMutableData
+ * or written to an NSOutputStream when it fills.
+ */
+typedef struct WriterStateStruct
+{
+  /**
+   * The data being written to, or nil if writing to a stream.
+   */
+  NSMutableData *data;
+  /**
+   * The stream being written to, or nil if writing to data.
+   */
+  NSOutputStream *stream;
+  /**
+   * Error value, set if writing to the stream failed.
+   */
+  NSError *error;
+  /**
+   * The total number of bytes passed on so far.
+   */
+  NSUInteger written;
+  /**
+   * The number of bytes in the buffer.
+   */
+  NSUInteger length;
+  /**
+   * Buffer used to collect output.
+   */
+  uint8_t buffer[OUTPUT_SIZE];
+} WriterState;
+
+/**
+ * Escape table for ASCII characters.  Zero means the character is written
+ * as is, 'u' means it must be written as a unicode escape, and anything
+ * else is the character to write after a backslash.
+ */
+static const char escapes[128] = {
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static NSError*
+writingError(void)
+{
+  NSDictionary *userInfo = [[NSDictionary alloc] initWithObjectsAndKeys:
+    _(@"JSON writing error"), NSLocalizedDescriptionKey,
+    nil];
+  NSError *error = [NSError errorWithDomain: NSCocoaErrorDomain
+                                       code: 0
+                                   userInfo: userInfo];
+  [userInfo release];
+  return error;
+}
+
+/**
+ * Passes on the contents of the output buffer.  The buffer is always
+ * emptied, so once writing has failed any further output is discarded.
+ */
+static BOOL
+flushOutput(WriterState *w)
+{
+  const uint8_t *bytes = w->buffer;
+  NSUInteger toWrite = w->length;
+
+  w->length = 0;
+  if (nil != w->error)
+    {
+      return NO;
+    }
+  if (nil != w->data)
+    {
+      [w->data appendBytes: bytes length: toWrite];
+      w->written += toWrite;
+      return YES;
+    }
+  while (toWrite > 0)
+    {
+      NSInteger wrote = [w->stream write: bytes maxLength: toWrite];
+
+      if (wrote <= 0)
+        {
+          w->error = [w->stream streamError];
+          if (nil == w->error)
+            {
+              w->error = writingError();
+            }
+          return NO;
+        }
+      bytes += wrote;
+      toWrite -= wrote;
+      w->written += wrote;
+    }
+  return YES;
+}
+
+/**
+ * Adds bytes to the output buffer, passing it on when it fills.
+ */
+static inline void
+writeBytes(WriterState *w, const void *bytes, NSUInteger length)
+{
+  if (w->length + length > OUTPUT_SIZE)
+    {
+      flushOutput(w);
+      while (length > OUTPUT_SIZE)
+        {
+          memcpy(w->buffer, bytes, OUTPUT_SIZE);
+          w->length = OUTPUT_SIZE;
+          flushOutput(w);
+          bytes = ((const uint8_t*)bytes) + OUTPUT_SIZE;
+          length -= OUTPUT_SIZE;
+        }
+    }
+  memcpy(w->buffer + w->length, bytes, length);
+  w->length += length;
+}
+
+static inline void
+writeByte(WriterState *w, uint8_t c)
+{
+  if (w->length == OUTPUT_SIZE)
+    {
+      flushOutput(w);
+    }
+  w->buffer[w->length++] = c;
+}
 
 static inline void
-writeTabs(NSMutableString *output, NSInteger tabs)
+writeTabs(WriterState *w, NSInteger tabs)
 {
   NSInteger i;
 
   for (i = 0 ; i < tabs ; i++)
     {
-      [output appendString: @"\t"];
+      writeByte(w, '\t');
     }
 }
 
 static inline void
-writeNewline(NSMutableString *output, NSInteger tabs)
+writeNewline(WriterState *w, NSInteger tabs)
 {
   if (tabs >= 0)
     {
-      [output appendString: @"\n"];
+      writeByte(w, '\n');
+    }
+}
+
+/**
+ * Writes a string as UTF-8, with quotes and escapes.  Runs of characters
+ * which need no escaping are found using the escape table and copied
+ * in one go.
+ */
+static void
+writeString(WriterState *w, NSString *str)
+{
+  NSUInteger length = [str length];
+  NSUInteger pos = 0;
+  unichar chars[256];
+
+  writeByte(w, '"');
+  while (pos < length)
+    {
+      NSUInteger count = length - pos;
+      NSUInteger i = 0;
+
+      if (count > 256)
+        {
+          count = 256;
+        }
+      [str getCharacters: chars range: NSMakeRange(pos, count)];
+      /* Don't split a surrogate pair between chunks.
+       */
+      if (count > 1 && pos + count < length
+        && chars[count - 1] >= 0xd800 && chars[count - 1] < 0xdc00)
+        {
+          count--;
+        }
+      pos += count;
+
+      while (i < count)
+        {
+          uint8_t run[256];
+          NSUInteger n = 0;
+          unichar c;
+
+          while (i < count && (c = chars[i]) < 0x80 && 0 == escapes[c])
+            {
+              run[n++] = (uint8_t)c;
+              i++;
+            }
+          if (n > 0)
+            {
+              writeBytes(w, run, n);
+            }
+          if (i == count)
+            {
+              break;
+            }
+          c = chars[i++];
+          if (c < 0x80)
+            {
+              char e = escapes[c];
+
+              writeByte(w, '\\');
+              writeByte(w, e);
+              if ('u' == e)
+                {
+                  writeBytes(w, "00", 2);
+                  writeByte(w, hexDigits[c >> 4]);
+                  writeByte(w, hexDigits[c & 0xf]);
+                }
+            }
+          else if (c < 0x800)
+            {
+              writeByte(w, 0xc0 | (c >> 6));
+              writeByte(w, 0x80 | (c & 0x3f));
+            }
+          else if (c >= 0xd800 && c < 0xdc00
+            && i < count && chars[i] >= 0xdc00 && chars[i] < 0xe000)
+            {
+              uint32_t u;
+
+              u = 0x10000 + ((c - 0xd800) << 10) + (chars[i++] - 0xdc00);
+
+              writeByte(w, 0xf0 | (u >> 18));
+              writeByte(w, 0x80 | ((u >> 12) & 0x3f));
+              writeByte(w, 0x80 | ((u >> 6) & 0x3f));
+              writeByte(w, 0x80 | (u & 0x3f));
+            }
+          else if (c >= 0xd800 && c < 0xe000)
+            {
+              /* A lone surrogate can't be encoded as UTF-8, so escape it.
+               */
+              writeBytes(w, "\\u", 2);
+              writeByte(w, hexDigits[c >> 12]);
+              writeByte(w, hexDigits[(c >> 8) & 0xf]);
+              writeByte(w, hexDigits[(c >> 4) & 0xf]);
+              writeByte(w, hexDigits[c & 0xf]);
+            }
+          else
+            {
+              writeByte(w, 0xe0 | (c >> 12));
+              writeByte(w, 0x80 | ((c >> 6) & 0x3f));
+              writeByte(w, 0x80 | (c & 0x3f));
+            }
+        }
+    }
+  writeByte(w, '"');
+}
+
+/**
+ * Writes a number.  Integers are written exactly, and floating point
+ * values with the fewest digits which read back as the same value.
+ * Returns NO for values which JSON can't represent.
+ */
+static BOOL
+writeNumber(WriterState *w, NSNumber *num)
+{
+  const char *type = [num objCType];
+  char buf[32];
+  int len;
+
+  switch (*type)
+    {
+      case 'c':
+      case 's':
+      case 'i':
+      case 'l':
+      case 'q':
+        len = snprintf(buf, sizeof(buf), "%lld", [num longLongValue]);
+        break;
+      case 'C':
+      case 'S':
+      case 'I':
+      case 'L':
+      case 'Q':
+        len = snprintf(buf, sizeof(buf), "%llu", [num unsignedLongLongValue]);
+        break;
+      default:
+        {
+          double d = [num doubleValue];
+
+          if (d != d || d - d != 0.0)
+            {
+              return NO;        // NaN or infinity
+            }
+          len = doubleToNumber(buf, sizeof(buf), "%.15g", d);
+          if (numberToDouble(buf) != d)
+            {
+              len = doubleToNumber(buf, sizeof(buf), "%.17g", d);
+            }
+        }
+    }
+  if (0 != w)
+    {
+      writeBytes(w, buf, len);
     }
+  return YES;
 }
 
+/**
+ * Writes obj, or just checks that it can be written if w is null.
+ */
 static BOOL
-writeObject(id obj, NSMutableString *output, NSInteger tabs)
+writeObject(id obj, WriterState *w, NSInteger tabs)
 {
+  if (0 != w && nil != w->error)
+    {
+      return NO;
+    }
   if ([obj isKindOfClass: NSArrayClass])
     {
       BOOL writeComma = NO;
-      [output appendString: @"["];
+
+      if (0 != w) writeByte(w, '[');
       FOR_IN(id, o, obj)
-        if (writeComma)
+        if (0 != w)
           {
-            [output appendString: @","];
+            if (writeComma)
+              {
+                writeByte(w, ',');
+              }
+            writeNewline(w, tabs);
+            writeTabs(w, tabs);
           }
         writeComma = YES;
-        writeNewline(output, tabs);
-        writeTabs(output, tabs);
-        writeObject(o, output, tabs + 1);
+        if (NO == writeObject(o, w, tabs + 1))
+          {
+            return NO;
+          }
       END_FOR_IN(obj)
-      writeNewline(output, tabs);
-      writeTabs(output, tabs);
-      [output appendString: @"]"];
+      if (0 != w)
+        {
+          writeNewline(w, tabs);
+          writeTabs(w, tabs);
+          writeByte(w, ']');
+        }
     }
   else if ([obj isKindOfClass: NSDictionaryClass])
     {
       BOOL writeComma = NO;
-      [output appendString: @"{"];
+
+      if (0 != w) writeByte(w, '{');
       FOR_IN(id, o, obj)
         // Keys in dictionaries must be strings
         if (![o isKindOfClass: NSStringClass]) { return NO; }
-        if (writeComma)
+        if (0 != w)
           {
-            [output appendString: @","];
+            if (writeComma)
+              {
+                writeByte(w, ',');
+              }
+            writeNewline(w, tabs);
+            writeTabs(w, tabs);
+            writeString(w, o);
+            if (tabs >= 0)
+              {
+                writeBytes(w, ": ", 2);
+              }
+            else
+              {
+                writeByte(w, ':');
+              }
           }
         writeComma = YES;
-        writeNewline(output, tabs);
-        writeTabs(output, tabs);
-        writeObject(o, output, tabs + 1);
-        [output appendString: @": "];
-        writeObject([obj objectForKey: o], output, tabs + 1);
+        if (NO == writeObject([obj objectForKey: o], w, tabs + 1))
+          {
+            return NO;
+          }
       END_FOR_IN(obj)
-      writeNewline(output, tabs);
-      writeTabs(output, tabs);
-      [output appendString: @"}"];
+      if (0 != w)
+        {
+          writeNewline(w, tabs);
+          writeTabs(w, tabs);
+          writeByte(w, '}');
+        }
     }
   else if ([obj isKindOfClass: NSStringClass])
     {
-      NSString  *str = (NSString*)obj;
-      unsigned	length = [str length];
-
-      if (length == 0)
-        {
-          [output appendString: @"\"\""];
-        }
-      else
+      if (0 != w)
         {
-          unsigned	size = 2;
-          unichar	*from;
-          unsigned	i = 0;
-          unichar	*to;
-          unsigned	j = 0;
-
-          from = NSZoneMalloc (NSDefaultMallocZone(), sizeof(unichar) * length);
-          [str getCharacters: from];
-
-          for (i = 0; i < length; i++)
-            {
-              unichar	c = from[i];
-
-              if (c == '"' || c == '\\' || c == '\b'
-                || c == '\f' || c == '\n' || c == '\r' || c == '\t')
-                {
-                  size += 2;
-                }
-              else if (c < 0x20)
-                {
-                  size += 6;
-                }
-              else
-                {
-                  size++;
-                }
-            }
-
-          to = NSZoneMalloc (NSDefaultMallocZone(), sizeof(unichar) * size);
-          to[j++] = '"';
-          for (i = 0; i < length; i++)
-            {
-              unichar	c = from[i];
-
-              if (c == '"' || c == '\\' || c == '\b'
-                || c == '\f' || c == '\n' || c == '\r' || c == '\t')
-                {
-                  to[j++] = '\\';
-                  switch (c)
-                    {
-                      case '\\': to[j++] = '\\'; break;
-                      case '\b': to[j++] = 'b'; break;
-                      case '\f': to[j++] = 'f'; break;
-                      case '\n': to[j++] = 'n'; break;
-                      case '\r': to[j++] = 'r'; break;
-                      case '\t': to[j++] = 't'; break;
-                      default: to[j++] = '"'; break;
-                    }
-                }
-              else if (c < 0x20)
-                {
-                  char	buf[5];
-
-                  to[j++] = '\\';
-                  to[j++] = 'u';
-                  sprintf(buf, "%04x", c);
-                  to[j++] = buf[0];
-                  to[j++] = buf[1];
-                  to[j++] = buf[2];
-                  to[j++] = buf[3];
-                }
-              else
-                {
-                  to[j++] = c;
-                }
-            }
-          to[j] = '"';
-          str = [[NSStringClass alloc] initWithCharacters: to length: size];
-          NSZoneFree (NSDefaultMallocZone (), to);
-          NSZoneFree (NSDefaultMallocZone (), from);
-          [output appendString: str];
-          [str release];
+          writeString(w, obj);
         }
     }
   else if (obj == boolN)
     {
-      [output appendString: @"false"];
+      if (0 != w) writeBytes(w, "false", 5);
     }
   else if (obj == boolY)
     {
-      [output appendString: @"true"];
+      if (0 != w) writeBytes(w, "true", 4);
     }
   else if ([obj isKindOfClass: NSNumberClass])
     {
-      [output appendFormat: @"%g", [obj doubleValue]];
+      return writeNumber(w, obj);
     }
   else if ([obj isKindOfClass: NSNullClass])
     {
-      [output appendString: @"null"];
+      if (0 != w) writeBytes(w, "null", 4);
     }
   else
     {
@@ -916,9 +1440,6 @@ writeObject(id obj, NSMutableString *output, NSInteger tabs)
       NSStringClass = [NSString class];
       NSDictionaryClass = [NSDictionary class];
       NSNumberClass = [NSNumber class];
-      escapeSet = [NSMutableCharacterSet new];
-      [[NSObject leakAt: &escapeSet] release];
-      [escapeSet addCharactersInString: @"\"\\"];
       boolN = [[NSNumber alloc] initWithBool: NO];
       [[NSObject leakAt: &boolN] release];
       boolY = [[NSNumber alloc] initWithBool: YES];
@@ -931,18 +1452,18 @@ writeObject(id obj, NSMutableString *output, NSInteger tabs)
                        options: (NSJSONWritingOptions)opt
                          error: (NSError **)error
 {
-  /* Temporary string: allocate more space than we are likely to use so we just
-   * quickly claim a page and then give it back later
-   */
-  NSMutableString *str = [[NSMutableString alloc] initWithCapacity: 4096];
-  NSData *data = nil;
-  NSUInteger tabs;
+  WriterState *w;
+  NSMutableData *data = nil;
+  NSInteger tabs;
 
   tabs = ((opt & NSJSONWritingPrettyPrinted) == NSJSONWritingPrettyPrinted) ?
     0 : NSIntegerMin;
-  if (writeObject(obj, str, tabs))
+  w = NSZoneMalloc(NSDefaultMallocZone(), sizeof(WriterState));
+  memset(w, '\0', sizeof(WriterState) - OUTPUT_SIZE);
+  w->data = data = [NSMutableData dataWithCapacity: OUTPUT_SIZE];
+  if (writeObject(obj, w, tabs))
     {
-      data = [str dataUsingEncoding: NSUTF8StringEncoding];
+      flushOutput(w);
       if (NULL != error)
         {
           *error = nil;
@@ -950,43 +1471,55 @@ writeObject(id obj, NSMutableString *output, NSInteger tabs)
     }
   else
     {
+      data = nil;
       if (NULL != error)
 	{
-	  NSDictionary *userInfo = [[NSDictionary alloc] initWithObjectsAndKeys:
-	    _(@"JSON writing error"), NSLocalizedDescriptionKey,
-	    nil];
-	  *error = [NSError errorWithDomain: NSCocoaErrorDomain
-				       code: 0
-				   userInfo: userInfo];
+	  *error = writingError();
 	}
     }
-  [str release];
+  NSZoneFree(NSDefaultMallocZone(), w);
   return data;
 }
 
 + (BOOL) isValidJSONObject: (id)obj
 {
-  return writeObject(obj, nil, NSIntegerMin);
+  return writeObject(obj, 0, NSIntegerMin);
 }
 
 + (id) JSONObjectWithData: (NSData *)data
                   options: (NSJSONReadingOptions)opt
                     error: (NSError **)error
 {
-  uint8_t BOM[4];
+  uint8_t BOM[4] = { 0 };
   ParserState p = { 0 };
   id obj;
 
   [data getBytes: BOM length: 4];
   getEncoding(BOM, &p);
-  p.source = [[NSString alloc] initWithData: data encoding: p.enc];
-  p.updateBuffer = updateStringBuffer;
+  if (NSUTF8StringEncoding == p.enc)
+    {
+      /* Decode UTF-8 directly from the data rather than making a string.
+       */
+      p.bytes = [data bytes];
+      p.bytesLength = [data length];
+      p.bytesEnd = p.BOMLength;
+      p.updateBuffer = updateBytesBuffer;
+    }
+  else
+    {
+      p.source = [[NSString alloc] initWithData: data encoding: p.enc];
+      p.updateBuffer = updateStringBuffer;
+    }
   p.mutableContainers
     = (opt & NSJSONReadingMutableContainers) == NSJSONReadingMutableContainers;
   p.mutableStrings
     = (opt & NSJSONReadingMutableLeaves) == NSJSONReadingMutableLeaves;
   obj = parseValue(&p);
   [p.source release];
+  if (nil != p.error)
+    {
+      DESTROY(obj);
+    }
   if (NULL != error)
     {
       *error = p.error;
@@ -1038,28 +1571,383 @@ writeObject(id obj, NSMutableString *output, NSInteger tabs)
                       options: (NSJSONWritingOptions)opt
                         error: (NSError **)error
 {
-  NSData *data = [self dataWithJSONObject: obj options: opt error: error];
+  WriterState *w;
+  NSInteger tabs;
+  NSInteger result = 0;
+
+  /* Check the object first, since once we start writing we can't take
+   * back what has gone to the stream.
+   */
+  if (NO == writeObject(obj, 0, NSIntegerMin))
+    {
+      if (NULL != error)
+        {
+          *error = writingError();
+        }
+      return 0;
+    }
+  tabs = ((opt & NSJSONWritingPrettyPrinted) == NSJSONWritingPrettyPrinted) ?
+    0 : NSIntegerMin;
+  w = NSZoneMalloc(NSDefaultMallocZone(), sizeof(WriterState));
+  memset(w, '\0', sizeof(WriterState) - OUTPUT_SIZE);
+  w->stream = stream;
+  if (writeObject(obj, w, tabs) && flushOutput(w))
+    {
+      result = w->written;
+      if (NULL != error)
+        {
+          *error = nil;
+        }
+    }
+  else if (NULL != error)
+    {
+      *error = w->error;
+    }
+  NSZoneFree(NSDefaultMallocZone(), w);
+  return result;
+}
+@end
+
+/* States of a GSJSONReader.
+ */
+#define READER_START    0       // Encoding not yet checked
+#define READER_VALUES   1       // Reading a sequence of values
+#define READER_OPEN     2       // Expecting the start of the top level array
+#define READER_ELEMENTS 3       // Expecting the first element or the end
+#define READER_ELEMENT  4       // Expecting an element after a comma
+#define READER_COMMA    5       // Expecting a comma or the end
+#define READER_DONE     6       // Past the end of the top level array
+
+static NSError*
+readerError(NSString *reason)
+{
+  NSDictionary *userInfo = [[NSDictionary alloc] initWithObjectsAndKeys:
+    _(@"JSON Parse error"), NSLocalizedDescriptionKey,
+    reason, NSLocalizedFailureReasonErrorKey,
+    nil];
+  NSError *error = [NSError errorWithDomain: NSCocoaErrorDomain
+                                       code: 0
+                                   userInfo: userInfo];
+  [userInfo release];
+  return error;
+}
+
+@interface GSJSONReader (Private)
+- (BOOL) _parse;
+- (BOOL) _scanned;
+@end
+
+@implementation GSJSONReader
 
-  if (nil != data)
++ (void) initialize
+{
+  if (self == [GSJSONReader class])
     {
-      const char *bytes = [data bytes];
-      NSUInteger toWrite = [data length];
+      [NSJSONSerialization class];      // Set up boolean constants.
+    }
+}
+
+- (BOOL) appendBytes: (const void*)bytes length: (NSUInteger)length
+{
+  if (YES == _finished)
+    {
+      [NSException raise: NSInternalInconsistencyException
+                  format: @"[%@-%@] called after -finish",
+        NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  if (nil != _error)
+    {
+      return NO;
+    }
+  [_data appendBytes: bytes length: length];
+  return [self _parse];
+}
 
-      while (toWrite > 0)
+- (BOOL) appendData: (NSData*)data
+{
+  return [self appendBytes: [data bytes] length: [data length]];
+}
+
+- (void) dealloc
+{
+  [_data release];
+  [_objects release];
+  [_error release];
+  [super dealloc];
+}
+
+- (NSError*) error
+{
+  return _error;
+}
+
+- (BOOL) finish
+{
+  if (NO == _finished)
+    {
+      _finished = YES;
+      if (YES == [self _parse] && YES == _elements && READER_DONE != _state)
+        {
+          ASSIGN(_error, readerError(_(@"Unexpected end of JSON data")));
+        }
+    }
+  return (nil == _error) ? YES : NO;
+}
+
+- (id) init
+{
+  return [self initWithOptions: 0];
+}
+
+- (id) initWithOptions: (NSJSONReadingOptions)opt
+{
+  if (nil != (self = [super init]))
+    {
+      _data = [NSMutableData new];
+      _objects = [NSMutableArray new];
+      _options = opt;
+    }
+  return self;
+}
+
+- (id) nextObject
+{
+  id    obj;
+
+  if ([_objects count] == 0)
+    {
+      return nil;
+    }
+  obj = [[_objects objectAtIndex: 0] retain];
+  [_objects removeObjectAtIndex: 0];
+  return [obj autorelease];
+}
+
+- (NSInteger) readFromStream: (NSInputStream*)stream
+{
+  uint8_t       buf[16384];
+  NSInteger     length;
+
+  length = [stream read: buf maxLength: sizeof(buf)];
+  if (length < 0)
+    {
+      if (nil == _error)
+        {
+          ASSIGN(_error, [stream streamError]);
+        }
+      return -1;
+    }
+  if (0 == length)
+    {
+      return (YES == [self finish]) ? 0 : -1;
+    }
+  return (YES == [self appendBytes: buf length: length]) ? length : -1;
+}
+
+- (void) setReadsArrayElements: (BOOL)flag
+{
+  if (READER_START != _state || [_data length] > 0)
+    {
+      [NSException raise: NSInternalInconsistencyException
+                  format: @"[%@-%@] called after data was appended",
+        NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
+    }
+  _elements = flag;
+}
+
+/* Parses as many complete values as are available.
+ */
+- (BOOL) _parse
+{
+  const uint8_t *bytes = [_data bytes];
+  NSUInteger    length = [_data length];
+
+  if (nil != _error)
+    {
+      return NO;
+    }
+  if (READER_START == _state)
+    {
+      ParserState       p = { 0 };
+      uint8_t           BOM[4] = { 0 };
+
+      if (length < 4 && NO == _finished)
+        {
+          return YES;   // Not enough to tell the encoding.
+        }
+      memcpy(BOM, bytes, length < 4 ? length : 4);
+      getEncoding(BOM, &p);
+      if (length >= 4 && NSUTF8StringEncoding != p.enc)
+        {
+          ASSIGN(_error, readerError(_(@"JSON data is not UTF-8 encoded")));
+          return NO;
+        }
+      _offset = (NSUTF8StringEncoding == p.enc) ? p.BOMLength : 0;
+      _state = (YES == _elements) ? READER_OPEN : READER_VALUES;
+    }
+
+  /* If we ran out of data part way through a value last time, only scan
+   * the new data until the value is complete, so that a large value
+   * arriving in small pieces is not parsed over and over.
+   */
+  if (YES == _pending && NO == _finished && NO == [self _scanned])
+    {
+      return YES;
+    }
+  _pending = NO;
+
+  for (;;)
+    {
+      ParserState       p = { 0 };
+      id                obj = nil;
+      NSUInteger        start;
+      unichar           c;
+
+      p.bytes = bytes;
+      p.bytesLength = length;
+      p.bytesEnd = _offset;
+      p.partial = (YES == _finished) ? NO : YES;
+      p.updateBuffer = updateBytesBuffer;
+      p.mutableContainers = (_options & NSJSONReadingMutableContainers)
+        == NSJSONReadingMutableContainers;
+      p.mutableStrings = (_options & NSJSONReadingMutableLeaves)
+        == NSJSONReadingMutableLeaves;
+
+      c = consumeSpace(&p);
+      start = bytesPosition(&p);
+      if (0 == c && nil == p.error && start == length)
+        {
+          _offset = length;
+          break;        // Nothing but whitespace left.
+        }
+      if ((READER_OPEN == _state && '[' == c)
+        || (READER_COMMA == _state && ',' == c)
+        || ((READER_ELEMENTS == _state || READER_COMMA == _state) && ']' == c))
+        {
+          consumeChar(&p);
+          _offset = bytesPosition(&p);
+          if ('[' == c)
+            {
+              _state = READER_ELEMENTS;
+            }
+          else if (',' == c)
+            {
+              _state = READER_ELEMENT;
+            }
+          else
+            {
+              _state = READER_DONE;
+            }
+          continue;
+        }
+      if (READER_VALUES == _state || READER_ELEMENTS == _state
+        || READER_ELEMENT == _state)
+        {
+          obj = parseValue(&p);
+        }
+      else
+        {
+          parseError(&p);       // Nothing else may follow here.
+        }
+      if (YES == p.exhausted)
+        {
+          /* The value is incomplete, so scan it from its start as data
+           * arrives and try again when it is complete.
+           */
+          [obj release];
+          _pending = YES;
+          _scan = start;
+          _depth = 0;
+          _inString = NO;
+          _escape = NO;
+          if (YES == [self _scanned])
+            {
+              _pending = NO;    // Complete already, so parse next time.
+            }
+          break;
+        }
+      if (nil != p.error)
+        {
+          [obj release];
+          ASSIGN(_error, p.error);
+          return NO;
+        }
+      _offset = bytesPosition(&p);
+      [_objects addObject: obj];
+      [obj release];
+      if (READER_VALUES != _state)
         {
-          NSInteger wrote = [stream write: (uint8_t*)bytes maxLength: toWrite];
-          bytes += wrote;
-          toWrite -= wrote;
-          if (0 == wrote)
+          _state = READER_COMMA;
+        }
+    }
+
+  /* Discard data we have finished with once it is at least half of what
+   * we hold, so memory use is bounded by the size of the largest value.
+   */
+  if (_offset > 0 && _offset >= length / 2)
+    {
+      [_data replaceBytesInRange: NSMakeRange(0, _offset)
+                       withBytes: 0
+                          length: 0];
+      _scan -= _offset;
+      _offset = 0;
+    }
+  return YES;
+}
+
+/* Scans the bytes of an incomplete value which have arrived since it was
+ * last scanned, keeping track of nesting and strings, and returns YES
+ * once the value is complete (or a scalar value has been followed by
+ * something which ends it).
+ */
+- (BOOL) _scanned
+{
+  const uint8_t *bytes = [_data bytes];
+  NSUInteger    length = [_data length];
+
+  while (_scan < length)
+    {
+      uint8_t   c = bytes[_scan++];
+
+      if (YES == _inString)
+        {
+          if (YES == _escape)
             {
-              if (NULL != error)
+              _escape = NO;
+            }
+          else if ('\\' == c)
+            {
+              _escape = YES;
+            }
+          else if ('"' == c)
+            {
+              _inString = NO;
+              if (0 == _depth)
                 {
-                  *error = [stream streamError];
+                  return YES;
                 }
-              return 0;
             }
         }
+      else if ('"' == c)
+        {
+          _inString = YES;
+        }
+      else if ('[' == c || '{' == c)
+        {
+          _depth++;
+        }
+      else if (']' == c || '}' == c)
+        {
+          if (0 == _depth || 0 == --_depth)
+            {
+              return YES;
+            }
+        }
+      else if (0 == _depth && (',' == c || isspace(c)))
+        {
+          return YES;
+        }
     }
-  return [data length];
+  return NO;
 }
 @end
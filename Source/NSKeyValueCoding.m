@@ -25,13 +25,17 @@
    */
 
 #import "common.h"
+#include <pthread.h>
 #import "Foundation/NSArray.h"
 #import "Foundation/NSAutoreleasePool.h"
 #import "Foundation/NSDictionary.h"
 #import "Foundation/NSEnumerator.h"
 #import "Foundation/NSException.h"
 #import "Foundation/NSKeyValueCoding.h"
+#import "Foundation/NSLock.h"
+#import "Foundation/NSMapTable.h"
 #import "Foundation/NSMethodSignature.h"
+#import "GSPrivate.h"
 #import "Foundation/NSNull.h"
 #import "Foundation/NSSet.h"
 #import "Foundation/NSValue.h"
@@ -77,12 +81,247 @@ static inline void setupCompat()
 
 #endif
 
+/* Cache of the results of looking up how to get or set the value for
+ * a key in instances of a class.  The cache is keyed on the class (the
+ * real class, so a class which KVO has swizzled in is distinct from the
+ * original) and then on the key.  Classes which override
+ * -respondsToSelector: are not cached since the way we access a key in
+ * their instances may vary between instances.
+ * Each thread has its own cache, so looking up an accessor takes no lock.
+ * When methods are added to any class (see GSFlushMethodCacheForClass())
+ * the cache generation changes, and each thread discards its cache the
+ * next time it uses it.
+ */
+typedef struct {
+  SEL		sel;
+  const char	*type;
+  unsigned	size;
+  int		off;
+} GSKVCAccessor;
+
+typedef struct {
+  unsigned	generation;
+  NSMapTable	*getters;
+  NSMapTable	*setters;
+} GSKVCCache;
+
+static pthread_key_t	cacheKey;
+static volatile unsigned	generation = 0;
+static NSMapTable	*types = 0;	// Interned type encodings.
+static NSLock		*kvcLock = nil;	// Protects types.
+static IMP		respondsImp = 0;
+
+static NSUInteger
+cstrHash(NSMapTable *t, const void *k)
+{
+  const unsigned char	*p = (const unsigned char*)k;
+  NSUInteger		h = 5381;
+
+  while (*p != 0)
+    {
+      h = (h << 5) + h + *p++;
+    }
+  return h;
+}
+
+static BOOL
+cstrEqual(NSMapTable *t, const void *k1, const void *k2)
+{
+  return (strcmp((const char*)k1, (const char*)k2) == 0) ? YES : NO;
+}
+
+static void
+cstrRelease(NSMapTable *t, void *k)
+{
+  free(k);
+}
+
+static const NSMapTableKeyCallBacks cstrKeyCallBacks = {
+  cstrHash, cstrEqual, 0, cstrRelease, 0, 0
+};
+
+static void
+accessorRelease(NSMapTable *t, void *v)
+{
+  free(v);
+}
+
+static const NSMapTableValueCallBacks accessorValueCallBacks = {
+  0, accessorRelease, 0
+};
+
+static void
+tableRelease(NSMapTable *t, void *v)
+{
+  NSFreeMapTable((NSMapTable*)v);
+}
+
+static const NSMapTableValueCallBacks tableValueCallBacks = {
+  0, tableRelease, 0
+};
+
+static void
+cacheEmpty(GSKVCCache *cache)
+{
+  if (cache->getters != 0)
+    {
+      NSFreeMapTable(cache->getters);
+      cache->getters = 0;
+    }
+  if (cache->setters != 0)
+    {
+      NSFreeMapTable(cache->setters);
+      cache->setters = 0;
+    }
+}
+
+static void
+cacheRelease(void *p)
+{
+  cacheEmpty((GSKVCCache*)p);
+  free(p);
+}
+
+static inline void
+setupCache()
+{
+  if (nil == kvcLock)
+    {
+      [gnustep_global_lock lock];
+      if (nil == kvcLock)
+	{
+	  respondsImp = [NSObject instanceMethodForSelector:
+	    @selector(respondsToSelector:)];
+	  types = NSCreateMapTable(cstrKeyCallBacks,
+	    NSNonOwnedPointerMapValueCallBacks, 0);
+	  pthread_key_create(&cacheKey, cacheRelease);
+	  kvcLock = [NSLock new];
+	}
+      [gnustep_global_lock unlock];
+    }
+}
+
+/* Return the cache for the current thread, emptied if it is out of date.
+ */
+static inline GSKVCCache *
+threadCache()
+{
+  GSKVCCache	*cache = (GSKVCCache*)pthread_getspecific(cacheKey);
+  unsigned	g = generation;
+
+  if (cache == 0)
+    {
+      cache = (GSKVCCache*)calloc(1, sizeof(GSKVCCache));
+      pthread_setspecific(cacheKey, cache);
+    }
+  else if (cache->generation != g)
+    {
+      cacheEmpty(cache);
+    }
+  cache->generation = g;
+  return cache;
+}
+
+/* Look up the accessor for key in instances of c, returning YES and
+ * copying it to *a if it is in the cache.
+ */
+static BOOL
+cachedAccessor(NSMapTable *cache, Class c, const char *key, GSKVCAccessor *a)
+{
+  if (cache != 0)
+    {
+      NSMapTable	*keys = (NSMapTable*)NSMapGet(cache, (void*)c);
+
+      if (keys != 0)
+	{
+	  GSKVCAccessor	*e = (GSKVCAccessor*)NSMapGet(keys, key);
+
+	  if (e != 0)
+	    {
+	      *a = *e;
+	      return YES;
+	    }
+	}
+    }
+  return NO;
+}
+
+/* Store the accessor for key in instances of c.  If the accessor is
+ * a method, its type must be the method return type (for a getter) or
+ * the type of its argument (for a setter), otherwise it must be nil.
+ */
+static void
+cacheAccessor(NSMapTable **cache, Class c, const char *key, GSKVCAccessor *a)
+{
+  GSKVCAccessor	*e;
+  NSMapTable	*keys;
+
+  if ((IMP)class_getMethodImplementation(c, @selector(respondsToSelector:))
+    != respondsImp)
+    {
+      return;
+    }
+  e = (GSKVCAccessor*)malloc(sizeof(GSKVCAccessor));
+  *e = *a;
+  if (e->sel != 0 && e->type != 0)
+    {
+      const char	*t;
+
+      [kvcLock lock];
+      t = (const char*)NSMapGet(types, e->type);
+      if (t == 0)
+	{
+	  t = strdup(e->type);
+	  NSMapInsert(types, t, t);
+	}
+      [kvcLock unlock];
+      e->type = t;
+    }
+  if (*cache == 0)
+    {
+      *cache = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+	tableValueCallBacks, 0);
+    }
+  keys = (NSMapTable*)NSMapGet(*cache, (void*)c);
+  if (keys == 0)
+    {
+      keys = NSCreateMapTable(cstrKeyCallBacks, accessorValueCallBacks, 0);
+      NSMapInsert(*cache, (void*)c, keys);
+    }
+  if (NSMapGet(keys, key) == 0)
+    {
+      NSMapInsertKnownAbsent(keys, strdup(key), e);
+    }
+  else
+    {
+      free(e);
+    }
+}
+
+void
+GSPrivateKVCFlush(void)
+{
+  __sync_add_and_fetch(&generation, 1);
+}
+
 static void
 SetValueForKey(NSObject *self, id anObject, const char *key, unsigned size)
 {
   SEL		sel = 0;
   const char	*type = 0;
   int		off = 0;
+  Class		c;
+  GSKVCAccessor	a;
+  GSKVCCache	*cache;
+
+  setupCache();
+  cache = threadCache();
+  c = object_getClass(self);
+  if (YES == cachedAccessor(cache->setters, c, key, &a))
+    {
+      GSObjCSetVal(self, key, anObject, a.sel, a.type, a.size, a.off);
+      return;
+    }
 
   if (size > 0)
     {
@@ -146,6 +385,24 @@ SetValueForKey(NSObject *self, id anObject, const char *key, unsigned size)
 	      GSOnceFLog(@"Key-value access using _setKey: is deprecated:");
 	    }
 	}
+
+      a.sel = sel;
+      a.type = type;
+      a.size = size;
+      a.off = off;
+      if (sel != 0)
+	{
+	  NSMethodSignature	*sig = [self methodSignatureForSelector: sel];
+
+	  /* Only cache a method we know GSObjCSetVal() will accept.
+	   */
+	  a.type = ([sig numberOfArguments] == 3)
+	    ? [sig getArgumentTypeAtIndex: 2] : 0;
+	}
+      if (sel == 0 || a.type != 0)
+	{
+	  cacheAccessor(&cache->setters, c, key, &a);
+	}
     }
   GSObjCSetVal(self, key, anObject, sel, type, size, off);
 }
@@ -155,6 +412,17 @@ static id ValueForKey(NSObject *self, const char *key, unsigned size)
   SEL		sel = 0;
   int		off = 0;
   const char	*type = NULL;
+  Class		c;
+  GSKVCAccessor	a;
+  GSKVCCache	*cache;
+
+  setupCache();
+  cache = threadCache();
+  c = object_getClass(self);
+  if (YES == cachedAccessor(cache->getters, c, key, &a))
+    {
+      return GSObjCGetVal(self, key, a.sel, a.type, a.size, a.off);
+    }
 
   if (size > 0)
     {
@@ -232,6 +500,23 @@ static id ValueForKey(NSObject *self, const char *key, unsigned size)
 		}
 	    }
 	}
+
+      a.sel = sel;
+      a.type = type;
+      a.size = size;
+      a.off = off;
+      if (sel != 0)
+	{
+	  NSMethodSignature	*sig = [self methodSignatureForSelector: sel];
+
+	  /* Only cache a method we know GSObjCGetVal() will accept.
+	   */
+	  a.type = ([sig numberOfArguments] == 2) ? [sig methodReturnType] : 0;
+	}
+      if (sel == 0 || a.type != 0)
+	{
+	  cacheAccessor(&cache->getters, c, key, &a);
+	}
     }
   return GSObjCGetVal(self, key, sel, type, size, off);
 }
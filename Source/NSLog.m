@@ -74,6 +74,15 @@
 
 #import "GSPrivate.h"
 
+#include <pthread.h>
+#include <math.h>
+
+#if	!defined(__MINGW__)
+#define	GS_LOG_ASYNC	1
+#include <sys/uio.h>
+#include <signal.h>
+#endif
+
 extern NSThread	*GSCurrentThread();
 
 /**
@@ -107,20 +116,14 @@ GSLogLock()
   return myLock;
 }
 
-static void
-_NSLog_standard_printf_handler(NSString* message)
+/* Returns the message as data in the default C string encoding,
+ * or in UTF8 if that is not possible.
+ */
+static NSData *
+logData(NSString *message)
 {
-  NSData	*d;
-  const char	*buf;
-  unsigned	len;
-#if	defined(__MINGW__)
-  LPCWSTR	null_terminated_buf;
-#else
-#if	defined(HAVE_SYSLOG) || defined(HAVE_SLOGF)
-  char	*null_terminated_buf = NULL;
-#endif
-#endif
   static NSStringEncoding enc = 0;
+  NSData		*d;
 
   if (enc == 0)
     {
@@ -132,7 +135,69 @@ _NSLog_standard_printf_handler(NSString* message)
       d = [message dataUsingEncoding: NSUTF8StringEncoding
 		allowLossyConversion: NO];
     }
+  return d;
+}
+
+/* Writes the date and time (in the local time zone) into buf in the
+ * format NSLogv() uses.  Formatting a calendar date is slow, so the
+ * text for the current second is kept and only the milliseconds are
+ * formatted on each call.
+ */
+static void
+logTime(char *buf, unsigned size)
+{
+  static pthread_mutex_t	timeLock = PTHREAD_MUTEX_INITIALIZER;
+  static NSTimeInterval		last = 0.0;
+  static char			text[32];
+  NSTimeInterval		now = GSPrivateTimeNow();
+  NSTimeInterval		second = floor(now);
+  int				milli = (int)((now - second) * 1000.0);
+  NSCalendarDate		*d;
+  char				tmp[32];
+
+  pthread_mutex_lock(&timeLock);
+  if (second == last && text[0] != '\0')
+    {
+      snprintf(buf, size, "%s.%03d", text, milli);
+      pthread_mutex_unlock(&timeLock);
+      return;
+    }
+  pthread_mutex_unlock(&timeLock);
+
+  /* Format the new second without holding the lock, in case anything
+   * used by the calendar date wants to log a message.
+   */
+  d = [[NSCalendarDate alloc] initWithTimeIntervalSinceReferenceDate: second];
+  strncpy(tmp, [[d descriptionWithCalendarFormat: @"%Y-%m-%d %H:%M:%S"]
+    UTF8String], sizeof(tmp) - 1);
+  tmp[sizeof(tmp) - 1] = '\0';
+  RELEASE(d);
+
+  pthread_mutex_lock(&timeLock);
+  if (second > last || text[0] == '\0')
+    {
+      memcpy(text, tmp, sizeof(text));
+      last = second;
+    }
+  pthread_mutex_unlock(&timeLock);
+  snprintf(buf, size, "%s.%03d", tmp, milli);
+}
+
+static void
+_NSLog_standard_printf_handler(NSString* message)
+{
+  NSData	*d;
+  const char	*buf;
+  unsigned	len;
+#if	defined(__MINGW__)
+  LPCWSTR	null_terminated_buf;
+#else
+#if	defined(HAVE_SYSLOG) || defined(HAVE_SLOGF)
+  char	*null_terminated_buf = NULL;
+#endif
+#endif
 
+  d = logData(message);
   if (d == nil)		// Should never happen.
     {
       buf = [message lossyCString];
@@ -270,6 +335,391 @@ _NSLog_standard_printf_handler(NSString* message)
  */
 NSLog_printf_handler *_NSLog_printf_handler = _NSLog_standard_printf_handler;
 
+#ifdef	GS_LOG_ASYNC
+/* Asynchronous logging.
+ * Log lines are appended to a queue by the logging threads and written
+ * out by a writer thread, many lines to each writev() call.  The lock
+ * protecting the queue is held only long enough to add or remove lines,
+ * never while writing, except when the queue is being flushed.
+ */
+#define	LOG_BATCH	64		// Most lines written in one call.
+#define	LOG_LIMIT	(1024 * 1024)	// Most bytes queued before waiting.
+
+typedef struct LogLine {
+  struct LogLine	*next;
+  unsigned		len;
+  char			bytes[];
+} LogLine;
+
+static pthread_mutex_t	logMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	logReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	logSpace = PTHREAD_COND_INITIALIZER;
+static LogLine		*logHead = 0;
+static LogLine		*logTail = 0;
+static unsigned		logQueued = 0;
+static BOOL		logWriting = NO;
+static BOOL		logAsync = NO;
+static BOOL		logStarted = NO;
+
+/* Writes out and frees a list of lines, returning the number of bytes
+ * they contained.  Lines which can not be written to the descriptor
+ * go to the syslog where that is available.
+ */
+static unsigned
+logWrite(LogLine *line)
+{
+  unsigned	total = 0;
+
+  while (line != 0)
+    {
+      struct iovec	iov[LOG_BATCH];
+      LogLine		*batch = line;
+      int		count = 0;
+      int		index = 0;
+
+      while (line != 0 && count < LOG_BATCH)
+	{
+	  iov[count].iov_base = line->bytes;
+	  iov[count].iov_len = line->len;
+	  total += line->len;
+	  count++;
+	  line = line->next;
+	}
+
+      while (index < count)
+	{
+	  ssize_t	result = writev(_NSLogDescriptor, iov + index,
+	    count - index);
+
+	  if (result < 0)
+	    {
+	      if (errno == EINTR)
+		{
+		  continue;
+		}
+#if	defined(HAVE_SYSLOG)
+	      while (index < count)
+		{
+		  syslog(SYSLOGMASK, "%.*s", (int)iov[index].iov_len,
+		    (char*)iov[index].iov_base);
+		  index++;
+		}
+#endif
+	      break;
+	    }
+	  /* Step past whatever was written, which may end part way
+	   * through a line.
+	   */
+	  while (index < count && (size_t)result >= iov[index].iov_len)
+	    {
+	      result -= iov[index++].iov_len;
+	    }
+	  if (index < count)
+	    {
+	      iov[index].iov_base = (char*)iov[index].iov_base + result;
+	      iov[index].iov_len -= result;
+	    }
+	}
+
+      while (batch != line)
+	{
+	  LogLine	*next = batch->next;
+
+	  free(batch);
+	  batch = next;
+	}
+    }
+  return total;
+}
+
+static void *
+logWriter(void *arg)
+{
+  pthread_mutex_lock(&logMutex);
+  for (;;)
+    {
+      LogLine	*batch;
+      unsigned	written;
+
+      while (logHead == 0)
+	{
+	  pthread_cond_wait(&logReady, &logMutex);
+	}
+      batch = logHead;
+      logHead = logTail = 0;
+      logWriting = YES;
+      pthread_mutex_unlock(&logMutex);
+
+      written = logWrite(batch);
+
+      pthread_mutex_lock(&logMutex);
+      logQueued -= written;
+      logWriting = NO;
+      pthread_cond_broadcast(&logSpace);
+    }
+  return 0;
+}
+
+/* Adds a line to the queue.  If the writer has fallen too far behind,
+ * waits for it to catch up so that a flood of messages can not use up
+ * all the memory.  Returns NO if there is no memory for the line, in
+ * which case the caller should write it out itself.
+ */
+static BOOL
+logEnqueue(const char *buf, unsigned len)
+{
+  LogLine	*line = malloc(sizeof(LogLine) + len);
+
+  if (line == 0)
+    {
+      return NO;
+    }
+  line->next = 0;
+  line->len = len;
+  memcpy(line->bytes, buf, len);
+
+  pthread_mutex_lock(&logMutex);
+  while (logQueued > LOG_LIMIT)
+    {
+      pthread_cond_wait(&logSpace, &logMutex);
+    }
+  if (logTail == 0)
+    {
+      logHead = line;
+    }
+  else
+    {
+      logTail->next = line;
+    }
+  logTail = line;
+  logQueued += len;
+  pthread_cond_signal(&logReady);
+  pthread_mutex_unlock(&logMutex);
+  return YES;
+}
+
+static void
+logForkPrepare(void)
+{
+  pthread_mutex_lock(&logMutex);
+}
+
+static void
+logForkParent(void)
+{
+  pthread_mutex_unlock(&logMutex);
+}
+
+/* The writer thread does not exist in a child process, and the lines
+ * queued belong to the parent, so the child starts again logging
+ * synchronously.
+ */
+static void
+logForkChild(void)
+{
+  pthread_mutex_init(&logMutex, 0);
+  logHead = logTail = 0;
+  logQueued = 0;
+  logWriting = NO;
+  logAsync = NO;
+  logStarted = NO;
+}
+
+/* Installed for fatal signals which nobody else handles, so that the
+ * lines queued before a crash are not lost with the process.
+ * The handler is reset to the default on entry, so raising the signal
+ * again terminates the process as it would have been terminated anyway.
+ */
+static void
+logSignal(int sig)
+{
+  GSLogFlushFromSignal();
+  raise(sig);
+}
+
+static void
+logSignals(void)
+{
+  static int	sigs[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+  unsigned	i;
+
+  for (i = 0; i < sizeof(sigs)/sizeof(*sigs); i++)
+    {
+#ifdef	HAVE_SIGACTION
+      struct sigaction	act;
+
+      if (sigaction(sigs[i], 0, &act) == 0 && act.sa_handler == SIG_DFL)
+	{
+	  memset(&act, 0, sizeof(act));
+	  act.sa_handler = logSignal;
+	  act.sa_flags = SA_RESETHAND | SA_NODEFER;
+	  sigemptyset(&act.sa_mask);
+	  sigaction(sigs[i], &act, 0);
+	}
+#else
+      void	(*handler)(int);
+
+      handler = signal(sigs[i], logSignal);
+      if (handler != SIG_DFL)
+	{
+	  signal(sigs[i], handler);
+	}
+#endif
+    }
+}
+#endif	/* GS_LOG_ASYNC */
+
+/**
+ * Writes out any log messages which have been queued by NSLogv() in
+ * asynchronous mode (see GSLogSetAsynchronous()), returning when they
+ * have been written.<br />
+ * This is called automatically when the process exits and when an
+ * uncaught exception terminates it.<br />
+ * If the writer thread is still busy after a second, the queued lines
+ * are left for it to write (so that they are not written out of order)
+ * and this returns without them having been written.<br />
+ * It takes locks and frees memory, so it must not be called from a
+ * signal handler; use GSLogFlushFromSignal() there instead.
+ */
+void
+GSLogFlush(void)
+{
+#ifdef	GS_LOG_ASYNC
+  struct timespec	limit;
+  unsigned		written;
+
+  pthread_mutex_lock(&logMutex);
+  /* Let the writer finish the lines it is writing, but do not wait
+   * for ever in case it is stuck (or we are crashing in the writer).
+   */
+  limit.tv_sec = time(0) + 1;
+  limit.tv_nsec = 0;
+  while (logWriting == YES)
+    {
+      if (pthread_cond_timedwait(&logSpace, &logMutex, &limit) == ETIMEDOUT)
+	{
+	  break;
+	}
+    }
+  if (logWriting == NO)
+    {
+      written = logWrite(logHead);
+      logHead = logTail = 0;
+      logQueued -= written;
+      pthread_cond_broadcast(&logSpace);
+    }
+  pthread_mutex_unlock(&logMutex);
+#endif
+}
+
+/**
+ * Writes out any log messages which have been queued by NSLogv() in
+ * asynchronous mode, using only calls which are safe in a signal
+ * handler.<br />
+ * The lines are written with write() and are not freed.  Nothing is
+ * written if the queue is locked (for instance by the thread which was
+ * interrupted by the signal) or if the writer thread is part way through
+ * writing earlier lines, since writing now would put lines out of order.
+ * <br />
+ * When asynchronous logging is turned on, a handler which calls this
+ * is installed for SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT unless
+ * the program already handles or ignores those signals.  A program with
+ * its own handlers for fatal signals may call this from them.
+ */
+void
+GSLogFlushFromSignal(void)
+{
+#ifdef	GS_LOG_ASYNC
+  if (pthread_mutex_trylock(&logMutex) == 0)
+    {
+      if (logWriting == NO)
+	{
+	  LogLine	*line = logHead;
+
+	  while (line != 0)
+	    {
+	      const char	*ptr = line->bytes;
+	      unsigned		len = line->len;
+
+	      while (len > 0)
+		{
+		  ssize_t	result = write(_NSLogDescriptor, ptr, len);
+
+		  if (result < 0)
+		    {
+		      if (errno == EINTR)
+			{
+			  continue;
+			}
+		      break;
+		    }
+		  ptr += result;
+		  len -= result;
+		}
+	      logQueued -= line->len;
+	      line = line->next;
+	    }
+	  /* The written lines are leaked rather than freed, as free() is
+	   * not safe here.
+	   */
+	  logHead = logTail = 0;
+	}
+      pthread_mutex_unlock(&logMutex);
+    }
+#endif
+}
+
+/**
+ * Turns asynchronous logging on or off.<br />
+ * Normally NSLogv() writes each message before it returns, with all
+ * logging threads taking turns to do so.  In asynchronous mode the
+ * messages are instead queued and written in batches by a separate
+ * thread, so a thread which logs does not wait for the write (unless
+ * over a megabyte of messages are waiting to be written).<br />
+ * Asynchronous mode is only used while messages are being written to
+ * <ref type="variable" id="_NSLogDescriptor">_NSLogDescriptor</ref> by
+ * the standard handler, and is not available on mswindows.<br />
+ * Turning it off writes out any queued messages first.
+ */
+void
+GSLogSetAsynchronous(BOOL flag)
+{
+#ifdef	GS_LOG_ASYNC
+  if (flag == YES)
+    {
+      pthread_mutex_lock(&logMutex);
+      if (logStarted == NO)
+	{
+	  static BOOL	registered = NO;
+	  pthread_attr_t	attr;
+	  pthread_t		thread;
+
+	  pthread_attr_init(&attr);
+	  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	  if (pthread_create(&thread, &attr, logWriter, 0) == 0)
+	    {
+	      logStarted = YES;
+	      if (registered == NO)
+		{
+		  registered = YES;
+		  atexit(GSLogFlush);
+		  pthread_atfork(logForkPrepare, logForkParent, logForkChild);
+		  logSignals();
+		}
+	    }
+	  pthread_attr_destroy(&attr);
+	}
+      logAsync = logStarted;
+      pthread_mutex_unlock(&logMutex);
+    }
+  else
+    {
+      logAsync = NO;
+      GSLogFlush();
+    }
+#endif
+}
+
 /**
  * <p>Provides the standard OpenStep logging facility.  For details see
  * the lower level NSLogv() function (which this function uses).
@@ -356,21 +806,22 @@ NSLogv(NSString* format, va_list args)
   else
 #endif
     {
+      char	when[64];
+
+      logTime(when, sizeof(when));
       if (GSPrivateDefaultsFlag(GSLogThread) == YES)
 	{
 	  prefix = [NSString
-	    stringWithFormat: @"%@ %@[%d,%"PRIxPTR"x] ",
-	    [[NSCalendarDate calendarDate]
-	      descriptionWithCalendarFormat: @"%Y-%m-%d %H:%M:%S.%F"],
+	    stringWithFormat: @"%s %@[%d,%"PRIxPTR"x] ",
+	    when,
 	    [[NSProcessInfo processInfo] processName],
 	    pid, (NSUInteger)GSCurrentThread()];
 	}
       else
 	{
 	  prefix = [NSString
-	    stringWithFormat: @"%@ %@[%d] ",
-	    [[NSCalendarDate calendarDate]
-	      descriptionWithCalendarFormat: @"%Y-%m-%d %H:%M:%S.%F"],
+	    stringWithFormat: @"%s %@[%d] ",
+	    when,
 	    [[NSProcessInfo processInfo] processName],
 	    pid];
 	}
@@ -385,6 +836,21 @@ NSLogv(NSString* format, va_list args)
 
   prefix = [prefix stringByAppendingString: message];
 
+#ifdef	GS_LOG_ASYNC
+  if (logAsync == YES
+    && _NSLog_printf_handler == _NSLog_standard_printf_handler
+    && GSPrivateDefaultsFlag(GSLogSyslog) == NO)
+    {
+      NSData	*d = logData(prefix);
+
+      if (d != nil && logEnqueue([d bytes], [d length]) == YES)
+	{
+	  [arp drain];
+	  return;
+	}
+    }
+#endif
+
   if (myLock == nil)
     {
       GSLogLock();
@@ -480,6 +480,7 @@ static Class	runLoopClass;
   [self invalidate];
   (void)close(desc);
   desc = -1;
+  GSPrivatePortClosedDescriptor();
 }
 
 - (void) invalidate
@@ -1622,6 +1623,7 @@ typedef	struct {
 	      (void) close(lDesc);
 	      unlink([name bytes]);
 	      lDesc = -1;
+	      GSPrivatePortClosedDescriptor();
 	    }
 
 	  handleArray = NSAllMapTableValues(handles);
@@ -176,6 +176,13 @@ typedef	struct	Obs {
 
 #define	ENDOBS	((Observation*)-1)
 
+/* Without garbage collection, notifications may be posted from a
+ * snapshot of the table of observations without locking (see below).
+ */
+#if	!defined(__OBJC_GC__) && !GS_WITH_GC
+#define	NC_SNAPSHOT	1
+#endif
+
 static inline NSUInteger doHash(BOOL shouldHash, NSString* key)
 {
   if (key == nil)
@@ -300,6 +307,15 @@ typedef struct NCTbl {
   GSIMapTable		cache[CACHESIZE];
   unsigned short	chunkIndex;
   unsigned short	cacheIndex;
+#ifdef	NC_SNAPSHOT
+  struct NCSnap	* volatile snapshot;	/* Copy used for posting.	*/
+  struct NCSnap		*retired;	/* Copies no longer in use.	*/
+  unsigned		changes;	/* Count of removals.		*/
+  unsigned		observations;	/* Count of observations.	*/
+  unsigned		stablePosts;	/* Posts since the last change.	*/
+  volatile unsigned	epoch;		/* Current posting epoch.	*/
+  volatile int		active[2];	/* Posts in progress by epoch.	*/
+#endif
 } NCTable;
 
 #define	TABLE		((NCTable*)_table)
@@ -416,6 +432,20 @@ static void endNCTable(NCTable *t)
 
   TEST_RELEASE(t->_lock);
 
+#ifdef	NC_SNAPSHOT
+  if (t->snapshot != 0)
+    {
+      snapFree(t->snapshot);
+    }
+  while (t->retired != 0)
+    {
+      NCSnap	*s = t->retired;
+
+      t->retired = s->next;
+      snapFree(s);
+    }
+#endif
+
   /*
    * Free observations without notification names or numbers.
    */
@@ -525,6 +555,16 @@ static void obsRetain(Observation *o)
 }
 #endif
 
+/* Records the removal of an observation from the table, so that any
+ * snapshot of the table is withdrawn.
+ */
+#ifdef	NC_SNAPSHOT
+#define	obsRemoved(X)	do { NCTable *_t = (NCTable*)(X)->link; \
+  _t->changes++; _t->observations--; } while (0)
+#else
+#define	obsRemoved(X)
+#endif
+
 static void listFree(Observation *list)
 {
   while (list != ENDOBS)
@@ -533,6 +573,7 @@ static void listFree(Observation *list)
 
       list = o->next;
       o->next = 0;
+      obsRemoved(o);
       obsFree(o);
     }
 }
@@ -553,6 +594,7 @@ static Observation *listPurge(Observation *list, id observer)
     {
       tmp = list->next;
       list->next = 0;
+      obsRemoved(list);
       obsFree(list);
       list = tmp;
     }
@@ -567,6 +609,7 @@ static Observation *listPurge(Observation *list, id observer)
 
 	      tmp->next = next->next;
 	      next->next = 0;
+	      obsRemoved(next);
 	      obsFree(next);
 	    }
 	  else
@@ -642,6 +685,304 @@ purgeCollectedFromMapNode(GSIMapTable map, GSIMapNode node)
 #define purgeCollectedFromMapNode(X, Y) ((Observation*)Y->value.ext)
 #endif
 
+#ifdef	NC_SNAPSHOT
+/*
+ * Posting without locking.
+ * Once a table has been posted to a few times without observations
+ * being added or removed, we make a snapshot of it: a copy of the lists
+ * of observations as arrays, in maps which are never changed after the
+ * snapshot is published.  Notifications are then posted using the
+ * snapshot, without locking the table, so threads posting at the same
+ * time do not wait for each other.  Adding or removing an observation
+ * withdraws the snapshot (posting uses the lock again until the table
+ * settles down), and the withdrawn copy is freed once no posts which
+ * might be using it remain.
+ *
+ * To know when that is, each post using a snapshot counts itself in one
+ * of two counters, chosen by the current epoch.  The epoch is advanced
+ * only when no posts from the previous epoch remain, so once the epoch
+ * has advanced twice after a snapshot was withdrawn, nothing can be
+ * using it.  Observations in a snapshot are retained by it, so they are
+ * not reused while it exists, and removed observations are recognised
+ * (and skipped) as before by their 'next' field being zero.
+ *
+ * Making a snapshot copies every observation in the table, so the
+ * number of locked posts needed before one is made grows with the size
+ * of the table: a snapshot of N observations is only made after
+ * N / SNAPSHOT_RATIO posts without a change, which limits the copying to
+ * SNAPSHOT_RATIO observations per post.  The cost is that a large table
+ * which changes often is posted to with the lock (as it was before
+ * snapshots existed) rather than being copied over and over again.
+ */
+#define	SNAPSHOT_POSTS	16	/* Least locked posts before a snapshot. */
+#define	SNAPSHOT_RATIO	4	/* Most observations copied per post.	*/
+
+typedef struct NCList {
+  unsigned	count;
+  Observation	*obs[];
+} NCList;
+
+typedef struct NCSnap {
+  struct NCSnap	*next;		/* Next withdrawn snapshot.	*/
+  unsigned	epoch;		/* Epoch when withdrawn.	*/
+  NCList	*wildcard;	/* Observations of everything.	*/
+  GSIMapTable	nameless;	/* Objects to observations.	*/
+  GSIMapTable	named;		/* Names to maps of objects.	*/
+} NCSnap;
+
+static NCList *
+snapList(Observation *list)
+{
+  Observation	*o;
+  NCList	*l;
+  unsigned	count = 0;
+
+  for (o = list; o != ENDOBS; o = o->next)
+    {
+      count++;
+    }
+  l = NSZoneMalloc(_zone, sizeof(NCList) + count * sizeof(Observation*));
+  l->count = 0;
+  for (o = list; o != ENDOBS; o = o->next)
+    {
+      obsRetain(o);
+      l->obs[l->count++] = o;
+    }
+  return l;
+}
+
+static void
+snapListFree(NCList *l)
+{
+  while (l->count > 0)
+    {
+      obsFree(l->obs[--l->count]);
+    }
+  NSZoneFree(_zone, l);
+}
+
+/* Copies a map of objects to lists of observations.
+ */
+static GSIMapTable
+snapMap(GSIMapTable map)
+{
+  GSIMapTable		m;
+  GSIMapEnumerator_t	e = GSIMapEnumeratorForMap(map);
+  GSIMapNode		n;
+
+  m = NSZoneMalloc(_zone, sizeof(GSIMapTable_t));
+  GSIMapInitWithZoneAndCapacity(m, _zone, map->nodeCount);
+  m->extra = NO;
+  while ((n = GSIMapEnumeratorNextNode(&e)) != 0)
+    {
+      GSIMapAddPair(m, n->key, (GSIMapVal)(void*)snapList(n->value.ext));
+    }
+  return m;
+}
+
+static void
+snapMapFree(GSIMapTable m)
+{
+  GSIMapEnumerator_t	e = GSIMapEnumeratorForMap(m);
+  GSIMapNode		n;
+
+  while ((n = GSIMapEnumeratorNextNode(&e)) != 0)
+    {
+      snapListFree((NCList*)n->value.ptr);
+    }
+  GSIMapEmptyMap(m);
+  NSZoneFree(_zone, m);
+}
+
+/* Makes and publishes a snapshot of the table, which must be locked.
+ */
+static void
+snapBuild(NCTable *t)
+{
+  NCSnap		*s;
+  GSIMapEnumerator_t	e = GSIMapEnumeratorForMap(t->named);
+  GSIMapNode		n;
+
+  s = NSZoneMalloc(_zone, sizeof(NCSnap));
+  s->next = 0;
+  s->epoch = 0;
+  s->wildcard = snapList(t->wildcard);
+  s->nameless = snapMap(t->nameless);
+  s->named = NSZoneMalloc(_zone, sizeof(GSIMapTable_t));
+  GSIMapInitWithZoneAndCapacity(s->named, _zone, t->named->nodeCount);
+  s->named->extra = YES;        // This table retains keys
+  while ((n = GSIMapEnumeratorNextNode(&e)) != 0)
+    {
+      GSIMapAddPair(s->named, (GSIMapKey)RETAIN(n->key.obj),
+	(GSIMapVal)(void*)snapMap((GSIMapTable)n->value.ptr));
+    }
+  __sync_synchronize();		// Complete the copy before publishing it.
+  t->snapshot = s;
+}
+
+static void
+snapFree(NCSnap *s)
+{
+  GSIMapEnumerator_t	e = GSIMapEnumeratorForMap(s->named);
+  GSIMapNode		n;
+
+  while ((n = GSIMapEnumeratorNextNode(&e)) != 0)
+    {
+      snapMapFree((GSIMapTable)n->value.ptr);
+    }
+  GSIMapEmptyMap(s->named);
+  NSZoneFree(_zone, s->named);
+  snapMapFree(s->nameless);
+  snapListFree(s->wildcard);
+  NSZoneFree(_zone, s);
+}
+
+/* Frees any withdrawn snapshots which can no longer be in use, advancing
+ * the epoch where possible.  The table must be locked.
+ */
+static void
+snapReclaim(NCTable *t)
+{
+  while (t->retired != 0)
+    {
+      NCSnap	**p = &t->retired;
+
+      while (*p != 0)
+	{
+	  NCSnap	*s = *p;
+
+	  if (t->epoch - s->epoch >= 2)
+	    {
+	      *p = s->next;
+	      snapFree(s);
+	    }
+	  else
+	    {
+	      p = &s->next;
+	    }
+	}
+      if (t->retired == 0 || t->active[(t->epoch + 1) & 1] != 0)
+	{
+	  break;	// Done, or posts from the last epoch remain.
+	}
+      __sync_fetch_and_add(&t->epoch, 1);
+    }
+}
+
+/* Withdraws the snapshot when observations have been added or removed.
+ * The table must be locked.
+ */
+static void
+snapChanged(NCTable *t)
+{
+  NCSnap	*s = t->snapshot;
+
+  t->stablePosts = 0;
+  if (s != 0)
+    {
+      t->snapshot = 0;
+      __sync_synchronize();	// Withdraw it before checking for posts.
+      s->epoch = t->epoch;
+      s->next = t->retired;
+      t->retired = s;
+    }
+  snapReclaim(t);
+}
+
+/* Counts a post in the current epoch and returns the snapshot to use
+ * (if there is one), setting *slot to the counter to be passed to
+ * snapLeave() when the post is complete.
+ */
+static inline NCSnap *
+snapEnter(NCTable *t, unsigned *slot)
+{
+  for (;;)
+    {
+      unsigned	e = t->epoch;
+
+      __sync_fetch_and_add(&t->active[e & 1], 1);
+      if (t->epoch == e)
+	{
+	  *slot = e & 1;
+	  return t->snapshot;
+	}
+      __sync_fetch_and_sub(&t->active[e & 1], 1);
+    }
+}
+
+static inline void
+snapLeave(NCTable *t, unsigned slot)
+{
+  __sync_fetch_and_sub(&t->active[slot], 1);
+}
+
+static void
+snapPost(NCSnap *s, NSString *name, id object, NSNotification *notification)
+{
+  NCList	*lists[4];
+  unsigned	count = 0;
+  GSIMapNode	n;
+
+  /*
+   * Gather the lists in the same order as the locked code gathers the
+   * observations, so they are notified in the same (reverse) order.
+   */
+  lists[count++] = s->wildcard;
+  if (object != nil)
+    {
+      n = GSIMapNodeForSimpleKey(s->nameless, (GSIMapKey)object);
+      if (n != 0)
+	{
+	  lists[count++] = (NCList*)n->value.ptr;
+	}
+    }
+  n = GSIMapNodeForKey(s->named, (GSIMapKey)((id)name));
+  if (n != 0)
+    {
+      GSIMapTable	m = (GSIMapTable)n->value.ptr;
+
+      n = GSIMapNodeForSimpleKey(m, (GSIMapKey)object);
+      if (n != 0)
+	{
+	  lists[count++] = (NCList*)n->value.ptr;
+	}
+      if (object != nil)
+	{
+	  n = GSIMapNodeForSimpleKey(m, (GSIMapKey)nil);
+	  if (n != 0)
+	    {
+	      lists[count++] = (NCList*)n->value.ptr;
+	    }
+	}
+    }
+
+  while (count-- > 0)
+    {
+      NCList	*l = lists[count];
+      unsigned	i = l->count;
+
+      while (i-- > 0)
+	{
+	  Observation	*o = l->obs[i];
+
+	  if (o->next != 0)
+	    {
+	      NS_DURING
+		{
+		  [o->observer performSelector: o->selector
+				    withObject: notification];
+		}
+	      NS_HANDLER
+		{
+		  NSLog(@"Problem posting notification: %@", localException);
+		}
+	      NS_ENDHANDLER
+	    }
+	}
+    }
+}
+#endif	/* NC_SNAPSHOT */
+
 
 
 /**
@@ -803,6 +1144,9 @@ static NSNotificationCenter *default_center = nil;
   lockNCTable(TABLE);
 
   o = obsNew(TABLE, selector, observer);
+#ifdef	NC_SNAPSHOT
+  TABLE->observations++;
+#endif
 
   /*
    * Record the Observation in one of the linked lists.
@@ -871,6 +1215,9 @@ static NSNotificationCenter *default_center = nil;
       WILDCARD = o;
     }
 
+#ifdef	NC_SNAPSHOT
+  snapChanged(TABLE);
+#endif
   unlockNCTable(TABLE);
 }
 
@@ -886,6 +1233,10 @@ static NSNotificationCenter *default_center = nil;
 		   name: (NSString*)name
                  object: (id)object
 {
+#ifdef	NC_SNAPSHOT
+  unsigned	changes;
+#endif
+
   if (name == nil && object == nil && observer == nil)
       return;
 
@@ -896,6 +1247,9 @@ static NSNotificationCenter *default_center = nil;
    */
 
   lockNCTable(TABLE);
+#ifdef	NC_SNAPSHOT
+  changes = TABLE->changes;
+#endif
 
   if (name == nil && object == nil)
     {
@@ -1030,6 +1384,15 @@ static NSNotificationCenter *default_center = nil;
 	  GSIMapRemoveKey(NAMED, (GSIMapKey)((id)name));
 	}
     }
+#ifdef	NC_SNAPSHOT
+  /* Observers often remove themselves from centers they never used,
+   * so the snapshot is only withdrawn if something was removed.
+   */
+  if (TABLE->changes != changes)
+    {
+      snapChanged(TABLE);
+    }
+#endif
   unlockNCTable(TABLE);
 }
 
@@ -1074,6 +1437,23 @@ static NSNotificationCenter *default_center = nil;
     }
   object = [notification object];
 
+#ifdef	NC_SNAPSHOT
+  if (TABLE->snapshot != 0)
+    {
+      unsigned	slot;
+      NCSnap	*s = snapEnter(TABLE, &slot);
+
+      if (s != 0)
+	{
+	  snapPost(s, name, object, notification);
+	  snapLeave(TABLE, slot);
+	  RELEASE(notification);
+	  return;
+	}
+      snapLeave(TABLE, slot);
+    }
+#endif
+
   /*
    * Lock the table of observations while we traverse it.
    *
@@ -1091,6 +1471,21 @@ static NSNotificationCenter *default_center = nil;
 #endif
   lockNCTable(TABLE);
 
+#ifdef	NC_SNAPSHOT
+  /*
+   * If the table has settled down, make a snapshot for later posts.
+   */
+  if (TABLE->retired != 0)
+    {
+      snapReclaim(TABLE);
+    }
+  if (TABLE->snapshot == 0 && ++TABLE->stablePosts
+    >= SNAPSHOT_POSTS + TABLE->observations / SNAPSHOT_RATIO)
+    {
+      snapBuild(TABLE);
+    }
+#endif
+
   /*
    * Find all the observers that specified neither NAME nor OBJECT.
    */
@@ -358,6 +358,11 @@ static BOOL useSmallFloat;
 #define SMALL_REPEATING_DOUBLE_MASK 3
 // 4 is GSTinyString
 #define SMALL_FLOAT_MASK 5
+// 6 is GSSmallDate (in NSDate.m)
+
+/* The largest magnitude which fits in a small integer.
+ */
+#define SMALL_INT_MAX (INTPTR_MAX >> OBJC_SMALL_OBJECT_SHIFT)
 
 @interface NSSmallInt : NSSignedIntegerNumber
 @end
@@ -815,8 +820,8 @@ if (aValue >= -1 && aValue <= 12)\
   CHECK_SINGLETON (aValue);
 #ifdef OBJC_SMALL_OBJECT_SHIFT
   if (useSmallInt &&
-      (aValue < (INT_MAX>>OBJC_SMALL_OBJECT_SHIFT)) &&
-      (aValue > -(INT_MAX>>OBJC_SMALL_OBJECT_SHIFT)))
+      (aValue < SMALL_INT_MAX) &&
+      (aValue > -SMALL_INT_MAX))
     {
        return (id)((((NSInteger)aValue) << OBJC_SMALL_OBJECT_SHIFT) | SMALL_INT_MASK);
     }
@@ -876,6 +881,17 @@ if (aValue >= -1 && aValue <= 12)\
     {
       return [self numberWithInt: (int) aValue];
     }
+#if defined(OBJC_SMALL_OBJECT_SHIFT) && (OBJC_SMALL_OBJECT_SHIFT == 3)
+  /* On 64-bit systems most long long values (timestamps, file sizes and
+   * the like) also fit in a small integer.
+   */
+  if (useSmallInt &&
+      (aValue < (long long)SMALL_INT_MAX) &&
+      (aValue > -(long long)SMALL_INT_MAX))
+    {
+       return (id)((((intptr_t)aValue) << OBJC_SMALL_OBJECT_SHIFT) | SMALL_INT_MASK);
+    }
+#endif
   n = NSAllocateObject (NSLongLongNumberClass, 0, 0);
   n->value = aValue;
   return AUTORELEASE(n);
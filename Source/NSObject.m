@@ -1089,6 +1089,11 @@ static id gs_weak_load(id obj)
        */
       gnustep_global_lock = [NSRecursiveLock new];
 
+      /* Set up string hashing ... this must be done before any hash
+       * values are generated.
+       */
+      GSPrivateHashInit();
+
       /* Behavior debugging ... enable with environment variable if needed.
        */
       GSObjCBehaviorDebug(GSPrivateEnvironmentFlag("GNUSTEP_BEHAVIOR_DEBUG",
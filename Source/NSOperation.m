@@ -44,16 +44,35 @@
   NSMutableArray *dependencies; \
   GSOperationCompletionBlock completionBlock;
 
+/* A first-in-first-out queue of operations, held in a circular buffer.
+ * The operations are not retained (the queue's operations array does that).
+ */
+typedef struct {
+  id		*items;
+  NSUInteger	capacity;
+  NSUInteger	head;
+  NSUInteger	count;
+} GSOperationFIFO;
+
+@class	NSHashTable;
+
+/* The waiting array has one FIFO for each of the five queue priorities.
+ * The members table holds the operations which have not yet finished,
+ * while the operations array may still contain some finished ones
+ * which are removed in batches.
+ */
 #define	GS_NSOperationQueue_IVARS \
   NSRecursiveLock	*lock; \
-  NSConditionLock	*cond; \
+  NSCondition		*cond; \
   NSMutableArray	*operations; \
-  NSMutableArray	*waiting; \
-  NSMutableArray	*starting; \
+  NSHashTable		*members; \
+  GSOperationFIFO	waiting[5]; \
+  GSOperationFIFO	starting; \
   NSString		*name; \
   BOOL			suspended; \
   NSInteger		executing; \
   NSInteger		threadCount; \
+  NSInteger		idleCount; \
   NSInteger		count;
 
 #import "Foundation/NSOperation.h"
@@ -62,7 +81,9 @@
 #import "Foundation/NSDictionary.h"
 #import "Foundation/NSEnumerator.h"
 #import "Foundation/NSException.h"
+#import "Foundation/NSHashTable.h"
 #import "Foundation/NSKeyValueObserving.h"
+#import "Foundation/NSProcessInfo.h"
 #import "Foundation/NSThread.h"
 #import "GSPrivate.h"
 
@@ -70,7 +91,8 @@
 #include	"GSInternal.h"
 GS_PRIVATE_INTERNAL(NSOperation)
 
-/* The pool of threads for 'non-concurrent' operations in a queue.
+/* The minimum size of the pool of threads for 'non-concurrent' operations
+ * in a queue.  The pool grows to the number of processors on larger hosts.
  */
 #define	POOL	8
 
@@ -556,6 +578,7 @@ GS_PRIVATE_INTERNAL(NSOperationQueue)
 @interface	NSOperationQueue (Private)
 + (void) _mainQueue;
 - (void) _execute;
+- (void) _finished: (NSOperation*)op;
 - (void) _thread;
 - (void) observeValueForKeyPath: (NSString *)keyPath
 		       ofObject: (id)object
@@ -564,16 +587,70 @@ GS_PRIVATE_INTERNAL(NSOperationQueue)
 @end
 
 static NSInteger	maxConcurrent = 200;	// Thread pool size
+static NSInteger	poolSize = POOL;
+
+static void
+fifoPush(GSOperationFIFO *f, id op)
+{
+  if (f->count == f->capacity)
+    {
+      NSUInteger	size = (f->capacity == 0) ? 16 : f->capacity * 2;
+      id		*items;
+      NSUInteger	i;
+
+      items = NSZoneMalloc(NSDefaultMallocZone(), size * sizeof(id));
+      for (i = 0; i < f->count; i++)
+	{
+	  items[i] = f->items[(f->head + i) % f->capacity];
+	}
+      if (f->items != 0)
+	{
+	  NSZoneFree(NSDefaultMallocZone(), f->items);
+	}
+      f->items = items;
+      f->capacity = size;
+      f->head = 0;
+    }
+  f->items[(f->head + f->count) % f->capacity] = op;
+  f->count++;
+}
+
+static id
+fifoPop(GSOperationFIFO *f)
+{
+  id	op;
+
+  if (f->count == 0)
+    {
+      return nil;
+    }
+  op = f->items[f->head];
+  f->head = (f->head + 1) % f->capacity;
+  f->count--;
+  return op;
+}
 
-static NSComparisonResult
-sortFunc(id o1, id o2, void *ctxt)
+static void
+fifoFree(GSOperationFIFO *f)
 {
-  NSOperationQueuePriority p1 = [o1 queuePriority];
-  NSOperationQueuePriority p2 = [o2 queuePriority];
+  if (f->items != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), f->items);
+      f->items = 0;
+    }
+  f->capacity = f->head = f->count = 0;
+}
 
-  if (p1 < p2) return NSOrderedDescending;
-  if (p1 > p2) return NSOrderedAscending;
-  return NSOrderedSame;
+/* Map a queue priority to the index of its FIFO in the waiting array.
+ */
+static inline unsigned
+priorityIndex(NSOperationQueuePriority p)
+{
+  if (p <= NSOperationQueuePriorityVeryLow) return 0;
+  if (p <= NSOperationQueuePriorityLow) return 1;
+  if (p < NSOperationQueuePriorityHigh) return 2;
+  if (p < NSOperationQueuePriorityVeryHigh) return 3;
+  return 4;
 }
 
 static NSString	*threadKey = @"NSOperationQueue";
@@ -590,6 +667,13 @@ static NSOperationQueue *mainQueue = nil;
 {
   if (mainQueue == nil)
     {
+      NSInteger	cpus;
+
+      cpus = [[NSProcessInfo processInfo] activeProcessorCount];
+      if (cpus > poolSize)
+	{
+	  poolSize = cpus;
+	}
       [self performSelectorOnMainThread: @selector(_mainQueue)
 			     withObject: nil
 			  waitUntilDone: YES];
@@ -610,24 +694,34 @@ static NSOperationQueue *mainQueue = nil;
 	NSStringFromClass([self class]), NSStringFromSelector(_cmd)];
     }
   [internal->lock lock];
-  if (NSNotFound == [internal->operations indexOfObjectIdenticalTo: op]
-    && NO == [op isFinished])
+  if (0 == NSHashGet(internal->members, op) && NO == [op isFinished])
     {
-      [op addObserver: self
-	   forKeyPath: @"isReady"
-	      options: NSKeyValueObservingOptionNew
-	      context: NULL];
       [self willChangeValueForKey: @"operations"];
       [self willChangeValueForKey: @"operationCount"];
       [internal->operations addObject: op];
+      NSHashInsert(internal->members, op);
       [self didChangeValueForKey: @"operationCount"];
       [self didChangeValueForKey: @"operations"];
       if (YES == [op isReady])
 	{
-	  [self observeValueForKeyPath: @"isReady"
-			      ofObject: op
-				change: nil
-			       context: nil];
+	  /* Ready now, so there is no need to observe readiness.
+	   */
+	  fifoPush(&internal->waiting[priorityIndex([op queuePriority])], op);
+	  [self _execute];
+	}
+      else
+	{
+	  [op addObserver: self
+	       forKeyPath: @"isReady"
+		  options: NSKeyValueObservingOptionNew
+		  context: NULL];
+	  if (YES == [op isReady])
+	    {
+	      [self observeValueForKeyPath: @"isReady"
+				  ofObject: op
+				    change: nil
+				   context: nil];
+	    }
 	}
     }
   [internal->lock unlock];
@@ -682,21 +776,30 @@ static NSOperationQueue *mainQueue = nil;
 		{
 		  continue;		// Not added
 		}
-	      if (NSNotFound
-		!= [internal->operations indexOfObjectIdenticalTo: op])
+	      if (0 != NSHashGet(internal->members, op))
 		{
 		  buf[index] = nil;	// Not added
 		  toAdd--;
 		  continue;
 		}
-	      [op addObserver: self
-		   forKeyPath: @"isReady"
-		      options: NSKeyValueObservingOptionNew
-		      context: NULL];
 	      [internal->operations addObject: op];
-	      if (NO == [op isReady])
+	      NSHashInsert(internal->members, op);
+	      if (YES == [op isReady])
 		{
-		  buf[index] = nil;	// Not yet ready
+		  fifoPush(&internal->waiting[priorityIndex([op queuePriority])],
+		    op);
+		  buf[index] = nil;	// Already waiting
+		}
+	      else
+		{
+		  [op addObserver: self
+		       forKeyPath: @"isReady"
+			  options: NSKeyValueObservingOptionNew
+			  context: NULL];
+		  if (NO == [op isReady])
+		    {
+		      buf[index] = nil;	// Not yet ready
+		    }
 		}
 	    }
 	  [self didChangeValueForKey: @"operationCount"];
@@ -714,6 +817,7 @@ static NSOperationQueue *mainQueue = nil;
 		}
 	    }
           [internal->lock unlock];
+	  [self _execute];
 	}
       GS_ENDITEMBUF()
       if (YES == invalidArg)
@@ -737,9 +841,18 @@ static NSOperationQueue *mainQueue = nil;
 
 - (void) dealloc
 {
+  unsigned	i;
+
+  for (i = 0; i < 5; i++)
+    {
+      fifoFree(&internal->waiting[i]);
+    }
+  fifoFree(&internal->starting);
+  if (internal->members != 0)
+    {
+      NSFreeHashTable(internal->members);
+    }
   [internal->operations release];
-  [internal->starting release];
-  [internal->waiting release];
   [internal->name release];
   [internal->cond release];
   [internal->lock release];
@@ -755,10 +868,10 @@ static NSOperationQueue *mainQueue = nil;
       internal->suspended = NO;
       internal->count = NSOperationQueueDefaultMaxConcurrentOperationCount;
       internal->operations = [NSMutableArray new];
-      internal->starting = [NSMutableArray new];
-      internal->waiting = [NSMutableArray new];
+      internal->members
+	= NSCreateHashTable(NSNonOwnedPointerHashCallBacks, 0);
       internal->lock = [NSRecursiveLock new];
-      internal->cond = [[NSConditionLock alloc] initWithCondition: 0];
+      internal->cond = [NSCondition new];
     }
   return self;
 }
@@ -793,7 +906,7 @@ static NSOperationQueue *mainQueue = nil;
   NSUInteger	c;
 
   [internal->lock lock];
-  c = [internal->operations count];
+  c = NSCountHashTable(internal->members);
   [internal->lock unlock];
   return c;
 }
@@ -803,7 +916,28 @@ static NSOperationQueue *mainQueue = nil;
   NSArray	*a;
 
   [internal->lock lock];
-  a = [NSArray arrayWithArray: internal->operations];
+  if ([internal->operations count] == NSCountHashTable(internal->members))
+    {
+      a = [NSArray arrayWithArray: internal->operations];
+    }
+  else
+    {
+      NSMutableArray	*m;
+      NSEnumerator	*e;
+      NSOperation	*op;
+
+      m = [NSMutableArray arrayWithCapacity:
+	NSCountHashTable(internal->members)];
+      e = [internal->operations objectEnumerator];
+      while ((op = [e nextObject]) != nil)
+	{
+	  if (0 != NSHashGet(internal->members, op))
+	    {
+	      [m addObject: op];
+	    }
+	}
+      a = m;
+    }
   [internal->lock unlock];
   return a;
 }
@@ -862,6 +996,13 @@ static NSOperationQueue *mainQueue = nil;
   [internal->lock lock];
   while ((op = [internal->operations lastObject]) != nil)
     {
+      if (0 == NSHashGet(internal->members, op))
+	{
+	  /* Already finished, just not yet removed.
+	   */
+	  [internal->operations removeLastObject];
+	  continue;
+	}
       [op retain];
       [internal->lock unlock];
       [op waitUntilFinished];
@@ -893,90 +1034,126 @@ static NSOperationQueue *mainQueue = nil;
   [internal->lock lock];
   if (YES == [object isFinished])
     {
-      internal->executing--;
       [object removeObserver: self
 		  forKeyPath: @"isFinished"];
-      [self willChangeValueForKey: @"operations"];
-      [self willChangeValueForKey: @"operationCount"];
-      [internal->operations removeObjectIdenticalTo: object];
-      [self didChangeValueForKey: @"operationCount"];
-      [self didChangeValueForKey: @"operations"];
+      [self _finished: object];
     }
   else if (YES == [object isReady])
     {
       [object removeObserver: self
 		  forKeyPath: @"isReady"];
-      [internal->waiting addObject: object];
+      fifoPush(&internal->waiting[priorityIndex([object queuePriority])],
+	object);
     }
   [internal->lock unlock];
   [self _execute];
 }
 
-- (void) _thread
+/* Record that an operation has finished.  Finished operations are
+ * removed from the operations array in batches (once they make up half
+ * of it) so that finishing is not linear in the number of operations.
+ */
+- (void) _finished: (NSOperation*)op
 {
-  NSAutoreleasePool	*pool = [NSAutoreleasePool new];
+  NSUInteger	total;
+  NSUInteger	live;
 
-  for (;;)
+  [internal->lock lock];
+  internal->executing--;
+  [self willChangeValueForKey: @"operations"];
+  [self willChangeValueForKey: @"operationCount"];
+  NSHashRemove(internal->members, op);
+  total = [internal->operations count];
+  live = NSCountHashTable(internal->members);
+  if (total - live >= live)
     {
-      NSOperation	*op;
-      NSDate		*when;
-      BOOL		found;
+      NSMutableArray	*m;
 
-      when = [[NSDate alloc] initWithTimeIntervalSinceNow: 5.0];
-      found = [internal->cond lockWhenCondition: 1 beforeDate: when];
-      [when release];
-      if (NO == found)
+      if (live == 0)
 	{
-	  break;	// Idle for 5 seconds ... exit thread.
-	}
-
-      if ([internal->starting count] > 0)
-	{
-          op = [internal->starting objectAtIndex: 0];
-	  [internal->starting removeObjectAtIndex: 0];
+	  m = [NSMutableArray new];
 	}
       else
 	{
-	  op = nil;
-	}
+	  NSEnumerator	*e;
+	  NSOperation	*o;
 
-      if ([internal->starting count] > 0)
-	{
-	  // Signal any other idle threads,
-          [internal->cond unlockWithCondition: 1];
+	  m = [[NSMutableArray alloc] initWithCapacity: live];
+	  e = [internal->operations objectEnumerator];
+	  while ((o = [e nextObject]) != nil)
+	    {
+	      if (0 != NSHashGet(internal->members, o))
+		{
+		  [m addObject: o];
+		}
+	    }
 	}
-      else
+      [internal->operations release];
+      internal->operations = m;
+    }
+  [self didChangeValueForKey: @"operationCount"];
+  [self didChangeValueForKey: @"operations"];
+  [internal->lock unlock];
+  [self _execute];
+}
+
+- (void) _thread
+{
+  NSAutoreleasePool	*pool = [NSAutoreleasePool new];
+
+  [internal->cond lock];
+  for (;;)
+    {
+      NSOperation	*op;
+
+      if (0 == internal->starting.count)
 	{
-	  // There are no more operations starting.
-          [internal->cond unlockWithCondition: 0];
+	  NSDate	*when;
+	  BOOL		found = YES;
+
+	  when = [[NSDate alloc] initWithTimeIntervalSinceNow: 5.0];
+	  internal->idleCount++;
+	  while (YES == found && 0 == internal->starting.count)
+	    {
+	      found = [internal->cond waitUntilDate: when];
+	    }
+	  internal->idleCount--;
+	  [when release];
+	  if (0 == internal->starting.count)
+	    {
+	      break;	// Idle for 5 seconds ... exit thread.
+	    }
 	}
+      op = fifoPop(&internal->starting);
+      [internal->cond unlock];
 
-      if (nil != op)
+      NS_DURING
 	{
-          NS_DURING
-	    {
-	      NSAutoreleasePool	*opPool = [NSAutoreleasePool new];
+	  NSAutoreleasePool	*opPool = [NSAutoreleasePool new];
 
-	      if (NO == [op isCancelled])
-		{
-		  [NSThread setThreadPriority: [op threadPriority]];
-		  [op main];
-		}
-	      [opPool release];
-	    }
-          NS_HANDLER
+	  if (NO == [op isCancelled])
 	    {
-	      NSLog(@"Problem running operation %@ ... %@",
-		op, localException);
+	      [NSThread setThreadPriority: [op threadPriority]];
+	      [op main];
 	    }
-          NS_ENDHANDLER
-	  [op _finish];
+	  [opPool release];
 	}
-    }
+      NS_HANDLER
+	{
+	  NSLog(@"Problem running operation %@ ... %@",
+	    op, localException);
+	}
+      NS_ENDHANDLER
+      [op _finish];
 
-  [internal->lock lock];
+      /* We started this operation, so we know it has finished and can
+       * tell the queue directly rather than by observing it.
+       */
+      [self _finished: op];
+      [internal->cond lock];
+    }
   internal->threadCount--;
-  [internal->lock unlock];
+  [internal->cond unlock];
   [pool release];
   [NSThread exit];
 }
@@ -995,45 +1172,50 @@ static NSOperationQueue *mainQueue = nil;
       max = maxConcurrent;
     }
 
-  while (NO == [self isSuspended]
-    && max > internal->executing
-    && [internal->waiting count] > 0)
+  while (NO == [self isSuspended] && max > internal->executing)
     {
-      NSOperation	*op;
+      NSOperation	*op = nil;
+      int		i;
 
-      /* Make sure we have a sorted queue of operations waiting to execute.
+      /* Take the first operation from the highest priority queue which
+       * has any operations waiting.
        */
-      [internal->waiting sortUsingFunction: sortFunc context: 0];
+      for (i = 4; i >= 0 && nil == op; i--)
+	{
+	  op = fifoPop(&internal->waiting[i]);
+	}
+      if (nil == op)
+	{
+	  break;
+	}
 
-      /* Take the first operation from the queue and start it executing.
-       * We set ourselves up as an observer for the operating finishing
-       * and we keep track of the count of operations we have started,
-       * but the actual startup is left to the NSOperation -start method.
+      /* We keep track of the count of operations we have started.
+       * A concurrent operation manages its own execution, so we must
+       * observe it to find out when it has finished, and the actual
+       * startup is left to the NSOperation -start method.  Other
+       * operations are run (and reported as finished) by our threads.
        */
-      op = [internal->waiting objectAtIndex: 0];
-      [internal->waiting removeObjectAtIndex: 0];
-      [op addObserver: self
-	   forKeyPath: @"isFinished"
-	      options: NSKeyValueObservingOptionNew
-	      context: NULL];
       internal->executing++;
       if (YES == [op isConcurrent])
 	{
+	  [op addObserver: self
+	       forKeyPath: @"isFinished"
+		  options: NSKeyValueObservingOptionNew
+		  context: NULL];
           [op start];
 	}
       else
 	{
-	  NSUInteger	pending;
-
 	  [internal->cond lock];
-	  pending = [internal->starting count];
-	  [internal->starting addObject: op];
+	  fifoPush(&internal->starting, op);
 
-	  /* Create a new thread if all existing threads are busy and
-	   * we haven't reached the pool limit.
+	  /* Create a new thread if there are not enough idle threads to
+	   * take the operations starting and we haven't reached the pool
+	   * limit.
 	   */
 	  if (0 == internal->threadCount
-	    || (pending > 0 && internal->threadCount < POOL))
+	    || (internal->starting.count > (NSUInteger)internal->idleCount
+	      && internal->threadCount < poolSize))
 	    {
 	      internal->threadCount++;
 	      [NSThread detachNewThreadSelector: @selector(_thread)
@@ -1042,11 +1224,11 @@ static NSOperationQueue *mainQueue = nil;
 	    }
 	  /* Tell the thread pool that there is an operation to start.
 	   */
-	  [internal->cond unlockWithCondition: 1];
+	  [internal->cond signal];
+	  [internal->cond unlock];
 	}
     }
   [internal->lock unlock];
 }
 
 @end
-
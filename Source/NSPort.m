@@ -251,6 +251,20 @@ static Class	NSPort_concrete_class;
 
 @end
 
+static volatile unsigned	closedDescriptors = 0;
+
+void
+GSPrivatePortClosedDescriptor(void)
+{
+  __sync_add_and_fetch(&closedDescriptors, 1);
+}
+
+unsigned
+GSPrivatePortClosedDescriptors(void)
+{
+  return closedDescriptors;
+}
+
 /*
  * This is a callback method used by the NSRunLoop class to determine which
  * descriptors to watch for the port.  Subclasses override it.
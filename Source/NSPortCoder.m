@@ -39,13 +39,25 @@
 #  include <objc/encoding.h>
 #endif
 
+#define	GS_NSPortCoder_IVARS \
+  id			_table;		/* Connection's coding table.	*/ \
+  NSMutableData		*_defs;		/* Definitions to be sent.	*/ \
+  NSMutableData		*_defIds;	/* Numbers of those items.	*/ \
+  unsigned		_defCount;	/* Number of definitions.	*/ \
+  unsigned		_hdrLength	/* Length of compact header.	*/
+
 #define	EXPOSE_NSPortCoder_IVARS	1
 #import "Foundation/NSException.h"
 #import "Foundation/NSByteOrder.h"
 #import "Foundation/NSCoder.h"
 #import "Foundation/NSAutoreleasePool.h"
+#import "Foundation/NSConnection.h"
 #import "Foundation/NSData.h"
+#import "Foundation/NSLock.h"
+#import "Foundation/NSMapTable.h"
 #import "Foundation/NSPort.h"
+#import "Foundation/NSPortNameServer.h"
+#import "Foundation/NSValue.h"
 
 @class	NSMutableDataMalloc;
 @interface NSMutableDataMalloc : NSObject	// Help the compiler
@@ -89,11 +101,38 @@ static GC_descr	nodeDesc;	// Type descriptor for map node.
 #undef	_IN_PORT_CODER_M
 
 #import "GNUstepBase/DistributedObjects.h"
+#import "GSPortPrivate.h"
+
+#define	GSInternal		NSPortCoderInternal
+#include	"GSInternal.h"
+GS_PRIVATE_INTERNAL(NSPortCoder)
+
+#define	Itable		(internal->_table)
+#define	Idefs		(internal->_defs)
+#define	IdefIds		(internal->_defIds)
+#define	IdefCount	(internal->_defCount)
+#define	IhdrLength	(internal->_hdrLength)
 
 typedef	unsigned char	uchar;
 
 #define	PREFIX		"GNUstep DO archive"
 
+/*
+ *	A message in the compact format starts with this rather than the
+ *	prefix, and may use extra type tags for variable length integers
+ *	and for items from the connection's coding table.
+ */
+#define	COMPACT		"GSDC"
+#define	_GSC_VINT	0x0d		/* Zigzag variable length int.	*/
+#define	_GSC_VUINT	0x0e		/* Variable length unsigned.	*/
+#define	_GSC_ISTR	0x18		/* String from coding table.	*/
+#define	_GSC_ICLS	0x19		/* Class from coding table.	*/
+#define	_GSC_ISEL	0x1a		/* Selector from coding table.	*/
+
+#define	MAX_ISTR	32		/* Longest string put in table.	*/
+#define	MAX_STRINGS	1024		/* Most strings put in table.	*/
+#define	MAX_NAME	1024		/* Longest class or selector.	*/
+
 static SEL eSerSel;
 static SEL eTagSel;
 static SEL xRefSel;
@@ -174,6 +213,11 @@ typeToName2(char type)
       case _GSC_CHARPTR:	return "cstring";
       case _GSC_ARY_B:	return "array";
       case _GSC_STRUCT_B:	return "struct";
+      case _GSC_VINT:	return "variable length int";
+      case _GSC_VUINT:	return "variable length unsigned int";
+      case _GSC_ISTR:	return "string (from table)";
+      case _GSC_ICLS:	return "class (from table)";
+      case _GSC_ISEL:	return "selector (from table)";
       default:
 	{
 	  static char	buf1[32];
@@ -282,12 +326,70 @@ typeCheck(char t1, char t2)
     }
 }
 
+/*
+ *	Variable length integers for the compact format ... seven bits
+ *	per byte, least significant first, with the top bit set in all
+ *	but the last byte.
+ */
+static inline void
+putVarint(NSMutableData *d, uint64_t v)
+{
+  uint8_t	buf[10];
+  unsigned	len = 0;
+
+  while (v >= 0x80)
+    {
+      buf[len++] = (uint8_t)(v | 0x80);
+      v >>= 7;
+    }
+  buf[len++] = (uint8_t)v;
+  [d appendBytes: buf length: len];
+}
+
+static inline const uint8_t *
+getRun(NSData *d, unsigned *cursor, unsigned len)
+{
+  const uint8_t	*bytes = [d bytes];
+
+  if (len > [d length] || *cursor > [d length] - len)
+    {
+      [NSException raise: NSRangeException
+		  format: @"Range: (%u, %u) Size: %"PRIuPTR,
+	*cursor, len, [d length]];
+    }
+  *cursor += len;
+  return bytes + *cursor - len;
+}
+
+static inline uint64_t
+getVarint(NSData *d, unsigned *cursor)
+{
+  uint64_t	v = 0;
+  unsigned	shift = 0;
+  uint8_t	c;
+
+  do
+    {
+      if (shift > 63)
+	{
+	  [NSException raise: NSInternalInconsistencyException
+		      format: @"overflow in variable length integer"];
+	}
+      c = *getRun(d, cursor, 1);
+      v |= (uint64_t)(c & 0x7f) << shift;
+      shift += 7;
+    }
+  while (c & 0x80);
+  return v;
+}
+
 @interface	GSClassInfo : NSObject
 {
 @public
   Class		class;
   unsigned	version;
   NSString	*name;
+  GSClassInfo	*superInfo;	/* Only in coding tables.	*/
 }
 + (id) newWithClass: (Class)c andVersion: (unsigned)v;
 - (NSString*) className;
@@ -317,6 +419,7 @@ typeCheck(char t1, char t2)
 - (void) dealloc
 {
   TEST_RELEASE(name);
+  TEST_RELEASE(superInfo);
   NSDeallocateObject(self);
   GSNOSUPERDEALLOC;
 }
@@ -324,7 +427,159 @@ typeCheck(char t1, char t2)
 
 
 
+@implementation	GSCodingTable
 
+- (void) dealloc
+{
+  if (classes != 0)
+    {
+      NSFreeMapTable(classes);
+      NSFreeMapTable(selectors);
+      NSFreeMapTable(strings);
+      NSFreeMapTable(received);
+    }
+  if (sent != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), sent);
+    }
+  RELEASE(lock);
+  [super dealloc];
+}
+
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      lock = [NSLock new];
+      classes = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+	NSIntegerMapValueCallBacks, 0);
+      selectors = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+	NSIntegerMapValueCallBacks, 0);
+      strings = NSCreateMapTable(NSObjectMapKeyCallBacks,
+	NSIntegerMapValueCallBacks, 0);
+      received = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+	NSObjectMapValueCallBacks, 0);
+    }
+  return self;
+}
+
+/*
+ * Must be called with the lock held.
+ */
+- (unsigned) _number: (NSMapTable*)m key: (const void*)k known: (BOOL*)known
+{
+  unsigned	n = (unsigned)(uintptr_t)NSMapGet(m, k);
+
+  if (n == 0)
+    {
+      n = ++next;
+      NSMapInsert(m, k, (void*)(uintptr_t)n);
+    }
+  *known = (n < size && sent[n] != 0) ? YES : NO;
+  return n;
+}
+
+- (unsigned) numberForClass: (Class)c known: (BOOL*)known
+{
+  unsigned	n;
+
+  [lock lock];
+  n = [self _number: classes key: (void*)c known: known];
+  [lock unlock];
+  return n;
+}
+
+- (unsigned) numberForSelector: (SEL)s known: (BOOL*)known
+{
+  unsigned	n;
+
+  [lock lock];
+  n = [self _number: selectors key: (void*)s known: known];
+  [lock unlock];
+  return n;
+}
+
+/*
+ * Returns zero if the string is not in the table and the table is full.
+ */
+- (unsigned) numberForString: (NSString*)s known: (BOOL*)known
+{
+  unsigned	n = 0;
+
+  *known = NO;
+  [lock lock];
+  if (NSMapGet(strings, s) != 0 || NSCountMapTable(strings) < MAX_STRINGS)
+    {
+      s = [s copy];
+      n = [self _number: strings key: s known: known];
+      RELEASE(s);
+    }
+  [lock unlock];
+  return n;
+}
+
+- (id) itemForNumber: (unsigned)n
+{
+  id	item;
+
+  [lock lock];
+  item = (id)NSMapGet(received, (void*)(uintptr_t)n);
+  [lock unlock];
+  if (item == nil)
+    {
+      [NSException raise: NSInternalInconsistencyException
+		  format: @"coding table item missing - %u", n];
+    }
+  return item;
+}
+
+- (void) markSent: (const unsigned*)numbers count: (unsigned)count
+{
+  [lock lock];
+  while (count-- > 0)
+    {
+      unsigned	n = numbers[count];
+
+      if (n >= size)
+	{
+	  unsigned	s = size;
+
+	  size = n + 64;
+	  sent = NSZoneRealloc(NSDefaultMallocZone(), sent, size);
+	  memset(sent + s, 0, size - s);
+	}
+      sent[n] = 1;
+    }
+  [lock unlock];
+}
+
+/*
+ * The other end may define an item more than once, but items are never
+ * replaced, so a decoder may use an item without retaining it.
+ */
+- (void) setItem: (id)item forNumber: (unsigned)n
+{
+  [lock lock];
+  if (NSMapGet(received, (void*)(uintptr_t)n) == 0)
+    {
+      NSMapInsert(received, (void*)(uintptr_t)n, item);
+    }
+  [lock unlock];
+}
+
+@end
+
+
+
+@interface	NSPortCoder (Compact)
+- (void) _define: (unsigned)n kind: (uint8_t)kind;
+- (BOOL) _defines: (unsigned)n;
+- (id) _itemForNumber: (unsigned)n;
+- (unsigned) _numberForClass: (Class)c;
+- (unsigned) _numberForSelector: (SEL)s;
+- (unsigned) _numberForString: (NSString*)s;
+- (void) _readDefinitionsAt: (unsigned*)pos;
+@end
 
 @interface	NSPortCoder (Headers)
 - (void) _deserializeHeaderAt: (unsigned*)pos
@@ -346,6 +601,7 @@ static Class	connectionClass;
 static Class	mutableArrayClass;
 static Class	mutableDataClass;
 static Class	mutableDictionaryClass;
+static Class	stringClass;
 
 static IMP	_eSerImp;	/* Method to serialize with.	*/
 static IMP	_eTagImp;	/* Serialize a type tag.	*/
@@ -384,6 +640,7 @@ static unsigned	encodingVersion;
       _eTagImp = [mutableDataClass instanceMethodForSelector: eTagSel];
       _xRefImp = [mutableDataClass instanceMethodForSelector: xRefSel];
       mutableDictionaryClass = [NSMutableDictionary class];
+      stringClass = [NSString class];
     }
 }
 
@@ -410,6 +667,13 @@ static unsigned	encodingVersion;
   RELEASE(_comp);
   RELEASE(_conn);
   RELEASE(_cInfo);
+  if (GS_EXISTS_INTERNAL)
+    {
+      RELEASE(Itable);
+      RELEASE(Idefs);
+      RELEASE(IdefIds);
+      GS_DESTROY_INTERNAL(NSPortCoder)
+    }
   if (_clsMap != 0)
     {
       GSIMapEmptyMap(_clsMap);
@@ -673,6 +937,21 @@ static unsigned	encodingVersion;
 	  return;
 	}
 
+      case _GSC_ISTR:
+	{
+	  id	obj;
+
+	  /*
+	   *	A string from the coding table is shared rather than being
+	   *	a new object, so we retain it as for a cross-reference.
+	   */
+	  typeCheck(*type, _GSC_ID);
+	  obj = [self _itemForNumber: xref];
+	  IF_NO_GC(RETAIN(obj));
+	  *(id*)address = obj;
+	  return;
+	}
+
       case _GSC_CID:
 	{
 	  id		obj;
@@ -784,6 +1063,39 @@ static unsigned	encodingVersion;
 	  return;
 	}
 
+      case _GSC_ICLS:
+	{
+	  GSClassInfo	*classInfo;
+
+	  if (*type != _C_ID)
+	    {
+	      typeCheck(*type, _GSC_CLASS);
+	    }
+	  classInfo = [self _itemForNumber: xref];
+	  *(Class*)address = classInfo->class;
+
+	  /*
+	   *	Record the versions of the class and its superclasses for
+	   *	-versionForClassName:
+	   */
+	  if (_cInfo == nil)
+	    {
+	      _cInfo = [[mutableDictionaryClass alloc] initWithCapacity: 8];
+	    }
+	  while (classInfo != nil && classInfo->class != 0
+	    && [_cInfo objectForKey: [classInfo className]] == nil)
+	    {
+	      [_cInfo setObject: classInfo forKey: [classInfo className]];
+	      classInfo = classInfo->superInfo;
+	    }
+	  return;
+	}
+
+      case _GSC_ISEL:
+	typeCheck(*type, _GSC_SEL);
+	*(SEL*)address = [[self _itemForNumber: xref] pointerValue];
+	return;
+
       case _GSC_SEL:
 	{
 	  SEL		sel;
@@ -1028,6 +1340,37 @@ static unsigned	encodingVersion;
 	  }
 	return;
 
+      case _GSC_VINT:
+      case _GSC_VUINT:
+	{
+	  uint64_t	val = getVarint(_src, &_cursor);
+
+	  if ((info & _GSC_MASK) == _GSC_VINT)
+	    {
+	      val = (val >> 1) ^ (0 - (val & 1));
+	    }
+	  switch (*type)
+	    {
+	      case _C_SHT:	*(short*)address = (short)val; return;
+	      case _C_USHT:	*(unsigned short*)address = (unsigned short)val;
+				return;
+	      case _C_INT:	*(int*)address = (int)val; return;
+	      case _C_UINT:	*(unsigned int*)address = (unsigned int)val;
+				return;
+	      case _C_LNG:	*(long*)address = (long)val; return;
+	      case _C_ULNG:	*(unsigned long*)address = (unsigned long)val;
+				return;
+#ifdef	_C_LNG_LNG
+	      case _C_LNG_LNG:	*(long long*)address = (long long)val; return;
+	      case _C_ULNG_LNG:	*(unsigned long long*)address = val; return;
+#endif
+	      default:
+		[NSException raise: NSInternalInconsistencyException
+			    format: @"expected %s and got %s",
+		  typeToName1(*type), typeToName2(info)];
+	    }
+	}
+
       default:
 	[NSException raise: NSInternalInconsistencyException
 		    format: @"read unknown type info - %d", info];
@@ -1140,6 +1483,7 @@ static unsigned	encodingVersion;
    * released if it is keeping this coder in a cache.
    */
   DESTROY(_conn);
+  DESTROY(Itable);
 }
 
 - (void) encodeArrayOfObjCType: (const char*)type
@@ -1414,9 +1758,31 @@ static unsigned	encodingVersion;
 
       if (node == 0 || node->value.nsu == 0)
 	{
-	  Class	cls;
+	  Class	cls = 0;
 	  id	obj;
 
+	  obj = [anObject replacementObjectForPortCoder: self];
+	  if (GSObjCIsInstance(obj) == YES)
+	    {
+	      cls = [obj classForPortCoder];
+	      /*
+	       *	In the compact format, short immutable strings go in the
+	       *	connection's coding table and are sent as their number.
+	       *	They take no object cross-reference.
+	       */
+	      if (Itable != nil && cls == stringClass
+		&& [obj length] <= MAX_ISTR)
+		{
+		  unsigned	n = [self _numberForString: obj];
+
+		  if (n > 0)
+		    {
+		      (*_xRefImp)(_dst, xRefSel, _GSC_ISTR, n);
+		      return;
+		    }
+		}
+	    }
+
 	  if (node == 0)
 	    {
 	      node = GSIMapAddPair(_uIdMap,
@@ -1427,7 +1793,6 @@ static unsigned	encodingVersion;
 	      node->value.nsu = ++_xRefO;
 	    }
 
-	  obj = [anObject replacementObjectForPortCoder: self];
 	  if (GSObjCIsInstance(obj) == NO)
 	    {
 	      /*
@@ -1439,7 +1804,6 @@ static unsigned	encodingVersion;
 	    }
 	  else
 	    {
-	      cls = [obj classForPortCoder];
 	      (*_xRefImp)(_dst, xRefSel, _GSC_ID, node->value.nsu);
 	      (*_eValImp)(self, eValSel, @encode(Class), &cls);
 	      [obj encodeWithCoder: self];
@@ -1608,6 +1972,44 @@ static unsigned	encodingVersion;
 	break;
     }
 
+  /*
+   *	The compact format sends integers as variable length values, which
+   *	are usually much shorter than their natural size.
+   */
+  if (Itable != nil)
+    {
+      int64_t	sv = 0;
+      uint64_t	uv = 0;
+      uchar	info = _GSC_VINT;
+
+      switch (*type)
+	{
+	  case _C_SHT:		sv = *(short*)buf; break;
+	  case _C_INT:		sv = *(int*)buf; break;
+	  case _C_LNG:		sv = *(long*)buf; break;
+	  case _C_LNG_LNG:	sv = *(long long*)buf; break;
+	  case _C_USHT:		uv = *(unsigned short*)buf; info = _GSC_VUINT;
+				break;
+	  case _C_UINT:		uv = *(unsigned int*)buf; info = _GSC_VUINT;
+				break;
+	  case _C_ULNG:		uv = *(unsigned long*)buf; info = _GSC_VUINT;
+				break;
+	  case _C_ULNG_LNG:	uv = *(unsigned long long*)buf;
+				info = _GSC_VUINT; break;
+	  default:		info = _GSC_NONE; break;
+	}
+      if (info != _GSC_NONE)
+	{
+	  if (info == _GSC_VINT)
+	    {
+	      uv = ((uint64_t)sv << 1) ^ (uint64_t)(sv >> 63);
+	    }
+	  (*_eTagImp)(_dst, eTagSel, info);
+	  putVarint(_dst, uv);
+	  return;
+	}
+    }
+
   switch (*type)
     {
       case _C_CLASS:
@@ -1618,6 +2020,15 @@ static unsigned	encodingVersion;
 	     */
 	    (*_eTagImp)(_dst, eTagSel, _GSC_CLASS | _GSC_XREF | _GSC_X_0);
 	  }
+	else if (Itable != nil)
+	  {
+	    /*
+	     *	Compact format - the definition of the class (and its
+	     *	superclasses) goes in the header.
+	     */
+	    (*_xRefImp)(_dst, xRefSel, _GSC_ICLS,
+	      [self _numberForClass: *(Class*)buf]);
+	  }
 	else
 	  {
 	    Class	c = *(Class*)buf;
@@ -1686,6 +2097,11 @@ static unsigned	encodingVersion;
 	     */
 	    (*_eTagImp)(_dst, eTagSel, _GSC_SEL | _GSC_XREF | _GSC_X_0);
 	  }
+	else if (Itable != nil)
+	  {
+	    (*_xRefImp)(_dst, xRefSel, _GSC_ISEL,
+	      [self _numberForSelector: *(SEL*)buf]);
+	  }
 	else
 	  {
 	    SEL		s = *(SEL*)buf;
@@ -1814,6 +2230,7 @@ static unsigned	encodingVersion;
 {
   BOOL	firstTime;
 
+  GS_CREATE_INTERNAL(NSPortCoder)
   _conn = RETAIN([connectionClass connectionWithReceivePort: recv
 						   sendPort: send]);
   if (_comp == nil)
@@ -1897,6 +2314,23 @@ static unsigned	encodingVersion;
 	      GSIMapCleanMap(_ptrMap);
 	    }
 
+	  /*
+	   * Use the compact format if the other end has agreed to it.
+	   */
+	  ASSIGN(Itable, [_conn _compactCodingTable]);
+	  IdefCount = 0;
+	  IhdrLength = 0;
+	  if (Itable != nil)
+	    {
+	      if (Idefs == nil)
+		{
+		  Idefs = [mutableDataClass new];
+		  IdefIds = [mutableDataClass new];
+		}
+	      [Idefs setLength: 0];
+	      [IdefIds setLength: 0];
+	    }
+
 	  /*
 	   *	Write dummy header
 	   */
@@ -1945,6 +2379,7 @@ static unsigned	encodingVersion;
 	  /*
 	   *	Read header including version and crossref table sizes.
 	   */
+	  DESTROY(Itable);
 	  _cursor = 0;
 	  [self _deserializeHeaderAt: &_cursor
 			     version: &_version
@@ -2067,6 +2502,38 @@ static unsigned	encodingVersion;
 
 @implementation	NSPortCoder (Private)
 
+/*
+ * Called by the connection once the message has been sent, so that
+ * later messages need not repeat the coding table definitions in it.
+ */
+- (void) _definitionsSent
+{
+  if (Itable != nil && IdefCount > 0)
+    {
+      [Itable markSent: [IdefIds bytes] count: IdefCount];
+    }
+}
+
+/*
+ * Used by the connection when a message is batched, to mark the coding
+ * table definitions in it as sent once the batch has been sent.
+ */
+- (void) _addDefinitionsTo: (NSMutableData*)d
+{
+  if (Itable != nil && IdefCount > 0)
+    {
+      [d appendBytes: [IdefIds bytes] length: IdefCount * sizeof(unsigned)];
+    }
+}
+
+/*
+ * Returns YES if a decoder has not yet reached the end of its data.
+ */
+- (BOOL) _hasMoreData
+{
+  return (_src != nil && _cursor < [_src length]) ? YES : NO;
+}
+
 - (NSMutableArray*) _components
 {
   if (nil != _dst)
@@ -2095,8 +2562,22 @@ static unsigned	encodingVersion;
 {
   unsigned	plen = strlen(PREFIX);
   unsigned	size = plen+36;
+  unsigned	clen = strlen(COMPACT);
   char		header[size+1];
 
+  if ([_src length] >= *pos + clen
+    && memcmp((const char*)[_src bytes] + *pos, COMPACT, clen) == 0)
+    {
+      *pos += clen;
+      *v = (unsigned)getVarint(_src, pos);
+      *c = (unsigned)getVarint(_src, pos);
+      *o = (unsigned)getVarint(_src, pos);
+      *p = (unsigned)getVarint(_src, pos);
+      ASSIGN(Itable, [_conn _codingTable]);
+      [self _readDefinitionsAt: pos];
+      return;
+    }
+
   [_src getBytes: header range: NSMakeRange(*pos, size)];
   *pos += size;
   header[size] = '\0';
@@ -2122,6 +2603,34 @@ static unsigned	encodingVersion;
   char		header[headerLength+1];
   unsigned	dataLength = [_dst length];
 
+  if (Itable != nil)
+    {
+      NSMutableData	*h;
+
+      /*
+       * The compact header varies in length, and includes the coding
+       * table definitions used in the message.
+       */
+      if (locationInData + IhdrLength > dataLength)
+	{
+	  [NSException raise: NSInternalInconsistencyException
+		      format: @"serializeHeader:at: bad location"];
+	}
+      h = [mutableDataClass dataWithCapacity: 32 + [Idefs length]];
+      [h appendBytes: COMPACT length: strlen(COMPACT)];
+      putVarint(h, v);
+      putVarint(h, cc);
+      putVarint(h, oc);
+      putVarint(h, pc);
+      putVarint(h, IdefCount);
+      [h appendData: Idefs];
+      [_dst replaceBytesInRange: NSMakeRange(locationInData, IhdrLength)
+		      withBytes: [h bytes]
+			 length: [h length]];
+      IhdrLength = [h length];
+      return;
+    }
+
   snprintf(header, sizeof(header), "%s%08x:%08x:%08x:%08x:",
     PREFIX, v, cc, oc, pc);
 
@@ -2143,6 +2652,235 @@ static unsigned	encodingVersion;
 
 @end
 
+@implementation	NSPortCoder (Compact)
+
+- (BOOL) _defines: (unsigned)n
+{
+  const unsigned	*ids = [IdefIds bytes];
+  unsigned		i;
+
+  for (i = 0; i < IdefCount; i++)
+    {
+      if (ids[i] == n)
+	{
+	  return YES;
+	}
+    }
+  return NO;
+}
+
+/*
+ * Start a definition record of the given kind for item n.
+ */
+- (void) _define: (unsigned)n kind: (uint8_t)kind
+{
+  [Idefs appendBytes: &kind length: 1];
+  putVarint(Idefs, n);
+  [IdefIds appendBytes: &n length: sizeof(n)];
+  IdefCount++;
+}
+
+- (id) _itemForNumber: (unsigned)n
+{
+  if (Itable == nil)
+    {
+      [NSException raise: NSInternalInconsistencyException
+		  format: @"coding table item in message without table"];
+    }
+  return [Itable itemForNumber: n];
+}
+
+- (unsigned) _numberForClass: (Class)c
+{
+  BOOL		known;
+  unsigned	n = [Itable numberForClass: c known: &known];
+
+  if (known == NO && [self _defines: n] == NO)
+    {
+      Class		s = class_getSuperclass(c);
+      const char	*name = class_getName(c);
+      unsigned		len = strlen(name);
+      int		tmp = class_getVersion(c);
+      unsigned		sn = 0;
+
+      if (tmp < 0)
+	{
+	  [NSException raise: NSInternalInconsistencyException
+		      format: @"negative class version"];
+	}
+      /*
+       * Superclasses are defined first so that their version information
+       * is available when objects of the subclass are decoded.
+       */
+      if (s != 0 && s != c)
+	{
+	  sn = [self _numberForClass: s];
+	}
+      [self _define: n kind: 'c'];
+      putVarint(Idefs, (unsigned)tmp);
+      putVarint(Idefs, sn);
+      putVarint(Idefs, len);
+      [Idefs appendBytes: name length: len];
+    }
+  return n;
+}
+
+- (unsigned) _numberForSelector: (SEL)s
+{
+  BOOL		known;
+  unsigned	n = [Itable numberForSelector: s known: &known];
+
+  if (known == NO && [self _defines: n] == NO)
+    {
+      const char	*name = sel_getName(s);
+      const char	*types = GSTypesFromSelector(s);
+      unsigned		len = strlen(name);
+
+      [self _define: n kind: 's'];
+      putVarint(Idefs, len);
+      [Idefs appendBytes: name length: len];
+      len = (types == 0) ? 0 : strlen(types);
+      putVarint(Idefs, len);
+      [Idefs appendBytes: types length: len];
+    }
+  return n;
+}
+
+/*
+ * Returns zero if the string can't be put in the coding table.
+ */
+- (unsigned) _numberForString: (NSString*)s
+{
+  BOOL		known;
+  unsigned	n = [Itable numberForString: s known: &known];
+
+  if (n > 0 && known == NO && [self _defines: n] == NO)
+    {
+      NSData	*d = [s dataUsingEncoding: NSUTF8StringEncoding];
+
+      [self _define: n kind: 'u'];
+      putVarint(Idefs, [d length]);
+      [Idefs appendData: d];
+    }
+  return n;
+}
+
+/*
+ * Read the coding table definitions from the header of a message in the
+ * compact format.  This is done when the message arrives, since messages
+ * may be decoded in a different order from that in which they were sent.
+ */
+- (void) _readDefinitionsAt: (unsigned*)pos
+{
+  unsigned	count = (unsigned)getVarint(_src, pos);
+
+  while (count-- > 0)
+    {
+      uint8_t		kind = *getRun(_src, pos, 1);
+      unsigned		n = (unsigned)getVarint(_src, pos);
+      unsigned		len = 0;
+      const uint8_t	*b;
+      id		item;
+
+      switch (kind)
+	{
+	  case 'c':
+	    {
+	      unsigned		cver = (unsigned)getVarint(_src, pos);
+	      unsigned		sn = (unsigned)getVarint(_src, pos);
+	      GSClassInfo	*info;
+	      Class		c;
+
+	      len = (unsigned)getVarint(_src, pos);
+	      if (len > MAX_NAME)
+		{
+		  [NSException raise: NSInternalInconsistencyException
+			      format: @"class name too long (%u)", len];
+		}
+	      b = getRun(_src, pos, len);
+	      {
+		char	name[len + 1];
+
+		memcpy(name, b, len);
+		name[len] = '\0';
+		c = objc_lookUpClass(name);
+		if (c == 0)
+		  {
+		    NSLog(@"[%s %s] can't find class - %s",
+		      class_getName([self class]), sel_getName(_cmd), name);
+		  }
+	      }
+	      info = [GSClassInfo newWithClass: c andVersion: cver];
+	      if (sn > 0)
+		{
+		  info->superInfo = RETAIN([Itable itemForNumber: sn]);
+		}
+	      item = info;
+	      break;
+	    }
+
+	  case 's':
+	    {
+	      unsigned	tlen;
+	      const uint8_t	*t;
+	      SEL	sel;
+
+	      len = (unsigned)getVarint(_src, pos);
+	      b = getRun(_src, pos, len);
+	      tlen = (unsigned)getVarint(_src, pos);
+	      t = getRun(_src, pos, tlen);
+	      if (len > MAX_NAME || tlen > MAX_NAME)
+		{
+		  [NSException raise: NSInternalInconsistencyException
+			      format: @"selector name or types too long"];
+		}
+	      {
+		char	name[len + 1];
+		char	types[tlen + 1];
+
+		memcpy(name, b, len);
+		name[len] = '\0';
+		memcpy(types, t, tlen);
+		types[tlen] = '\0';
+		if (tlen > 0)
+		  {
+		    sel = GSSelectorFromNameAndTypes(name, types);
+		  }
+		else
+		  {
+		    sel = sel_registerName(name);
+		  }
+		if (sel == 0)
+		  {
+		    [NSException raise: NSInternalInconsistencyException
+				format: @"can't make sel with name '%s' "
+		      @"and types '%s'", name, types];
+		  }
+	      }
+	      item = RETAIN([NSValue valueWithPointer: sel]);
+	      break;
+	    }
+
+	  case 'u':
+	    len = (unsigned)getVarint(_src, pos);
+	    b = getRun(_src, pos, len);
+	    item = [[stringClass alloc] initWithBytes: b
+					       length: len
+					     encoding: NSUTF8StringEncoding];
+	    break;
+
+	  default:
+	    [NSException raise: NSInternalInconsistencyException
+			format: @"unknown coding table definition - %d", kind];
+	    return;
+	}
+      [Itable setItem: item forNumber: n];
+      RELEASE(item);
+    }
+}
+
+@end
+
 @implementation	NSObject (NSPortCoder)
 /**
  * Override to substitute class when an instance is being serialized by an
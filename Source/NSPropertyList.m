@@ -77,6 +77,46 @@ static Class	GSMutableStringClass;
 
 extern BOOL GSScanDouble(unichar*, unsigned, double*);
 
+/* Test two property list values for equality.
+ * If either is an NSNumber, we insist that they are the same class
+ * so that numbers with the same numeric value but different classes
+ * are not treated as the same number (that confuses OSXs decoding).
+ */
+static BOOL
+plEqual(id o1, id o2)
+{
+  if (object_getClass(o1) != object_getClass(o2)
+    && ([o1 isKindOfClass: NSNumberClass]
+      || [o2 isKindOfClass: NSNumberClass]))
+    {
+      return NO;
+    }
+  return [o1 isEqual: o2];
+}
+
+/*
+ *	Setup for inline operation of the binary generator's tables of
+ *	unique objects.  Collections are kept in a separate table (marked
+ *	by its 'extra' field) where they are compared by identity rather
+ *	than value.  The objects are all in the property list, so need not
+ *	be retained.
+ */
+#define	GSI_MAP_KTYPES	GSUNION_OBJ | GSUNION_NSINT
+#define	GSI_MAP_VTYPES	GSUNION_NSINT
+#define	GSI_MAP_RETAIN_KEY(M, X)
+#define	GSI_MAP_RELEASE_KEY(M, X)
+#define	GSI_MAP_RETAIN_VAL(M, X)
+#define	GSI_MAP_RELEASE_VAL(M, X)
+#define	GSI_MAP_HASH(M, X)	\
+  ((M)->extra ? ((X).nsu >> 4) : [(X).obj hash])
+#define	GSI_MAP_EQUAL(M, X, Y)	((X).nsu == (Y).nsu \
+  || (NO == (M)->extra && plEqual((X).obj, (Y).obj)))
+#define	GSI_MAP_EXTRA	BOOL
+#define	GSI_MAP_NOCLEAN	1
+#define	GSI_MAP_POW2	1
+
+#include "GNUstepBase/GSIMap.h"
+
 @class	GSMutableDictionary;
 @interface GSMutableDictionary : NSObject	// Help the compiler
 @end
@@ -451,38 +491,104 @@ foundIgnorableWhitespace: (NSString *)string
   unsigned		object_count;	// Number of objects
   unsigned		root_index;	// Index of root object
   unsigned		table_start;	// Start address of object table
+  BOOL			lazy;		// Decode containers on demand
 }
 
 - (id) initWithData: (NSData*)plData
 	 mutability: (NSPropertyListMutabilityOptions)m;
+- (id) initWithData: (NSData*)plData
+	 mutability: (NSPropertyListMutabilityOptions)m
+	       lazy: (BOOL)flag;
 - (id) rootObject;
 - (id) objectAtIndex: (NSUInteger)index;
+- (id) objectAtReference: (unsigned)n from: (unsigned)refs cache: (id*)slot;
 
 @end
 
+/* Immutable collections returned by a lazy binary parser.  They keep the
+ * parser (and so the property list data) alive and decode each member
+ * from the data the first time it is used.
+ */
+@interface GSBinaryPLArray : NSArray
+{
+  GSBinaryPLParser	*parser;
+  unsigned		refs;		// Position of object references
+  unsigned		count;
+  id			*objects;	// Decoded members or nil
+}
+- (id) initWithParser: (GSBinaryPLParser*)p
+		 refs: (unsigned)pos
+		count: (unsigned)c;
+@end
+
+@interface GSBinaryPLDictionary : NSDictionary
+{
+  GSBinaryPLParser	*parser;
+  unsigned		refs;		// Key references then value references
+  unsigned		count;
+  id			*keys;		// Decoded keys or nil
+  id			*values;	// Decoded values or nil
+  NSMapTable		*positions;	// Maps keys to index + 1
+}
+- (id) initWithParser: (GSBinaryPLParser*)p
+		 refs: (unsigned)pos
+		count: (unsigned)c;
+@end
+
+/* Immutable data referring directly to the bytes of the property list.
+ */
+@interface GSBinaryPLData : NSData
+{
+  NSData		*backing;
+  const void		*start;
+  NSUInteger		size;
+}
+- (id) initWithData: (NSData*)d bytes: (const void*)b length: (NSUInteger)l;
+@end
+
 @interface GSBinaryPLGenerator : NSObject
 {
-  NSMutableData *dest;
-  NSMapTable 	*objectList;
-  NSMutableArray *objectsToDoList;
-  id root;
+  NSMutableData		*dest;		// Data to append output to, or ...
+  NSOutputStream	*stream;	// ... stream to write output to.
+  NSError		*error;		// Set if writing to the stream failed
+  unsigned char		*buffer;	// Output not yet written
+  NSUInteger		used;		// Number of bytes in buffer
+  NSUInteger		flushed;	// Number of bytes already written
+  GSIMapTable_t		map;		// Maps objects to their number + 1
+  GSIMapTable_t		collections;	// Maps collections likewise
+  id			*objects;	// Objects in numbered order
+  unsigned char		*kinds;		// How each object is stored
+  NSUInteger		count;		// Number of objects
+  NSUInteger		capacity;	// Space in objects and kinds
+  unsigned		*refs;		// Numbers of collection members
+  NSUInteger		refCount;	// Number of member numbers
+  NSUInteger		refCapacity;	// Space in refs
+  NSUInteger		refPos;		// Next member number to write
+  NSUInteger		*offsets;	// Position of each object
+  void			*scratch;	// Workspace
+  NSUInteger		scratchSize;	// Size of workspace
+  Class			lastClass;	// Class of last object examined
+  unsigned char		lastKind;	// How instances of lastClass are stored
+  id			root;
 
   // Number of bytes per object table index
   unsigned int index_size;
   // Number of bytes per object table entry
   unsigned int offset_size;
 
-  unsigned int table_start;
-  unsigned int table_size;
-  unsigned int *table;
+  NSUInteger table_start;
 }
 
 + (void) serializePropertyList: (id)aPropertyList
                       intoData: (NSMutableData *)destination;
++ (NSInteger) serializePropertyList: (id)aPropertyList
+			   toStream: (NSOutputStream*)destination
+			      error: (NSError**)e;
 - (id) initWithPropertyList: (id)aPropertyList
                    intoData: (NSMutableData *)destination;
+- (id) initWithPropertyList: (id)aPropertyList
+		   toStream: (NSOutputStream*)destination;
 - (void) generate;
-- (void) storeObject: (id)object;
 - (void) cleanup;
 
 @end
@@ -578,6 +684,15 @@ static const unsigned char whitespace[32] = {
 
 #define GS_IS_WHITESPACE(X) IS_BIT_SET(whitespace[(X)/8], (X) % 8)
 
+/* Word at a time scanning (as in isASCII() in GSString.m).
+ * PL_ZEROS() is non-zero if any byte in the word w is zero, and
+ * PL_BYTES() is non-zero if any byte in w is equal to c.
+ */
+#define	PL_ONES		0x0101010101010101ULL
+#define	PL_HIGHS	0x8080808080808080ULL
+#define	PL_ZEROS(w)	(((w) - PL_ONES) & ~(w) & PL_HIGHS)
+#define	PL_BYTES(w, c)	PL_ZEROS((w) ^ (PL_ONES * (c)))
+
 static NSCharacterSet *oldQuotables = nil;
 static NSCharacterSet *xmlQuotables = nil;
 
@@ -668,24 +783,86 @@ static BOOL skipSpace(pldata *pld)
 	{
 	  pld->lin++;
 	}
+      else if (c == ' ' || c == '\t')
+	{
+	  uint64_t	run = PL_ONES * c;
+
+	  /* Skip indentation a word at a time.
+	   */
+	  while (pld->end - pld->pos > sizeof(run))
+	    {
+	      uint64_t	w;
+
+	      memcpy(&w, pld->ptr + pld->pos + 1, sizeof(w));
+	      if (w != run)
+		{
+		  break;
+		}
+	      pld->pos += sizeof(w);
+	    }
+	}
       pld->pos++;
     }
   pld->err = @"reached end of string";
   return NO;
 }
 
+/* Makes a string from ASCII bytes, stored as eight bit characters.
+ */
+static inline id
+plASCII(pldata *pld, const unsigned char *bytes, unsigned length)
+{
+  if (pld->key == NO && pld->opt == NSPropertyListMutableContainersAndLeaves)
+    {
+      return [[GSMutableString alloc] initWithBytes: bytes
+					     length: length
+					   encoding: NSASCIIStringEncoding];
+    }
+  return [[NSStringClass alloc] initWithBytes: bytes
+				       length: length
+				     encoding: NSASCIIStringEncoding];
+}
+
 static inline id parseQuotedString(pldata* pld)
 {
   unsigned	start = ++pld->pos;
   unsigned	escaped = 0;
   unsigned	shrink = 0;
   BOOL		hex = NO;
+  BOOL		ascii = YES;
   NSString	*obj;
 
   while (pld->pos < pld->end)
     {
-      unsigned char	c = pld->ptr[pld->pos];
+      unsigned char	c;
+
+      if (0 == escaped)
+	{
+	  /* Skip plain text a word at a time, stopping at any word which
+	   * may hold a quote, backslash, newline or non-ASCII character.
+	   */
+	  while (pld->end - pld->pos >= sizeof(uint64_t))
+	    {
+	      uint64_t	w;
 
+	      memcpy(&w, pld->ptr + pld->pos, sizeof(w));
+	      if ((w & PL_HIGHS) || PL_BYTES(w, '"') || PL_BYTES(w, '\\')
+		|| PL_BYTES(w, '\n'))
+		{
+		  break;
+		}
+	      pld->pos += sizeof(w);
+	    }
+	  if (pld->pos >= pld->end)
+	    {
+	      break;
+	    }
+	}
+      c = pld->ptr[pld->pos];
+      if (c & 0x80)
+	{
+	  ascii = NO;
+	}
       if (escaped)
 	{
 	  if (escaped == 1 && c >= '0' && c <= '7')
@@ -754,6 +931,30 @@ static inline id parseQuotedString(pldata* pld)
     {
       obj = @"";
     }
+  else if (0 == shrink && YES == ascii)
+    {
+      obj = plASCII(pld, &pld->ptr[start], pld->pos - start);
+    }
+  else if (0 == shrink)
+    {
+      if (pld->key == NO
+	&& pld->opt == NSPropertyListMutableContainersAndLeaves)
+	{
+	  obj = [GSMutableString alloc];
+	}
+      else
+	{
+	  obj = [NSStringClass alloc];
+	}
+      obj = [obj initWithBytes: &pld->ptr[start]
+			length: pld->pos - start
+		      encoding: NSUTF8StringEncoding];
+      if (nil == obj)
+	{
+	  pld->err = @"invalid utf8 data while parsing quoted string";
+	  return nil;
+	}
+    }
   else
     {
       unsigned	length;
@@ -867,7 +1068,7 @@ static inline id parseQuotedString(pldata* pld)
 	}
       else
 	{
-	  obj = [GSMutableString alloc];
+	  obj = [NSStringClass alloc];
 	  obj = [obj initWithCharactersNoCopy: chars
 				       length: length
 				 freeWhenDone: YES];
@@ -880,10 +1081,6 @@ static inline id parseQuotedString(pldata* pld)
 static inline id parseUnquotedString(pldata *pld)
 {
   unsigned	start = pld->pos;
-  unsigned	i;
-  unsigned	length;
-  id		obj;
-  unichar	*chars;
 
   while (pld->pos < pld->end)
     {
@@ -892,28 +1089,10 @@ static inline id parseUnquotedString(pldata *pld)
       pld->pos++;
     }
 
-  length = pld->pos - start;
-  chars = NSAllocateCollectable(sizeof(unichar) * length, 0);
-  for (i = 0; i < length; i++)
-    {
-      chars[i] = pld->ptr[start + i];
-    }
-
-  if (pld->key == NO && pld->opt == NSPropertyListMutableContainersAndLeaves)
-    {
-      obj = [GSMutableString alloc];
-      obj = [obj initWithCharactersNoCopy: chars
-				   length: length
-			     freeWhenDone: YES];
-    }
-  else
-    {
-      obj = [GSMutableString alloc];
-      obj = [obj initWithCharactersNoCopy: chars
-				   length: length
-			     freeWhenDone: YES];
-    }
-  return obj;
+  /* Non-ASCII characters are all quotable, so there is no need to
+   * widen the characters.
+   */
+  return plASCII(pld, &pld->ptr[start], pld->pos - start);
 }
 
 static id parsePlItem(pldata* pld)
@@ -2536,7 +2715,13 @@ GSPropertyListMake(id obj, NSDictionary *loc, BOOL xml,
   id			result = nil;
   const unsigned char	*bytes = 0;
   unsigned int		length = 0;
+  BOOL			lazy = NO;
 
+  if (anOption & GSPropertyListReadLazily)
+    {
+      anOption &= ~GSPropertyListReadLazily;
+      lazy = YES;
+    }
   if (data == nil)
     {
       errorStr = @"nil data argument passed to method";
@@ -2652,7 +2837,7 @@ GSPropertyListMake(id obj, NSDictionary *loc, BOOL xml,
           {
             GSBinaryPLParser	*p = [GSBinaryPLParser alloc];
             
-            p = [p initWithData: data mutability: anOption];
+            p = [p initWithData: data mutability: anOption lazy: lazy];
             result = [p rootObject];
             RELEASE(p);
           }
@@ -2693,12 +2878,20 @@ GSPropertyListMake(id obj, NSDictionary *loc, BOOL xml,
                         options: (NSPropertyListWriteOptions)anOption
                           error: (out NSError**)error
 {
+  NSData	*data;
+
+  if (aFormat == NSPropertyListBinaryFormat_v1_0)
+    {
+      return [GSBinaryPLGenerator serializePropertyList: aPropertyList
+					       toStream: stream
+						  error: error];
+    }
   // FIXME: The NSData operations should be implemented on top of this method, 
   // not the other way round,
-  NSData *data = [self dataWithPropertyList: aPropertyList
-                                     format: aFormat
-                                    options: 0
-                                      error: error];
+  data = [self dataWithPropertyList: aPropertyList
+                             format: aFormat
+                            options: 0
+                              error: error];
 
   return [stream write: [data bytes] maxLength: [data length]];
 }
@@ -2789,6 +2982,18 @@ GSPropertyListMake(id obj, NSDictionary *loc, BOOL xml,
 
 - (id) initWithData: (NSData*)plData
 	 mutability: (NSPropertyListMutabilityOptions)m
+{
+  return [self initWithData: plData mutability: m lazy: NO];
+}
+
+/* In lazy mode (only possible for immutable results) arrays and
+ * dictionaries are decoded as they are used and data objects refer to
+ * the property list bytes, so the data is copied (which merely retains
+ * it unless it is mutable) to keep those bytes stable.
+ */
+- (id) initWithData: (NSData*)plData
+	 mutability: (NSPropertyListMutabilityOptions)m
+	       lazy: (BOOL)flag
 {
   _length = [plData length];
   if (_length < 32)
@@ -2843,9 +3048,17 @@ GSPropertyListMake(id obj, NSDictionary *loc, BOOL xml,
 	}
       else
 	{
-	  ASSIGN(data, plData);
-	  _bytes = (const unsigned char*)[data bytes];
 	  mutability = m;
+	  lazy = (flag && m == NSPropertyListImmutable) ? YES : NO;
+	  if (YES == lazy)
+	    {
+	      data = [plData copy];
+	    }
+	  else
+	    {
+	      ASSIGN(data, plData);
+	    }
+	  _bytes = (const unsigned char*)[data bytes];
 	}
     }
 
@@ -2951,6 +3164,39 @@ NSAssert(pos + count < _length, NSInvalidArgumentException);
   return [self objectAtIndex: root_index];
 }
 
+- (id) objectAtReference: (unsigned)n from: (unsigned)refs cache: (id*)slot
+{
+  id	o = *slot;
+
+  if (nil == o)
+    {
+      unsigned	pos = refs + n * index_size;
+
+      o = RETAIN([self objectAtIndex: [self readObjectIndexAt: &pos]]);
+      /* Another thread may have decoded the same member meanwhile,
+       * in which case we use its object and discard ours.
+       */
+      if (NO == __sync_bool_compare_and_swap(slot, nil, o))
+	{
+	  RELEASE(o);
+	  o = *slot;
+	}
+    }
+  return o;
+}
+
+/* Checks that a container's object references lie within the data
+ * before any proxy is made for it.
+ */
+- (void) checkReferences: (unsigned)pos count: (unsigned long)c
+{
+  if (c > (_length - pos) / index_size || pos + c * index_size >= _length)
+    {
+      [NSException raise: NSGenericException
+		  format: @"Container larger than supplied data"];
+    }
+}
+
 - (id) objectAtIndex: (NSUInteger)index
 {
   unsigned char	next;
@@ -3024,7 +3270,14 @@ NSAssert(pos + count < _length, NSInvalidArgumentException);
       unsigned len = next - 0x40;
 
 NSAssert(counter + len <= _length, NSInvalidArgumentException);
-      if (mutability == NSPropertyListMutableContainersAndLeaves)
+      if (YES == lazy)
+	{
+	  result = [[GSBinaryPLData alloc] initWithData: data
+						  bytes: _bytes + counter
+						 length: len];
+	  result = AUTORELEASE(result);
+	}
+      else if (mutability == NSPropertyListMutableContainersAndLeaves)
 	{
 	  result = [NSMutableData dataWithBytes: _bytes + counter
 					 length: len];
@@ -3042,7 +3295,14 @@ NSAssert(counter + len <= _length, NSInvalidArgumentException);
 
       len = [self readCountAt: &counter];
 NSAssert(counter + len <= _length, NSInvalidArgumentException);
-      if (mutability == NSPropertyListMutableContainersAndLeaves)
+      if (YES == lazy)
+	{
+	  result = [[GSBinaryPLData alloc] initWithData: data
+						  bytes: _bytes + counter
+						 length: len];
+	  result = AUTORELEASE(result);
+	}
+      else if (mutability == NSPropertyListMutableContainersAndLeaves)
 	{
 	  result = [NSMutableData dataWithBytes: _bytes + counter
 					 length: len];
@@ -3155,6 +3415,14 @@ NSAssert(counter + len <= _length, NSInvalidArgumentException);
       unsigned	i;
       id	objects[len];
 
+      if (YES == lazy)
+	{
+	  [self checkReferences: counter count: len];
+	  result = [[GSBinaryPLArray alloc] initWithParser: self
+						      refs: counter
+						     count: len];
+	  return AUTORELEASE(result);
+	}
       for (i = 0; i < len; i++)
         {
 	  int oid = [self readObjectIndexAt: &counter];
@@ -3180,6 +3448,14 @@ NSAssert(counter + len <= _length, NSInvalidArgumentException);
       id	*objects;
 
       len = [self readCountAt: &counter];
+      if (YES == lazy)
+	{
+	  [self checkReferences: counter count: len];
+	  result = [[GSBinaryPLArray alloc] initWithParser: self
+						      refs: counter
+						     count: len];
+	  return AUTORELEASE(result);
+	}
       objects = NSAllocateCollectable(sizeof(id) * len, NSScannedOption);
 
       for (i = 0; i < len; i++)
@@ -3208,6 +3484,14 @@ NSAssert(counter + len <= _length, NSInvalidArgumentException);
       id	keys[len];
       id	values[len];
 
+      if (YES == lazy)
+	{
+	  [self checkReferences: counter count: len * 2];
+	  result = [[GSBinaryPLDictionary alloc] initWithParser: self
+							   refs: counter
+							  count: len];
+	  return AUTORELEASE(result);
+	}
       for (i = 0; i < len; i++)
         {
 	  int oid = [self readObjectIndexAt: &counter];
@@ -3245,6 +3529,14 @@ NSAssert(counter + len <= _length, NSInvalidArgumentException);
       id	*values;
 
       len = [self readCountAt: &counter];
+      if (YES == lazy)
+	{
+	  [self checkReferences: counter count: len * 2];
+	  result = [[GSBinaryPLDictionary alloc] initWithParser: self
+							   refs: counter
+							  count: len];
+	  return AUTORELEASE(result);
+	}
       keys = NSAllocateCollectable(sizeof(id) * len * 2, NSScannedOption);
       values = keys + len;
       for (i = 0; i < len; i++)
@@ -3287,455 +3579,676 @@ NSAssert(counter + len <= _length, NSInvalidArgumentException);
 
 @end
 
-/* Test two items for equality ... both are objects.
- * If either is an NSNumber, we insist that they are the same class
- * so that numbers with the same numeric value but different classes
- * are not treated as the same number (that confuses OSXs decoding).
- */
-static BOOL
-isEqualFunc(const void *item1, const void *item2,
-  NSUInteger (*size)(const void *item))
+@implementation GSBinaryPLArray
+
+- (NSUInteger) count
 {
-  id	o1 = (id)item1;
-  id	o2 = (id)item2;
+  return count;
+}
 
-  if ([o1 isKindOfClass: [NSNumber class]]
-    || [o2 isKindOfClass: [NSNumber class]])
+- (void) dealloc
+{
+  if (objects != 0)
     {
-      if ([o1 class] != [o2 class])
+      unsigned	i;
+
+      for (i = 0; i < count; i++)
 	{
-	  return NO;
+	  RELEASE(objects[i]);
 	}
+      NSZoneFree(NSDefaultMallocZone(), objects);
     }
-  return [o1 isEqual: o2];
-}
-
-@implementation GSBinaryPLGenerator
-
-+ (void) serializePropertyList: (id)aPropertyList
-		      intoData: (NSMutableData *)destination
-{
-  GSBinaryPLGenerator *gen;
-
-  gen = [[GSBinaryPLGenerator alloc]
-    initWithPropertyList: aPropertyList intoData: destination];
-  [gen generate];
-  RELEASE(gen);
+  RELEASE(parser);
+  [super dealloc];
 }
 
-- (id) initWithPropertyList: (id) aPropertyList
-		   intoData: (NSMutableData *)destination
+- (id) initWithParser: (GSBinaryPLParser*)p
+		 refs: (unsigned)pos
+		count: (unsigned)c
 {
-  ASSIGN(root, aPropertyList);
-  ASSIGN(dest, destination);
-  [dest setLength: 0];
-
+  if ((self = [super init]) != nil)
+    {
+      parser = RETAIN(p);
+      refs = pos;
+      count = c;
+      if (count > 0)
+	{
+	  objects = NSZoneCalloc(NSDefaultMallocZone(), count, sizeof(id));
+	}
+    }
   return self;
 }
 
-- (void) dealloc
+- (id) objectAtIndex: (NSUInteger)index
 {
-  DESTROY(root);
-  [self cleanup];
-  DESTROY(dest);
-  [super dealloc];
+  if (index >= count)
+    {
+      [NSException raise: NSRangeException
+		  format: @"Index %"PRIuPTR" is out of range %u (in '%@')",
+	index, count, NSStringFromSelector(_cmd)];
+    }
+  return [parser objectAtReference: index from: refs cache: &objects[index]];
 }
 
-- (NSData*) data
+@end
+
+@implementation GSBinaryPLDictionary
+
+- (NSUInteger) count
 {
-  return dest;
+  return count;
 }
 
-- (void) setup
+- (void) dealloc
 {
-  NSPointerFunctions	*k;
-  NSPointerFunctions	*v;
-
-  [dest setLength: 0];
-  if (index_size == 1)
-    {
-      table_size = 256;
-    }
-  else if (index_size == 2)
-    {
-      table_size = 256 * 256;
-    }
-  else if (index_size == 3)
+  if (keys != 0)
     {
-      table_size = 256 * 256 * 256;
+      unsigned	i;
+
+      for (i = 0; i < count * 2; i++)
+	{
+	  RELEASE(keys[i]);
+	}
+      NSZoneFree(NSDefaultMallocZone(), keys);
     }
-  else if (index_size == 4)
+  if (positions != 0)
     {
-      table_size = UINT_MAX;
+      NSFreeMapTable(positions);
     }
-
-  table = NSZoneMalloc(0, table_size * sizeof(int));
-
-  objectsToDoList = [[NSMutableArray alloc] init];
-  k = [NSPointerFunctions pointerFunctionsWithOptions:
-    NSPointerFunctionsObjectPersonality];
-  [k setIsEqualFunction: isEqualFunc];
-  v = [NSPointerFunctions pointerFunctionsWithOptions:
-    NSPointerFunctionsIntegerPersonality|NSPointerFunctionsOpaqueMemory];
-  objectList = [[NSMapTable alloc] initWithKeyPointerFunctions: k
-					 valuePointerFunctions: v
-						      capacity: 1000];
-
-  [objectsToDoList addObject: root];
-  [objectList setObject: (id)1 forKey: root];
+  RELEASE(parser);
+  [super dealloc];
 }
 
-- (void) cleanup
+- (id) initWithParser: (GSBinaryPLParser*)p
+		 refs: (unsigned)pos
+		count: (unsigned)c
 {
-  DESTROY(objectsToDoList);
-  DESTROY(objectList);
-  if (table != NULL)
+  if ((self = [super init]) != nil)
     {
-      NSZoneFree(0, table);
-      table = NULL;
+      parser = RETAIN(p);
+      refs = pos;
+      count = c;
+      if (count > 0)
+	{
+	  keys = NSZoneCalloc(NSDefaultMallocZone(), count * 2, sizeof(id));
+	  values = keys + count;
+	}
     }
+  return self;
 }
 
-- (void) writeObjects
+- (NSEnumerator*) keyEnumerator
 {
-  id object;
-  const char *prefix = "bplist00";
-
-  [dest appendBytes: prefix length: strlen(prefix)];
+  unsigned	i;
 
-  while ([objectsToDoList count] != 0)
+  for (i = 0; i < count; i++)
     {
-      object = [objectsToDoList objectAtIndex: 0];
-      [self storeObject: object];
-      [objectsToDoList removeObjectAtIndex: 0];
+      [parser objectAtReference: i from: refs cache: &keys[i]];
     }
+  return [[NSArray arrayWithObjects: keys count: count] objectEnumerator];
 }
 
-- (void) markOffset: (unsigned int) offset for: (id)object
+- (id) objectForKey: (id)aKey
 {
-  int oid;
+  NSUInteger	n;
 
-  oid = (NSInteger)[objectList objectForKey: object];
-  if (oid <= 0)
+  if (nil == aKey || 0 == count)
     {
-      [NSException raise: NSGenericException
-		   format: @"Unknown object %@.", object];
+      return nil;
     }
-  oid--;
-  if (oid >= table_size)
+  if (0 == positions)
     {
-      [NSException raise: NSRangeException
-		   format: @"Object table index out of bounds %d.", oid];
+      NSMapTable	*m;
+      unsigned		i;
+
+      /* Looking a key up needs all the keys, but the values are left
+       * until they are asked for.
+       */
+      m = NSCreateMapTable(NSObjectMapKeyCallBacks,
+	NSIntegerMapValueCallBacks, count);
+      for (i = 0; i < count; i++)
+	{
+	  id	k = [parser objectAtReference: i from: refs cache: &keys[i]];
+
+	  if (0 == NSMapGet(m, k))
+	    {
+	      NSMapInsert(m, k, (void*)(uintptr_t)(i + 1));
+	    }
+	}
+      if (NO == __sync_bool_compare_and_swap(&positions, 0, m))
+	{
+	  NSFreeMapTable(m);
+	}
+    }
+  n = (NSUInteger)(uintptr_t)NSMapGet(positions, aKey);
+  if (0 == n--)
+    {
+      return nil;
     }
+  return [parser objectAtReference: count + n from: refs cache: &values[n]];
+}
+
+@end
+
+@implementation GSBinaryPLData
 
-  table[oid] = offset;
+- (const void*) bytes
+{
+  return start;
 }
 
-- (void) writeObjectTable
+- (void) dealloc
 {
-  unsigned int size;
-  unsigned int len;
-  unsigned int i;
-  unsigned char *buffer;
-  unsigned int last_offset;
+  RELEASE(backing);
+  [super dealloc];
+}
 
-  table_start = [dest length];
-  // This is a bit too much, as the length
-  // of the last object is added.
-  last_offset = table_start;
+/* NB. The NSData designated initialiser is not for use by subclasses
+ * which provide their own storage, so we don't call it.
+ */
+- (id) initWithData: (NSData*)d bytes: (const void*)b length: (NSUInteger)l
+{
+  backing = RETAIN(d);
+  start = b;
+  size = l;
+  return self;
+}
 
-  if (last_offset < 256)
-    {
-      offset_size = 1;
-    }
-  else if (last_offset < 256 * 256)
-    {
-      offset_size = 2;
-    }
-  else if (last_offset < 256 * 256 * 256)
-    {
-      offset_size = 3;
-    }
-  else if (last_offset <= UINT_MAX)
-    {
-      offset_size = 4;
-    }
-  else
-    {
-      [NSException raise: NSRangeException
-	format: @"Object table offset out of bounds %d.", last_offset];
-    }
+- (NSUInteger) length
+{
+  return size;
+}
 
-  len = [objectList count];
-  size = offset_size * len;
+@end
 
-  buffer = NSZoneMalloc(0, size);
+/* The kinds of object stored in a binary property list.
+ */
+enum {
+  PLUnknown = 0,
+  PLString,
+  PLData,
+  PLNumber,
+  PLDate,
+  PLArray,
+  PLDictionary,
+  PLUID		// Dictionary holding a keyed archiver object reference
+};
 
-  if (offset_size == 1)
-    {
-      for (i = 0; i < len; i++)
-        {
-	  unsigned char ci;
+#define	PL_BUFSIZE	65536
 
-	  ci = table[i];
-	  buffer[i] = ci;
-	}
-    }
-  else if (offset_size == 2)
-    {
-      for (i = 0; i < len; i++)
-        {
-	  unsigned short si;
+@implementation GSBinaryPLGenerator
 
-	  si = table[i];
-	  buffer[2 * i] = (si >> 8);
-	  buffer[2 * i + 1] = si % 256;
-	}
-    }
-  else if (offset_size == 3)
-    {
-      for (i = 0; i < len; i++)
-        {
-	  unsigned int si;
++ (void) serializePropertyList: (id)aPropertyList
+		      intoData: (NSMutableData *)destination
+{
+  GSBinaryPLGenerator *gen;
 
-	  si = table[i];
-	  buffer[3 * i] = (si >> 16);
-	  buffer[3 * i + 1] = (si >> 8) % 256;
-	  buffer[3 * i + 2] = si % 256;
-	}
+  gen = [[GSBinaryPLGenerator alloc]
+    initWithPropertyList: aPropertyList intoData: destination];
+  [gen generate];
+  RELEASE(gen);
+}
+
++ (NSInteger) serializePropertyList: (id)aPropertyList
+			   toStream: (NSOutputStream*)destination
+			      error: (NSError**)e
+{
+  GSBinaryPLGenerator	*gen;
+  NSInteger		result;
+
+  gen = [[GSBinaryPLGenerator alloc]
+    initWithPropertyList: aPropertyList toStream: destination];
+  [gen generate];
+  if (nil == gen->error)
+    {
+      result = gen->flushed;
     }
-  else if (offset_size == 4)
+  else
     {
-      for (i = 0; i < len; i++)
-        {
-	  unsigned int si;
-
-	  si = table[i];
-	  buffer[4 * i] = (si >> 24);
-	  buffer[4 * i + 1] = (si >> 16) % 256;
-	  buffer[4 * i + 2] = (si >> 8) % 256;
-	  buffer[4 * i + 3] = si % 256;
+      if (e != 0)
+	{
+	  *e = AUTORELEASE(RETAIN(gen->error));
 	}
+      result = 0;
     }
-
-  [dest appendBytes: buffer length: size];
-  NSZoneFree(0, buffer);
+  RELEASE(gen);
+  return result;
 }
 
-- (void) writeMetaData
+- (id) initWithPropertyList: (id) aPropertyList
+		   intoData: (NSMutableData *)destination
 {
-  unsigned char meta[32];
-  unsigned int i;
-  unsigned int len;
+  ASSIGN(root, aPropertyList);
+  ASSIGN(dest, destination);
+  [dest setLength: 0];
 
-  for (i = 0; i < 32; i++)
-    {
-      meta[i] = 0;
-    }
+  return self;
+}
 
-  meta[6] = offset_size;
-  meta[7] = index_size;
+- (id) initWithPropertyList: (id) aPropertyList
+		   toStream: (NSOutputStream*)destination
+{
+  ASSIGN(root, aPropertyList);
+  ASSIGN(stream, destination);
 
-  len = [objectList count];
-  meta[12] = (len >> 24);
-  meta[13] = (len >> 16) % 256;
-  meta[14] = (len >> 8) % 256;
-  meta[15] = len % 256;
-  // root index is always 0, no need to write it
-  meta[28] = (table_start >> 24);
-  meta[29] = (table_start >> 16) % 256;
-  meta[30] = (table_start >> 8) % 256;
-  meta[31] = table_start % 256;
+  return self;
+}
 
-  [dest appendBytes: meta length: 32];
+- (void) dealloc
+{
+  DESTROY(root);
+  [self cleanup];
+  DESTROY(dest);
+  DESTROY(stream);
+  DESTROY(error);
+  [super dealloc];
 }
 
-- (NSInteger) indexForObject: (id)object
+- (NSData*) data
 {
-  NSInteger index;
+  return dest;
+}
 
-  index = (NSInteger)[objectList objectForKey: object];
-  if (index <= 0)
+- (void) cleanup
+{
+  if (buffer != 0)
     {
-      index = [objectList count];
-      [objectList setObject: (id)(++index) forKey: object];
-      [objectsToDoList addObject: object];
+      GSIMapEmptyMap(&map);
+      GSIMapEmptyMap(&collections);
+      NSZoneFree(NSDefaultMallocZone(), buffer);
+      buffer = 0;
+    }
+  if (objects != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), objects);
+      NSZoneFree(NSDefaultMallocZone(), kinds);
+      objects = 0;
+      kinds = 0;
+    }
+  if (refs != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), refs);
+      refs = 0;
+    }
+  if (offsets != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), offsets);
+      offsets = 0;
+    }
+  if (scratch != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), scratch);
+      scratch = 0;
     }
-
-  return index - 1;
 }
 
-- (void) storeIndex: (NSInteger)index
+/* Returns a scratch buffer of at least the specified size.
+ */
+- (void*) scratch: (NSUInteger)size
 {
-  if (index_size == 1)
+  if (size > scratchSize)
     {
-      unsigned char oid;
+      scratch = NSZoneRealloc(NSDefaultMallocZone(), scratch, size);
+      scratchSize = size;
+    }
+  return scratch;
+}
 
-      oid = index;
-      [dest appendBytes: &oid length: 1];
+/* Sends bytes straight to the destination, bypassing the buffer.
+ */
+- (void) write: (const unsigned char*)bytes length: (NSUInteger)length
+{
+  if (nil != error)
+    {
+      return;	// Output has already failed.
     }
-  else if (index_size == 2)
+  flushed += length;
+  if (nil != dest)
     {
-      unsigned short oid;
-
-      oid = NSSwapHostShortToBig(index);
-      [dest appendBytes: &oid length: 2];
+      [dest appendBytes: bytes length: length];
+      return;
     }
-  else if (index_size == 3)
+  while (length > 0)
     {
-      unsigned char buffer[index_size];
-      int i;
-      unsigned num = index;
+      NSInteger	r = [stream write: bytes maxLength: length];
 
-      for (i = index_size - 1; i >= 0; i--)
-        {
-	  buffer[i] = num & 0xFF;
-          num >>= 8;
+      if (r <= 0)
+	{
+	  ASSIGN(error, [stream streamError]);
+	  if (nil == error)
+	    {
+	      ASSIGN(error, create_error(0, @"failed to write to stream"));
+	    }
+	  return;
 	}
-      [dest appendBytes: buffer length: index_size];
+      bytes += r;
+      length -= r;
     }
-  else if (index_size == 4)
-    {
-      unsigned int oid;
+}
 
-      oid = NSSwapHostIntToBig(index);
-      [dest appendBytes: &oid length: 4];
+- (void) flush
+{
+  if (used > 0)
+    {
+      [self write: buffer length: used];
+      used = 0;
     }
-  else
+}
+
+- (void) appendBytes: (const void*)bytes length: (NSUInteger)length
+{
+  if (used + length > PL_BUFSIZE)
     {
-      [NSException raise: NSGenericException
-		   format: @"Unknown table size %d", index_size];
+      [self flush];
+      if (length > PL_BUFSIZE)
+	{
+	  [self write: bytes length: length];
+	  return;
+	}
     }
+  memcpy(buffer + used, bytes, length);
+  used += length;
 }
 
-- (void) storeCount: (unsigned int)count
+/* Works out how an object is stored.  Dictionaries can only be checked
+ * for keyed archiver references one by one, but otherwise the kind is
+ * decided by the class, and property lists tend to contain many
+ * instances of few classes, so we remember the last class checked.
+ */
+- (unsigned char) kindOf: (id)object
 {
-  unsigned char code;
+  Class		c = object_getClass(object);
+  unsigned char	kind;
 
-  if (count < 256)
+  if (c == lastClass)
     {
-      unsigned char c;
-
-      code = 0x10;
-      [dest appendBytes: &code length: 1];
-      c = count;
-      [dest appendBytes: &c length: 1];
+      kind = lastKind;
     }
-  else if (count < 256 * 256)
+  else
     {
-      unsigned short c;
-
-      code = 0x11;
-      [dest appendBytes: &code length: 1];
-      c = count;
-      c = NSSwapHostShortToBig(c);
-      [dest appendBytes: &c length: 2];
+      if ([object isKindOfClass: NSStringClass])
+	{
+	  kind = PLString;
+	}
+      else if ([object isKindOfClass: NSDataClass])
+	{
+	  kind = PLData;
+	}
+      else if ([object isKindOfClass: NSNumberClass])
+	{
+	  kind = PLNumber;
+	}
+      else if ([object isKindOfClass: NSDateClass])
+	{
+	  kind = PLDate;
+	}
+      else if ([object isKindOfClass: NSArrayClass])
+	{
+	  kind = PLArray;
+	}
+      else if ([object isKindOfClass: NSDictionaryClass])
+	{
+	  kind = PLDictionary;
+	}
+      else
+	{
+	  kind = PLUnknown;
+	}
+      lastClass = c;
+      lastKind = kind;
     }
-  else
+  if (PLDictionary == kind && [object objectForKey: @"CF$UID"] != nil)
     {
-      code = 0x13;
-      [dest appendBytes: &code length: 1];
-      count = NSSwapHostIntToBig(count);
-      [dest appendBytes: &count length: 4];
+      kind = PLUID;
     }
+  return kind;
 }
 
-- (void) storeData: (NSData*) data
+/* Returns the number of an object in the object table, adding it to
+ * the table if it is not there already.  Strings, numbers, dates and
+ * data are shared by value, collections only if they are identical
+ * (comparing collections is expensive and they rarely repeat), so
+ * collections are kept in a table of their own keyed by address.
+ */
+- (NSUInteger) numberForObject: (id)object
 {
-  unsigned int len;
-  unsigned char code;
-
-  len = [data length];
+  unsigned char	kind = [self kindOf: object];
+  GSIMapTable	table;
+  GSIMapKey	key;
+  GSIMapNode	node;
 
-  if (len < 0x0F)
+  if (PLArray == kind || PLDictionary == kind)
     {
-      code = 0x40 + len;
-      [dest appendBytes: &code length: 1];
-      [dest appendData: data];
+      table = &collections;
     }
   else
     {
-      code = 0x4F;
-      [dest appendBytes: &code length: 1];
-      [self storeCount: len];
-      [dest appendData: data];
+      table = &map;
+    }
+  key.obj = object;
+  node = GSIMapNodeForKey(table, key);
+  if (0 != node)
+    {
+      return node->value.nsu - 1;
+    }
+  if (count == capacity)
+    {
+      capacity = capacity * 2 + 1024;
+      objects = NSZoneRealloc(NSDefaultMallocZone(), objects,
+	capacity * sizeof(id));
+      kinds = NSZoneRealloc(NSDefaultMallocZone(), kinds, capacity);
     }
+  objects[count] = object;
+  kinds[count] = kind;
+  GSIMapAddPair(table, key, (GSIMapVal)(NSUInteger)++count);
+  return count - 1;
 }
 
-- (void) storeString: (NSString*) string
+- (void) addReference: (NSUInteger)number
+{
+  if (refCount == refCapacity)
+    {
+      refCapacity = refCapacity * 2 + 1024;
+      refs = NSZoneRealloc(NSDefaultMallocZone(), refs,
+	refCapacity * sizeof(unsigned));
+    }
+  refs[refCount++] = number;
+}
+
+/* Numbers every object in the property list (breadth first, starting
+ * with the root) and records the numbers of the members of each
+ * collection in the order in which the collections will be written,
+ * so that the property list is only traversed once.
+ */
+- (void) flatten
 {
-  unsigned int len;
-  NSData        *ascii;
-  unsigned char code;
+  NSUInteger	i;
+
+  [self numberForObject: root];
+  for (i = 0; i < count; i++)
+    {
+      id	object = objects[i];
+      NSUInteger	n;
+      NSUInteger	j;
+      id	*items;
+
+      switch (kinds[i])
+	{
+	  case PLArray:
+	    n = [object count];
+	    items = [self scratch: n * sizeof(id)];
+	    [object getObjects: items];
+	    for (j = 0; j < n; j++)
+	      {
+		[self addReference: [self numberForObject: items[j]]];
+	      }
+	    break;
+
+	  case PLDictionary:
+	    n = [object count];
+	    items = [self scratch: n * 2 * sizeof(id)];
+	    [object getObjects: items + n andKeys: items];
+	    for (j = 0; j < n * 2; j++)
+	      {
+		[self addReference: [self numberForObject: items[j]]];
+	      }
+	    break;
+
+	  case PLUnknown:
+	    NSLog(@"Unknown object class %@", object);
+	    break;
+	}
+    }
+}
 
-  len = [string length];
+/* Writes the marker byte for an object whose length (count) is
+ * encoded in the low bits, or follows as an integer if it is large.
+ */
+- (void) storeCode: (unsigned char)code count: (NSUInteger)len
+{
+  unsigned char	b[6];
 
-  ascii = [string dataUsingEncoding: NSASCIIStringEncoding
-               allowLossyConversion: NO];
-  if (ascii)
+  if (len < 0x0F)
     {
-      if (len < 0x0F)
+      b[0] = code + len;
+      [self appendBytes: b length: 1];
+    }
+  else
+    {
+      b[0] = code + 0x0F;
+      if (len < 256)
 	{
-	  code = 0x50 + len;
-	  [dest appendBytes: &code length: 1];
-	  [dest appendData: ascii];
+	  b[1] = 0x10;
+	  b[2] = len;
+	  [self appendBytes: b length: 3];
+	}
+      else if (len < 256 * 256)
+	{
+	  b[1] = 0x11;
+	  b[2] = len >> 8;
+	  b[3] = len;
+	  [self appendBytes: b length: 4];
 	}
       else
 	{
-	  code = 0x5F;
-	  [dest appendBytes: &code length: 1];
-	  [self storeCount: len];
-	  [dest appendData: ascii];
+	  b[1] = 0x13;	// NB. four bytes, as the parser expects
+	  b[2] = len >> 24;
+	  b[3] = len >> 16;
+	  b[4] = len >> 8;
+	  b[5] = len;
+	  [self appendBytes: b length: 6];
 	}
     }
-  else
+}
+
+/* Writes the object numbers of the next n collection members.
+ */
+- (void) storeReferences: (NSUInteger)n
+{
+  unsigned	*r = refs + refPos;
+  unsigned	*end = r + n;
+
+  while (r < end)
     {
-      NSUInteger        offset;
-      unichar           *buffer;
+      unsigned	oid = *r++;
 
-      if (len < 0x0F)
+      if (used + index_size > PL_BUFSIZE)
 	{
-	  code = 0x60 + len;
-	  [dest appendBytes: &code length: 1];
+	  [self flush];
 	}
-      else
-        {
-	  code = 0x6F;
-	  [dest appendBytes: &code length: 1];
-	  [self storeCount: len];
+      switch (index_size)
+	{
+	  case 4: buffer[used++] = oid >> 24;
+	  case 3: buffer[used++] = oid >> 16;
+	  case 2: buffer[used++] = oid >> 8;
+	  case 1: buffer[used++] = oid;
 	}
+    }
+  refPos += n;
+}
 
-      offset = [dest length];
-      [dest setLength: offset + sizeof(unichar)*len];
-      buffer = [dest mutableBytes] + offset;
-      [string getCharacters: buffer];
+- (void) storeData: (NSData*) data
+{
+  NSUInteger	len = [data length];
 
-#if     !GS_WORDS_BIGENDIAN
-      /* Always store in big-endian, so if machine is little-endian,
-       * perform byte-swapping.
-       */
-      {
-        uint8_t *o = (uint8_t*)buffer;
-	int     i;
+  [self storeCode: 0x40 count: len];
+  [self appendBytes: [data bytes] length: len];
+}
 
-	for (i = 0; i < len; i++)
-	  {
-	    uint8_t c = *o++;
+/* Strings are written as ASCII if possible, otherwise as big-endian
+ * UTF-16, copying characters straight into the output buffer.
+ */
+- (void) storeString: (NSString*) string
+{
+  NSUInteger	len = [string length];
+  unichar	*chars = [self scratch: len * sizeof(unichar)];
+  NSUInteger	i;
+  BOOL		ascii = YES;
 
-	    o[-1] = *o;
-            *o++ = c;
-	  }
-      }
-#endif
+  [string getCharacters: chars range: NSMakeRange(0, len)];
+  for (i = 0; i < len; i++)
+    {
+      if (chars[i] > 0x7f)
+	{
+	  ascii = NO;
+	  break;
+	}
+    }
+  if (YES == ascii)
+    {
+      [self storeCode: 0x50 count: len];
+      i = 0;
+      while (i < len)
+	{
+	  NSUInteger	n;
+
+	  if (used == PL_BUFSIZE)
+	    {
+	      [self flush];
+	    }
+	  n = PL_BUFSIZE - used;
+	  if (n > len - i)
+	    {
+	      n = len - i;
+	    }
+	  while (n-- > 0)
+	    {
+	      buffer[used++] = (unsigned char)chars[i++];
+	    }
+	}
+    }
+  else
+    {
+      [self storeCode: 0x60 count: len];
+      i = 0;
+      while (i < len)
+	{
+	  NSUInteger	n;
+
+	  if (used + 2 > PL_BUFSIZE)
+	    {
+	      [self flush];
+	    }
+	  n = (PL_BUFSIZE - used) / 2;
+	  if (n > len - i)
+	    {
+	      n = len - i;
+	    }
+	  while (n-- > 0)
+	    {
+	      unichar	c = chars[i++];
+
+	      buffer[used++] = c >> 8;
+	      buffer[used++] = c;
+	    }
+	}
     }
 }
 
 - (void) storeNumber: (NSNumber*) number
 {
-  const char *type;
-  unsigned char code;
-
-  type = [number objCType];
+  const char	*type = [number objCType];
+  unsigned char	b[9];
 
   switch (*type)
     {
@@ -3757,49 +4270,47 @@ isEqualFunc(const void *item1, const void *item2,
 	  // FIXME: We need a better way to determine boolean values!
 	  if ((val == 0) && ((*type == 'c') || (*type == 'C')))
 	    {
-	      code = 0x08;
-	      [dest appendBytes: &code length: 1];
+	      b[0] = 0x08;
+	      [self appendBytes: b length: 1];
 	    }
 	  else if ((val == 1) && ((*type == 'c') || (*type == 'C')))
 	    {
-	      code = 0x09;
-	      [dest appendBytes: &code length: 1];
+	      b[0] = 0x09;
+	      [self appendBytes: b length: 1];
 	    }
 	  else if (val < 256)
 	    {
-	      unsigned char cval;
-
-	      code = 0x10;
-	      [dest appendBytes: &code length: 1];
-	      cval = (unsigned char) val;
-	      [dest appendBytes: &cval length: 1];
+	      b[0] = 0x10;
+	      b[1] = val;
+	      [self appendBytes: b length: 2];
 	    }
 	  else if (val < 256 * 256)
 	    {
-	      unsigned short sval;
-
-	      code = 0x11;
-	      [dest appendBytes: &code length: 1];
-	      sval = NSSwapHostShortToBig([number unsignedShortValue]);
-	      [dest appendBytes: &sval length: 2];
+	      b[0] = 0x11;
+	      b[1] = val >> 8;
+	      b[2] = val;
+	      [self appendBytes: b length: 3];
 	    }
 	  else if (val <= UINT_MAX)
 	    {
-	      unsigned int ival;
-
-	      code = 0x12;
-	      [dest appendBytes: &code length: 1];
-	      ival = NSSwapHostIntToBig([number unsignedIntValue]);
-	      [dest appendBytes: &ival length: 4];
+	      b[0] = 0x12;
+	      b[1] = val >> 24;
+	      b[2] = val >> 16;
+	      b[3] = val >> 8;
+	      b[4] = val;
+	      [self appendBytes: b length: 5];
 	    }
 	  else
 	    {
-	      unsigned long long lval;
+	      int	i;
 
-	      code = 0x13;
-	      [dest appendBytes: &code length: 1];
-	      lval = NSSwapHostLongLongToBig([number unsignedLongLongValue]);
-	      [dest appendBytes: &lval length: 8];
+	      b[0] = 0x13;
+	      for (i = 8; i > 0; i--)
+		{
+		  b[i] = val;
+		  val >>= 8;
+		}
+	      [self appendBytes: b length: 9];
 	    }
 	  break;
 	}
@@ -3807,18 +4318,18 @@ isEqualFunc(const void *item1, const void *item2,
         {
 	  NSSwappedFloat val = NSSwapHostFloatToBig([number floatValue]);
 
-	  code = 0x22;
-	  [dest appendBytes: &code length: 1];
-	  [dest appendBytes: &val length: sizeof(float)];
+	  b[0] = 0x22;
+	  memcpy(b + 1, &val, sizeof(float));
+	  [self appendBytes: b length: 1 + sizeof(float)];
 	  break;
 	}
       case 'd':
         {
 	  NSSwappedDouble val = NSSwapHostDoubleToBig([number doubleValue]);
 
-	  code = 0x23;
-	  [dest appendBytes: &code length: 1];
-	  [dest appendBytes: &val length: sizeof(double)];
+	  b[0] = 0x23;
+	  memcpy(b + 1, &val, sizeof(double));
+	  [self appendBytes: b length: 1 + sizeof(double)];
 	  break;
 	}
       default:
@@ -3829,183 +4340,188 @@ isEqualFunc(const void *item1, const void *item2,
 
 - (void) storeDate: (NSDate*) date
 {
-  unsigned char code;
-  NSSwappedDouble out;
+  unsigned char		b[9];
+  NSSwappedDouble	out;
 
-  code = 0x33;
-  [dest appendBytes: &code length: 1];
+  b[0] = 0x33;
   out = NSSwapHostDoubleToBig([date timeIntervalSinceReferenceDate]);
-  [dest appendBytes: &out length: sizeof(double)];
+  memcpy(b + 1, &out, sizeof(double));
+  [self appendBytes: b length: 9];
 }
 
-- (void) storeArray: (NSArray*) array
+- (void) storeUID: (NSDictionary*) dict
 {
-  unsigned char code;
-  unsigned int len;
-  unsigned int i;
-
-  len = [array count];
+  unsigned int	index = [[dict objectForKey: @"CF$UID"] intValue];
+  unsigned char	b[3];
 
-  if (len < 0x0F)
+  // Special dictionary from keyed encoding
+  if (index < 256)
     {
-      code = 0xA0 + len;
-      [dest appendBytes: &code length: 1];
+      b[0] = 0x80;
+      b[1] = index;
+      [self appendBytes: b length: 2];
     }
   else
     {
-      code = 0xAF;
-      [dest appendBytes: &code length: 1];
-      [self storeCount: len];
-    }
-
-  for (i = 0; i < len; i++)
-    {
-      id obj;
-      NSInteger oid;
-
-      obj = [array objectAtIndex: i];
-      oid = [self indexForObject: obj];
-      [self storeIndex: oid];
+      b[0] = 0x81;
+      b[1] = index >> 8;
+      b[2] = index;
+      [self appendBytes: b length: 3];
     }
 }
 
-- (void) storeDictionary: (NSDictionary*) dict
+- (void) writeObjects
 {
-  unsigned char code;
-  NSNumber *num;
-  unsigned int i;
+  NSUInteger	i;
 
-  num = [dict objectForKey: @"CF$UID"];
-  if (num != nil)
-    {
-      // Special dictionary from keyed encoding
-      unsigned int index;
-
-      index = [num intValue];
-      if (index < 256)
-        {
-	  unsigned char ci;
-
-	  code = 0x80;
-	  [dest appendBytes: &code length: 1];
-	  ci = (unsigned char)index;
-	  [dest appendBytes: &ci length: 1];
-	}
-      else
-        {
-	  unsigned short si;
-
-	  code = 0x81;
-	  [dest appendBytes: &code length: 1];
-	  si = NSSwapHostShortToBig((unsigned short)index);
-	  [dest appendBytes: &si length: 2];
-	}
-    }
-  else
+  [self appendBytes: "bplist00" length: 8];
+  offsets = NSZoneMalloc(NSDefaultMallocZone(), count * sizeof(NSUInteger));
+  for (i = 0; i < count; i++)
     {
-      unsigned int len = [dict count];
-      NSArray *keys = [dict allKeys];
-      NSMutableArray *objects = [NSMutableArray arrayWithCapacity: len];
-      id key;
-
-      for (i = 0; i < len; i++)
-        {
-	  key = [keys objectAtIndex: i];
-	  [objects addObject: [dict objectForKey: key]];
-	}
-
-      if (len < 0x0F)
-        {
-	  code = 0xD0 + len;
-	  [dest appendBytes: &code length: 1];
-	}
-      else
-        {
-	  code = 0xDF;
-	  [dest appendBytes: &code length: 1];
-	  [self storeCount: len];
-	}
-
-      for (i = 0; i < len; i++)
-        {
-	  id obj;
-	  NSInteger oid;
-
-	  obj = [keys objectAtIndex: i];
-	  oid = [self indexForObject: obj];
-	  [self storeIndex: oid];
-	}
-
-      for (i = 0; i < len; i++)
-        {
-	  id obj;
-	  NSInteger oid;
+      id	object = objects[i];
+      NSUInteger	n;
 
-	  obj = [objects objectAtIndex: i];
-	  oid = [self indexForObject: obj];
-	  [self storeIndex: oid];
+      offsets[i] = flushed + used;
+      switch (kinds[i])
+	{
+	  case PLString:
+	    [self storeString: object];
+	    break;
+	  case PLData:
+	    [self storeData: object];
+	    break;
+	  case PLNumber:
+	    [self storeNumber: object];
+	    break;
+	  case PLDate:
+	    [self storeDate: object];
+	    break;
+	  case PLArray:
+	    n = [object count];
+	    [self storeCode: 0xA0 count: n];
+	    [self storeReferences: n];
+	    break;
+	  case PLDictionary:
+	    n = [object count];
+	    [self storeCode: 0xD0 count: n];
+	    [self storeReferences: n * 2];
+	    break;
+	  case PLUID:
+	    [self storeUID: object];
+	    break;
 	}
     }
 }
 
-- (void) storeObject: (id)object
+- (void) writeObjectTable
 {
-  [self markOffset: [dest length] for: object];
+  NSUInteger	i;
 
-  if ([object isKindOfClass: NSStringClass])
+  table_start = flushed + used;
+  if (table_start < 256)
     {
-      [self storeString: object];
+      offset_size = 1;
     }
-  else if ([object isKindOfClass: NSDataClass])
+  else if (table_start < 256 * 256)
     {
-      [self storeData: object];
+      offset_size = 2;
     }
-  else if ([object isKindOfClass: NSNumberClass])
+  else if (table_start < 256 * 256 * 256)
     {
-      [self storeNumber: object];
+      offset_size = 3;
     }
-  else if ([object isKindOfClass: NSDateClass])
+  else if (table_start <= UINT_MAX)
     {
-      [self storeDate: object];
+      offset_size = 4;
     }
-  else if ([object isKindOfClass: NSArrayClass])
+  else
     {
-      [self storeArray: object];
+      [NSException raise: NSRangeException
+	format: @"Object table offset out of bounds %"PRIuPTR".", table_start];
     }
-  else if ([object isKindOfClass: NSDictionaryClass])
+
+  for (i = 0; i < count; i++)
     {
-      [self storeDictionary: object];
+      NSUInteger	offset = offsets[i];
+
+      if (used + offset_size > PL_BUFSIZE)
+	{
+	  [self flush];
+	}
+      switch (offset_size)
+	{
+	  case 4: buffer[used++] = offset >> 24;
+	  case 3: buffer[used++] = offset >> 16;
+	  case 2: buffer[used++] = offset >> 8;
+	  case 1: buffer[used++] = offset;
+	}
     }
-  else
+}
+
+- (void) writeMetaData
+{
+  unsigned char meta[32];
+  int		i;
+
+  memset(meta, 0, sizeof(meta));
+  meta[6] = offset_size;
+  meta[7] = index_size;
+  // root index is always 0, no need to write it
+  for (i = 0; i < 4; i++)
     {
-      NSLog(@"Unknown object class %@", object);
+      meta[15 - i] = count >> (8 * i);
+      meta[31 - i] = table_start >> (8 * i);
     }
+  [self appendBytes: meta length: 32];
 }
 
 - (void) generate
 {
-  BOOL done = NO;
-
-  index_size = 1;
+  GSIMapInitWithZoneAndCapacity(&map, NSDefaultMallocZone(), 1024);
+  map.extra = NO;
+  GSIMapInitWithZoneAndCapacity(&collections, NSDefaultMallocZone(), 256);
+  collections.extra = YES;
+  buffer = NSZoneMalloc(NSDefaultMallocZone(), PL_BUFSIZE);
+  used = 0;
 
-  while (!done && (index_size <= 4))
+  NS_DURING
     {
-      NS_DURING
+      [self flatten];
+
+      /* With every object numbered, we know how many bytes an object
+       * reference needs before writing anything.
+       */
+      if (count <= 256)
 	{
-	  [self setup];
-	  [self writeObjects];
-	  done = YES;
+	  index_size = 1;
 	}
-      NS_HANDLER
+      else if (count <= 256 * 256)
 	{
-	  [self cleanup];
-	  index_size += 1;
+	  index_size = 2;
 	}
-      NS_ENDHANDLER
-    }
+      else if (count <= 256 * 256 * 256)
+	{
+	  index_size = 3;
+	}
+      else
+	{
+	  index_size = 4;
+	}
+      GSIMapEmptyMap(&map);
+      GSIMapEmptyMap(&collections);
 
-  [self writeObjectTable];
-  [self writeMetaData];
+      [self writeObjects];
+      [self writeObjectTable];
+      [self writeMetaData];
+      [self flush];
+    }
+  NS_HANDLER
+    {
+      [self cleanup];
+      [localException raise];
+    }
+  NS_ENDHANDLER
+  [self cleanup];
 }
 
 @end
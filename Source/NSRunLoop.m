@@ -140,17 +140,37 @@ static NSDate	*theFuture = nil;
 
 
 
+/*
+ * Timed performers are kept in a map keyed on the target, with each
+ * value being an array of the performers for that target.  This lets
+ * us cancel the performers for a target without examining all of the
+ * performers set up in the loop.
+ */
 @interface NSRunLoop (TimedPerformers)
-- (NSMutableArray*) _timedPerformers;
+- (NSMapTable*) _timedPerformers;
 @end
 
 @implementation	NSRunLoop (TimedPerformers)
-- (NSMutableArray*) _timedPerformers
+- (NSMapTable*) _timedPerformers
 {
   return _timedPerformers;
 }
 @end
 
+static void
+addTimedPerformer(NSMapTable *perf, id target, id item)
+{
+  NSMutableArray	*a = (NSMutableArray*)NSMapGet(perf, (void*)target);
+
+  if (a == nil)
+    {
+      a = [[NSMutableArray alloc] initWithCapacity: 1];
+      NSMapInsert(perf, (void*)target, (void*)a);
+      RELEASE(a);
+    }
+  [a addObject: item];
+}
+
 /*
  * The GSTimedPerformer class is used to hold information about
  * messages which are due to be sent to objects at a particular time.
@@ -185,10 +205,27 @@ static NSDate	*theFuture = nil;
 
 - (void) fire
 {
+  NSMapTable		*perf;
+  NSMutableArray	*a;
+
   DESTROY(timer);
   [target performSelector: selector withObject: argument];
-  [[[NSRunLoop currentRunLoop] _timedPerformers]
-    removeObjectIdenticalTo: self];
+  perf = [[NSRunLoop currentRunLoop] _timedPerformers];
+  a = (NSMutableArray*)NSMapGet(perf, (void*)target);
+  if (a != nil)
+    {
+      if ([a count] == 1 && [a objectAtIndex: 0] == self)
+	{
+	  /* Removing the map entry will release us, so we must not
+	   * access our instance variables after this.
+	   */
+	  NSMapRemove(perf, (void*)target);
+	}
+      else
+	{
+	  [a removeObjectIdenticalTo: self];
+	}
+    }
 }
 
 - (void) finalize
@@ -258,6 +295,210 @@ static inline BOOL timerInvalidated(NSTimer *t)
   return t->_invalidated;
 }
 
+/*
+ * Functions to maintain the heap of timers in a run loop context.
+ * The heap is a binary min-heap ordered by fire date, so that adding a
+ * timer and finding/removing the earliest one are O(log n) operations
+ * rather than requiring a scan of all the timers in the mode.
+ */
+static inline BOOL
+timerBefore(GSRunLoopTimer *a, GSRunLoopTimer *b)
+{
+  if (a->when < b->when)
+    {
+      return YES;
+    }
+  if (a->when > b->when)
+    {
+      return NO;
+    }
+  return (a->seq < b->seq) ? YES : NO;
+}
+
+static void
+timerSiftUp(GSRunLoopTimer *heap, unsigned i)
+{
+  GSRunLoopTimer	e = heap[i];
+
+  while (i > 0)
+    {
+      unsigned	parent = (i - 1) / 2;
+
+      if (timerBefore(&e, &heap[parent]) == NO)
+	{
+	  break;
+	}
+      heap[i] = heap[parent];
+      i = parent;
+    }
+  heap[i] = e;
+}
+
+static void
+timerSiftDown(GSRunLoopTimer *heap, unsigned count, unsigned i)
+{
+  GSRunLoopTimer	e = heap[i];
+
+  for (;;)
+    {
+      unsigned	child = 2 * i + 1;
+
+      if (child >= count)
+	{
+	  break;
+	}
+      if (child + 1 < count && timerBefore(&heap[child + 1], &heap[child]))
+	{
+	  child++;
+	}
+      if (timerBefore(&heap[child], &e) == NO)
+	{
+	  break;
+	}
+      heap[i] = heap[child];
+      i = child;
+    }
+  heap[i] = e;
+}
+
+/* Add a timer to the heap.  The heap takes ownership of the reference
+ * the caller holds to the timer.
+ */
+static void
+timerPush(GSRunLoopCtxt *context, NSTimer *t)
+{
+  GSRunLoopTimer	*e;
+
+  if (context->timerCount == context->timerCapacity)
+    {
+      unsigned	c = (context->timerCapacity == 0)
+	? 8 : context->timerCapacity * 2;
+
+#if	GS_WITH_GC
+      if (context->timers == 0)
+	{
+	  context->timers = NSAllocateCollectable(c * sizeof(GSRunLoopTimer),
+	    NSScannedOption);
+	}
+      else
+	{
+	  context->timers = NSReallocateCollectable(context->timers,
+	    c * sizeof(GSRunLoopTimer), NSScannedOption);
+	}
+#else
+      if (context->timers == 0)
+	{
+	  context->timers = NSZoneMalloc(NSDefaultMallocZone(),
+	    c * sizeof(GSRunLoopTimer));
+	}
+      else
+	{
+	  context->timers = NSZoneRealloc(NSDefaultMallocZone(),
+	    context->timers, c * sizeof(GSRunLoopTimer));
+	}
+#endif
+      context->timerCapacity = c;
+    }
+  e = &context->timers[context->timerCount];
+  e->when = [timerDate(t) timeIntervalSinceReferenceDate];
+  e->seq = context->timerSeq++;
+  e->timer = t;
+  timerSiftUp(context->timers, context->timerCount++);
+}
+
+/* Remove the first timer from the heap.  The caller takes ownership of
+ * the reference the heap held.
+ */
+static NSTimer *
+timerPop(GSRunLoopCtxt *context)
+{
+  NSTimer	*t = context->timers[0].timer;
+
+  if (--context->timerCount > 0)
+    {
+      context->timers[0] = context->timers[context->timerCount];
+      timerSiftDown(context->timers, context->timerCount, 0);
+    }
+  return t;
+}
+
+/* Discard a timer which has been removed from the heap.
+ */
+static void
+timerDiscard(GSRunLoopCtxt *context, NSTimer *t)
+{
+  NSHashRemove(context->timerSet, t);
+  RELEASE(t);
+}
+
+/* Return the valid timer with the earliest fire date, removing any
+ * invalidated timers and correcting stale fire dates found at the top
+ * of the heap on the way.
+ */
+static NSTimer *
+timerFirst(GSRunLoopCtxt *context)
+{
+  while (context->timerCount > 0)
+    {
+      GSRunLoopTimer	*e = &context->timers[0];
+      NSTimeInterval	ti;
+
+      if (timerInvalidated(e->timer) == YES)
+	{
+	  timerDiscard(context, timerPop(context));
+	  continue;
+	}
+      ti = [timerDate(e->timer) timeIntervalSinceReferenceDate];
+      if (ti != e->when)
+	{
+	  e->when = ti;
+	  timerSiftDown(context->timers, context->timerCount, 0);
+	  continue;
+	}
+      return e->timer;
+    }
+  return nil;
+}
+
+/* Rebuild the heap from scratch, removing invalidated timers and using
+ * the current fire dates.  This is needed when the fire date of a timer
+ * has been moved earlier (the heap assumes dates only advance), and is
+ * also done periodically so that timers which were invalidated long
+ * before their fire dates do not accumulate.
+ */
+static void
+timerRebuild(GSRunLoopCtxt *context)
+{
+  GSRunLoopTimer	*heap = context->timers;
+  unsigned		count = context->timerCount;
+  unsigned		kept = 0;
+  unsigned		i;
+
+  for (i = 0; i < count; i++)
+    {
+      NSTimer	*t = heap[i].timer;
+
+      if (timerInvalidated(t) == YES)
+	{
+	  timerDiscard(context, t);
+	}
+      else
+	{
+	  heap[kept] = heap[i];
+	  heap[kept].when = [timerDate(t) timeIntervalSinceReferenceDate];
+	  kept++;
+	}
+    }
+  context->timerCount = kept;
+  i = kept / 2;
+  while (i-- > 0)
+    {
+      timerSiftDown(heap, kept, i);
+    }
+  context->timerEpoch = GSPrivateTimerEpoch();
+  context->timerSwept = context->timerSeq;
+}
+
 
 
 @implementation NSObject (TimedPerformers)
@@ -268,25 +509,23 @@ static inline BOOL timerInvalidated(NSTimer *t)
  */
 + (void) cancelPreviousPerformRequestsWithTarget: (id)target
 {
-  NSMutableArray	*perf = [[NSRunLoop currentRunLoop] _timedPerformers];
-  unsigned		count = [perf count];
+  NSMapTable		*perf = [[NSRunLoop currentRunLoop] _timedPerformers];
+  NSMutableArray	*a = (NSMutableArray*)NSMapGet(perf, (void*)target);
 
-  if (count > 0)
+  if (a != nil)
     {
-      GSTimedPerformer	*array[count];
+      unsigned		count = [a count];
 
       IF_NO_GC(RETAIN(target));
-      [perf getObjects: array];
+      IF_NO_GC(RETAIN(a));
+      NSMapRemove(perf, (void*)target);
       while (count-- > 0)
 	{
-	  GSTimedPerformer	*p = array[count];
+	  GSTimedPerformer	*p = [a objectAtIndex: count];
 
-	  if (p->target == target)
-	    {
-	      [p invalidate];
-	      [perf removeObjectAtIndex: count];
-	    }
+	  [p invalidate];
 	}
+      RELEASE(a);
       RELEASE(target);
     }
 }
@@ -302,27 +541,32 @@ static inline BOOL timerInvalidated(NSTimer *t)
 					selector: (SEL)aSelector
 					  object: (id)arg
 {
-  NSMutableArray	*perf = [[NSRunLoop currentRunLoop] _timedPerformers];
-  unsigned		count = [perf count];
+  NSMapTable		*perf = [[NSRunLoop currentRunLoop] _timedPerformers];
+  NSMutableArray	*a = (NSMutableArray*)NSMapGet(perf, (void*)target);
 
-  if (count > 0)
+  if (a != nil)
     {
-      GSTimedPerformer	*array[count];
+      unsigned		count = [a count];
 
       IF_NO_GC(RETAIN(target));
       IF_NO_GC(RETAIN(arg));
-      [perf getObjects: array];
+      IF_NO_GC(RETAIN(a));
       while (count-- > 0)
 	{
-	  GSTimedPerformer	*p = array[count];
+	  GSTimedPerformer	*p = [a objectAtIndex: count];
 
-	  if (p->target == target && sel_isEqual(p->selector, aSelector)
+	  if (sel_isEqual(p->selector, aSelector)
 	    && (p->argument == arg || [p->argument isEqual: arg]))
 	    {
 	      [p invalidate];
-	      [perf removeObjectAtIndex: count];
+	      [a removeObjectAtIndex: count];
 	    }
 	}
+      if ([a count] == 0)
+	{
+	  NSMapRemove(perf, (void*)target);
+	}
+      RELEASE(a);
       RELEASE(arg);
       RELEASE(target);
     }
@@ -339,7 +583,7 @@ static inline BOOL timerInvalidated(NSTimer *t)
 					     target: self
 					   argument: argument
 					      delay: seconds];
-  [[loop _timedPerformers] addObject: item];
+  addTimedPerformer([loop _timedPerformers], self, item);
   RELEASE(item);
   [loop addTimer: item->timer forMode: NSDefaultRunLoopMode];
 }
@@ -362,7 +606,7 @@ static inline BOOL timerInvalidated(NSTimer *t)
 						 target: self
 					       argument: argument
 						  delay: seconds];
-      [[loop _timedPerformers] addObject: item];
+      addTimedPerformer([loop _timedPerformers], self, item);
       RELEASE(item);
       if ([modes isProxy])
 	{
@@ -419,6 +663,13 @@ static inline BOOL timerInvalidated(NSTimer *t)
       RELEASE(context);
     }
   watchers = context->watchers;
+#ifdef	HAVE_EPOLL
+  if (item->type == ET_RDESC || item->type == ET_WDESC
+    || item->type == ET_EDESC)
+    {
+      [context forgetDescriptor: (int)(intptr_t)item->data];
+    }
+#endif
   GSIArrayAddItem(watchers, (GSIArrayItem)((id)item));
   i = GSIArrayCount(watchers);
   if (i % 1000 == 0 && i > context->maxWatchers)
@@ -545,7 +796,8 @@ static inline BOOL timerInvalidated(NSTimer *t)
       _contextStack = [NSMutableArray new];
       _contextMap = NSCreateMapTable (NSNonRetainedObjectMapKeyCallBacks,
 					 NSObjectMapValueCallBacks, 0);
-      _timedPerformers = [[NSMutableArray alloc] initWithCapacity: 8];
+      _timedPerformers = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+	NSObjectMapValueCallBacks, 0);
 #ifdef	HAVE_POLL_F
 #if	GS_WITH_GC
       _extra = NSAllocateCollectable(sizeof(pollextra), NSScannedOption);
@@ -593,6 +845,12 @@ static inline BOOL timerInvalidated(NSTimer *t)
 	    {
 	      info->_invalidated = YES;
 	      GSIArrayRemoveItemAtIndex(watchers, i);
+#ifdef	HAVE_EPOLL
+	      if (type == ET_RDESC || type == ET_WDESC || type == ET_EDESC)
+		{
+		  [context forgetDescriptor: (int)(intptr_t)data];
+		}
+#endif
 	    }
 	}
     }
@@ -794,7 +1052,10 @@ static inline BOOL timerInvalidated(NSTimer *t)
     {
       NSFreeMapTable(_contextMap);
     }
-  RELEASE(_timedPerformers);
+  if (_timedPerformers != 0)
+    {
+      NSFreeMapTable(_timedPerformers);
+    }
   [super dealloc];
 }
 
@@ -816,7 +1077,6 @@ static inline BOOL timerInvalidated(NSTimer *t)
 	  forMode: (NSString*)mode
 {
   GSRunLoopCtxt	*context;
-  GSIArray	timers;
   unsigned      i;
 
   if ([timer isKindOfClass: [NSTimer class]] == NO
@@ -843,32 +1103,26 @@ static inline BOOL timerInvalidated(NSTimer *t)
       NSMapInsert(_contextMap, context->mode, context);
       RELEASE(context);
     }
-  timers = context->timers;
-  i = GSIArrayCount(timers);
-  while (i-- > 0)
+  if (NSHashGet(context->timerSet, timer) != 0)
     {
-      if (timer == GSIArrayItemAtIndex(timers, i).obj)
-        {
-          return;       /* Timer already present */
-        }
+      return;       /* Timer already present */
     }
   /*
-   * NB. A previous version of the timer code maintained an ordered
-   * array on the theory that we could improve performance by only
-   * checking the first few timers (up to the first one whose fire
-   * date is in the future) each time -limitDateForMode: is called.
-   * The problem with this was that it's possible for one timer to
-   * be added in multiple modes (or to different run loops) and for
-   * a repeated timer this could mean that the firing of the timer
-   * in one mode/loop adjusts its date ... without changing the
-   * ordering of the timers in the other modes/loops which contain
-   * the timer.  When the ordering of timers in an array was broken
-   * we could get delays in processing timeouts, so we reverted to
-   * simply having timers in an unordered array and checking them
-   * all each time -limitDateForMode: is called.
+   * NB. It's possible for one timer to be added in multiple modes (or
+   * to different run loops) and for a repeated timer this means that
+   * the firing of the timer in one mode/loop adjusts its date without
+   * changing the ordering of the timers in the other modes/loops which
+   * contain the timer.  A previous version of this code kept an ordered
+   * array and suffered delays in processing timeouts as a result.
+   * We now keep a heap in which each entry records the date the timer
+   * had when the entry was made.  Since a fire date normally only ever
+   * advances, an entry is never later than the real date, so stale
+   * entries can be corrected when they reach the top of the heap.
+   * Where a fire date is moved earlier, the heap is rebuilt.
    */
-  GSIArrayAddItem(timers, (GSIArrayItem)((id)timer));
-  i = GSIArrayCount(timers);
+  NSHashInsert(context->timerSet, timer);
+  timerPush(context, RETAIN(timer));
+  i = context->timerCount;
   if (i % 1000 == 0 && i > context->maxTimers)
     {
       context->maxTimers = i;
@@ -956,17 +1210,10 @@ updateTimer(NSTimer *t, NSDate *d, NSTimeInterval now)
       _currentMode = mode;
       NS_DURING
 	{
-	  GSIArray		timers = context->timers;
 	  NSTimeInterval	now;
-          NSDate                *earliest;
 	  NSDate		*d;
 	  NSTimer		*t;
 	  NSTimeInterval	ti;
-	  NSTimeInterval	ei;
-          unsigned              c;
-          unsigned              i;
-
-	  ei = 0.0;	// Only needed to avoid compiler warning
 
 	  /*
 	   * Save current time so we don't keep redoing system call to
@@ -996,68 +1243,53 @@ updateTimer(NSTimer *t, NSDate *d, NSTimeInterval now)
                 }
             }
 
-	  /* Fire the oldest/first valid timer whose fire date has passed
-	   * and fire it.
-	   * We fire timers in the order in which they were added to the
-	   * run loop rather than in date order.  This prevents code
-	   * from blocking other timers by adding timers whose fire date
-	   * is some time in the past... we guarantee fair handling.
+	  /* If a fire date has been moved earlier, the heap ordering may
+	   * be wrong, so we must rebuild it.  We also rebuild it once
+	   * as many entries have been added as the heap contains, to
+	   * get rid of timers invalidated long before their fire dates
+	   * (this keeps the cost amortised to O(1) per entry).
 	   */
-	  c = GSIArrayCount(timers);
-	  for (i = 0; i < c; i++)
+	  if (context->timerEpoch != GSPrivateTimerEpoch()
+	    || context->timerSeq - context->timerSwept
+	    > context->timerCount + 64)
 	    {
-	      t = GSIArrayItemAtIndex(timers, i).obj;
-	      if (timerInvalidated(t) == NO)
-		{
-		  d = timerDate(t);
-		  ti = [d timeIntervalSinceReferenceDate];
-		  if (ti < now)
-		    {
-		      GSIArrayRemoveItemAtIndexNoRelease(timers, i);
-		      [t fire];
-		      GSPrivateNotifyASAP(_currentMode);
-		      IF_NO_GC([arp emptyPool];)
-		      if (updateTimer(t, d, now) == YES)
-			{
-			  /* Updated ... replace in array.
-			   */
-			  GSIArrayAddItemNoRetain(timers,
-			    (GSIArrayItem)((id)t));
-			}
-		      else
-			{
-			  /* The timer was invalidated, so we can
-			   * release it as we aren't putting it back
-			   * in the array.
-			   */
-			  RELEASE(t);
-			}
-		      break;
-		    }
-		}
+	      timerRebuild(context);
 	    }
 
-	  /* Now, find the earliest remaining timer date while removing
-	   * any invalidated timers.  We iterate from the end of the
-	   * array to minimise the amount of array alteration needed.
+	  /* Fire the earliest valid timer whose fire date has passed.
+	   * Timers with equal fire dates are fired in the order in which
+	   * they were added, and a repeating timer goes to the back of
+	   * that order when it is put back after firing ... so code which
+	   * adds timers whose fire date is in the past can't block other
+	   * timers which are already due.
 	   */
-	  earliest = nil;
-	  i = GSIArrayCount(timers);
-	  while (i-- > 0)
+	  if ((t = timerFirst(context)) != nil)
 	    {
-	      t = GSIArrayItemAtIndex(timers, i).obj;
-	      if (timerInvalidated(t) == YES)
-		{
-		  GSIArrayRemoveItemAtIndex(timers, i);
-		}
-	      else
+	      d = timerDate(t);
+	      ti = [d timeIntervalSinceReferenceDate];
+	      if (ti < now)
 		{
-		  d = timerDate(t);
-		  ti = [d timeIntervalSinceReferenceDate];
-		  if (earliest == nil || ti < ei)
+		  /* Take the timer out of the heap while it fires, but
+		   * leave it in the set so a nested loop can't add it
+		   * a second time.
+		   */
+		  timerPop(context);
+		  [t fire];
+		  GSPrivateNotifyASAP(_currentMode);
+		  IF_NO_GC([arp emptyPool];)
+		  if (updateTimer(t, d, now) == YES)
+		    {
+		      /* Updated ... put back in the heap.
+		       */
+		      timerPush(context, t);
+		    }
+		  else
 		    {
-		      earliest = d;
-		      ei = ti;
+		      /* The timer was invalidated, so we can
+		       * release it as we aren't putting it back
+		       * in the heap.
+		       */
+		      timerDiscard(context, t);
 		    }
 		}
 	    }
@@ -1065,10 +1297,10 @@ updateTimer(NSTimer *t, NSDate *d, NSTimeInterval now)
           /* The earliest date of a valid timeout is copied into 'when'
            * and used as our limit date.
            */
-          if (earliest != nil)
-            {
-              when = [earliest copy];
-            }
+	  if ((t = timerFirst(context)) != nil)
+	    {
+	      when = [timerDate(t) copy];
+	    }
 	  _currentMode = savedMode;
 	}
       NS_HANDLER
@@ -1156,7 +1388,7 @@ updateTimer(NSTimer *t, NSDate *d, NSTimeInterval now)
 
       if (context == nil
 	|| (GSIArrayCount(context->watchers) == 0
-	  && GSIArrayCount(context->timers) == 0))
+	  && context->timerCount == 0))
 	{
 	  NSDebugMLLog(@"NSRunLoop", @"no inputs or timers in mode %@", mode);
 	  GSPrivateNotifyASAP(_currentMode);
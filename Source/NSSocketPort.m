@@ -702,6 +702,7 @@ static Class	runLoopClass;
   [self invalidate];
   (void)close(desc);
   desc = -1;
+  GSPrivatePortClosedDescriptor();
 }
 
 - (void) invalidate
@@ -2074,6 +2075,7 @@ static Class		tcpPortClass;
 	    {
 	      (void) close(listener);
 	      listener = -1;
+	      GSPrivatePortClosedDescriptor();
 #if	defined(__MINGW__)
 	      WSACloseEvent(eventListener);
 	      eventListener = WSA_INVALID_EVENT;
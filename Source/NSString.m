@@ -2547,14 +2547,30 @@ GSICUCollatorOpen(NSStringCompareOptions mask, NSLocale *locale)
   if (len > 0)
     {
       unichar		buf[64];
-      unichar		*ptr = (len <= 64) ? buf :
-	NSZoneMalloc(NSDefaultMallocZone(), len * sizeof(unichar));
 
-      [self getCharacters: ptr range: NSMakeRange(0,len)];
-      ret = GSPrivateHash(0, (const void*)ptr, len * sizeof(unichar));
-      if (ptr != buf)
+      if (len <= 64)
 	{
-	  NSZoneFree(NSDefaultMallocZone(), ptr);
+	  [self getCharacters: buf range: NSMakeRange(0, len)];
+	  ret = GSPrivateHash(0, (const void*)buf, len * sizeof(unichar));
+	}
+      else
+	{
+	  GSPrivateHashState	state;
+	  int			pos = 0;
+
+	  /* Hash the characters a chunk at a time to avoid allocating
+	   * memory for a copy of the whole string.
+	   */
+	  GSPrivateStartHash(&state, 0);
+	  while (pos < len)
+	    {
+	      int	l = (len - pos > 64) ? 64 : len - pos;
+
+	      [self getCharacters: buf range: NSMakeRange(pos, l)];
+	      GSPrivateIncrementalHash(&state, buf, l * sizeof(unichar));
+	      pos += l;
+	    }
+	  ret = GSPrivateFinishHash(&state);
 	}
 
       /*
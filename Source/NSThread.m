@@ -56,6 +56,10 @@
 #  include <fcntl.h>
 #endif
 
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
 #if defined(__POSIX_SOURCE)\
         || defined(__EXT_POSIX1_198808)\
         || defined(O_NONBLOCK)
@@ -137,6 +141,8 @@ static NSNotificationCenter *nc = nil;
   NSConditionLock	*lock;		// Not retained.
   NSArray		*modes;
   BOOL                  invalidated;
+@public
+  GSPerformHolder	*next;		// Link in list of pending performers.
 }
 + (GSPerformHolder*) newForReceiver: (id)r
 			   argument: (id)a
@@ -894,17 +900,99 @@ static void *nsthreadLauncher(void* thread)
 
 
 
+/* Pending performers are kept in a singly linked list (most recently
+ * added first) which producer threads push onto with an atomic compare
+ * and swap, while the thread owning the run loop takes the whole list
+ * at once.  As the consumer never removes single entries there is no
+ * ABA problem.  Where the compiler has no atomic builtins we fall back
+ * to protecting the list with the lock.
+ */
+#if defined(__llvm__) || (defined(USE_ATOMIC_BUILTINS) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1)))
+#define	GS_PERFORM_CAS(P,O,N)	__sync_bool_compare_and_swap(P,O,N)
+#endif
+
+/* Push a performer onto the list, returning YES if the list was empty
+ * (in which case the run loop thread needs to be woken).
+ */
+static BOOL
+pushPerformer(GSRunLoopThreadInfo *info, GSPerformHolder *h)
+{
+  GSPerformHolder	*old;
+
+#if	defined(GS_PERFORM_CAS)
+  do
+    {
+      old = info->performers;
+      h->next = old;
+    }
+  while (!GS_PERFORM_CAS(&info->performers, old, h));
+#else
+  [info->lock lock];
+  old = info->performers;
+  h->next = old;
+  info->performers = h;
+  [info->lock unlock];
+#endif
+  return (old == nil) ? YES : NO;
+}
+
+/* Take all the pending performers, returning them in the order in which
+ * they were added.
+ */
+static GSPerformHolder *
+takePerformers(GSRunLoopThreadInfo *info)
+{
+  GSPerformHolder	*list;
+  GSPerformHolder	*fifo = nil;
+
+#if	defined(GS_PERFORM_CAS)
+  do
+    {
+      list = info->performers;
+    }
+  while (list != nil && !GS_PERFORM_CAS(&info->performers, list, nil));
+#else
+  [info->lock lock];
+  list = info->performers;
+  info->performers = nil;
+  [info->lock unlock];
+#endif
+  while (list != nil)
+    {
+      GSPerformHolder	*h = list;
+
+      list = h->next;
+      h->next = fifo;
+      fifo = h;
+    }
+  return fifo;
+}
+
 @implementation GSRunLoopThreadInfo
 - (void) addPerformer: (id)performer
 {
+  RETAIN(performer);
+  if (NO == pushPerformer(self, performer))
+    {
+      /* There were already performers waiting, so the thread has been
+       * woken (or is about to be), and will handle this one as well.
+       */
+      return;
+    }
   [lock lock];
-  [performers addObject: performer];
 #if defined(__MINGW__)
   if (SetEvent(event) == 0)
     {
       NSLog(@"Set event failed - %@", [NSError _last]);
     }
 #else
+#if	defined(HAVE_EVENTFD)
+  if (outputFd >= 0 && outputFd == inputFd)
+    {
+      eventfd_write(outputFd, 1);
+    }
+  else
+#endif
   /* The write could concievably fail if the pipe is full.
    * In that case we need to release the lock teporarily to allow the other
    * thread to consume data from the pipe.  It's possible that the thread
@@ -923,7 +1011,6 @@ static void *nsthreadLauncher(void* thread)
 - (void) dealloc
 {
   [self invalidate];
-  DESTROY(performers);
   DESTROY(lock);
   DESTROY(loop);
   [super dealloc];
@@ -941,7 +1028,22 @@ static void *nsthreadLauncher(void* thread)
 #else
   int	fd[2];
 
+#if	defined(HAVE_EVENTFD)
+  /* Where possible a single eventfd descriptor serves as both ends
+   * of the 'pipe'.
+   */
+  if ((fd[0] = eventfd(0, 0)) >= 0)
+    {
+      fd[1] = fd[0];
+    }
+  else if (pipe(fd) != 0)
+    {
+      fd[0] = -1;
+    }
+  if (fd[0] >= 0)
+#else
   if (pipe(fd) == 0)
+#endif
     {
       int	e;
 
@@ -984,15 +1086,24 @@ static void *nsthreadLauncher(void* thread)
     }
 #endif
   lock = [NSLock new];
-  performers = [NSMutableArray new];
+  performers = nil;
   return self;
 }
 
 - (void) invalidate
 {
+  GSPerformHolder	*h;
+
+  h = takePerformers(self);
+  while (h != nil)
+    {
+      GSPerformHolder	*n = h->next;
+
+      [h invalidate];
+      RELEASE(h);
+      h = n;
+    }
   [lock lock];
-  [performers makeObjectsPerformSelector: @selector(invalidate)];
-  [performers removeAllObjects];
 #ifdef __MINGW__
   if (event != INVALID_HANDLE_VALUE)
     {
@@ -1003,6 +1114,10 @@ static void *nsthreadLauncher(void* thread)
   if (inputFd >= 0)
     {
       close(inputFd);
+      if (outputFd == inputFd)
+	{
+	  outputFd = -1;	// Using eventfd
+	}
       inputFd = -1;
     }
   if (outputFd >= 0)
@@ -1016,10 +1131,11 @@ static void *nsthreadLauncher(void* thread)
 
 - (void) fire
 {
-  NSArray	*toDo;
-  unsigned int	i;
-  unsigned int	c;
+  GSPerformHolder	*h;
 
+  /* Reset the wakeup before taking the performers, so that any performer
+   * added after we take the list will wake us again.
+   */
   [lock lock];
 #if defined(__MINGW__)
   if (event != INVALID_HANDLE_VALUE)
@@ -1035,9 +1151,9 @@ static void *nsthreadLauncher(void* thread)
       char	buf[BUFSIZ];
 
       /* We don't care how much we read.  If there have been multiple
-       * performers queued then there will be multiple bytes available,
-       * but we always handle all available performers, so we can also
-       * read all available bytes.
+       * wakeups then there will be multiple bytes available (or, for
+       * an eventfd, a count greater than one), but we always handle all
+       * available performers, so we can also read all available bytes.
        * The descriptor is non-blocking ... so it's safe to ask for more
        * bytes than are available.
        */
@@ -1045,30 +1161,21 @@ static void *nsthreadLauncher(void* thread)
 	;
     }
 #endif
-
-  c = [performers count];
-  if (0 == c)
-    {
-      /* We deal with all available performers each time we fire, so
-       * it's likely that we will fire when we have no performers left.
-       * In that case we can skip the copying and emptying of the array.
-       */
-      [lock unlock];
-      return;
-    }
-  toDo = [NSArray arrayWithArray: performers];
-  [performers removeAllObjects];
   [lock unlock];
 
-  for (i = 0; i < c; i++)
+  h = takePerformers(self);
+  while (h != nil)
     {
-      GSPerformHolder	*h = [toDo objectAtIndex: i];
+      GSPerformHolder	*n = h->next;
 
+      h->next = nil;
       [loop performSelector: @selector(fire)
 		     target: h
 		   argument: nil
 		      order: 0
 		      modes: [h modes]];
+      RELEASE(h);
+      h = n;
     }
 }
 @end
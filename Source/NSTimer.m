@@ -34,12 +34,26 @@
 #import "Foundation/NSException.h"
 #import "Foundation/NSRunLoop.h"
 #import "Foundation/NSInvocation.h"
+#import "GSPrivate.h"
 
 @class	NSGDate;
 @interface NSGDate : NSObject	// Help the compiler
 @end
 static Class	NSDate_class;
 
+/* Incremented when a fire date is moved earlier.  The run loop orders its
+ * timers on the assumption that fire dates only ever advance, so it must
+ * re-sort them when this changes.  We don't care about lost updates when
+ * several threads increment this at once, since any change is enough.
+ */
+static unsigned	timerEpoch = 0;
+
+unsigned
+GSPrivateTimerEpoch(void)
+{
+  return timerEpoch;
+}
+
 /**
  * <p>An <code>NSTimer</code> provides a way to send a message at some time in
  * the future, possibly repeating every time a fixed interval has passed. To
@@ -328,6 +342,11 @@ static Class	NSDate_class;
  */
 - (void) setFireDate: (NSDate*)fireDate
 {
+  if (_date != nil && [fireDate timeIntervalSinceReferenceDate]
+    < [_date timeIntervalSinceReferenceDate])
+    {
+      timerEpoch++;
+    }
   ASSIGN(_date, fireDate);
 }
 
@@ -26,8 +26,62 @@
 
 #define	EXPOSE_NSURLCache_IVARS	1
 #import "GSURLPrivate.h"
+#import "Foundation/NSArray.h"
+#import "Foundation/NSByteOrder.h"
+#import "Foundation/NSData.h"
+#import "Foundation/NSDate.h"
+#import "Foundation/NSDictionary.h"
+#import "Foundation/NSEnumerator.h"
+#import "Foundation/NSFileHandle.h"
+#import "Foundation/NSFileManager.h"
+#import "Foundation/NSPathUtilities.h"
+#import "Foundation/NSProcessInfo.h"
+#import "Foundation/NSPropertyList.h"
+#import "Foundation/NSSet.h"
+#import "Foundation/NSValue.h"
+
+#ifdef	HAVE_SYS_FILE_H
+#  include <sys/file.h>
+#endif
+
+#if	defined(HAVE_SYS_FCNTL_H)
+#  include <sys/fcntl.h>
+#elif	defined(HAVE_FCNTL_H)
+#  include <fcntl.h>
+#endif
+
+/* The on-disk cache is a directory holding one file for the body of
+ * each cached response (so the body can be mapped into memory rather
+ * than read) and a journal file holding the index.
+ * Each journal record is a four byte (big endian) length followed by a
+ * binary property list.  A record is either an array containing a key
+ * and the entry for that key, or an array containing only a key (when
+ * the entry for that key has been removed).  The journal is rewritten
+ * when it contains many more records than there are entries.
+ * The index is held in memory, so looking up a response costs no more
+ * than a dictionary lookup and the mapping of its body file.
+ * Since each cache keeps its own index, only one cache at a time may
+ * use a directory.  The first holds an exclusive lock on a lock file in
+ * the directory (the journal itself is replaced when it is rewritten, so
+ * can't be locked), and any other cache for the same directory (such as
+ * the shared cache of a second copy of the same program) keeps its
+ * responses in memory only.
+ */
+static NSString	*journalName = @"index";
+static NSString	*lockName = @"lock";
+
+/* Keys in index entries.
+ */
+static NSString	*fileKey = @"F";	// Name of body file
+static NSString	*sizeKey = @"S";	// Size of body
+static NSString	*timeKey = @"T";	// Time of last use
+static NSString	*statusKey = @"C";	// HTTP status code
+static NSString	*headersKey = @"H";	// HTTP headers
+static NSString	*typeKey = @"M";	// MIME type
+static NSString	*encodingKey = @"E";	// Text encoding name
+static NSString	*lengthKey = @"L";	// Expected content length
+static NSString	*policyKey = @"P";	// Storage policy
 
-// FIXME ... locking and disk storage needed
 typedef struct {
   unsigned		diskCapacity;
   unsigned		memoryCapacity;
@@ -35,6 +89,12 @@ typedef struct {
   unsigned		memoryUsage;
   NSString		*path;
   NSMutableDictionary	*memory;
+  NSRecursiveLock	*lock;
+  NSMutableDictionary	*index;		// Disk entries keyed by URL
+  NSFileHandle		*journal;
+  unsigned		records;	// Records in journal
+  unsigned long		nextFile;	// For naming body files
+  int			lockDesc;	// Locks directory, or -1
 } Internal;
  
 #define	this	((Internal*)(self->_NSURLCacheInternal))
@@ -43,6 +103,76 @@ typedef struct {
 
 static NSURLCache	*shared = nil;
 
+/* Return the key used for the on-disk cache, or nil if the request
+ * should not be stored on disk.
+ */
+static NSString *
+diskKey(NSURLRequest *request)
+{
+  NSString	*method = [request HTTPMethod];
+
+  if (method != nil && NO == [method isEqualToString: @"GET"])
+    {
+      return nil;
+    }
+  return [[request URL] absoluteString];
+}
+
+/* Return YES if the response headers forbid storing the response.
+ */
+static BOOL
+noStore(NSURLResponse *response)
+{
+  if ([response isKindOfClass: [NSHTTPURLResponse class]])
+    {
+      NSString	*cc;
+
+      cc = [[(NSHTTPURLResponse*)response allHeaderFields]
+	objectForKey: @"Cache-Control"];
+      if (cc != nil
+	&& [[cc lowercaseString] rangeOfString: @"no-store"].length > 0)
+	{
+	  return YES;
+	}
+    }
+  return NO;
+}
+
+static NSComparisonResult
+sortByTime(id k1, id k2, void *ctxt)
+{
+  NSDictionary	*index = (NSDictionary*)ctxt;
+  NSDictionary	*e1 = [index objectForKey: k1];
+  NSDictionary	*e2 = [index objectForKey: k2];
+  double	t1 = [[e1 objectForKey: timeKey] doubleValue];
+  double	t2 = [[e2 objectForKey: timeKey] doubleValue];
+  unsigned long	n1;
+  unsigned long	n2;
+
+  if (t1 < t2) return NSOrderedAscending;
+  if (t1 > t2) return NSOrderedDescending;
+
+  /* Used at the same time, so the one stored first (in the file with
+   * the lower number) is older.
+   */
+  n1 = strtoul([[e1 objectForKey: fileKey] UTF8String], 0, 16);
+  n2 = strtoul([[e2 objectForKey: fileKey] UTF8String], 0, 16);
+  if (n1 < n2) return NSOrderedAscending;
+  if (n1 > n2) return NSOrderedDescending;
+  return NSOrderedSame;
+}
+
+@interface	NSURLCache (Disk)
+- (void) _diskAppend: (NSString*)key entry: (NSDictionary*)entry;
+- (void) _diskCompact;
+- (void) _diskEvict: (NSUInteger)size;
+- (void) _diskLoad;
+- (void) _diskRemove: (NSString*)key;
+- (NSCachedURLResponse*) _diskResponse: (NSString*)key;
+- (void) _diskStore: (NSCachedURLResponse*)cachedResponse
+	     forKey: (NSString*)key;
+@end
+
 @implementation	NSURLCache
 
 + (id) allocWithZone: (NSZone*)z
@@ -52,6 +182,7 @@ static NSURLCache	*shared = nil;
   if (o != nil)
     {
       o->_NSURLCacheInternal = NSZoneCalloc(z, 1, sizeof(Internal));
+      inst->lockDesc = -1;
     }
   return o;
 }
@@ -67,6 +198,14 @@ static NSURLCache	*shared = nil;
 {
   if (this != 0)
     {
+      [this->journal closeFile];
+      RELEASE(this->journal);
+      if (this->lockDesc >= 0)
+	{
+	  close(this->lockDesc);	// Releases the lock.
+	}
+      RELEASE(this->index);
+      RELEASE(this->lock);
       RELEASE(this->memory);
       RELEASE(this->path);
       NSZoneFree([self zone], this);
@@ -81,10 +220,9 @@ static NSURLCache	*shared = nil;
   [gnustep_global_lock lock];
   if (shared == nil)
     {
-      NSString	*path = nil;
-
-// FIXME user-library-path/Caches/current-app-name
+      NSString	*path;
 
+      path = [[NSProcessInfo processInfo] processName];
       shared = [[self alloc] initWithMemoryCapacity: 4 * 1024 * 1024
 				       diskCapacity: 20 * 1024 * 1024
 					   diskPath: path];
@@ -97,8 +235,21 @@ static NSURLCache	*shared = nil;
 
 - (NSCachedURLResponse *) cachedResponseForRequest: (NSURLRequest *)request
 {
-  // FIXME ... handle disk cache
-  return [this->memory objectForKey: request];
+  NSCachedURLResponse	*item;
+
+  [this->lock lock];
+  item = [[this->memory objectForKey: request] retain];
+  if (nil == item && this->index != nil)
+    {
+      NSString	*key = diskKey(request);
+
+      if (key != nil)
+	{
+	  item = [[self _diskResponse: key] retain];
+	}
+    }
+  [this->lock unlock];
+  return [item autorelease];
 }
 
 - (NSUInteger) currentDiskUsage
@@ -126,8 +277,30 @@ static NSURLCache	*shared = nil;
       this->diskCapacity = diskCapacity;
       this->memoryUsage = 0;
       this->memoryCapacity = memoryCapacity;
-      this->path = [path copy];
       this->memory = [NSMutableDictionary new];
+      this->lock = [NSRecursiveLock new];
+      if ([path length] > 0 && NO == [path isAbsolutePath])
+	{
+	  NSArray	*a;
+
+	  /* A relative path is in the user's cache directory.
+	   */
+	  a = NSSearchPathForDirectoriesInDomains(NSCachesDirectory,
+	    NSUserDomainMask, YES);
+	  if ([a count] > 0)
+	    {
+	      path = [[a objectAtIndex: 0] stringByAppendingPathComponent: path];
+	    }
+	  else
+	    {
+	      path = nil;
+	    }
+	}
+      this->path = [path copy];
+      if (this->path != nil && diskCapacity > 0)
+	{
+	  [self _diskLoad];
+	}
     }
   return self;
 }
@@ -139,43 +312,103 @@ static NSURLCache	*shared = nil;
 
 - (void) removeAllCachedResponses
 {
-  // FIXME ... disk storage
+  [this->lock lock];
   [this->memory removeAllObjects];
-  this->diskUsage = 0;
   this->memoryUsage = 0;
+  if (this->index != nil)
+    {
+      NSFileManager	*mgr = [NSFileManager defaultManager];
+      NSEnumerator	*e = [this->index objectEnumerator];
+      NSDictionary	*entry;
+
+      while ((entry = [e nextObject]) != nil)
+	{
+	  [mgr removeFileAtPath: [this->path stringByAppendingPathComponent:
+	    [entry objectForKey: fileKey]] handler: nil];
+	}
+      [this->index removeAllObjects];
+      [self _diskCompact];
+    }
+  this->diskUsage = 0;
+  [this->lock unlock];
 }
 
 - (void) removeCachedResponseForRequest: (NSURLRequest *)request
 {
-  NSCachedURLResponse	*item = [self cachedResponseForRequest: request];
+  NSCachedURLResponse	*item;
 
+  [this->lock lock];
+  item = [this->memory objectForKey: request];
   if (item != nil)
     {
-      // FIXME ... disk storage
       this->memoryUsage -= [[item data] length];
       [this->memory removeObjectForKey: request];
     }
+  if (this->index != nil)
+    {
+      NSString	*key = diskKey(request);
+
+      if (key != nil)
+	{
+	  [self _diskRemove: key];
+	}
+    }
+  [this->lock unlock];
 }
 
 - (void) setDiskCapacity: (NSUInteger)diskCapacity
 {
-  [self notImplemented: _cmd];
-  // FIXME
+  [this->lock lock];
+  this->diskCapacity = diskCapacity;
+  if (this->index != nil && this->diskUsage > diskCapacity)
+    {
+      [self _diskEvict: 0];
+    }
+  [this->lock unlock];
 }
 
 - (void) setMemoryCapacity: (NSUInteger)memoryCapacity
 {
-  [self notImplemented: _cmd];
-  // FIXME
+  [this->lock lock];
+  this->memoryCapacity = memoryCapacity;
+  while (this->memoryUsage > this->memoryCapacity)
+    {
+      NSURLRequest		*request;
+      NSCachedURLResponse	*item;
+
+      request = [[this->memory allKeys] lastObject];
+      item = [this->memory objectForKey: request];
+      this->memoryUsage -= [[item data] length];
+      [this->memory removeObjectForKey: request];
+    }
+  [this->lock unlock];
 }
 
 - (void) storeCachedResponse: (NSCachedURLResponse *)cachedResponse
 		  forRequest: (NSURLRequest *)request
 {
-  switch ([cachedResponse storagePolicy])
+  NSURLCacheStoragePolicy	policy = [cachedResponse storagePolicy];
+
+  if (policy != NSURLCacheStorageNotAllowed
+    && YES == noStore([cachedResponse response]))
+    {
+      policy = NSURLCacheStorageNotAllowed;
+    }
+  [this->lock lock];
+  switch (policy)
     {
       case NSURLCacheStorageAllowed:
-// FIXME ... maybe on disk?
+	if (this->index != nil)
+	  {
+	    NSString	*key = diskKey(request);
+
+	    if (key != nil)
+	      {
+		[self _diskStore: cachedResponse forKey: key];
+	      }
+	  }
+	/* Fall through to store in memory as well.
+	 */
 
       case NSURLCacheStorageAllowedInMemoryOnly:
         {
@@ -193,9 +426,12 @@ static NSURLCache	*shared = nil;
 		}
 	      while (this->memoryUsage + size > this->memoryCapacity)
 	        {
+		  NSURLRequest	*r = [[this->memory allKeys] lastObject];
+
 // FIXME ... should delete least recently used.
-		  [self removeCachedResponseForRequest:
-		    [[this->memory allKeys] lastObject]];
+		  old = [this->memory objectForKey: r];
+		  this->memoryUsage -= [[old data] length];
+		  [this->memory removeObjectForKey: r];
 		}
 	      [this->memory setObject: cachedResponse forKey: request];
 	      this->memoryUsage += size;
@@ -207,10 +443,387 @@ static NSURLCache	*shared = nil;
         break;
 
       default:
+	[this->lock unlock];
         [NSException raise: NSInternalInconsistencyException
 		    format: @"storing cached response with bad policy (%d)",
 		    [cachedResponse storagePolicy]];
     }
+  [this->lock unlock];
+}
+
+@end
+
+@implementation	NSURLCache (Disk)
+
+/* Append a record to the journal, rewriting the whole journal instead
+ * if it has grown much larger than the index.
+ */
+- (void) _diskAppend: (NSString*)key entry: (NSDictionary*)entry
+{
+  NSMutableData	*m;
+  NSData	*d;
+  NSArray	*a;
+  uint32_t	len;
+
+  if (this->records > 2 * [this->index count] + 64)
+    {
+      [self _diskCompact];
+      return;
+    }
+  if (entry == nil)
+    {
+      a = [NSArray arrayWithObject: key];
+    }
+  else
+    {
+      a = [NSArray arrayWithObjects: key, entry, nil];
+    }
+  d = [NSPropertyListSerialization dataFromPropertyList: a
+    format: NSPropertyListBinaryFormat_v1_0
+    errorDescription: 0];
+  len = GSSwapHostI32ToBig([d length]);
+  m = [NSMutableData dataWithCapacity: [d length] + 4];
+  [m appendBytes: &len length: 4];
+  [m appendData: d];
+  NS_DURING
+    {
+      [this->journal writeData: m];
+      this->records++;
+    }
+  NS_HANDLER
+    {
+      NSLog(@"Problem writing URL cache index in %@: %@",
+	this->path, localException);
+    }
+  NS_ENDHANDLER
+}
+
+/* Write a new journal containing only the current index entries.
+ */
+- (void) _diskCompact
+{
+  NSString	*file = [this->path stringByAppendingPathComponent: journalName];
+  NSMutableData	*m = [NSMutableData dataWithCapacity: 1024];
+  NSEnumerator	*e = [this->index keyEnumerator];
+  NSString	*key;
+
+  while ((key = [e nextObject]) != nil)
+    {
+      NSArray	*a;
+      NSData	*d;
+      uint32_t	len;
+
+      a = [NSArray arrayWithObjects: key, [this->index objectForKey: key], nil];
+      d = [NSPropertyListSerialization dataFromPropertyList: a
+	format: NSPropertyListBinaryFormat_v1_0
+	errorDescription: 0];
+      len = GSSwapHostI32ToBig([d length]);
+      [m appendBytes: &len length: 4];
+      [m appendData: d];
+    }
+  [this->journal closeFile];
+  DESTROY(this->journal);
+  this->records = [this->index count];
+  if (NO == [m writeToFile: file atomically: YES])
+    {
+      NSLog(@"Unable to write URL cache index in %@", this->path);
+    }
+  this->journal = RETAIN([NSFileHandle fileHandleForUpdatingAtPath: file]);
+  [this->journal seekToEndOfFile];
+}
+
+/* Remove least recently used entries until there is space for an
+ * entry of the specified size.  We remove down to a little below the
+ * capacity so that we don't need to do this on every store.
+ */
+- (void) _diskEvict: (NSUInteger)size
+{
+  NSUInteger	target = this->diskCapacity - this->diskCapacity / 8;
+  NSArray	*keys;
+  NSUInteger	count;
+  NSUInteger	i;
+
+  target = (size > target) ? 0 : target - size;
+  keys = [[this->index allKeys] sortedArrayUsingFunction: sortByTime
+						 context: this->index];
+  count = [keys count];
+  for (i = 0; i < count && this->diskUsage > target; i++)
+    {
+      [self _diskRemove: [keys objectAtIndex: i]];
+    }
+}
+
+/* Read the journal (if any) to build the index, and remove any files
+ * in the cache directory which are not referenced by the index.
+ */
+- (void) _diskLoad
+{
+  NSFileManager	*mgr = [NSFileManager defaultManager];
+  NSString	*file = [this->path stringByAppendingPathComponent: journalName];
+  NSData	*d;
+  NSEnumerator	*e;
+  NSDictionary	*entry;
+  NSMutableSet	*names;
+  NSString	*name;
+  BOOL		isDir;
+
+  if (NO == [mgr fileExistsAtPath: this->path isDirectory: &isDir])
+    {
+      if (NO == [mgr createDirectoryAtPath: this->path
+	       withIntermediateDirectories: YES
+				attributes: nil
+				     error: 0])
+	{
+	  NSLog(@"Unable to create URL cache directory %@", this->path);
+	  return;
+	}
+    }
+  else if (NO == isDir)
+    {
+      NSLog(@"URL cache path %@ is not a directory", this->path);
+      return;
+    }
+
+#if	defined(LOCK_EX)
+  /* If another cache (perhaps in another process) is using the directory
+   * we leave the index nil, so responses are only cached in memory.
+   */
+  name = [this->path stringByAppendingPathComponent: lockName];
+  this->lockDesc = open([name fileSystemRepresentation], O_RDWR|O_CREAT, 0600);
+  if (this->lockDesc < 0 || flock(this->lockDesc, LOCK_EX|LOCK_NB) < 0)
+    {
+      if (this->lockDesc >= 0)
+	{
+	  close(this->lockDesc);
+	  this->lockDesc = -1;
+	}
+      return;
+    }
+#endif
+
+  this->index = [NSMutableDictionary new];
+  d = [NSData dataWithContentsOfFile: file];
+  if (d != nil)
+    {
+      const uint8_t	*bytes = [d bytes];
+      NSUInteger	length = [d length];
+      NSUInteger	pos = 0;
+
+      while (pos + 4 <= length)
+	{
+	  uint32_t	len;
+	  NSArray	*a;
+
+	  memcpy(&len, bytes + pos, 4);
+	  len = GSSwapBigI32ToHost(len);
+	  pos += 4;
+	  if (len > length - pos)
+	    {
+	      break;	// Truncated record.
+	    }
+	  a = [NSPropertyListSerialization propertyListFromData:
+	    [d subdataWithRange: NSMakeRange(pos, len)]
+	    mutabilityOption: NSPropertyListMutableContainers
+	    format: 0
+	    errorDescription: 0];
+	  pos += len;
+	  if (NO == [a isKindOfClass: [NSArray class]] || [a count] == 0)
+	    {
+	      break;	// Corrupt record.
+	    }
+	  if ([a count] == 1)
+	    {
+	      [this->index removeObjectForKey: [a objectAtIndex: 0]];
+	    }
+	  else
+	    {
+	      [this->index setObject: [a objectAtIndex: 1]
+			      forKey: [a objectAtIndex: 0]];
+	    }
+	}
+    }
+
+  /* Work out the disk usage and the next free file name.
+   */
+  names = [NSMutableSet setWithCapacity: [this->index count]];
+  e = [this->index objectEnumerator];
+  while ((entry = [e nextObject]) != nil)
+    {
+      unsigned long	n;
+
+      name = [entry objectForKey: fileKey];
+      [names addObject: name];
+      n = strtoul([name UTF8String], 0, 16);
+      if (n >= this->nextFile)
+	{
+	  this->nextFile = n + 1;
+	}
+      this->diskUsage += [[entry objectForKey: sizeKey] unsignedIntValue];
+    }
+
+  /* Remove body files which are not in the index (left by a process
+   * which stopped before it could write the index).
+   */
+  e = [[mgr directoryContentsAtPath: this->path] objectEnumerator];
+  while ((name = [e nextObject]) != nil)
+    {
+      if (NO == [name isEqualToString: journalName]
+	&& NO == [name isEqualToString: lockName]
+	&& NO == [names containsObject: name])
+	{
+	  [mgr removeFileAtPath: [this->path stringByAppendingPathComponent:
+	    name] handler: nil];
+	}
+    }
+  [self _diskCompact];
+  if (this->diskUsage > this->diskCapacity)
+    {
+      [self _diskEvict: 0];
+    }
+}
+
+- (void) _diskRemove: (NSString*)key
+{
+  NSDictionary	*entry = [this->index objectForKey: key];
+
+  if (entry != nil)
+    {
+      NSString	*file;
+
+      file = [this->path stringByAppendingPathComponent:
+	[entry objectForKey: fileKey]];
+      [[NSFileManager defaultManager] removeFileAtPath: file handler: nil];
+      this->diskUsage -= [[entry objectForKey: sizeKey] unsignedIntValue];
+      [this->index removeObjectForKey: key];
+      [self _diskAppend: key entry: nil];
+    }
+}
+
+- (NSCachedURLResponse*) _diskResponse: (NSString*)key
+{
+  NSMutableDictionary	*entry = [this->index objectForKey: key];
+  NSCachedURLResponse	*item;
+  NSURLResponse		*response;
+  NSNumber		*status;
+  NSData		*data;
+  NSURL			*url;
+
+  if (entry == nil)
+    {
+      return nil;
+    }
+  if ([[entry objectForKey: sizeKey] unsignedIntValue] == 0)
+    {
+      data = [NSData data];	// An empty file can't be mapped.
+    }
+  else
+    {
+      data = [NSData dataWithContentsOfMappedFile:
+	[this->path stringByAppendingPathComponent:
+	[entry objectForKey: fileKey]]];
+    }
+  if (data == nil)
+    {
+      [self _diskRemove: key];	// Body has gone missing.
+      return nil;
+    }
+
+  url = [NSURL URLWithString: key];
+  status = [entry objectForKey: statusKey];
+  if (status != nil)
+    {
+      response = [[NSHTTPURLResponse alloc]
+	initWithURL: url
+	 statusCode: [status integerValue]
+	HTTPVersion: @"HTTP/1.1"
+       headerFields: [entry objectForKey: headersKey]];
+    }
+  else
+    {
+      response = [[NSURLResponse alloc]
+		  initWithURL: url
+		     MIMEType: [entry objectForKey: typeKey]
+	expectedContentLength: [[entry objectForKey: lengthKey] intValue]
+	     textEncodingName: [entry objectForKey: encodingKey]];
+    }
+  item = [[NSCachedURLResponse alloc]
+    initWithResponse: response
+		data: data
+	    userInfo: nil
+       storagePolicy: [[entry objectForKey: policyKey] intValue]];
+  RELEASE(response);
+
+  /* Record the time of use for LRU eviction.  This is not written to
+   * the journal (it reaches disk when the journal is rewritten) so that
+   * lookups don't need to write to disk.
+   */
+  [entry setObject: [NSNumber numberWithDouble:
+    [NSDate timeIntervalSinceReferenceDate]] forKey: timeKey];
+  return AUTORELEASE(item);
+}
+
+- (void) _diskStore: (NSCachedURLResponse*)cachedResponse
+	     forKey: (NSString*)key
+{
+  NSURLResponse		*response = [cachedResponse response];
+  NSData		*data = [cachedResponse data];
+  NSUInteger		size = [data length];
+  NSMutableDictionary	*entry;
+  NSString		*name;
+  id			o;
+
+  [self _diskRemove: key];
+  if (size > this->diskCapacity)
+    {
+      return;
+    }
+  if (this->diskUsage + size > this->diskCapacity)
+    {
+      [self _diskEvict: size];
+    }
+
+  name = [NSString stringWithFormat: @"%lx", this->nextFile++];
+  if (NO == [data writeToFile: [this->path stringByAppendingPathComponent: name]
+		   atomically: YES])
+    {
+      return;
+    }
+  entry = [NSMutableDictionary dictionaryWithCapacity: 8];
+  [entry setObject: name forKey: fileKey];
+  [entry setObject: [NSNumber numberWithUnsignedInt: size] forKey: sizeKey];
+  [entry setObject: [NSNumber numberWithDouble:
+    [NSDate timeIntervalSinceReferenceDate]] forKey: timeKey];
+  [entry setObject: [NSNumber numberWithInt: [cachedResponse storagePolicy]]
+	    forKey: policyKey];
+  if ([response isKindOfClass: [NSHTTPURLResponse class]])
+    {
+      NSHTTPURLResponse	*r = (NSHTTPURLResponse*)response;
+
+      [entry setObject: [NSNumber numberWithInteger: [r statusCode]]
+		forKey: statusKey];
+      o = [r allHeaderFields];
+      if (o != nil)
+	{
+	  [entry setObject: [NSDictionary dictionaryWithDictionary: o]
+		    forKey: headersKey];
+	}
+    }
+  else
+    {
+      if ((o = [response MIMEType]) != nil)
+	{
+	  [entry setObject: o forKey: typeKey];
+	}
+      if ((o = [response textEncodingName]) != nil)
+	{
+	  [entry setObject: o forKey: encodingKey];
+	}
+      [entry setObject: [NSNumber numberWithLongLong:
+	[response expectedContentLength]] forKey: lengthKey];
+    }
+  [this->index setObject: entry forKey: key];
+  this->diskUsage += size;
+  [self _diskAppend: key entry: entry];
 }
 
 @end
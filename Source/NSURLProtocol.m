@@ -66,38 +66,82 @@ zfree(void *opaque, void *mem)
 #endif
 #endif
 
+/* Maximum number of idle connections kept for each host/port/TLS
+ * combination, and the maximum time an idle connection is kept.
+ */
+static NSUInteger	poolMaxIdle = 8;
+static NSTimeInterval	poolMaxAge = 120.0;
+
+/* Maximum number of requests outstanding on a pipelined connection.
+ */
+static NSUInteger	poolMaxPipeline = 4;
+
+/* A pair of streams for a connection to a server which may be reused
+ * for another request once the response to the current one has been
+ * read.  Idle pairs are pooled by a key made from the host, port and
+ * whether TLS is in use, with a stack of idle pairs for each key so that
+ * the most recently used (least likely to have been closed by the
+ * server) is taken first.
+ * While a pair is in use for a pipelinable request, it is also listed
+ * as busy so that further requests for the same server (from the same
+ * thread) may be queued on it.  The pipeline array holds the protocols
+ * using the connection in the order their requests were sent, the first
+ * being the one currently reading its response.
+ */
 @interface	GSSocketStreamPair : NSObject
 {
   NSInputStream		*ip;
   NSOutputStream	*op;
-  NSHost		*host;
-  uint16_t		port;
-  NSDate		*expires;
-  BOOL			ssl;
-}
+  NSString		*key;
+  NSTimeInterval	expires;
+  NSMutableArray	*pipeline;	// Protocols sharing the connection
+  NSMutableData		*pending;	// Queued requests not yet written
+  NSThread		*thread;	// Thread using the connection
+  BOOL			sending;	// First request not yet written
+  BOOL			broken;		// Can't be used for more requests
+}
++ (NSString*) keyForHost: (NSString*)h port: (uint16_t)p forSSL: (BOOL)s;
++ (GSSocketStreamPair*) pairForKey: (NSString*)k;
++ (GSSocketStreamPair*) pipelineForKey: (NSString*)k;
 + (void) purge: (NSNotification*)n;
++ (NSDictionary*) statistics;
+- (void) abandon: (id)protocol;
 - (void) cache: (NSDate*)when;
 - (void) close;
-- (NSDate*) expires;
-- (id) initWithHost: (NSHost*)h port: (uint16_t)p forSSL: (BOOL)s;
+- (NSArray*) detachFollowers;
+- (void) enqueue: (id)protocol request: (NSData*)data;
+- (void) flush;
+- (BOOL) isBroken;
+- (id) nextAfter: (id)protocol;
+- (void) requestSent;
+- (void) setBusy: (id)protocol;
+- (id) initWithInputStream: (NSInputStream*)i
+	      outputStream: (NSOutputStream*)o
+		       key: (NSString*)k;
 - (NSInputStream*) inputStream;
 - (NSOutputStream*) outputStream;
 @end
 
 @implementation	GSSocketStreamPair
 
-static NSMutableArray	*pairCache = nil;
-static NSLock		*pairLock = nil;
+static NSMutableDictionary	*pairCache = nil;
+static NSMutableDictionary	*pairBusy = nil;
+static NSLock			*pairLock = nil;
+static NSUInteger		pairHits = 0;
+static NSUInteger		pairMisses = 0;
+static NSUInteger		pairExpired = 0;
+static NSUInteger		pairDiscarded = 0;
+static NSUInteger		pairIdle = 0;
+static NSUInteger		pairPipelined = 0;
 
 + (void) initialize
 {
   if (pairCache == nil)
     {
-      /* No use trying to use a dictionary ... NSHost objects all hash
-       * to the same value.
-       */
-      pairCache = [NSMutableArray new];
+      pairCache = [NSMutableDictionary new];
       [[NSObject leakAt: &pairCache] release];
+      pairBusy = [NSMutableDictionary new];
+      [[NSObject leakAt: &pairBusy] release];
       pairLock = [NSLock new];
       [[NSObject leakAt: &pairLock] release];
       /*  Purge expired pairs at intervals.
@@ -108,50 +152,199 @@ static NSLock		*pairLock = nil;
     }
 }
 
++ (NSString*) keyForHost: (NSString*)h port: (uint16_t)p forSSL: (BOOL)s
+{
+  return [NSString stringWithFormat: @"%@:%u:%d",
+    [h lowercaseString], (unsigned)p, (int)s];
+}
+
+/* Take the most recently cached usable pair for the key from the pool.
+ */
++ (GSSocketStreamPair*) pairForKey: (NSString*)k
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  NSMutableArray	*stack;
+  GSSocketStreamPair	*pair = nil;
+  NSMutableArray	*dead = nil;
+
+  [pairLock lock];
+  stack = [pairCache objectForKey: k];
+  while (nil == pair && [stack count] > 0)
+    {
+      pair = [[stack lastObject] retain];
+      [stack removeLastObject];
+      pairIdle--;
+      if (pair->expires <= now
+	|| [pair->ip streamStatus] != NSStreamStatusOpen
+	|| [pair->op streamStatus] != NSStreamStatusOpen)
+	{
+	  pairExpired++;
+	  if (nil == dead)
+	    {
+	      dead = [NSMutableArray array];
+	    }
+	  [dead addObject: pair];
+	  [pair release];
+	  pair = nil;
+	}
+    }
+  if (nil == pair)
+    {
+      pairMisses++;
+    }
+  else
+    {
+      pairHits++;
+    }
+  [pairLock unlock];
+  [dead makeObjectsPerformSelector: @selector(close)];
+  return [pair autorelease];
+}
+
+/* Find a connection in use by the current thread on which another
+ * request may be pipelined.
+ */
++ (GSSocketStreamPair*) pipelineForKey: (NSString*)k
+{
+  NSThread		*t = [NSThread currentThread];
+  GSSocketStreamPair	*pair = nil;
+  NSEnumerator		*e;
+  GSSocketStreamPair	*p;
+
+  [pairLock lock];
+  e = [[pairBusy objectForKey: k] objectEnumerator];
+  while ((p = [e nextObject]) != nil)
+    {
+      if (p->thread == t && NO == p->broken
+	&& [p->pipeline count] < poolMaxPipeline)
+	{
+	  pair = [[p retain] autorelease];
+	  break;
+	}
+    }
+  [pairLock unlock];
+  return pair;
+}
+
 + (void) purge: (NSNotification*)n
 {
-  NSDate	*now = [NSDate date];
-  unsigned	count;
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  NSMutableArray	*dead = [NSMutableArray array];
+  NSEnumerator		*e;
+  NSString		*k;
 
   [pairLock lock];
-  count = [pairCache count];
-  while (count-- > 0)
+  e = [[pairCache allKeys] objectEnumerator];
+  while ((k = [e nextObject]) != nil)
     {
-      GSSocketStreamPair	*p = [pairCache objectAtIndex: count];
+      NSMutableArray	*stack = [pairCache objectForKey: k];
 
-      if ([[p expires] timeIntervalSinceDate: now] <= 0.0)
+      /* Pairs are pushed as they are cached, so the oldest (which expire
+       * first) are at the bottom of the stack.
+       */
+      while ([stack count] > 0
+	&& ((GSSocketStreamPair*)[stack objectAtIndex: 0])->expires <= now)
+	{
+	  [dead addObject: [stack objectAtIndex: 0]];
+	  [stack removeObjectAtIndex: 0];
+	  pairIdle--;
+	  pairExpired++;
+	}
+      if ([stack count] == 0)
 	{
-	  [pairCache removeObjectAtIndex: count];
+	  [pairCache removeObjectForKey: k];
 	}
     }
   [pairLock unlock];
+  [dead makeObjectsPerformSelector: @selector(close)];
 }
 
++ (NSDictionary*) statistics
+{
+  NSDictionary	*d;
+
+  [pairLock lock];
+  d = [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedInteger: pairHits], @"Hits",
+    [NSNumber numberWithUnsignedInteger: pairMisses], @"Misses",
+    [NSNumber numberWithUnsignedInteger: pairExpired], @"Expired",
+    [NSNumber numberWithUnsignedInteger: pairDiscarded], @"Discarded",
+    [NSNumber numberWithUnsignedInteger: pairIdle], @"Idle",
+    [NSNumber numberWithUnsignedInteger: pairPipelined], @"Pipelined",
+    [NSNumber numberWithUnsignedInteger: [pairCache count]], @"Hosts",
+    nil];
+  [pairLock unlock];
+  return d;
+}
+
+/* Return the receiver to the pool until the specified date (limited to
+ * the maximum idle time), or close it if it can't be kept.
+ */
 - (void) cache: (NSDate*)when
 {
-  NSTimeInterval	ti = [when timeIntervalSinceNow];
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  NSTimeInterval	ti = [when timeIntervalSinceReferenceDate];
+  NSMutableArray	*stack;
+  BOOL			cached = NO;
 
-  if (ti <= 0.0)
+  NSAssert(ip != nil, NSGenericException);
+  [self setBusy: nil];
+  [ip setDelegate: nil];
+  [op setDelegate: nil];
+  [ip removeFromRunLoop: [NSRunLoop currentRunLoop]
+		forMode: NSDefaultRunLoopMode];
+  [op removeFromRunLoop: [NSRunLoop currentRunLoop]
+		forMode: NSDefaultRunLoopMode];
+  if (ti > now + poolMaxAge)
     {
-      [self close];
-      return;
+      ti = now + poolMaxAge;
     }
-  NSAssert(ip != nil, NSGenericException);
-  if (ti > 120.0)
+  expires = ti;
+  if (ti > now)
     {
-      ASSIGN(expires, [NSDate dateWithTimeIntervalSinceNow: 120.0]);
+      [pairLock lock];
+      stack = [pairCache objectForKey: key];
+      if (nil == stack)
+	{
+	  stack = [NSMutableArray new];
+	  [pairCache setObject: stack forKey: key];
+	  [stack release];
+	}
+      if ([stack count] < poolMaxIdle)
+	{
+	  [stack addObject: self];
+	  pairIdle++;
+	  cached = YES;
+	}
+      else
+	{
+	  pairDiscarded++;
+	}
+      [pairLock unlock];
     }
-  else
-    { 
-      ASSIGN(expires, when);
+  if (NO == cached)
+    {
+      [self close];
+    }
+}
+
+/* Stop another request using the connection (its request may already
+ * have been sent, so the connection can't be reused).
+ */
+- (void) abandon: (id)protocol
+{
+  NSUInteger	index = [pipeline indexOfObjectIdenticalTo: protocol];
+
+  if (index != NSNotFound)
+    {
+      broken = YES;
+      [pipeline removeObjectAtIndex: index];
     }
-  [pairLock lock];
-  [pairCache addObject: self];
-  [pairLock unlock];
 }
 
 - (void) close
 {
+  [self setBusy: nil];
   [ip setDelegate: nil];
   [op setDelegate: nil];
   [ip removeFromRunLoop: [NSRunLoop currentRunLoop]
@@ -167,74 +360,159 @@ static NSLock		*pairLock = nil;
 - (void) dealloc
 {
   [self close];
-  DESTROY(host);
-  DESTROY(expires);
+  DESTROY(key);
+  DESTROY(pipeline);
+  DESTROY(pending);
   [super dealloc];
 }
 
-- (NSDate*) expires
+/* Remove and return the protocols waiting to read responses after the
+ * current one, so that they can be restarted on other connections.
+ */
+- (NSArray*) detachFollowers
 {
-  return expires;
+  NSArray	*a = nil;
+
+  broken = YES;
+  if ([pipeline count] > 1)
+    {
+      a = [pipeline subarrayWithRange: NSMakeRange(1, [pipeline count] - 1)];
+      [pipeline removeObjectsInRange: NSMakeRange(1, [pipeline count] - 1)];
+    }
+  return a;
 }
 
-- (id) init
+/* Queue the request for a protocol which will read its response once
+ * the protocols already using the connection have read theirs.
+ */
+- (void) enqueue: (id)protocol request: (NSData*)data
 {
-  DESTROY(self);
+  [pipeline addObject: protocol];
+  if (nil == pending)
+    {
+      pending = [NSMutableData new];
+    }
+  [pending appendData: data];
+  [pairLock lock];
+  pairPipelined++;
+  [pairLock unlock];
+  if (NO == sending)
+    {
+      [self flush];
+    }
+}
+
+/* Write as much queued request data as possible.  Any remainder is
+ * written when the stream next has space available.
+ */
+- (void) flush
+{
+  while ([pending length] > 0)
+    {
+      NSInteger	written;
+
+      written = [op write: [pending bytes] maxLength: [pending length]];
+      if (written <= 0)
+	{
+	  break;
+	}
+      [pending replaceBytesInRange: NSMakeRange(0, written)
+			 withBytes: 0
+			    length: 0];
+    }
+}
+
+- (BOOL) isBroken
+{
+  return broken;
+}
+
+/* The protocol has read its response, so the next one in the pipeline
+ * becomes the reader.  Returns the next protocol, or nil if there is
+ * none.
+ */
+- (id) nextAfter: (id)protocol
+{
+  if ([pipeline count] > 0 && [pipeline objectAtIndex: 0] == protocol)
+    {
+      [pipeline removeObjectAtIndex: 0];
+    }
+  if ([pipeline count] > 0)
+    {
+      return [pipeline objectAtIndex: 0];
+    }
   return nil;
 }
 
-- (id) initWithHost: (NSHost*)h port: (uint16_t)p forSSL: (BOOL)s;
+/* The first request on the connection has been written, so any queued
+ * requests may follow it.
+ */
+- (void) requestSent
+{
+  sending = NO;
+  [self flush];
+}
+
+/* Mark the connection as in use (by a protocol whose request may have
+ * others pipelined behind it) or, if protocol is nil, as no longer
+ * available for pipelining.
+ */
+- (void) setBusy: (id)protocol
 {
-  unsigned		count;
-  NSDate		*now;
+  NSMutableArray	*busy;
 
-  now = [NSDate date];
   [pairLock lock];
-  count = [pairCache count];
-  while (count-- > 0)
+  busy = [pairBusy objectForKey: key];
+  if (nil == protocol)
     {
-      GSSocketStreamPair	*pair = [pairCache objectAtIndex: count];
-
-      if ([pair->expires timeIntervalSinceDate: now] <= 0.0)
+      if (nil != thread)
+	{
+	  [busy removeObjectIdenticalTo: self];
+	  if ([busy count] == 0)
+	    {
+	      [pairBusy removeObjectForKey: key];
+	    }
+	  thread = nil;
+	}
+      [pipeline removeAllObjects];
+      DESTROY(pending);
+    }
+  else
+    {
+      if (nil == busy)
 	{
-	  [pairCache removeObjectAtIndex: count];
+	  busy = [NSMutableArray new];
+	  [pairBusy setObject: busy forKey: key];
+	  [busy release];
 	}
-      else if (pair->port == p && pair->ssl == s && [pair->host isEqual: h])
+      [busy addObject: self];
+      thread = [NSThread currentThread];
+      sending = YES;
+      broken = NO;
+      if (nil == pipeline)
 	{
-	  /* Found a match ... remove from cache and return as self.
-	   */
-	  DESTROY(self);
-	  self = [pair retain];
-	  [pairCache removeObjectAtIndex: count];
-	  [pairLock unlock];
-	  return self;
+	  pipeline = [NSMutableArray new];
 	}
+      [pipeline addObject: protocol];
     }
   [pairLock unlock];
+}
+
+- (id) init
+{
+  DESTROY(self);
+  return nil;
+}
 
+- (id) initWithInputStream: (NSInputStream*)i
+	      outputStream: (NSOutputStream*)o
+		       key: (NSString*)k
+{
   if ((self = [super init]) != nil)
     {
-      [NSStream getStreamsToHost: host
-			    port: port
-		     inputStream: &ip
-		    outputStream: &op];
-      if (ip == nil || op == nil)
-	{
-	  DESTROY(self);
-	  return nil;
-	}
-      ssl = s;
-      port = p;
-      host = [h retain];
-      [ip retain];
-      [op retain];
-      if (ssl == YES)
-        {
-          [ip setProperty: NSStreamSocketSecurityLevelNegotiatedSSL
-		   forKey: NSStreamSocketSecurityLevelKey];
-          [op setProperty: NSStreamSocketSecurityLevelNegotiatedSSL
-		   forKey: NSStreamSocketSecurityLevelKey];
-        }
+      ip = [i retain];
+      op = [o retain];
+      key = [k copy];
     }
   return self;
 }
@@ -251,6 +529,25 @@ static NSLock		*pairLock = nil;
 
 @end
 
+@implementation	NSURLProtocol (GNUstepExtensions)
+
++ (NSDictionary*) connectionPoolStatistics
+{
+  return [GSSocketStreamPair statistics];
+}
+
++ (void) setConnectionPoolMaximumIdle: (NSUInteger)max
+			      timeout: (NSTimeInterval)timeout
+{
+  [GSSocketStreamPair class];	// Make sure the pool is set up.
+  [pairLock lock];
+  poolMaxIdle = max;
+  poolMaxAge = timeout;
+  [pairLock unlock];
+}
+
+@end
+
 @interface _NSAboutURLProtocol : NSURLProtocol
 @end
 
@@ -264,7 +561,6 @@ static NSLock		*pairLock = nil;
   <NSURLAuthenticationChallengeSender>
 {
   GSMimeParser		*_parser;	// Parser handling incoming data
-  unsigned		_parseOffset;	// Bytes of body loaded in parser.
   float			_version;	// The HTTP version in use.
   int			_statusCode;	// The HTTP status code returned.
   NSInputStream		*_body;		// for sending the body
@@ -274,6 +570,10 @@ static NSLock		*pairLock = nil;
   BOOL			_debug;
   BOOL			_isLoading;
   BOOL			_shouldClose;
+  BOOL			_reused;	// Connection taken from the pool
+  NSString		*_poolKey;	// Pool key for the connection
+  NSDate		*_keepAlive;	// When the server may drop it
+  GSSocketStreamPair	*_pair;		// The connection in use
   NSURLAuthenticationChallenge	*_challenge;
   NSURLCredential		*_credential;
   NSHTTPURLResponse		*_response;
@@ -281,6 +581,16 @@ static NSLock		*pairLock = nil;
 - (void) setDebug: (BOOL)flag;
 @end
 
+@interface _NSHTTPURLProtocol (Private)
+- (void) _buildRequest;
+- (BOOL) _canPipeline;
+- (BOOL) _canRetry;
+- (void) _got: (NSStream*)stream;
+- (void) _gotBytes: (const unsigned char*)buffer count: (int)readCount;
+- (void) _retry;
+- (void) _takeOver: (NSData*)excess;
+@end
+
 @interface _NSHTTPSURLProtocol : _NSHTTPURLProtocol
 @end
 
@@ -628,6 +938,9 @@ static NSURLProtocol	*placeholder = nil;
   [_body release];			// for sending the body
   [_response release];
   [_credential release];
+  [_poolKey release];
+  [_keepAlive release];
+  [_pair release];
   [super dealloc];
 }
 
@@ -681,6 +994,7 @@ static NSURLProtocol	*placeholder = nil;
   _statusCode = 0;	/* No status returned yet.	*/
   _isLoading = YES;
   _complete = NO;
+  _shouldClose = NO;
 
   /* Perform a redirect if the path is empty.
    * As per MacOs-X documentation.
@@ -740,13 +1054,84 @@ static NSURLProtocol	*placeholder = nil;
     }
   else
     {
-      NSURL	*url = [this->request URL];
-      NSHost	*host = [NSHost hostWithName: [url host]];
-      int	port = [[url port] intValue];
+      NSURL			*url = [this->request URL];
+      NSHost			*host;
+      int			port = [[url port] intValue];
+      BOOL			ssl;
+      GSSocketStreamPair	*pair = nil;
 
-      _parseOffset = 0;
       DESTROY(_parser);
+      DESTROY(_keepAlive);
+      DESTROY(_pair);
+
+      ssl = [[url scheme] isEqualToString: @"https"];
+      if (port == 0)
+        {
+	  port = (YES == ssl) ? 443 : 80;
+	}
+      ASSIGN(_poolKey, [GSSocketStreamPair keyForHost: [url host]
+						 port: port
+					       forSSL: ssl]);
+
+      /* If there is an idle connection to the server we can send the
+       * request on that rather than connecting again.  We only do that
+       * for a request which may be sent again if the server had closed
+       * the idle connection.
+       */
+      if (YES == [self _canRetry])
+	{
+	  pair = [GSSocketStreamPair pairForKey: _poolKey];
+	}
 
+      /* Failing that, a pipelinable request may be sent on a connection
+       * which is still busy with earlier requests, to read its response
+       * when theirs have been read.
+       */
+      if (nil == pair && YES == [self _canPipeline])
+	{
+	  pair = [GSSocketStreamPair pipelineForKey: _poolKey];
+	  if (nil != pair)
+	    {
+	      if (_debug == YES)
+		{
+		  NSLog(@"%@ pipelining on connection for %@", self, _poolKey);
+		}
+	      _pair = [pair retain];
+	      [self _buildRequest];
+	      [_pair enqueue: self request: _writeData];
+	      DESTROY(_writeData);
+	      return;
+	    }
+	}
+
+      if (nil != pair)
+	{
+	  if (_debug == YES)
+	    {
+	      NSLog(@"%@ reusing connection for %@", self, _poolKey);
+	    }
+	  _reused = YES;
+	  _pair = [pair retain];
+	  if (YES == [self _canPipeline])
+	    {
+	      [_pair setBusy: self];
+	    }
+	  this->input = [[pair inputStream] retain];
+	  this->output = [[pair outputStream] retain];
+	  [this->input setDelegate: self];
+	  [this->output setDelegate: self];
+	  [this->input scheduleInRunLoop: [NSRunLoop currentRunLoop]
+				 forMode: NSDefaultRunLoopMode];
+	  [this->output scheduleInRunLoop: [NSRunLoop currentRunLoop]
+				  forMode: NSDefaultRunLoopMode];
+	  /* The streams are already open, so start sending the request.
+	   */
+	  [self stream: this->output handleEvent: NSStreamEventOpenCompleted];
+	  return;
+	}
+      _reused = NO;
+
+      host = [NSHost hostWithName: [url host]];
       if (host == nil)
         {
 	  host = [NSHost hostWithAddress: [url host]];	// try dotted notation
@@ -755,11 +1140,6 @@ static NSURLProtocol	*placeholder = nil;
         {
 	  host = [NSHost hostWithAddress: @"127.0.0.1"];	// final default
 	}
-      if (port == 0)
-        {
-	  // default if not specified
-	  port = [[url scheme] isEqualToString: @"https"] ? 443 : 80;
-	}
 
       [NSStream getStreamsToHost: host
 			    port: port
@@ -786,7 +1166,10 @@ static NSURLProtocol	*placeholder = nil;
       [this->input retain];
       [this->output retain];
 #endif
-      if ([[url scheme] isEqualToString: @"https"] == YES)
+      _pair = [[GSSocketStreamPair alloc] initWithInputStream: this->input
+					      outputStream: this->output
+						       key: _poolKey];
+      if (YES == ssl)
         {
           static NSArray        *keys;
           NSUInteger            count;
@@ -835,12 +1218,32 @@ static NSURLProtocol	*placeholder = nil;
 
 - (void) stopLoading
 {
+  NSArray	*followers = nil;
+
   if (_debug == YES)
     {
       NSLog(@"%@ stopLoading", self);
     }
   _isLoading = NO;
   DESTROY(_writeData);
+  if (nil != _pair)
+    {
+      if (nil == this->input)
+	{
+	  /* Waiting for earlier responses on a pipelined connection.
+	   */
+	  [_pair abandon: self];
+	}
+      else
+	{
+	  /* The connection is about to be closed, so any requests
+	   * pipelined behind ours must be sent again.
+	   */
+	  followers = [[[_pair detachFollowers] retain] autorelease];
+	  [_pair close];
+	}
+      DESTROY(_pair);
+    }
   if (this->input != nil)
     {
       [this->input setDelegate: nil];
@@ -854,6 +1257,187 @@ static NSURLProtocol	*placeholder = nil;
       DESTROY(this->input);
       DESTROY(this->output);
     }
+  [followers makeObjectsPerformSelector: @selector(_retry)];
+}
+
+/* Build the request line and headers to be sent.
+ */
+- (void) _buildRequest
+{
+  NSMutableString	*m;
+  NSDictionary		*d;
+  NSEnumerator		*e;
+  NSString		*s;
+  NSURL			*u;
+  int			l;		
+
+  DESTROY(_writeData);
+  _writeOffset = 0;
+  if ([this->request HTTPBodyStream] == nil)
+    {
+      // Not streaming
+      l = [[this->request HTTPBody] length];
+      _version = 1.1;
+    }
+  else
+    {
+      // Stream and close
+      l = -1;
+      _version = 1.0;
+      _shouldClose = YES;
+    }
+
+  m = [[NSMutableString alloc] initWithCapacity: 1024];
+
+  /* The request line is of the form:
+   * method /path?query HTTP/version
+   * where the query part may be missing
+   */
+  [m appendString: [this->request HTTPMethod]];
+  [m appendString: @" "];
+  u = [this->request URL];
+  s = [[u fullPath] stringByAddingPercentEscapesUsingEncoding:
+    NSUTF8StringEncoding];
+  if ([s hasPrefix: @"/"] == NO)
+    {
+      [m appendString: @"/"];
+    }
+  [m appendString: s];
+  s = [u query];
+  if ([s length] > 0)
+    {
+      [m appendString: @"?"];
+      [m appendString: s];
+    }
+  [m appendFormat: @" HTTP/%0.1f\r\n", _version];
+
+  d = [this->request allHTTPHeaderFields];
+  e = [d keyEnumerator];
+  while ((s = [e nextObject]) != nil)
+    {
+      [m appendString: s];
+      [m appendString: @": "];
+      [m appendString: [d objectForKey: s]];
+      [m appendString: @"\r\n"];
+    }
+  /* Use valueForHTTPHeaderField: to check for content-type
+   * header as that does a case insensitive comparison and
+   * we therefore won't end up adding a second header by
+   * accident because the two header names differ in case.
+   */
+  if ([[this->request HTTPMethod] isEqual: @"POST"]
+    && [this->request valueForHTTPHeaderField:
+      @"Content-Type"] == nil)
+    {
+      /* On MacOSX, this is automatically added to POST methods */
+      [m appendString:
+	@"Content-Type: application/x-www-form-urlencoded\r\n"];
+    }
+  if ([this->request valueForHTTPHeaderField: @"Host"] == nil)
+    {
+      id	p = [u port];
+      id	h = [u host];
+
+      if (h == nil)
+	{
+	  h = @"";	// Must send an empty host header
+	}
+      if (p == nil)
+	{
+	  [m appendFormat: @"Host: %@\r\n", h];
+	}
+      else
+	{
+	  [m appendFormat: @"Host: %@:%@\r\n", h, p];
+	}
+    }
+  if (l >= 0 && [this->request
+    valueForHTTPHeaderField: @"Content-Length"] == nil)
+    {
+      [m appendFormat: @"Content-Length: %d\r\n", l];
+    }
+  [m appendString: @"\r\n"];	// End of headers
+  _writeData = RETAIN([m dataUsingEncoding: NSASCIIStringEncoding]);
+  RELEASE(m);
+}
+
+/* Whether the request may be sent on a connection still waiting for
+ * responses to earlier requests.  Only GET requests without a body may
+ * be pipelined, as they can safely be repeated if the server closes the
+ * connection before responding.
+ */
+- (BOOL) _canPipeline
+{
+  if (YES == [this->request HTTPShouldUsePipelining]
+    && YES == [[this->request HTTPMethod] isEqualToString: @"GET"]
+    && nil == [this->request HTTPBodyStream]
+    && [[this->request HTTPBody] length] == 0)
+    {
+      return YES;
+    }
+  return NO;
+}
+
+/* Whether the request may be sent again if the connection it was sent on
+ * turns out to have been closed by the server.  The server may have acted
+ * on the request before closing, so only idempotent methods (RFC 7231
+ * section 4.2.2) without a streamed body may be repeated.
+ */
+- (BOOL) _canRetry
+{
+  NSString	*method = [this->request HTTPMethod];
+
+  if (nil == [this->request HTTPBodyStream]
+    && (nil == method
+    || [method isEqualToString: @"GET"]
+    || [method isEqualToString: @"HEAD"]
+    || [method isEqualToString: @"OPTIONS"]
+    || [method isEqualToString: @"PUT"]
+    || [method isEqualToString: @"DELETE"]))
+    {
+      return YES;
+    }
+  return NO;
+}
+
+/* Called when the connection our request was pipelined on can't be used
+ * to read the response, so we must send the request again.
+ */
+- (void) _retry
+{
+  if (YES == _isLoading)
+    {
+      if (_debug == YES)
+	{
+	  NSLog(@"%@ retrying pipelined request", self);
+	}
+      DESTROY(_pair);
+      DESTROY(_writeData);
+      _isLoading = NO;
+      [self startLoading];
+    }
+}
+
+/* Called when the responses to the requests sent before ours on a
+ * pipelined connection have been read, so we can read our response
+ * (which may have started arriving already, as excess data from the
+ * previous response).
+ */
+- (void) _takeOver: (NSData*)excess
+{
+  if (_debug == YES)
+    {
+      NSLog(@"%@ reading pipelined response", self);
+    }
+  _reused = YES;
+  this->input = [[_pair inputStream] retain];
+  this->output = [[_pair outputStream] retain];
+  [this->input setDelegate: self];
+  [this->output setDelegate: self];
+  if ([excess length] > 0)
+    {
+      [self _gotBytes: [excess bytes] count: [excess length]];
+    }
 }
 
 - (void) _didLoad: (NSData*)d
@@ -866,11 +1450,24 @@ static NSURLProtocol	*placeholder = nil;
   unsigned char	buffer[BUFSIZ*64];
   int 		readCount;
   NSError	*e;
-  NSData	*d;
-  BOOL		wasInHeaders = NO;
 
   readCount = [(NSInputStream *)stream read: buffer
 				  maxLength: sizeof(buffer)];
+  if (YES == _reused && nil == _parser && YES == [self _canRetry]
+    && (readCount == 0
+    || (readCount < 0 && [stream streamStatus] == NSStreamStatusError)))
+    {
+      /* The server closed an idle connection we took from the pool
+       * before sending any of the response, so try the request again.
+       */
+      if (_debug)
+	{
+	  NSLog(@"%@ pooled connection dropped, retrying", self);
+	}
+      [self stopLoading];
+      [self startLoading];
+      return;
+    }
   if (readCount < 0)
     {
       if ([stream  streamStatus] == NSStreamStatusError)
@@ -885,6 +1482,18 @@ static NSURLProtocol	*placeholder = nil;
 	}
       return;
     }
+  [self _gotBytes: buffer count: readCount];
+}
+
+/* Handle data read from the connection (a zero count meaning that the
+ * remote end closed it).
+ */
+- (void) _gotBytes: (const unsigned char*)buffer count: (int)readCount
+{
+  NSError	*e;
+  NSData	*d;
+  BOOL		wasInHeaders = NO;
+
   if (_debug)
     {
       NSLog(@"%@ read %d bytes: '%*.*s'",
@@ -897,7 +1506,12 @@ static NSURLProtocol	*placeholder = nil;
       [_parser setIsHttp];
     }
   wasInHeaders = [_parser isInHeaders];
-  d = [NSData dataWithBytes: buffer length: readCount];
+  /* The parser copies what it needs to keep, so we can let it use the
+   * buffer directly.
+   */
+  d = [NSData dataWithBytesNoCopy: (void*)buffer
+			   length: readCount
+		     freeWhenDone: NO];
   if ([_parser parse: d] == NO && (_complete = [_parser isComplete]) == NO)
     {
       if (_debug == YES)
@@ -915,7 +1529,10 @@ static NSURLProtocol	*placeholder = nil;
     {
       BOOL		isInHeaders = [_parser isInHeaders];
       GSMimeDocument	*document = [_parser mimeDocument];
-      unsigned		bodyLength;
+      NSData		*excess;
+      NSArray		*followers = nil;
+      id		next = nil;
+      BOOL		keep;
 
       _complete = [_parser isComplete];
       if (YES == wasInHeaders && NO == isInHeaders)
@@ -941,6 +1558,22 @@ static NSURLProtocol	*placeholder = nil;
 	  else
 	    {
 	      _shouldClose = NO;	// Keep connection alive.
+	      s = [[document headerNamed: @"keep-alive"] value];
+	      if (s != nil)
+		{
+		  NSRange	r;
+
+		  r = [s rangeOfString: @"timeout="
+			       options: NSCaseInsensitiveSearch];
+		  if (r.length > 0)
+		    {
+		      int	t;
+
+		      t = [[s substringFromIndex: NSMaxRange(r)] intValue];
+		      ASSIGN(_keepAlive, [NSDate dateWithTimeIntervalSinceNow:
+			(t > 1 ? t - 1 : 0)]);
+		    }
+		}
 	    }
 
 	  s = [info objectForKey: NSHTTPPropertyStatusCodeKey];
@@ -1257,19 +1890,69 @@ static NSURLProtocol	*placeholder = nil;
 		}
 	    }
 
-	  [this->input removeFromRunLoop: [NSRunLoop currentRunLoop]
-				 forMode: NSDefaultRunLoopMode];
-	  [this->output removeFromRunLoop: [NSRunLoop currentRunLoop]
-				  forMode: NSDefaultRunLoopMode];
-	  if (_shouldClose == YES)
+	  /* Data following the response belongs to the response to the
+	   * next request pipelined on the connection (if any).
+	   */
+	  excess = [[[_parser excess] retain] autorelease];
+	  keep = NO;
+	  if (NO == _shouldClose && readCount > 0 && nil != this->output
+	    && nil != _pair && NO == [_pair isBroken])
+	    {
+	      /* If the parser didn't find the end of the response (eg. a
+	       * 204 with no content length), any data it has beyond the
+	       * headers could belong to a following response, in which
+	       * case we can't use the connection again.
+	       */
+	      if (YES == [_parser isComplete] || [[_parser data] length] == 0)
+		{
+		  keep = YES;
+		}
+	    }
+	  if (YES == keep)
+	    {
+	      next = [_pair nextAfter: self];
+	    }
+	  else
+	    {
+	      followers = [[[_pair detachFollowers] retain] autorelease];
+	    }
+	  if (nil != next)
+	    {
+	      /* Hand the connection on to the next request, leaving the
+	       * streams scheduled for it.
+	       */
+	      [this->input setDelegate: nil];
+	      [this->output setDelegate: nil];
+	      [[next retain] autorelease];
+	      DESTROY(this->input);
+	      DESTROY(this->output);
+	    }
+	  else if (YES == keep)
+	    {
+	      /* Keep the connection in the pool for another request.
+	       */
+	      [_pair cache: (nil == _keepAlive)
+		? [NSDate distantFuture] : _keepAlive];
+	      [this->input setDelegate: nil];
+	      [this->output setDelegate: nil];
+	      DESTROY(this->input);
+	      DESTROY(this->output);
+	    }
+	  else
 	    {
+	      [this->input removeFromRunLoop: [NSRunLoop currentRunLoop]
+				     forMode: NSDefaultRunLoopMode];
+	      [this->output removeFromRunLoop: [NSRunLoop currentRunLoop]
+				      forMode: NSDefaultRunLoopMode];
 	      [this->input setDelegate: nil];
 	      [this->output setDelegate: nil];
 	      [this->input close];
 	      [this->output close];
 	      DESTROY(this->input);
 	      DESTROY(this->output);
+	      [_pair close];
 	    }
+	  DESTROY(_pair);
 
 	  /*
 	   * Tell superclass that we have successfully loaded the data
@@ -1278,16 +1961,9 @@ static NSURLProtocol	*placeholder = nil;
 	  if (_isLoading == YES)
 	    {
 	      d = [_parser data];
-	      bodyLength = [d length];
-	      if (bodyLength > _parseOffset)
+	      if ([d length] > 0)
 		{
-		  if (_parseOffset > 0)
-		    {
-		      d = [d subdataWithRange: 
-			NSMakeRange(_parseOffset, bodyLength - _parseOffset)];
-		    }
-		  _parseOffset = bodyLength;
-		  [self _didLoad: d];
+		  [self _didLoad: [NSData dataWithData: d]];
 		}
 
 	      /* Check again in case the client cancelled the load inside
@@ -1299,24 +1975,25 @@ static NSURLProtocol	*placeholder = nil;
 	          [this->client URLProtocolDidFinishLoading: self];
 		}
 	    }
+	  [next _takeOver: excess];
+	  [followers makeObjectsPerformSelector: @selector(_retry)];
+	  return;
 	}
       else if (_isLoading == YES && _statusCode != 401)
 	{
 	  /*
-	   * Report partial data if possible.
+	   * Report partial data if possible.  The data is handed on as
+	   * it is decoded rather than accumulated, so however large the
+	   * body is we only buffer what has arrived since the last read.
 	   */
 	  if ([_parser isInBody])
 	    {
-	      d = [_parser data];
-	      bodyLength = [d length];
-	      if (bodyLength > _parseOffset)
+	      NSMutableData	*m = [_parser data];
+
+	      if ([m length] > 0)
 	        {
-		  if (_parseOffset > 0)
-		    {
-		      d = [d subdataWithRange: 
-			NSMakeRange(_parseOffset, [d length] - _parseOffset)];
-		    }
-		  _parseOffset = bodyLength;
+		  d = [NSData dataWithData: m];
+		  [m setLength: 0];
 		  [self _didLoad: d];
 		}
 	    }
@@ -1378,107 +2055,12 @@ static NSURLProtocol	*placeholder = nil;
       switch(event)
 	{
 	  case NSStreamEventOpenCompleted: 
-	    {
-	      NSMutableString	*m;
-	      NSDictionary	*d;
-	      NSEnumerator	*e;
-	      NSString		*s;
-	      NSURL		*u;
-	      int		l;		
-
-	      if (_debug == YES)
-	        {
-	          NSLog(@"%@ HTTP output stream opened", self);
-	        }
-	      DESTROY(_writeData);
-	      _writeOffset = 0;
-	      if ([this->request HTTPBodyStream] == nil)
-	        {
-		  // Not streaming
-		  l = [[this->request HTTPBody] length];
-		  _version = 1.1;
-		}
-	      else
-	        {
-		  // Stream and close
-		  l = -1;
-	          _version = 1.0;
-		  _shouldClose = YES;
-		}
-
-	      m = [[NSMutableString alloc] initWithCapacity: 1024];
-
-	      /* The request line is of the form:
-	       * method /path?query HTTP/version
-	       * where the query part may be missing
-	       */
-	      [m appendString: [this->request HTTPMethod]];
-	      [m appendString: @" "];
-	      u = [this->request URL];
-	      s = [[u fullPath] stringByAddingPercentEscapesUsingEncoding:
-		NSUTF8StringEncoding];
-	      if ([s hasPrefix: @"/"] == NO)
-	        {
-		  [m appendString: @"/"];
-		}
-	      [m appendString: s];
-	      s = [u query];
-	      if ([s length] > 0)
-	        {
-		  [m appendString: @"?"];
-		  [m appendString: s];
-		}
-	      [m appendFormat: @" HTTP/%0.1f\r\n", _version];
-
-	      d = [this->request allHTTPHeaderFields];
-	      e = [d keyEnumerator];
-	      while ((s = [e nextObject]) != nil)
-	        {
-		  [m appendString: s];
-		  [m appendString: @": "];
-		  [m appendString: [d objectForKey: s]];
-		  [m appendString: @"\r\n"];
-		}
-	      /* Use valueForHTTPHeaderField: to check for content-type
-	       * header as that does a case insensitive comparison and
-	       * we therefore won't end up adding a second header by
-	       * accident because the two header names differ in case.
-	       */
-	      if ([[this->request HTTPMethod] isEqual: @"POST"]
-	        && [this->request valueForHTTPHeaderField:
-		  @"Content-Type"] == nil)
-		{
-		  /* On MacOSX, this is automatically added to POST methods */
-		  [m appendString:
-		    @"Content-Type: application/x-www-form-urlencoded\r\n"];
-		}
-	      if ([this->request valueForHTTPHeaderField: @"Host"] == nil)
-		{
-		  id	p = [u port];
-		  id	h = [u host];
-
-		  if (h == nil)
-		    {
-		      h = @"";	// Must send an empty host header
-		    }
-		  if (p == nil)
-		    {
-		      [m appendFormat: @"Host: %@\r\n", h];
-		    }
-		  else
-		    {
-		      [m appendFormat: @"Host: %@:%@\r\n", h, p];
-		    }
-		}
-	      if (l >= 0 && [this->request
-	        valueForHTTPHeaderField: @"Content-Length"] == nil)
-		{
-		  [m appendFormat: @"Content-Length: %d\r\n", l];
-		}
-	      [m appendString: @"\r\n"];	// End of headers
-	      _writeData = RETAIN([m dataUsingEncoding: NSASCIIStringEncoding]);
-	      RELEASE(m);
-	    }			// Fall through to do the write
+	    if (_debug == YES)
+	      {
+		NSLog(@"%@ HTTP output stream opened", self);
+	      }
+	    [self _buildRequest];
+	    // Fall through to do the write
 
 	  case NSStreamEventHasSpaceAvailable: 
 	    {
@@ -1594,12 +2176,20 @@ static NSURLProtocol	*placeholder = nil;
 		      sent = YES;
 		    }
 		}
+	      else
+		{
+		  /* Our request has been sent, so write any requests
+		   * pipelined after it.
+		   */
+		  [_pair flush];
+		}
 	      if (sent == YES)
 		{
 		  if (_debug)
 		    {
 		      NSLog(@"%@ request sent", self);
 		    }
+		  [_pair requestSent];
 		  if (_shouldClose == YES)
 		    {
 		      [this->output setDelegate: nil];
@@ -1626,6 +2216,15 @@ static NSURLProtocol	*placeholder = nil;
     {
       NSError	*error = [[[stream streamError] retain] autorelease];
 
+      if (YES == _reused && nil == _parser && YES == [self _canRetry])
+	{
+	  /* Failed sending on a pooled connection the server had dropped,
+	   * so try again on a new connection.
+	   */
+	  [self stopLoading];
+	  [self startLoading];
+	  return;
+	}
       [self stopLoading];
       [this->client URLProtocol: self didFailWithError: error];
     }
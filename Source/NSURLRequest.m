@@ -38,6 +38,7 @@ typedef struct {
   NSString			*method;
   NSMutableDictionary		*headers;
   BOOL				shouldHandleCookies;
+  BOOL				shouldUsePipelining;
   NSURL				*URL;
   NSURL				*mainDocumentURL;
   NSURLRequestCachePolicy	cachePolicy;
@@ -114,6 +115,7 @@ typedef struct {
 	  ASSIGN(inst->bodyStream, this->bodyStream);
 	  ASSIGN(inst->method, this->method);
 	  inst->shouldHandleCookies = this->shouldHandleCookies;
+	  inst->shouldUsePipelining = this->shouldUsePipelining;
           inst->headers = [this->headers mutableCopy];
 	}
     }
@@ -268,6 +270,7 @@ typedef struct {
       ASSIGN(inst->bodyStream, this->bodyStream);
       ASSIGN(inst->method, this->method);
       inst->shouldHandleCookies = this->shouldHandleCookies;
+      inst->shouldUsePipelining = this->shouldUsePipelining;
       inst->headers = [this->headers mutableCopy];
     }
   return o;
@@ -347,6 +350,11 @@ typedef struct {
   return this->shouldHandleCookies;
 }
 
+- (BOOL) HTTPShouldUsePipelining
+{
+  return this->shouldUsePipelining;
+}
+
 - (NSString *) valueForHTTPHeaderField: (NSString *)field
 {
   return [this->headers objectForKey: field];
@@ -415,6 +423,11 @@ typedef struct {
   this->shouldHandleCookies = should;
 }
 
+- (void) setHTTPShouldUsePipelining: (BOOL)should
+{
+  this->shouldUsePipelining = should;
+}
+
 - (void) setValue: (NSString *)value forHTTPHeaderField: (NSString *)field
 {
   if (this->headers == nil)
@@ -26,9 +26,23 @@
 #ifdef HAVE_POLL_F
 #include <poll.h>
 #endif
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define	FDCOUNT	1024
 
+#ifdef	HAVE_EPOLL
+/* Special values for the epoll_reg array.  A value of zero means that the
+ * descriptor is not registered, a positive value is the set of events the
+ * descriptor is registered for.
+ */
+#define	EPOLL_RECHECK	-1	/* Registration may be stale.	*/
+#define	EPOLL_ALWAYS	-2	/* Not pollable (eg. disk file).	*/
+#endif
+
 #if	GS_WITH_GC == 0
 static SEL	wRelSel;
 static SEL	wRetSel;
@@ -74,8 +88,18 @@ static const NSMapTableValueCallBacks WatcherMapValueCallBacks =
   RELEASE(mode);
   GSIArrayEmpty(performers);
   NSZoneFree(performers->zone, (void*)performers);
-  GSIArrayEmpty(timers);
-  NSZoneFree(timers->zone, (void*)timers);
+  while (timerCount > 0)
+    {
+      RELEASE(timers[--timerCount].timer);
+    }
+  if (timers != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), (void*)timers);
+    }
+  if (timerSet != 0)
+    {
+      NSFreeHashTable(timerSet);
+    }
   GSIArrayEmpty(watchers);
   NSZoneFree(watchers->zone, (void*)watchers);
   if (_efdMap != 0)
@@ -97,6 +121,28 @@ static const NSMapTableValueCallBacks WatcherMapValueCallBacks =
     {
       NSZoneFree(NSDefaultMallocZone(), pollfds);
     }
+#ifdef	HAVE_EPOLL
+  if (epfd >= 0)
+    {
+      close(epfd);
+    }
+  if (epoll_reg != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), epoll_reg);
+    }
+  if (epoll_fds != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), epoll_fds);
+    }
+  if (epoll_events != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), epoll_events);
+    }
+  if (readyfds != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), readyfds);
+    }
+#endif
 #endif
   [super dealloc];
 }
@@ -160,6 +206,22 @@ static const NSMapTableValueCallBacks WatcherMapValueCallBacks =
   completed = YES;
 }
 
+#ifdef	HAVE_EPOLL
+- (void) forgetDescriptor: (int)fd
+{
+  if (fd >= 0 && (unsigned)fd < epoll_limit && epoll_reg[fd] != 0)
+    {
+      if (epoll_reg[fd] != EPOLL_ALWAYS)
+	{
+	  struct epoll_event	ev;
+
+	  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+	}
+      epoll_reg[fd] = 0;
+    }
+}
+#endif
+
 - (id) init
 {
   [NSException raise: NSInternalInconsistencyException
@@ -179,18 +241,16 @@ static const NSMapTableValueCallBacks WatcherMapValueCallBacks =
 #if	GS_WITH_GC
       z = (NSZone*)1;
       performers = NSAllocateCollectable(sizeof(GSIArray_t), NSScannedOption);
-      timers = NSAllocateCollectable(sizeof(GSIArray_t), NSScannedOption);
       watchers = NSAllocateCollectable(sizeof(GSIArray_t), NSScannedOption);
       _trigger = NSAllocateCollectable(sizeof(GSIArray_t), NSScannedOption);
 #else
       z = [self zone];
       performers = NSZoneMalloc(z, sizeof(GSIArray_t));
-      timers = NSZoneMalloc(z, sizeof(GSIArray_t));
       watchers = NSZoneMalloc(z, sizeof(GSIArray_t));
       _trigger = NSZoneMalloc(z, sizeof(GSIArray_t));
 #endif
       GSIArrayInitWithZoneAndCapacity(performers, z, 8);
-      GSIArrayInitWithZoneAndCapacity(timers, z, 8);
+      timerSet = NSCreateHashTable(NSNonOwnedPointerHashCallBacks, 0);
       GSIArrayInitWithZoneAndCapacity(watchers, z, 8);
       GSIArrayInitWithZoneAndCapacity(_trigger, z, 8);
 
@@ -200,6 +260,9 @@ static const NSMapTableValueCallBacks WatcherMapValueCallBacks =
 				      WatcherMapValueCallBacks, 0);
       _wfdMap = NSCreateMapTable (NSIntegerMapKeyCallBacks,
 				      WatcherMapValueCallBacks, 0);
+#ifdef	HAVE_EPOLL
+      epfd = -1;	// Created when we first poll.
+#endif
     }
   return self;
 }
@@ -267,6 +330,202 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
   pollfds[index].events |= event;
 }
 
+#ifdef	HAVE_EPOLL
+
+static void *
+epollRealloc(void *old, size_t size)
+{
+#if	GS_WITH_GC
+  if (old == 0)
+    {
+      return NSAllocateCollectable(size, 0);
+    }
+  return NSReallocateCollectable(old, size, 0);
+#else
+  if (old == 0)
+    {
+      return NSZoneMalloc(NSDefaultMallocZone(), size);
+    }
+  return NSZoneRealloc(NSDefaultMallocZone(), old, size);
+#endif
+}
+
+static inline uint32_t
+pollToEpoll(short events)
+{
+  uint32_t	e = 0;
+
+  if (events & POLLIN) e |= EPOLLIN;
+  if (events & POLLOUT) e |= EPOLLOUT;
+  if (events & POLLPRI) e |= EPOLLPRI;
+  return e;
+}
+
+static inline short
+epollToPoll(uint32_t events)
+{
+  short		e = 0;
+
+  if (events & EPOLLIN) e |= POLLIN;
+  if (events & EPOLLOUT) e |= POLLOUT;
+  if (events & EPOLLPRI) e |= POLLPRI;
+  if (events & EPOLLERR) e |= POLLERR;
+  if (events & EPOLLHUP) e |= POLLHUP;
+  return e;
+}
+
+/* Make sure the epoll_reg array can hold an entry for fd.
+ */
+static void
+epollGrowReg(GSRunLoopCtxt *ctxt, int fd)
+{
+  if ((unsigned)fd >= ctxt->epoll_limit)
+    {
+      unsigned	old = ctxt->epoll_limit;
+
+      ctxt->epoll_limit = fd + 64;
+      ctxt->epoll_reg = epollRealloc(ctxt->epoll_reg,
+	ctxt->epoll_limit * sizeof(*(ctxt->epoll_reg)));
+      memset(ctxt->epoll_reg + old, '\0',
+	(ctxt->epoll_limit - old) * sizeof(*(ctxt->epoll_reg)));
+    }
+}
+
+/* Mark a descriptor supplied by a port as needing to be re-registered,
+ * since it may have been closed and its number reused.
+ */
+static void
+epollRecheck(GSRunLoopCtxt *ctxt, int fd)
+{
+  if ((unsigned)fd < ctxt->epoll_limit && ctxt->epoll_reg[fd] > 0)
+    {
+      ctxt->epoll_reg[fd] = EPOLL_RECHECK;
+    }
+}
+
+/* Bring the epoll interest set into line with the descriptors in the
+ * pollfds array (built by setPollfd() for this pass of the loop).
+ * Only descriptors whose events have changed cost a system call, so an
+ * idle loop with many watchers does no kernel work proportional to the
+ * number of watchers.
+ * Descriptors which cannot be used with epoll (regular files) are always
+ * ready as far as poll() is concerned, so they are copied straight to
+ * the readyfds array and the number of them is returned.
+ */
+static int
+epollSync(GSRunLoopCtxt *ctxt)
+{
+  pollextra	*pe = (pollextra*)ctxt->extra;
+  unsigned	count = ctxt->pollfds_count;
+  int		always = 0;
+  unsigned	i;
+
+  if (ctxt->epoll_capacity < count)
+    {
+      ctxt->epoll_capacity = count + 8;
+      ctxt->epoll_fds = epollRealloc(ctxt->epoll_fds,
+	ctxt->epoll_capacity * sizeof(*(ctxt->epoll_fds)));
+      ctxt->epoll_events = epollRealloc(ctxt->epoll_events,
+	ctxt->epoll_capacity * sizeof(*(ctxt->epoll_events)));
+      ctxt->readyfds = epollRealloc(ctxt->readyfds,
+	ctxt->epoll_capacity * sizeof(*(ctxt->readyfds)));
+    }
+
+  /* Remove descriptors which are no longer of interest.
+   */
+  for (i = 0; i < ctxt->epoll_count; i++)
+    {
+      int	fd = ctxt->epoll_fds[i];
+
+      if (fd >= pe->limit || pe->index[fd] == -1)
+	{
+	  if (ctxt->epoll_reg[fd] != 0 && ctxt->epoll_reg[fd] != EPOLL_ALWAYS)
+	    {
+	      struct epoll_event	ev;
+
+	      /* Failure just means the descriptor was already closed.
+	       */
+	      epoll_ctl(ctxt->epfd, EPOLL_CTL_DEL, fd, &ev);
+	    }
+	  ctxt->epoll_reg[fd] = 0;
+	}
+    }
+
+  /* Add or modify the descriptors we want, remembering them so we can
+   * remove them when they are no longer wanted.
+   */
+  for (i = 0; i < count; i++)
+    {
+      struct pollfd	*p = &ctxt->pollfds[i];
+      int		fd = p->fd;
+      int		want = (int)pollToEpoll(p->events);
+      int		have;
+
+      epollGrowReg(ctxt, fd);
+      ctxt->epoll_fds[i] = fd;
+      have = ctxt->epoll_reg[fd];
+      if (have == EPOLL_ALWAYS)
+	{
+	  ctxt->readyfds[always].fd = fd;
+	  ctxt->readyfds[always].events = p->events;
+	  ctxt->readyfds[always].revents = p->events;
+	  always++;
+	}
+      else if (have != want)
+	{
+	  struct epoll_event	ev;
+	  int			result;
+
+	  memset(&ev, '\0', sizeof(ev));
+	  ev.events = (uint32_t)want;
+	  ev.data.fd = fd;
+	  if (have == 0)
+	    {
+	      result = epoll_ctl(ctxt->epfd, EPOLL_CTL_ADD, fd, &ev);
+	      if (result < 0 && errno == EEXIST)
+		{
+		  result = epoll_ctl(ctxt->epfd, EPOLL_CTL_MOD, fd, &ev);
+		}
+	    }
+	  else
+	    {
+	      result = epoll_ctl(ctxt->epfd, EPOLL_CTL_MOD, fd, &ev);
+	      if (result < 0 && errno == ENOENT)
+		{
+		  result = epoll_ctl(ctxt->epfd, EPOLL_CTL_ADD, fd, &ev);
+		}
+	    }
+	  if (result == 0)
+	    {
+	      ctxt->epoll_reg[fd] = want;
+	    }
+	  else if (errno == EPERM)
+	    {
+	      ctxt->epoll_reg[fd] = EPOLL_ALWAYS;
+	      ctxt->readyfds[always].fd = fd;
+	      ctxt->readyfds[always].events = p->events;
+	      ctxt->readyfds[always].revents = p->events;
+	      always++;
+	    }
+	  else
+	    {
+	      /* Most likely a bad descriptor ... let poll() semantics
+	       * apply and report it as invalid to the watcher.
+	       */
+	      ctxt->epoll_reg[fd] = 0;
+	      ctxt->readyfds[always].fd = fd;
+	      ctxt->readyfds[always].events = p->events;
+	      ctxt->readyfds[always].revents = POLLNVAL;
+	      always++;
+	    }
+	}
+    }
+  ctxt->epoll_count = count;
+  return always;
+}
+
+#endif	/* HAVE_EPOLL */
+
 /**
  * Perform a poll for the specified runloop context.
  * If the method has been called re-entrantly, the contexts stack
@@ -277,6 +536,7 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
 - (BOOL) pollUntil: (int)milliseconds within: (NSArray*)contexts
 {
   GSRunLoopThreadInfo   *threadInfo = GSRunLoopInfoForThread(nil);
+  struct pollfd	*ready;	/* Descriptors to examine for events. */
   int		poll_return;
   int		fdEnd;	/* Number of descriptors being monitored. */
   int		fdIndex;
@@ -284,6 +544,26 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
   unsigned	count;
   unsigned int	i;
   BOOL		immediate = NO;
+#ifdef	HAVE_EPOLL
+  static Class	socketPortClass = Nil;
+  static Class	messagePortClass = Nil;
+  unsigned	closed;
+  BOOL		recheckPorts;
+
+  /* The ports in this library tell us when they close a descriptor, so
+   * we only need to register their descriptors afresh after that has
+   * happened.  Other ports might close and reuse a descriptor at any
+   * time, so theirs are registered afresh on every pass.
+   */
+  if (Nil == socketPortClass)
+    {
+      messagePortClass = [NSMessagePort class];
+      socketPortClass = [NSSocketPort class];
+    }
+  closed = GSPrivatePortClosedDescriptors();
+  recheckPorts = (closed != epoll_closed) ? YES : NO;
+  epoll_closed = closed;
+#endif
 
   i = GSIArrayCount(watchers);
 
@@ -382,6 +662,16 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
 		  NSInteger port_fd_count = FDCOUNT;
 		  NSInteger port_fd_buffer[FDCOUNT];
 		  NSInteger *port_fd_array = port_fd_buffer;
+#ifdef	HAVE_EPOLL
+		  BOOL	recheck = recheckPorts;
+
+		  if (NO == recheck
+		    && NO == [port isKindOfClass: socketPortClass]
+		    && NO == [port isKindOfClass: messagePortClass])
+		    {
+		      recheck = YES;
+		    }
+#endif
 
 		  [port getFds: port_fd_array count: &port_fd_count];
                   while (port_fd_count > port_fd_size)
@@ -398,6 +688,12 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
 		    {
 		      fd = port_fd_array[port_fd_count];
 		      setPollfd(fd, POLLIN, self);
+#ifdef	HAVE_EPOLL
+		      if (YES == recheck)
+			{
+			  epollRecheck(self, fd);
+			}
+#endif
 		      NSMapInsert(_rfdMap, (void*)(intptr_t)fd, info);
 		    }
                   if (port_fd_array != port_fd_buffer) free(port_fd_array);
@@ -418,6 +714,56 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
       milliseconds = 0;
     }
 
+#ifdef	HAVE_EPOLL
+  if (epfd == -1)
+    {
+      epfd = epoll_create(64);
+      if (epfd >= 0)
+	{
+	  fcntl(epfd, F_SETFD, FD_CLOEXEC);
+	}
+      else
+	{
+	  NSDebugMLLog(@"NSRunLoop", @"epoll_create() failed ... using poll");
+	  epfd = -2;
+	}
+    }
+  if (epfd >= 0)
+    {
+      int	always = epollSync(self);
+      int	space = (int)pollfds_count - always;
+
+      if (always > 0)
+	{
+	  milliseconds = 0;
+	}
+      poll_return = 0;
+      if (space > 0)
+	{
+	  poll_return = epoll_wait(epfd, epoll_events, space, milliseconds);
+	}
+      if (poll_return > 0)
+	{
+	  for (i = 0; i < (unsigned)poll_return; i++)
+	    {
+	      struct pollfd	*p = &readyfds[always + i];
+
+	      p->fd = epoll_events[i].data.fd;
+	      p->events = 0;
+	      p->revents = epollToPoll(epoll_events[i].events);
+	    }
+	  poll_return += always;
+	}
+      else if (poll_return == 0)
+	{
+	  poll_return = always;
+	}
+      ready = readyfds;
+      fdEnd = poll_return;
+    }
+  else
+#endif
+    {
 #if 0
 {
   unsigned int i;
@@ -427,7 +773,7 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
   fprintf(stderr, "\n");
 }
 #endif
-  poll_return = poll (pollfds, pollfds_count, milliseconds);
+      poll_return = poll (pollfds, pollfds_count, milliseconds);
 #if 0
 {
   unsigned int i;
@@ -437,6 +783,9 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
   fprintf(stderr, "\n");
 }
 #endif
+      ready = pollfds;
+      fdEnd = pollfds_count;
+    }
 
   NSDebugMLLog(@"NSRunLoop", @"poll returned %d\n", poll_return);
 
@@ -516,7 +865,6 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
    * inputs where multiple inputs are in use.  Note - fairStart can be
    * modified while we are in the loop (by recursive calls).
    */
-  fdEnd = pollfds_count;
   if (++fairStart >= fdEnd)
     {
       fairStart = 0;
@@ -531,9 +879,9 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
   completed = NO;
   while (completed == NO)
     {
-      if (pollfds[fdIndex].revents != 0)
+      if (ready[fdIndex].revents != 0)
 	{
-	  int			fd = pollfds[fdIndex].fd;
+	  int			fd = ready[fdIndex].fd;
 	  GSRunLoopWatcher	*watcher;
 	  BOOL			found = NO;
 	  
@@ -543,7 +891,7 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
 	   * The ET_EDSEC handler is the primary handler for exceptions
 	   * though it is more generally used to deal with out-of-band data.
 	   */
-	  if (pollfds[fdIndex].revents & (POLLPRI|POLLERR|POLLHUP|POLLNVAL))
+	  if (ready[fdIndex].revents & (POLLPRI|POLLERR|POLLHUP|POLLNVAL))
 	    {
 	      watcher
 		= (GSRunLoopWatcher*)NSMapGet(_efdMap, (void*)(intptr_t)fd);
@@ -575,7 +923,7 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
 		}
 	      found = YES;
 	    }
-	  if (pollfds[fdIndex].revents & (POLLOUT|POLLERR|POLLHUP|POLLNVAL))
+	  if (ready[fdIndex].revents & (POLLOUT|POLLERR|POLLHUP|POLLNVAL))
 	    {
 	      watcher
 		= (GSRunLoopWatcher*)NSMapGet(_wfdMap, (void*)(intptr_t)fd);
@@ -607,7 +955,7 @@ static void setPollfd(int fd, int event, GSRunLoopCtxt *ctxt)
 		}
 	      found = YES;
 	    }
-	  if (pollfds[fdIndex].revents & (POLLIN|POLLERR|POLLHUP|POLLNVAL))
+	  if (ready[fdIndex].revents & (POLLIN|POLLERR|POLLHUP|POLLNVAL))
 	    {
               if (fd == threadInfo->inputFd)
                 {
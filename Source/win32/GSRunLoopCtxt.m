@@ -64,8 +64,18 @@ static const NSMapTableValueCallBacks WatcherMapValueCallBacks =
   RELEASE(mode);
   GSIArrayEmpty(performers);
   NSZoneFree(performers->zone, (void*)performers);
-  GSIArrayEmpty(timers);
-  NSZoneFree(timers->zone, (void*)timers);
+  while (timerCount > 0)
+    {
+      RELEASE(timers[--timerCount].timer);
+    }
+  if (timers != 0)
+    {
+      NSZoneFree(NSDefaultMallocZone(), (void*)timers);
+    }
+  if (timerSet != 0)
+    {
+      NSFreeHashTable(timerSet);
+    }
   GSIArrayEmpty(watchers);
   NSZoneFree(watchers->zone, (void*)watchers);
   if (handleMap != 0)
@@ -154,18 +164,16 @@ static const NSMapTableValueCallBacks WatcherMapValueCallBacks =
 #if	GS_WITH_GC
       z = (NSZone*)1;
       performers = NSAllocateCollectable(sizeof(GSIArray_t), NSScannedOption);
-      timers = NSAllocateCollectable(sizeof(GSIArray_t), NSScannedOption);
       watchers = NSAllocateCollectable(sizeof(GSIArray_t), NSScannedOption);
       _trigger = NSAllocateCollectable(sizeof(GSIArray_t), NSScannedOption);
 #else
       z = [self zone];
       performers = NSZoneMalloc(z, sizeof(GSIArray_t));
-      timers = NSZoneMalloc(z, sizeof(GSIArray_t));
       watchers = NSZoneMalloc(z, sizeof(GSIArray_t));
       _trigger = NSZoneMalloc(z, sizeof(GSIArray_t));
 #endif
       GSIArrayInitWithZoneAndCapacity(performers, z, 8);
-      GSIArrayInitWithZoneAndCapacity(timers, z, 8);
+      timerSet = NSCreateHashTable(NSNonOwnedPointerHashCallBacks, 0);
       GSIArrayInitWithZoneAndCapacity(watchers, z, 8);
       GSIArrayInitWithZoneAndCapacity(_trigger, z, 8);
 
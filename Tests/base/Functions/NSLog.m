@@ -0,0 +1,108 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSArray.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSString.h>
+#include <unistd.h>
+
+#define	LINES	200
+
+/* Reads everything written to the pipe so far.
+ */
+static NSString *
+readLog(int fd)
+{
+  char		buf[65536];
+  ssize_t	len = read(fd, buf, sizeof(buf));
+
+  if (len <= 0)
+    {
+      return @"";
+    }
+  return [[[NSString alloc] initWithBytes: buf length: len
+    encoding: NSUTF8StringEncoding] autorelease];
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  int			fds[2];
+  int			old;
+  NSString		*log;
+  NSArray		*lines;
+  NSString		*line;
+  BOOL			ok;
+  unsigned		i;
+
+  START_SET("NSLog")
+  if (pipe(fds) != 0)
+    {
+      SKIP("unable to create a pipe")
+    }
+  [GSLogLock() lock];
+  old = _NSLogDescriptor;
+  _NSLogDescriptor = fds[1];
+  [GSLogLock() unlock];
+
+  NSLog(@"synchronous %d", 1);
+  log = readLog(fds[0]);
+  PASS([log hasSuffix: @"synchronous 1\n"], "a message is logged");
+  PASS([log length] > 24 && [log characterAtIndex: 4] == '-'
+    && [log characterAtIndex: 19] == '.',
+    "the message starts with the date and time");
+
+  GSLogSetAsynchronous(YES);
+  for (i = 0; i < LINES; i++)
+    {
+      NSLog(@"asynchronous %u", i);
+    }
+  GSLogFlush();
+  log = readLog(fds[0]);
+  lines = [log componentsSeparatedByString: @"\n"];
+  PASS([lines count] == LINES + 1, "all asynchronous messages are written");
+  ok = YES;
+  for (i = 0; i < LINES && i < [lines count]; i++)
+    {
+      line = [NSString stringWithFormat: @"asynchronous %u", i];
+      if ([[lines objectAtIndex: i] hasSuffix: line] == NO)
+	{
+	  ok = NO;
+	}
+    }
+  PASS(ok, "asynchronous messages are written in order");
+
+  for (i = 0; i < LINES; i++)
+    {
+      NSLog(@"signal %u", i);
+    }
+  GSLogFlushFromSignal();
+  GSLogFlush();
+  log = readLog(fds[0]);
+  lines = [log componentsSeparatedByString: @"\n"];
+  ok = ([lines count] == LINES + 1);
+  for (i = 0; ok == YES && i < LINES; i++)
+    {
+      line = [NSString stringWithFormat: @"signal %u", i];
+      if ([[lines objectAtIndex: i] hasSuffix: line] == NO)
+	{
+	  ok = NO;
+	}
+    }
+  PASS(ok, "GSLogFlushFromSignal() writes each queued message once in order");
+
+  GSLogSetAsynchronous(NO);
+  NSLog(@"synchronous %d", 2);
+  log = readLog(fds[0]);
+  PASS([log hasSuffix: @"synchronous 2\n"],
+    "messages are written synchronously again");
+
+  [GSLogLock() lock];
+  _NSLogDescriptor = old;
+  [GSLogLock() unlock];
+  close(fds[0]);
+  close(fds[1]);
+  END_SET("NSLog")
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,177 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSKeyValueCoding.h>
+#import <Foundation/NSKeyValueObserving.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSValue.h>
+#import <GNUstepBase/GSObjCRuntime.h>
+
+#define	OBJECTS	1000
+#define	LOOPS	100
+#define	THREADS	4
+
+static NSConditionLock	*running = nil;
+static unsigned		failures = 0;
+
+@interface	Item : NSObject
+{
+@public
+  int		count;
+  id		value;
+  unsigned	sets;
+  unsigned	changes;
+}
+- (int) count;
+- (void) setCount: (int)c;
+@end
+
+@implementation	Item
+- (int) count
+{
+  return count;
+}
+- (void) dealloc
+{
+  [value release];
+  [super dealloc];
+}
+- (void) observeValueForKeyPath: (NSString*)k
+		       ofObject: (id)o
+			 change: (NSDictionary*)c
+			context: (void*)x
+{
+  changes++;
+}
+- (void) setCount: (int)c
+{
+  count = c;
+}
+/* Reads keys of the item repeatedly in another thread.
+ */
+- (void) readKeys: (id)ignored
+{
+  NSAutoreleasePool	*pool = [NSAutoreleasePool new];
+  unsigned		bad = 0;
+  unsigned		i;
+
+  for (i = 0; i < OBJECTS * LOOPS / 10; i++)
+    {
+      if ([[self valueForKey: @"count"] intValue] != count)
+	{
+	  bad++;
+	}
+      if (i % 100 == 0)
+	{
+	  [pool release];
+	  pool = [NSAutoreleasePool new];
+	}
+    }
+  [pool release];
+  [running lock];
+  failures += bad;
+  [running unlockWithCondition: [running condition] - 1];
+}
+@end
+
+static id
+addedGetter(Item *self, SEL _cmd)
+{
+  return @"method";
+}
+
+static void
+addedSetter(Item *self, SEL _cmd, id v)
+{
+  self->sets++;
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableArray	*items = [NSMutableArray arrayWithCapacity: OBJECTS];
+  Item			*item;
+  BOOL			ok;
+  unsigned		i;
+  unsigned		j;
+
+  for (i = 0; i < OBJECTS; i++)
+    {
+      item = [Item new];
+      [items addObject: item];
+      [item release];
+    }
+
+  /* Repeatedly access the same keys of many instances of a class,
+   * both through accessor methods and directly through instance variables.
+   */
+  ok = YES;
+  for (j = 0; j < LOOPS; j++)
+    {
+      for (i = 0; i < OBJECTS; i++)
+	{
+	  item = [items objectAtIndex: i];
+	  [item setValue: [NSNumber numberWithInt: i + j] forKey: @"count"];
+	  [item setValue: @"ivar" forKey: @"value"];
+	  if ([[item valueForKey: @"count"] intValue] != (int)(i + j)
+	    || [[item valueForKey: @"value"] isEqual: @"ivar"] == NO)
+	    {
+	      ok = NO;
+	    }
+	}
+    }
+  PASS(ok, "repeated key-value access gives correct results");
+
+  PASS_EXCEPTION([item valueForKey: @"missing"],
+    NSUndefinedKeyException, "undefined key raises every time");
+
+  /* Keys may be read in several threads while the cache is flushed.
+   */
+  running = [[NSConditionLock alloc] initWithCondition: THREADS];
+  for (i = 0; i < THREADS; i++)
+    {
+      [NSThread detachNewThreadSelector: @selector(readKeys:)
+			       toTarget: item
+			     withObject: nil];
+    }
+  for (i = 0; i < LOOPS; i++)
+    {
+      GSFlushMethodCacheForClass([Item class]);
+      [NSThread sleepForTimeInterval: 0.001];
+    }
+  [running lockWhenCondition: 0];
+  [running unlock];
+  [running release];
+  PASS(failures == 0, "keys are read in several threads");
+
+  PASS_EXCEPTION([item valueForKey: @"missing"],
+    NSUndefinedKeyException, "undefined key raises every time");
+
+  /* Observing a key changes the class of the observed instance,
+   * and setting the value must then notify the observer.
+   */
+  item = [items objectAtIndex: 0];
+  [item addObserver: item forKeyPath: @"count" options: 0 context: 0];
+  [item setValue: [NSNumber numberWithInt: 42] forKey: @"count"];
+  PASS(item->changes == 1 && item->count == 42,
+    "setting an observed key notifies the observer");
+  [item removeObserver: item forKeyPath: @"count"];
+
+  /* Methods added to the class at runtime must be used in preference
+   * to the instance variable once the method cache has been flushed.
+   */
+  class_addMethod([Item class], @selector(value), (IMP)addedGetter, "@@:");
+  class_addMethod([Item class], @selector(setValue:), (IMP)addedSetter,
+    "v@:@");
+  GSFlushMethodCacheForClass([Item class]);
+  item = [items objectAtIndex: 1];
+  PASS([[item valueForKey: @"value"] isEqual: @"method"],
+    "getter added at runtime is used");
+  [item setValue: @"x" forKey: @"value"];
+  PASS(item->sets == 1 && [item->value isEqual: @"ivar"],
+    "setter added at runtime is used");
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,101 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSCache.h>
+#import <Foundation/NSValue.h>
+
+#define	ENTRIES	100000
+
+@interface	Discardable : NSObject <NSDiscardableContent>
+{
+@public
+  BOOL	discarded;
+  BOOL	inUse;
+}
+@end
+
+@implementation	Discardable
+- (BOOL) beginContentAccess
+{
+  return discarded ? NO : YES;
+}
+- (void) discardContentIfPossible
+{
+  if (NO == inUse)
+    {
+      discarded = YES;
+    }
+}
+- (void) endContentAccess
+{
+}
+- (BOOL) isContentDiscarded
+{
+  return discarded;
+}
+@end
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSCache		*cache = [[NSCache new] autorelease];
+  Discardable		*first;
+  Discardable		*second;
+  Discardable		*d;
+  NSNumber		*key;
+  unsigned		i;
+
+  /* Filling a cache beyond its count limit must evict the least
+   * recently used objects, and must not take time proportional to the
+   * number of objects for each insertion.
+   */
+  [cache setCountLimit: ENTRIES / 2];
+  [cache setEvictsObjectsWithDiscardedContent: YES];
+  for (i = 0; i < ENTRIES; i++)
+    {
+      NSAutoreleasePool	*pool = [NSAutoreleasePool new];
+
+      d = [Discardable new];
+      [cache setObject: d forKey: [NSNumber numberWithUnsignedInt: i]];
+      [d release];
+      if (i % 1000 == 0 && i > 0)
+	{
+	  /* Keep touching the first object so that it is recently used.
+	   */
+	  [cache objectForKey: [NSNumber numberWithUnsignedInt: 0]];
+	}
+      [pool release];
+    }
+  PASS([cache objectForKey: [NSNumber numberWithUnsignedInt: 0]] != nil,
+    "recently used object is kept");
+  PASS([cache objectForKey: [NSNumber numberWithUnsignedInt: 1]] == nil,
+    "least recently used object is evicted");
+  PASS([cache objectForKey: [NSNumber numberWithUnsignedInt: ENTRIES - 1]]
+    != nil, "most recently added object is kept");
+  PASS([cache evictionCount] == ENTRIES / 2, "evictions are counted");
+  PASS([cache hitCount] == ENTRIES / 1000 + 1 && [cache missCount] == 1,
+    "hits and misses are counted");
+  [cache resetStatistics];
+  PASS([cache hitCount] == 0 && [cache missCount] == 0
+    && [cache evictionCount] == 0, "statistics can be reset");
+
+  /* An object whose content is in use is given a second chance.
+   */
+  [cache removeAllObjects];
+  [cache setCountLimit: 0];
+  [cache setTotalCostLimit: 10];
+  first = [[Discardable new] autorelease];
+  first->inUse = YES;
+  second = [[Discardable new] autorelease];
+  key = [NSNumber numberWithInt: 1];
+  [cache setObject: first forKey: key cost: 5];
+  [cache setObject: second forKey: [NSNumber numberWithInt: 2] cost: 5];
+  [cache setObject: [[Discardable new] autorelease]
+	    forKey: [NSNumber numberWithInt: 3]
+	      cost: 5];
+  PASS(first->discarded == NO && second->discarded == YES,
+    "object in use is skipped when evicting");
+  PASS([cache objectForKey: key] == first, "object in use remains cached");
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,164 @@
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSConnection.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDistantObject.h>
+#import <Foundation/NSInvocation.h>
+#import <Foundation/NSMethodSignature.h>
+#import <Foundation/NSPort.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSValue.h>
+
+#define	ONEWAY	100
+#define	BATCH	10
+
+@protocol	Counting
+- (oneway void) bump;
+- (int) count;
+- (int) twice: (int)i;
+@end
+
+@interface	Counter : NSObject <Counting>
+{
+  int	count;
+}
+@end
+
+@implementation	Counter
+- (oneway void) bump
+{
+  count++;
+}
+- (int) count
+{
+  return count;
+}
+- (int) twice: (int)i
+{
+  return i * 2;
+}
+@end
+
+/* Serves a Counter over a connection using the ports in the array.
+ */
+@interface	Server : NSObject
+- (void) serve: (NSArray*)ports;
+@end
+
+@implementation	Server
+- (void) serve: (NSArray*)ports
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSConnection		*c;
+
+  c = [[NSConnection alloc] initWithReceivePort: [ports objectAtIndex: 0]
+				       sendPort: [ports objectAtIndex: 1]];
+  [c setRootObject: [[Counter new] autorelease]];
+  [[NSRunLoop currentRunLoop] runUntilDate:
+    [NSDate dateWithTimeIntervalSinceNow: 30.0]];
+  [c release];
+  [arp release];
+}
+@end
+
+static unsigned
+statistic(NSConnection *c, NSString *key)
+{
+  return [[[c statistics] objectForKey: key] unsignedIntValue];
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSPort		*p1 = [NSPort port];
+  NSPort		*p2 = [NSPort port];
+  NSConnection		*c;
+  id<Counting>		proxy;
+  NSMutableArray	*invs;
+  NSMethodSignature	*sig;
+  unsigned		before;
+  unsigned		trips;
+  unsigned		i;
+  BOOL			ok;
+
+  START_SET("batching")
+  [NSThread detachNewThreadSelector: @selector(serve:)
+			   toTarget: [[Server new] autorelease]
+			 withObject: [NSArray arrayWithObjects: p2, p1, nil]];
+  [NSThread sleepForTimeInterval: 0.5];
+  c = [[[NSConnection alloc] initWithReceivePort: p1 sendPort: p2]
+    autorelease];
+  [c setReplyTimeout: 10.0];
+  proxy = (id<Counting>)[c rootProxy];
+  if (proxy == nil)
+    {
+      SKIP("unable to connect to the server thread")
+    }
+  [(NSDistantObject*)proxy setProtocolForProxy: @protocol(Counting)];
+
+  sig = [(id)proxy methodSignatureForSelector: @selector(twice:)];
+  PASS(sig != nil
+    && sig == [(id)proxy methodSignatureForSelector: @selector(twice:)],
+    "method signatures are cached by the proxy");
+
+  /* Oneway messages are collected into a single port message and sent
+   * before the next synchronous request.
+   */
+  PASS([c coalescesOnewayMessages] == NO, "coalescing is off by default");
+  [c setCoalescesOnewayMessages: YES];
+  before = statistic(c, NSConnectionRequestsSent);
+  for (i = 0; i < ONEWAY; i++)
+    {
+      [proxy bump];
+    }
+  PASS([proxy count] == ONEWAY, "coalesced oneway messages are delivered");
+  PASS(statistic(c, NSConnectionRequestsSent) == before + ONEWAY + 1,
+    "each coalesced message counts as a request");
+  PASS(statistic(c, @"NSConnectionBatchesSent") > 0
+    && statistic(c, @"NSConnectionBatchesSent") < ONEWAY,
+    "oneway messages were sent in batches");
+
+  /* Several synchronous calls cost a single round trip.
+   */
+  invs = [NSMutableArray arrayWithCapacity: BATCH];
+  sig = [(id)proxy methodSignatureForSelector: @selector(twice:)];
+  for (i = 0; i < BATCH; i++)
+    {
+      NSInvocation	*inv = [NSInvocation invocationWithMethodSignature: sig];
+      int		arg = i;
+
+      [inv setSelector: @selector(twice:)];
+      [inv setTarget: proxy];
+      [inv setArgument: &arg atIndex: 2];
+      [invs addObject: inv];
+    }
+  trips = statistic(c, @"NSConnectionRoundTrips");
+  [c forwardInvocations: invs];
+  PASS(statistic(c, @"NSConnectionRoundTrips") == trips + 1,
+    "a batch of calls is one round trip");
+  ok = YES;
+  for (i = 0; i < BATCH; i++)
+    {
+      int	result = -1;
+
+      [[invs objectAtIndex: i] getReturnValue: &result];
+      if (result != (int)i * 2)
+	{
+	  ok = NO;
+	}
+    }
+  PASS(ok, "each call in a batch gets its own result");
+
+  trips = statistic(c, @"NSConnectionRoundTrips");
+  [proxy twice: 1];
+  PASS(statistic(c, @"NSConnectionRoundTrips") == trips + 1,
+    "a single call is one round trip");
+
+  [c invalidate];
+  END_SET("batching")
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,167 @@
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSConnection.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSDistantObject.h>
+#import <Foundation/NSPort.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSValue.h>
+
+#define	CALLS	100
+
+@protocol	Echoing
+- (bycopy id) echo: (bycopy id)obj;
+- (int) add: (int)a to: (int)b;
+@end
+
+@interface	Echo : NSObject <Echoing>
+@end
+
+@implementation	Echo
+- (bycopy id) echo: (bycopy id)obj
+{
+  return obj;
+}
+- (int) add: (int)a to: (int)b
+{
+  return a + b;
+}
+@end
+
+/* Serves an Echo over a connection using the ports in the array.
+ */
+@interface	Server : NSObject
+- (void) serve: (NSArray*)ports;
+@end
+
+@implementation	Server
+- (void) serve: (NSArray*)ports
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSConnection		*c;
+
+  c = [[NSConnection alloc] initWithReceivePort: [ports objectAtIndex: 0]
+				       sendPort: [ports objectAtIndex: 1]];
+  [c setRootObject: [[Echo new] autorelease]];
+  [[NSRunLoop currentRunLoop] runUntilDate:
+    [NSDate dateWithTimeIntervalSinceNow: 30.0]];
+  [c release];
+  [arp release];
+}
+@end
+
+static NSConnection *
+startServer(BOOL compact)
+{
+  NSPort	*p1 = [NSPort port];
+  NSPort	*p2 = [NSPort port];
+  NSConnection	*c;
+
+  [NSThread detachNewThreadSelector: @selector(serve:)
+			   toTarget: [[Server new] autorelease]
+			 withObject: [NSArray arrayWithObjects: p2, p1, nil]];
+  [NSThread sleepForTimeInterval: 0.5];
+  c = [[[NSConnection alloc] initWithReceivePort: p1 sendPort: p2]
+    autorelease];
+  [c setReplyTimeout: 10.0];
+  [c setAllowsCompactCoding: compact];
+  return c;
+}
+
+static unsigned
+statistic(NSConnection *c, NSString *key)
+{
+  return [[[c statistics] objectForKey: key] unsignedIntValue];
+}
+
+/* Sends the object to the echo server CALLS times, returning the number
+ * of bytes sent, or zero if any echo was not equal to the original.
+ */
+static unsigned
+echo(NSConnection *c, id<Echoing> proxy, id obj)
+{
+  unsigned	before = statistic(c, @"NSConnectionBytesSent");
+  unsigned	i;
+
+  for (i = 0; i < CALLS; i++)
+    {
+      NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+      BOOL		ok = [[proxy echo: obj] isEqual: obj];
+
+      [arp release];
+      if (NO == ok)
+	{
+	  return 0;
+	}
+    }
+  return statistic(c, @"NSConnectionBytesSent") - before;
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSConnection		*compact;
+  NSConnection		*legacy;
+  id<Echoing>		cProxy;
+  id<Echoing>		lProxy;
+  NSDictionary		*payload;
+  unsigned		cBytes;
+  unsigned		lBytes;
+
+  START_SET("compact coding")
+  payload = [NSDictionary dictionaryWithObjectsAndKeys:
+    @"alpha", @"name",
+    [NSNumber numberWithInt: 42], @"answer",
+    [NSNumber numberWithInt: -7], @"negative",
+    [NSNumber numberWithLongLong: 1LL << 40], @"big",
+    [NSNumber numberWithDouble: 2.5], @"real",
+    [NSArray arrayWithObjects: @"one", @"two", @"three", @"one", nil], @"list",
+    @"a string which is much too long to go into the coding table",
+    @"long",
+    nil];
+
+  compact = startServer(YES);
+  PASS([compact allowsCompactCoding] == YES, "compact coding is allowed");
+  cProxy = (id<Echoing>)[compact rootProxy];
+  if (cProxy == nil)
+    {
+      SKIP("unable to connect to the server thread")
+    }
+  [(NSDistantObject*)cProxy setProtocolForProxy: @protocol(Echoing)];
+  PASS([compact usesCompactCoding] == YES,
+    "compact coding is agreed with a peer which supports it");
+  PASS([cProxy add: -1000000 to: 3] == -999997,
+    "integers survive the compact format");
+  PASS_EQUAL([cProxy echo: payload], payload,
+    "objects survive the compact format");
+
+  legacy = startServer(NO);
+  lProxy = (id<Echoing>)[legacy rootProxy];
+  if (lProxy == nil)
+    {
+      SKIP("unable to connect to the server thread")
+    }
+  [(NSDistantObject*)lProxy setProtocolForProxy: @protocol(Echoing)];
+  PASS([legacy usesCompactCoding] == NO,
+    "compact coding is not used when not allowed");
+  PASS_EQUAL([lProxy echo: payload], payload,
+    "objects survive the original format");
+
+  /* Compare the data sent for the same calls in each format.
+   */
+  cBytes = echo(compact, cProxy, payload);
+  lBytes = echo(legacy, lProxy, payload);
+  PASS(cBytes > 0 && lBytes > 0, "repeated calls echo correctly");
+  PASS(cBytes < lBytes,
+    "compact messages are smaller (%u against %u bytes)", cBytes, lBytes);
+
+  [compact invalidate];
+  [legacy invalidate];
+  END_SET("compact coding")
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,95 @@
+#import "Testing.h"
+#import <Foundation/NSArchiver.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSValue.h>
+
+/* Dates and numbers may be held in the object pointer on some systems;
+ * these tests check they behave just like ordinary objects.
+ */
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSTimeInterval	times[] = { 0.0, 1.0, -1.0, 0.1, 1e-70, -1e-70,
+    812345678.123456789, -978307200.0, 63113990400.0, -63113817600.0,
+    1e20, -1e20 };
+  NSDate		*now = [NSDate date];
+  NSDate		*date;
+  NSDate		*copy;
+  NSNumber		*num;
+  NSDictionary		*dict;
+  unsigned		i;
+  BOOL			ok;
+
+  ok = YES;
+  for (i = 0; i < sizeof(times) / sizeof(*times); i++)
+    {
+      date = [NSDate dateWithTimeIntervalSinceReferenceDate: times[i]];
+      if ([date timeIntervalSinceReferenceDate] != times[i])
+	{
+	  ok = NO;
+	}
+    }
+  PASS(ok, "dates keep their exact time interval");
+
+  date = [[NSDate alloc] initWithTimeIntervalSinceReferenceDate:
+    [now timeIntervalSinceReferenceDate]];
+  PASS([date isEqual: now] && [now isEqual: date],
+    "dates made in different ways are equal");
+  PASS([date hash] == [now hash], "equal dates have the same hash");
+  PASS([date compare: now] == NSOrderedSame, "equal dates compare the same");
+  [date release];
+
+  date = [NSDate dateWithTimeInterval: 1e-6 sinceDate: now];
+  PASS([date isEqual: now] == NO, "different dates are not equal");
+  PASS([date compare: now] == NSOrderedDescending
+    && [now compare: date] == NSOrderedAscending,
+    "dates compare in time order");
+  PASS([date timeIntervalSinceDate: now] > 0.0,
+    "intervals between dates work");
+  PASS([[NSDate distantPast] compare: date] == NSOrderedAscending
+    && [[NSDate distantFuture] compare: date] == NSOrderedDescending,
+    "dates compare with the distant past and future");
+
+  PASS_EQUAL([now dateByAddingTimeInterval: 60.0],
+    [NSDate dateWithTimeInterval: 60.0 sinceDate: now],
+    "a time interval may be added to a date");
+  PASS_EQUAL([now addTimeInterval: -60.0],
+    [NSDate dateWithTimeInterval: -60.0 sinceDate: now],
+    "a time interval may be subtracted from a date");
+
+  copy = [date copy];
+  PASS_EQUAL(copy, date, "a copied date is equal");
+  [copy release];
+  [[date retain] release];
+  PASS([date timeIntervalSinceDate: now] > 0.0, "retain and release work");
+
+  dict = [NSDictionary dictionaryWithObject: @"found" forKey: now];
+  date = [NSDate dateWithTimeIntervalSinceReferenceDate:
+    [now timeIntervalSinceReferenceDate]];
+  PASS_EQUAL([dict objectForKey: date], @"found",
+    "dates work as dictionary keys");
+
+  date = [NSUnarchiver unarchiveObjectWithData:
+    [NSArchiver archivedDataWithRootObject: now]];
+  PASS_EQUAL(date, now, "dates survive archiving");
+
+  PASS_EXCEPTION([NSDate dateWithTimeIntervalSinceReferenceDate: 0.0 / 0.0],
+    NSInvalidArgumentException, "a date may not be NaN");
+
+  num = [NSNumber numberWithLongLong: 1LL << 40];
+  PASS([num longLongValue] == 1LL << 40, "a large number keeps its value");
+  PASS_EQUAL(num, [NSNumber numberWithLongLong: 1LL << 40],
+    "equal large numbers are equal");
+  num = [NSNumber numberWithLongLong: -(1LL << 50) - 3];
+  PASS([num longLongValue] == -(1LL << 50) - 3,
+    "a large negative number keeps its value");
+  num = [NSNumber numberWithLongLong: LLONG_MAX];
+  PASS([num longLongValue] == LLONG_MAX, "the largest number keeps its value");
+  num = [NSNumber numberWithInt: INT_MIN + 1];
+  PASS([num intValue] == INT_MIN + 1, "a large int keeps its value");
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,134 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSFileHandle.h>
+#import <Foundation/NSNotification.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+#define	WRITES	500
+#define	PORT	@"32332"
+
+/* Counts the writes completed and collects the data received.
+ */
+@interface	Collector : NSObject
+{
+@public
+  NSFileHandle	*accepted;
+  NSData	*received;
+  unsigned	written;
+  unsigned	failed;
+}
+@end
+
+@implementation	Collector
+- (void) accepted: (NSNotification*)n
+{
+  accepted = [[[n userInfo] objectForKey:
+    NSFileHandleNotificationFileHandleItem] retain];
+  [accepted readToEndOfFileInBackgroundAndNotify];
+}
+- (void) dealloc
+{
+  [accepted release];
+  [received release];
+  [super dealloc];
+}
+- (void) received: (NSNotification*)n
+{
+  received = [[[n userInfo] objectForKey:
+    NSFileHandleNotificationDataItem] retain];
+}
+- (void) written: (NSNotification*)n
+{
+  if ([[n userInfo] objectForKey: GSFileHandleNotificationError] != nil)
+    {
+      failed++;
+    }
+  if (++written == WRITES)
+    {
+      [[n object] closeFile];
+    }
+}
+@end
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSNotificationCenter	*nc = [NSNotificationCenter defaultCenter];
+  Collector		*c = [[Collector new] autorelease];
+  NSMutableData		*expected = [NSMutableData data];
+  NSFileHandle		*server;
+  NSFileHandle		*client;
+  NSDictionary		*stats;
+  NSDate		*limit;
+  unsigned		i;
+
+  START_SET("coalesced writes")
+  [nc addObserver: c selector: @selector(accepted:)
+    name: NSFileHandleConnectionAcceptedNotification object: nil];
+  [nc addObserver: c selector: @selector(received:)
+    name: NSFileHandleReadToEndOfFileCompletionNotification object: nil];
+  [nc addObserver: c selector: @selector(written:)
+    name: GSFileHandleWriteCompletionNotification object: nil];
+
+  server = [NSFileHandle fileHandleAsServerAtAddress: @"127.0.0.1"
+    service: PORT protocol: @"tcp"];
+  if (server == nil)
+    {
+      SKIP("unable to listen on a local port")
+    }
+  [server acceptConnectionInBackgroundAndNotify];
+  client = [NSFileHandle fileHandleAsClientAtAddress: @"127.0.0.1"
+    service: PORT protocol: @"tcp"];
+  if (client == nil)
+    {
+      SKIP("unable to connect to a local port")
+    }
+
+  /* Queue many small writes, some empty, before any is sent.
+   */
+  for (i = 0; i < WRITES; i++)
+    {
+      NSData	*d = [NSData data];
+
+      if (i % 50 != 0)
+	{
+	  d = [[NSString stringWithFormat: @"line %u\n", i]
+	    dataUsingEncoding: NSASCIIStringEncoding];
+	}
+      [expected appendData: d];
+      [client writeInBackgroundAndNotify: d];
+    }
+  PASS([client writeInProgress], "writes are queued");
+
+  limit = [NSDate dateWithTimeIntervalSinceNow: 30.0];
+  while (c->received == nil && [limit timeIntervalSinceNow] > 0)
+    {
+      [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+	beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+    }
+  PASS(c->written == WRITES && c->failed == 0,
+    "each queued write is notified as complete");
+  PASS_EQUAL(c->received, expected, "queued writes arrive in order");
+
+  stats = [client writeStatistics];
+  PASS([[stats objectForKey: @"BytesWritten"] unsignedIntValue]
+    == [expected length], "the bytes written are counted");
+  PASS([[stats objectForKey: @"WriteCalls"] unsignedIntValue] < WRITES / 10,
+    "queued writes are gathered into few system calls (%u)",
+    [[stats objectForKey: @"WriteCalls"] unsignedIntValue]);
+  PASS([[stats objectForKey: @"WriteQueueMax"] unsignedIntValue] >= WRITES,
+    "the depth of the write queue is recorded");
+  PASS([[stats objectForKey: @"WriteQueue"] unsignedIntValue] == 0,
+    "the write queue is empty");
+
+  [nc removeObserver: c];
+  END_SET("coalesced writes")
+
+  [arp release]; arp = nil;
+  return 0;
+}
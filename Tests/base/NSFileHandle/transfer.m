@@ -0,0 +1,154 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSFileHandle.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSNotification.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSString.h>
+
+#define	SIZE	(5 * 1024 * 1024 + 13)
+#define	OFFSET	1000
+#define	PORT	@"32331"
+
+/* Collects the handles and data from the notifications of a transfer.
+ */
+@interface	Collector : NSObject
+{
+@public
+  NSFileHandle	*accepted;
+  NSData	*received;
+  NSDictionary	*written;
+}
+@end
+
+@implementation	Collector
+- (void) accepted: (NSNotification*)n
+{
+  accepted = [[[n userInfo] objectForKey:
+    NSFileHandleNotificationFileHandleItem] retain];
+  [accepted readToEndOfFileInBackgroundAndNotify];
+}
+- (void) dealloc
+{
+  [accepted release];
+  [received release];
+  [written release];
+  [super dealloc];
+}
+- (void) received: (NSNotification*)n
+{
+  received = [[[n userInfo] objectForKey:
+    NSFileHandleNotificationDataItem] retain];
+}
+- (void) written: (NSNotification*)n
+{
+  written = [[n userInfo] retain];
+  [[n object] closeFile];
+}
+@end
+
+static void
+runUntil(id *done)
+{
+  NSDate	*limit = [NSDate dateWithTimeIntervalSinceNow: 30.0];
+
+  while (*done == nil && [limit timeIntervalSinceNow] > 0)
+    {
+      [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+	beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+    }
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSNotificationCenter	*nc = [NSNotificationCenter defaultCenter];
+  NSString		*path = @"NSFileHandleTransfer.data";
+  NSMutableData		*content = [NSMutableData dataWithLength: SIZE];
+  unsigned char		*b = [content mutableBytes];
+  Collector		*c = [[Collector new] autorelease];
+  NSFileHandle		*file;
+  NSFileHandle		*server;
+  NSFileHandle		*client;
+  NSData		*d;
+  unsigned		i;
+
+  for (i = 0; i < SIZE; i++)
+    {
+      b[i] = (unsigned char)(i * 7 + i / 251);
+    }
+  [content writeToFile: path atomically: NO];
+
+  /* Reads go straight into the data returned.
+   */
+  file = [NSFileHandle fileHandleForReadingAtPath: path];
+  PASS_EQUAL([file readDataToEndOfFile], content,
+    "a large file is read to its end");
+  [file seekToFileOffset: OFFSET];
+  d = [file readDataOfLength: SIZE];
+  PASS_EQUAL(d,
+    [content subdataWithRange: NSMakeRange(OFFSET, SIZE - OFFSET)],
+    "a read of more than the rest of a file gets the rest");
+  [file seekToFileOffset: 0];
+  d = [file readDataOfLength: 100];
+  PASS_EQUAL(d, [content subdataWithRange: NSMakeRange(0, 100)],
+    "a short read gets the data asked for");
+  PASS([[file availableData] length] == SIZE - 100,
+    "available data in a file is the rest of it");
+  PASS([[file readDataToEndOfFile] length] == 0,
+    "nothing is read at the end of a file");
+
+  PASS_EXCEPTION([[NSFileHandle fileHandleWithStandardOutput]
+    transferInBackgroundAndNotifyFrom: [NSFileHandle fileHandleWithNullDevice]
+    offset: 0 length: 1], NSInvalidArgumentException,
+    "only a regular file may be transferred");
+
+  /* Transfer most of the file over a local connection.
+   */
+  START_SET("transfer")
+  [nc addObserver: c selector: @selector(accepted:)
+    name: NSFileHandleConnectionAcceptedNotification object: nil];
+  [nc addObserver: c selector: @selector(received:)
+    name: NSFileHandleReadToEndOfFileCompletionNotification object: nil];
+  [nc addObserver: c selector: @selector(written:)
+    name: GSFileHandleWriteCompletionNotification object: nil];
+
+  server = [NSFileHandle fileHandleAsServerAtAddress: @"127.0.0.1"
+    service: PORT protocol: @"tcp"];
+  if (server == nil)
+    {
+      SKIP("unable to listen on a local port")
+    }
+  [server acceptConnectionInBackgroundAndNotify];
+  client = [NSFileHandle fileHandleAsClientAtAddress: @"127.0.0.1"
+    service: PORT protocol: @"tcp"];
+  if (client == nil)
+    {
+      SKIP("unable to connect to a local port")
+    }
+
+  [client transferInBackgroundAndNotifyFrom: file
+				     offset: OFFSET
+				     length: SIZE - OFFSET];
+  runUntil((id*)&c->written);
+  PASS(c->written != nil
+    && [c->written objectForKey: GSFileHandleNotificationError] == nil,
+    "a transfer completes");
+  PASS([c->written objectForKey: NSFileHandleNotificationFileHandleItem]
+    == file, "the notification contains the source file handle");
+  runUntil((id*)&c->received);
+  PASS_EQUAL(c->received,
+    [content subdataWithRange: NSMakeRange(OFFSET, SIZE - OFFSET)],
+    "the data transferred is received");
+
+  [nc removeObserver: c];
+  END_SET("transfer")
+
+  [[NSFileManager defaultManager] removeItemAtPath: path error: 0];
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,128 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSError.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+#define	FILES	200
+
+/* Returns data of the given length with varying content.
+ */
+static NSData *
+content(unsigned length, unsigned seed)
+{
+  NSMutableData	*d = [NSMutableData dataWithLength: length];
+  unsigned char	*b = [d mutableBytes];
+  unsigned	i;
+
+  for (i = 0; i < length; i++)
+    {
+      b[i] = (unsigned char)(i * 31 + seed);
+    }
+  return d;
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSFileManager		*mgr = [NSFileManager defaultManager];
+  NSString		*src = @"NSFileManagerCopySource";
+  NSString		*dst = @"NSFileManagerCopyDestination";
+  NSString		*sub = [src stringByAppendingPathComponent: @"sub"];
+  NSString		*path;
+  NSDictionary		*attr;
+  NSError		*err = nil;
+  BOOL			ok;
+  unsigned		i;
+
+  [mgr removeItemAtPath: src error: 0];
+  [mgr removeItemAtPath: dst error: 0];
+  [mgr createDirectoryAtPath: sub withIntermediateDirectories: YES
+    attributes: nil error: 0];
+
+  for (i = 0; i < FILES; i++)
+    {
+      path = [src stringByAppendingPathComponent:
+	[NSString stringWithFormat: @"file%u", i]];
+      [content(i * 37, i) writeToFile: path atomically: NO];
+    }
+  path = [sub stringByAppendingPathComponent: @"large"];
+  [content(3 * 1024 * 1024 + 17, 7) writeToFile: path atomically: NO];
+  path = [sub stringByAppendingPathComponent: @"empty"];
+  [[NSData data] writeToFile: path atomically: NO];
+  attr = [NSDictionary dictionaryWithObject: [NSNumber numberWithInt: 0500]
+				     forKey: NSFilePosixPermissions];
+  [mgr createDirectoryAtPath: [sub stringByAppendingPathComponent: @"locked"]
+    withIntermediateDirectories: NO attributes: nil error: 0];
+  [content(100, 3) writeToFile: [sub stringByAppendingPathComponent:
+    @"locked/inside"] atomically: NO];
+  [mgr changeFileAttributes: attr
+    atPath: [sub stringByAppendingPathComponent: @"locked"]];
+
+  PASS([mgr copyItemAtPath: src toPath: dst error: &err],
+    "a directory tree is copied (%s)", [[err description] UTF8String]);
+
+  ok = YES;
+  for (i = 0; i < FILES; i++)
+    {
+      path = [dst stringByAppendingPathComponent:
+	[NSString stringWithFormat: @"file%u", i]];
+      if ([[NSData dataWithContentsOfFile: path]
+	isEqual: content(i * 37, i)] == NO)
+	{
+	  ok = NO;
+	}
+    }
+  PASS(ok, "small files are copied correctly");
+  path = [dst stringByAppendingPathComponent: @"sub/large"];
+  PASS_EQUAL([NSData dataWithContentsOfFile: path],
+    content(3 * 1024 * 1024 + 17, 7), "a large file is copied correctly");
+  path = [dst stringByAppendingPathComponent: @"sub/empty"];
+  PASS([[NSData dataWithContentsOfFile: path] length] == 0,
+    "an empty file is copied");
+  path = [dst stringByAppendingPathComponent: @"sub/locked/inside"];
+  PASS_EQUAL([NSData dataWithContentsOfFile: path], content(100, 3),
+    "a file in a read-only directory is copied");
+  path = [dst stringByAppendingPathComponent: @"sub/locked"];
+  PASS([[mgr fileAttributesAtPath: path traverseLink: NO]
+    filePosixPermissions] == 0500,
+    "directory permissions are copied");
+
+  /* With a handler the copy is done sequentially.
+   */
+  path = [dst stringByAppendingPathComponent: @"handled"];
+  PASS([mgr copyPath: src toPath: path
+	     handler: [[NSObject new] autorelease]],
+    "a directory tree is copied with a handler");
+  path = [path stringByAppendingPathComponent: @"sub/locked"];
+  PASS_EQUAL([NSData dataWithContentsOfFile:
+    [path stringByAppendingPathComponent: @"inside"]], content(100, 3),
+    "a file in a read-only directory is copied with a handler");
+  PASS([[mgr fileAttributesAtPath: path traverseLink: NO]
+    filePosixPermissions] == 0500,
+    "directory permissions are copied with a handler");
+  [mgr changeFileAttributes: [NSDictionary dictionaryWithObject:
+    [NSNumber numberWithInt: 0700] forKey: NSFilePosixPermissions]
+    atPath: path];
+
+  path = [dst stringByAppendingPathComponent: @"again"];
+  PASS([mgr copyPath: [src stringByAppendingPathComponent: @"file99"]
+	      toPath: path handler: nil]
+    && [[NSData dataWithContentsOfFile: path] isEqual: content(99 * 37, 99)],
+    "a single file is copied");
+
+  attr = [NSDictionary dictionaryWithObject: [NSNumber numberWithInt: 0700]
+				     forKey: NSFilePosixPermissions];
+  [mgr changeFileAttributes: attr
+    atPath: [sub stringByAppendingPathComponent: @"locked"]];
+  [mgr changeFileAttributes: attr
+    atPath: [dst stringByAppendingPathComponent: @"sub/locked"]];
+  [mgr removeItemAtPath: src error: 0];
+  [mgr removeItemAtPath: dst error: 0];
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,133 @@
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSSet.h>
+#import <Foundation/NSString.h>
+
+#define	DIRS	20
+#define	FILES	50
+
+/* Returns the set of paths returned by the enumerator, checking the
+ * attributes of each as it goes.
+ */
+static NSSet *
+walk(NSDirectoryEnumerator *e, BOOL *attributesOK)
+{
+  NSMutableSet	*found = [NSMutableSet set];
+  NSString	*path;
+
+  *attributesOK = YES;
+  while ((path = [e nextObject]) != nil)
+    {
+      NSDictionary	*attr = [e fileAttributes];
+      NSString		*type = [attr fileType];
+
+      if ([[path lastPathComponent] hasPrefix: @"link"])
+	{
+	  if (NO == [type isEqual: NSFileTypeSymbolicLink])
+	    {
+	      *attributesOK = NO;
+	    }
+	}
+      else if ([[path lastPathComponent] hasPrefix: @"dir"])
+	{
+	  if (NO == [type isEqual: NSFileTypeDirectory])
+	    {
+	      *attributesOK = NO;
+	    }
+	}
+      else if (NO == [type isEqual: NSFileTypeRegular]
+	|| [attr fileSize] != [[path lastPathComponent] length])
+	{
+	  *attributesOK = NO;
+	}
+      [found addObject: path];
+    }
+  return found;
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSFileManager		*mgr = [NSFileManager defaultManager];
+  NSString		*top = @"NSFileManagerEnumerate";
+  NSMutableSet		*expected = [NSMutableSet set];
+  NSDirectoryEnumerator	*e;
+  NSString		*path;
+  NSString		*dir = nil;
+  NSSet			*found;
+  BOOL			ok;
+  unsigned		i;
+  unsigned		j;
+
+  [mgr removeItemAtPath: top error: 0];
+  for (i = 0; i < DIRS; i++)
+    {
+      /* Every fourth directory is at the top, with the others nested
+       * below it.
+       */
+      path = [NSString stringWithFormat: @"dir%u", i];
+      dir = (i % 4 == 0) ? path : [dir stringByAppendingPathComponent: path];
+      [mgr createDirectoryAtPath: [top stringByAppendingPathComponent: dir]
+	withIntermediateDirectories: YES attributes: nil error: 0];
+      [expected addObject: dir];
+      for (j = 0; j < FILES; j++)
+	{
+	  NSString	*file;
+
+	  file = [dir stringByAppendingPathComponent:
+	    [NSString stringWithFormat: @"f%u", j]];
+	  [[[file lastPathComponent] dataUsingEncoding: NSASCIIStringEncoding]
+	    writeToFile: [top stringByAppendingPathComponent: file]
+	    atomically: NO];
+	  [expected addObject: file];
+	}
+    }
+  path = [[mgr currentDirectoryPath] stringByAppendingPathComponent:
+    [top stringByAppendingPathComponent: @"dir0"]];
+  [mgr createSymbolicLinkAtPath:
+    [top stringByAppendingPathComponent: @"dir4/link"] pathContent: path];
+  [expected addObject: @"dir4/link"];
+
+  e = [mgr enumeratorAtPath: top];
+  found = walk(e, &ok);
+  PASS_EQUAL(found, expected, "enumerator finds every path in a tree");
+  PASS(ok, "enumerator gives the attributes of each path");
+
+  e = [mgr enumeratorAtPath: top];
+  i = 0;
+  while ((path = [e nextObject]) != nil)
+    {
+      if ([path isEqual: @"dir0"])
+	{
+	  [e skipDescendents];
+	}
+      else if ([path hasPrefix: @"dir0/"])
+	{
+	  i++;
+	}
+    }
+  PASS(i == 0, "descendents of a directory may be skipped");
+
+  e = [mgr enumeratorAtPath: top threads: 4];
+  found = walk(e, &ok);
+  PASS_EQUAL(found, expected, "threaded enumerator finds every path in a tree");
+  PASS(ok, "threaded enumerator gives the attributes of each path");
+  PASS_EQUAL([[e directoryAttributes] fileType], NSFileTypeDirectory,
+    "threaded enumerator gives the attributes of the top directory");
+
+  e = [mgr enumeratorAtPath: top threads: 4];
+  PASS([e nextObject] != nil, "threaded enumerator may be abandoned");
+  e = nil;
+
+  e = [mgr enumeratorAtPath: @"NSFileManagerEnumerateMissing" threads: 4];
+  PASS([e nextObject] == nil, "threaded enumerator of a missing directory");
+
+  [mgr removeItemAtPath: top error: 0];
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,170 @@
+#import <Foundation/Foundation.h>
+#import "ObjectTesting.h"
+
+#define	RECORDS	2000
+
+/* Feed data to the reader in small chunks, collecting the parsed values.
+ */
+static BOOL
+feed(GSJSONReader *r, NSData *data, NSUInteger chunk, NSMutableArray *out)
+{
+  const uint8_t	*bytes = [data bytes];
+  NSUInteger	length = [data length];
+  NSUInteger	pos = 0;
+  id		obj;
+
+  while (pos < length)
+    {
+      NSUInteger	n = (length - pos < chunk) ? length - pos : chunk;
+
+      if (NO == [r appendBytes: bytes + pos length: n])
+	{
+	  return NO;
+	}
+      pos += n;
+      while ((obj = [r nextObject]) != nil)
+	{
+	  [out addObject: obj];
+	}
+    }
+  if (NO == [r finish])
+    {
+      return NO;
+    }
+  while ((obj = [r nextObject]) != nil)
+    {
+      [out addObject: obj];
+    }
+  return YES;
+}
+
+int main(void)
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableArray	*records = [NSMutableArray array];
+  NSMutableArray	*out;
+  NSMutableData		*lines = [NSMutableData data];
+  NSInputStream		*is;
+  GSJSONReader		*r;
+  NSData		*data;
+  NSInteger		n;
+  int			i;
+
+  for (i = 0; i < RECORDS; i++)
+    {
+      NSDictionary	*d;
+
+      d = [NSDictionary dictionaryWithObjectsAndKeys:
+	[NSNumber numberWithInt: i * 1000], @"id",
+	[NSString stringWithFormat: @"café \U0001F600 %d", i], @"name",
+	[NSArray arrayWithObjects: [NSNull null],
+	  [NSNumber numberWithInt: i % 2], nil], @"flags",
+	nil];
+      [records addObject: d];
+      data = [NSJSONSerialization dataWithJSONObject: d options: 0 error: 0];
+      [lines appendData: data];
+      [lines appendBytes: "\n" length: 1];
+    }
+
+  /* A top level array read element by element, in chunks which split
+   * multibyte characters, strings and numbers.
+   */
+  data = [NSJSONSerialization dataWithJSONObject: records
+					 options: NSJSONWritingPrettyPrinted
+					   error: 0];
+  r = [[GSJSONReader new] autorelease];
+  [r setReadsArrayElements: YES];
+  out = [NSMutableArray array];
+  PASS(feed(r, data, 7, out), "array elements parsed without error");
+  PASS_EQUAL(out, records, "array elements match the records");
+
+  /* Newline delimited values.
+   */
+  r = [[GSJSONReader new] autorelease];
+  out = [NSMutableArray array];
+  PASS(feed(r, lines, 13, out), "newline delimited values parsed");
+  PASS_EQUAL(out, records, "newline delimited values match the records");
+
+  /* A number split between chunks must not be returned early.
+   */
+  r = [[GSJSONReader new] autorelease];
+  [r appendBytes: "12" length: 2];
+  PASS([r nextObject] == nil, "incomplete number is not returned");
+  [r appendBytes: "34 " length: 3];
+  PASS_EQUAL([r nextObject], [NSNumber numberWithInt: 1234],
+    "number split between chunks is parsed");
+
+  /* A value is returned as soon as its last byte arrives, even when
+   * that is in a small chunk after a large one.
+   */
+  r = [[GSJSONReader new] autorelease];
+  [r setReadsArrayElements: YES];
+  data = [[NSString stringWithFormat: @"[{\"a\": \"%@",
+    [@"" stringByPaddingToLength: 10000 withString: @"x" startingAtIndex: 0]]
+    dataUsingEncoding: NSUTF8StringEncoding];
+  [r appendData: data];
+  PASS([r nextObject] == nil, "incomplete element is not returned");
+  [r appendBytes: "\\\"" length: 2];
+  PASS([r nextObject] == nil, "escaped quote does not end a string");
+  [r appendBytes: "\"}" length: 2];
+  PASS([[[r nextObject] objectForKey: @"a"] length] == 10001,
+    "element is returned when its last byte arrives");
+
+  /* Values read from a stream.
+   */
+  is = [NSInputStream inputStreamWithData: lines];
+  [is open];
+  r = [[GSJSONReader new] autorelease];
+  out = [NSMutableArray array];
+  do
+    {
+      id	obj;
+
+      n = [r readFromStream: is];
+      while ((obj = [r nextObject]) != nil)
+	{
+	  [out addObject: obj];
+	}
+    }
+  while (n > 0);
+  [is close];
+  PASS(n == 0 && [out isEqual: records], "values read from a stream");
+
+  /* Errors.
+   */
+  r = [[GSJSONReader new] autorelease];
+  PASS([r appendBytes: "[1, 2] {x" length: 9] == NO && [r error] != nil,
+    "invalid data gives an error");
+  r = [[GSJSONReader new] autorelease];
+  [r setReadsArrayElements: YES];
+  [r appendBytes: "[1, 2" length: 5];
+  PASS([r finish] == NO && [r error] != nil,
+    "unterminated array gives an error");
+  {
+    const char	*bad[] = { "[1 2 3]", "[,,1]", "[1,]", "[1,,2]", "[1] 2",
+      "[1]]" };
+    BOOL	ok = YES;
+
+    for (i = 0; i < (int)(sizeof(bad) / sizeof(*bad)); i++)
+      {
+	r = [[GSJSONReader new] autorelease];
+	[r setReadsArrayElements: YES];
+	if ([r appendBytes: bad[i] length: strlen(bad[i])] == YES
+	  && [r finish] == YES)
+	  {
+	    ok = NO;
+	  }
+      }
+    PASS(ok, "badly separated or trailing array elements give an error");
+  }
+  r = [[GSJSONReader new] autorelease];
+  [r setReadsArrayElements: YES];
+  PASS([r appendBytes: "[ ]\n " length: 5] == YES && [r finish] == YES
+    && [r nextObject] == nil, "an empty array followed by space is valid");
+  r = [[GSJSONReader new] autorelease];
+  PASS([r appendBytes: "\"\xff\xfe\"" length: 4] == NO,
+    "invalid UTF-8 gives an error");
+
+  [arp release]; arp = nil;
+  return 0;
+}
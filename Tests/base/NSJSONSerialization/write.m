@@ -0,0 +1,124 @@
+#import <Foundation/Foundation.h>
+#import "ObjectTesting.h"
+
+#include <math.h>
+#include <locale.h>
+
+static NSString *
+json(id obj)
+{
+  NSData	*d;
+
+  d = [NSJSONSerialization dataWithJSONObject: obj options: 0 error: 0];
+  return [[[NSString alloc] initWithData: d
+				encoding: NSUTF8StringEncoding] autorelease];
+}
+
+int main(void)
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableArray	*big = [NSMutableArray array];
+  NSOutputStream	*os;
+  NSString		*s;
+  NSError		*e;
+  NSData		*d;
+  NSInteger		n;
+  int			i;
+
+  PASS_EQUAL(json([NSArray arrayWithObject: @"a\"b\\c\n\t\001/"]),
+    @"[\"a\\\"b\\\\c\\n\\t\\u0001/\"]", "strings are escaped");
+  s = @"café € \U0001F600";
+  d = [NSJSONSerialization dataWithJSONObject: [NSArray arrayWithObject: s]
+				      options: 0
+					error: 0];
+  PASS([d length] == 4 + 3 + 2 + 1 + 3 + 1 + 4,
+    "non-ASCII characters are written as UTF-8");
+  PASS_EQUAL([[NSJSONSerialization JSONObjectWithData: d
+					       options: 0
+						 error: 0] lastObject],
+    s, "non-ASCII characters survive a round trip");
+
+  PASS_EQUAL(json([NSArray arrayWithObjects:
+    [NSNumber numberWithInt: -42],
+    [NSNumber numberWithLongLong: 1234567890123LL],
+    [NSNumber numberWithUnsignedLongLong: 18446744073709551615ULL],
+    [NSNumber numberWithDouble: 0.1],
+    [NSNumber numberWithDouble: 1.5e300],
+    nil]),
+    @"[-42,1234567890123,18446744073709551615,0.1,1.5e+300]",
+    "numbers are written exactly");
+  PASS(json([NSArray arrayWithObject: [NSNumber numberWithDouble: NAN]])
+    == nil, "NaN can't be written");
+
+  START_SET("numbers in a comma locale")
+    if (setlocale(LC_NUMERIC, "de_DE.UTF-8") == 0
+      && setlocale(LC_NUMERIC, "fr_FR.UTF-8") == 0)
+      {
+	SKIP("no locale with a decimal comma is installed")
+      }
+    PASS_EQUAL(json([NSArray arrayWithObject:
+      [NSNumber numberWithDouble: 1.5]]), @"[1.5]",
+      "numbers are written with a decimal point whatever the locale");
+    PASS_EQUAL([[NSJSONSerialization JSONObjectWithData:
+      [@"[2.25]" dataUsingEncoding: NSUTF8StringEncoding]
+      options: 0 error: 0] lastObject], [NSNumber numberWithDouble: 2.25],
+      "numbers are read with a decimal point whatever the locale");
+    setlocale(LC_NUMERIC, "C");
+  END_SET("numbers in a comma locale")
+  PASS([NSJSONSerialization isValidJSONObject:
+    [NSArray arrayWithObject: [NSArray arrayWithObject: [NSDate date]]]] == NO,
+    "nested invalid objects are detected");
+
+  PASS_EQUAL(json([NSDictionary dictionaryWithObject: [NSNull null]
+					      forKey: @"k"]),
+    @"{\"k\":null}", "compact output has no whitespace");
+
+  /* Write something much larger than the output buffer to a stream.
+   */
+  for (i = 0; i < 10000; i++)
+    {
+      [big addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+	[NSNumber numberWithInt: i], @"id",
+	[NSString stringWithFormat: @"item é %d", i], @"name",
+	nil]];
+    }
+  d = [NSJSONSerialization dataWithJSONObject: big
+				      options: NSJSONWritingPrettyPrinted
+					error: 0];
+  os = [NSOutputStream outputStreamToMemory];
+  [os open];
+  n = [NSJSONSerialization writeJSONObject: big
+				  toStream: os
+				   options: NSJSONWritingPrettyPrinted
+				     error: &e];
+  [os close];
+  PASS(n == [d length], "stream write reports length written");
+  PASS_EQUAL([os propertyForKey: NSStreamDataWrittenToMemoryStreamKey], d,
+    "stream output matches data output");
+  PASS_EQUAL([NSJSONSerialization JSONObjectWithData: d options: 0 error: 0],
+    big, "large output round trips");
+
+  /* A stream which fails part way through a long string.
+   */
+  {
+    uint8_t		buf[100];
+    NSMutableString	*m = [NSMutableString string];
+
+    for (i = 0; i < 2000; i++)
+      {
+	[m appendString: @"long é\n\""];
+      }
+    os = [NSOutputStream outputStreamToBuffer: buf capacity: sizeof(buf)];
+    [os open];
+    e = nil;
+    n = [NSJSONSerialization writeJSONObject: [NSArray arrayWithObject: m]
+				    toStream: os
+				     options: 0
+				       error: &e];
+    [os close];
+    PASS(n == 0 && e != nil, "a failing stream gives an error");
+  }
+
+  [arp release]; arp = nil;
+  return 0;
+}
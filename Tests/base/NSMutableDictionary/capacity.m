@@ -0,0 +1,73 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSEnumerator.h>
+#import <Foundation/NSSet.h>
+#import <Foundation/NSValue.h>
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableDictionary	*dict;
+  NSMutableSet		*set;
+  NSEnumerator		*e;
+  NSNumber		*key;
+  BOOL			ok;
+  unsigned		count;
+  unsigned		i;
+
+  /* Keys whose hashes share low order bits used to land in one bucket
+   * when the table size is a power of two, so check that lookups work
+   * as the tables grow through many sizes.
+   */
+  dict = [NSMutableDictionary dictionaryWithCapacity: 0];
+  set = [NSMutableSet setWithCapacity: 0];
+  for (i = 0; i < 10000; i++)
+    {
+      key = [NSNumber numberWithUnsignedInt: i * 1024];
+      [dict setObject: key forKey: key];
+      [set addObject: key];
+    }
+  PASS([dict count] == 10000, "dictionary holds all keys after growth");
+  PASS([set count] == 10000, "set holds all keys after growth");
+
+  ok = YES;
+  for (i = 0; i < 10000; i++)
+    {
+      key = [NSNumber numberWithUnsignedInt: i * 1024];
+      if ([dict objectForKey: key] == nil || [set member: key] == nil)
+	{
+	  ok = NO;
+	}
+    }
+  PASS(ok, "all keys can be found after growth");
+
+  for (i = 0; i < 10000; i += 2)
+    {
+      key = [NSNumber numberWithUnsignedInt: i * 1024];
+      [dict removeObjectForKey: key];
+      [set removeObject: key];
+    }
+  PASS([dict count] == 5000 && [set count] == 5000, "removal works");
+  PASS([dict objectForKey: [NSNumber numberWithUnsignedInt: 1024]] != nil
+    && [dict objectForKey: [NSNumber numberWithUnsignedInt: 0]] == nil,
+    "remaining keys are intact after removal");
+
+  count = 0;
+  e = [dict keyEnumerator];
+  while ((key = [e nextObject]) != nil)
+    {
+      count++;
+    }
+  PASS(count == 5000, "enumeration visits every key");
+
+  count = 0;
+  for (key in set)
+    {
+      count++;
+    }
+  PASS(count == 5000, "fast enumeration visits every member");
+
+  [arp release]; arp = nil;
+  return 0;
+}
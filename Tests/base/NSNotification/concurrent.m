@@ -0,0 +1,128 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSNotification.h>
+#import <Foundation/NSThread.h>
+
+#define	POSTS		10000
+#define	THREADS		4
+
+@interface	Counter : NSObject
+{
+@public
+  NSLock	*lock;
+  unsigned	count;
+}
+- (void) note: (NSNotification*)n;
+@end
+
+@implementation	Counter
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      lock = [NSLock new];
+    }
+  return self;
+}
+- (void) dealloc
+{
+  [lock release];
+  [super dealloc];
+}
+- (void) note: (NSNotification*)n
+{
+  [lock lock];
+  count++;
+  [lock unlock];
+}
+@end
+
+@interface	Poster : NSObject
+{
+@public
+  NSNotificationCenter	*center;
+  volatile unsigned	finished;
+}
+- (void) post: (id)object;
+@end
+
+@implementation	Poster
+- (void) post: (id)object
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  unsigned		i;
+
+  for (i = 0; i < POSTS; i++)
+    {
+      [center postNotificationName: @"Tick" object: object];
+    }
+  __sync_fetch_and_add(&finished, 1);
+  [arp release];
+}
+@end
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSNotificationCenter	*nc = [[NSNotificationCenter new] autorelease];
+  Counter		*named = [[Counter new] autorelease];
+  Counter		*any = [[Counter new] autorelease];
+  Counter		*late = [[Counter new] autorelease];
+  Poster		*poster = [[Poster new] autorelease];
+  NSDate		*limit;
+  unsigned		i;
+
+  [nc addObserver: named selector: @selector(note:) name: @"Tick" object: nil];
+  [nc addObserver: any selector: @selector(note:) name: nil object: poster];
+
+  /* Post often enough for the center to stop locking.
+   */
+  for (i = 0; i < 100; i++)
+    {
+      [nc postNotificationName: @"Tick" object: poster];
+    }
+  PASS(named->count == 100 && any->count == 100,
+    "repeated posts reach every observer");
+
+  [nc removeObserver: any];
+  [nc postNotificationName: @"Tick" object: poster];
+  PASS(named->count == 101 && any->count == 100,
+    "a removed observer is not notified");
+
+  for (i = 0; i < 100; i++)
+    {
+      [nc postNotificationName: @"Tock" object: poster];
+    }
+  [nc addObserver: late selector: @selector(note:) name: @"Tock" object: nil];
+  [nc postNotificationName: @"Tock" object: poster];
+  PASS(late->count == 1, "an added observer is notified");
+  PASS(named->count == 101, "other names are not notified");
+
+  /* Post from several threads while observers come and go.
+   */
+  named->count = 0;
+  poster->center = nc;
+  for (i = 0; i < THREADS; i++)
+    {
+      [NSThread detachNewThreadSelector: @selector(post:)
+			       toTarget: poster
+			     withObject: nil];
+    }
+  limit = [NSDate dateWithTimeIntervalSinceNow: 60.0];
+  while (poster->finished < THREADS && [limit timeIntervalSinceNow] > 0.0)
+    {
+      [nc addObserver: late selector: @selector(note:)
+		 name: @"Tick" object: nil];
+      [nc removeObserver: late name: @"Tick" object: nil];
+    }
+  PASS(poster->finished == THREADS, "concurrent posting completes");
+  PASS(named->count == THREADS * POSTS,
+    "concurrent posts reach the observer (%u)", named->count);
+
+  [nc removeObserver: named];
+  [nc removeObserver: late];
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,123 @@
+#import <Foundation/NSArray.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSOperation.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import "ObjectTesting.h"
+
+#define	COUNT	10000
+
+@interface      OpCount : NSOperation
+@end
+@implementation OpCount
+static NSLock		*lock = nil;
+static NSUInteger	count = 0;
++ (void) initialize
+{
+  lock = [NSLock new];
+}
+- (void) main
+{
+  [lock lock];
+  count++;
+  [lock unlock];
+}
+@end
+
+@interface      OpRecord : NSOperation
+{
+  NSMutableArray	*list;
+}
+- (id) initWithList: (NSMutableArray*)l;
+@end
+@implementation OpRecord
+- (id) initWithList: (NSMutableArray*)l
+{
+  if ((self = [super init]) != nil)
+    {
+      list = l;
+    }
+  return self;
+}
+- (void) main
+{
+  [list addObject: self];
+}
+@end
+
+int main()
+{
+  NSAutoreleasePool     *arp = [NSAutoreleasePool new];
+  NSOperationQueue      *q;
+  NSMutableArray        *a;
+  NSMutableArray        *list;
+  NSOperation           *op;
+  BOOL                  ok;
+  int                   i;
+
+  /* Lots of small operations must all run, and once they have finished
+   * the queue must be empty.
+   */
+  q = [NSOperationQueue new];
+  a = [NSMutableArray arrayWithCapacity: COUNT];
+  for (i = 0; i < COUNT; i++)
+    {
+      op = [OpCount new];
+      [a addObject: op];
+      [op release];
+    }
+  [q addOperations: a waitUntilFinished: YES];
+  PASS(count == COUNT, "all operations ran");
+  PASS([q operationCount] == 0, "queue is empty when all have finished");
+  PASS([[q operations] count] == 0, "operations array is empty");
+
+  for (i = 0; i < COUNT; i++)
+    {
+      op = [OpCount new];
+      [q addOperation: op];
+      [op release];
+    }
+  [q waitUntilAllOperationsAreFinished];
+  PASS(count == 2 * COUNT, "operations added singly all ran");
+  PASS([q operationCount] == 0, "queue is empty after adding singly");
+  [q release];
+
+  /* Operations which are ready are run in priority order, and in the
+   * order they were added within a priority.
+   */
+  q = [NSOperationQueue new];
+  [q setMaxConcurrentOperationCount: 1];
+  [q setSuspended: YES];
+  list = [NSMutableArray array];
+  a = [NSMutableArray array];
+  for (i = 0; i < 20; i++)
+    {
+      op = [[OpRecord alloc] initWithList: list];
+      [op setQueuePriority: (i % 5) * 4 - 8];
+      [a addObject: op];
+      [q addOperation: op];
+      [op release];
+    }
+  PASS([q operationCount] == 20, "suspended queue holds operations");
+  [q setSuspended: NO];
+  [q waitUntilAllOperationsAreFinished];
+  PASS([list count] == 20, "all prioritised operations ran");
+  ok = YES;
+  for (i = 1; i < 20; i++)
+    {
+      NSOperation	*o1 = [list objectAtIndex: i - 1];
+      NSOperation	*o2 = [list objectAtIndex: i];
+
+      if ([o1 queuePriority] < [o2 queuePriority]
+	|| ([o1 queuePriority] == [o2 queuePriority]
+	  && [a indexOfObjectIdenticalTo: o1] > [a indexOfObjectIdenticalTo: o2]))
+	{
+	  ok = NO;
+	}
+    }
+  PASS(ok, "operations ran in priority order, first in first out");
+
+  [q release];
+
+  [arp release]; arp = nil;
+  return 0;
+}
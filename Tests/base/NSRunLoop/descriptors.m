@@ -0,0 +1,121 @@
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSFileHandle.h>
+#import <Foundation/NSNotification.h>
+#import <Foundation/NSRunLoop.h>
+
+#include <unistd.h>
+
+#define	PIPES	200
+
+@interface	Counter : NSObject
+{
+@public
+  unsigned	count;
+}
+- (void) didRead: (NSNotification*)n;
+@end
+
+@implementation	Counter
+- (void) didRead: (NSNotification*)n
+{
+  count++;
+}
+@end
+
+/* Run the loop until the counter reaches the expected value, or until
+ * a few seconds have passed.
+ */
+static void
+runUntil(Counter *c, unsigned expected)
+{
+  NSDate	*limit = [NSDate dateWithTimeIntervalSinceNow: 5.0];
+
+  while (c->count < expected && [limit timeIntervalSinceNow] > 0.0)
+    {
+      [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+			       beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+    }
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSNotificationCenter	*nc = [NSNotificationCenter defaultCenter];
+  NSMutableArray	*readers = [NSMutableArray array];
+  NSMutableArray	*writers = [NSMutableArray array];
+  Counter		*c = [[Counter new] autorelease];
+  NSFileHandle		*r;
+  NSFileHandle		*w;
+  NSData		*d = [NSData dataWithBytes: "x" length: 1];
+  int			fds[2];
+  int			oldfd;
+  unsigned		i;
+
+  [nc addObserver: c
+	 selector: @selector(didRead:)
+	     name: NSFileHandleReadCompletionNotification
+	   object: nil];
+
+  for (i = 0; i < PIPES; i++)
+    {
+      if (pipe(fds) < 0)
+	{
+	  break;
+	}
+      r = [[NSFileHandle alloc] initWithFileDescriptor: fds[0]
+					closeOnDealloc: YES];
+      w = [[NSFileHandle alloc] initWithFileDescriptor: fds[1]
+					closeOnDealloc: YES];
+      [readers addObject: r];
+      [writers addObject: w];
+      [r release];
+      [w release];
+      [r readInBackgroundAndNotify];
+    }
+  PASS([readers count] == PIPES, "created many pipes");
+
+  /* Only a few of the watched descriptors become readable.
+   */
+  for (i = 0; i < PIPES; i += 50)
+    {
+      [[writers objectAtIndex: i] writeData: d];
+    }
+  runUntil(c, PIPES / 50);
+  PASS(c->count == PIPES / 50, "only readable descriptors are reported");
+
+  /* Close a watched descriptor and reuse its number for a new pipe,
+   * the loop must watch the new descriptor rather than the old one.
+   */
+  r = [readers objectAtIndex: 1];
+  oldfd = [r fileDescriptor];
+  [r closeFile];
+  [[writers objectAtIndex: 1] closeFile];
+  [readers removeObjectAtIndex: 1];
+  [writers removeObjectAtIndex: 1];
+  [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+			   beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+  if (pipe(fds) == 0)
+    {
+      r = [[NSFileHandle alloc] initWithFileDescriptor: fds[0]
+					closeOnDealloc: YES];
+      w = [[NSFileHandle alloc] initWithFileDescriptor: fds[1]
+					closeOnDealloc: YES];
+      [readers addObject: r];
+      [writers addObject: w];
+      [r release];
+      [w release];
+      [r readInBackgroundAndNotify];
+      [w writeData: d];
+      i = c->count;
+      runUntil(c, i + 1);
+      PASS(c->count == i + 1, "reused descriptor %d is watched", oldfd);
+    }
+
+  [nc removeObserver: c];
+  [arp release]; arp = nil;
+  return 0;
+}
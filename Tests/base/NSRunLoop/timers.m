@@ -0,0 +1,143 @@
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSTimer.h>
+
+#define	TIMERS	100000
+
+@interface	Counter : NSObject
+{
+@public
+  unsigned	count;
+  unsigned	performed;
+  NSTimeInterval	last;
+  BOOL		ordered;
+}
+- (void) perform: (id)arg;
+- (void) timeout: (NSTimer*)t;
+@end
+
+@implementation	Counter
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      ordered = YES;
+    }
+  return self;
+}
+- (void) perform: (id)arg
+{
+  performed++;
+}
+- (void) timeout: (NSTimer*)t
+{
+  NSTimeInterval	ti = [[t fireDate] timeIntervalSinceReferenceDate];
+
+  if (ti < last)
+    {
+      ordered = NO;
+    }
+  last = ti;
+  count++;
+}
+@end
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSRunLoop		*loop = [NSRunLoop currentRunLoop];
+  NSMutableArray	*timers = [NSMutableArray arrayWithCapacity: TIMERS];
+  Counter		*c = [[Counter new] autorelease];
+  NSTimeInterval	base = [NSDate timeIntervalSinceReferenceDate];
+  NSDate		*limit;
+  NSTimer		*t;
+  unsigned		i;
+
+  /* Arm lots of timers with fire dates spread over half a second,
+   * added in an order unrelated to their fire dates.
+   */
+  for (i = 0; i < TIMERS; i++)
+    {
+      NSDate	*d;
+
+      d = [NSDate dateWithTimeIntervalSinceReferenceDate:
+	base + 0.1 + ((i * 7919) % TIMERS) * (0.5 / TIMERS)];
+      t = [[NSTimer alloc] initWithFireDate: d
+				   interval: 0.0
+				     target: c
+				   selector: @selector(timeout:)
+				   userInfo: nil
+				    repeats: NO];
+      [loop addTimer: t forMode: NSDefaultRunLoopMode];
+      [timers addObject: t];
+      [t release];
+    }
+
+  /* Cancel every other timer, as a server would when connections
+   * complete before their timeouts.
+   */
+  for (i = 0; i < TIMERS; i += 2)
+    {
+      [[timers objectAtIndex: i] invalidate];
+    }
+
+  limit = [NSDate dateWithTimeIntervalSinceNow: 30.0];
+  while (c->count < TIMERS / 2 && [limit timeIntervalSinceNow] > 0.0)
+    {
+      [loop runMode: NSDefaultRunLoopMode
+	 beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+    }
+  PASS(c->count == TIMERS / 2, "all armed timers fire exactly once");
+  PASS(c->ordered == YES, "timers fire in date order");
+
+  /* A timer whose fire date is moved earlier must fire at the new date.
+   */
+  c->count = 0;
+  t = [NSTimer scheduledTimerWithTimeInterval: 1000.0
+				       target: c
+				     selector: @selector(timeout:)
+				     userInfo: nil
+				      repeats: NO];
+  [t setFireDate: [NSDate dateWithTimeIntervalSinceNow: 0.05]];
+  [loop runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.5]];
+  PASS(c->count == 1, "timer with fire date moved earlier fires");
+
+  /* Delayed performs can be cancelled for a target.
+   */
+  for (i = 0; i < 1000; i++)
+    {
+      [c performSelector: @selector(perform:)
+	      withObject: nil
+	      afterDelay: 0.05];
+    }
+  [c performSelector: @selector(perform:)
+	  withObject: @"x"
+	  afterDelay: 0.05];
+  [NSObject cancelPreviousPerformRequestsWithTarget: c
+					   selector: @selector(perform:)
+					     object: nil];
+  [loop runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.3]];
+  PASS(c->performed == 1, "cancelling by selector and object works");
+
+  for (i = 0; i < 1000; i++)
+    {
+      [c performSelector: @selector(perform:)
+	      withObject: nil
+	      afterDelay: 0.05];
+    }
+  [NSObject cancelPreviousPerformRequestsWithTarget: c];
+  [loop runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.3]];
+  PASS(c->performed == 1, "cancelling by target works");
+
+  [c performSelector: @selector(perform:)
+	  withObject: nil
+	  afterDelay: 0.05];
+  [loop runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.3]];
+  PASS(c->performed == 2, "delayed perform fires after cancellations");
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,61 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSSet.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+/* Check that every representation of the string has the same hash.
+ */
+static BOOL
+sameHash(NSString *s)
+{
+  NSUInteger	len = [s length];
+  unichar	buf[len + 1];
+  NSString	*u;
+  NSString	*c;
+  NSString	*m;
+
+  [s getCharacters: buf range: NSMakeRange(0, len)];
+  u = [NSString stringWithCharacters: buf length: len];
+  c = [NSString stringWithCString: [s cStringUsingEncoding:
+    NSISOLatin1StringEncoding] encoding: NSISOLatin1StringEncoding];
+  m = [NSMutableString stringWithString: s];
+  return [u hash] == [s hash] && [c hash] == [s hash] && [m hash] == [s hash];
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableSet		*hashes;
+  NSMutableString	*long1;
+  unsigned		i;
+
+  PASS(sameHash(@"a"), "short string has same hash in all forms");
+  PASS(sameHash(@"abcdefghijklmnop"), "16 character string hash matches");
+  PASS(sameHash(@"café crème"), "Latin-1 string hash matches");
+  long1 = [NSMutableString string];
+  for (i = 0; i < 100; i++)
+    {
+      [long1 appendFormat: @"%ué", i];
+    }
+  PASS(sameHash(long1), "long string hash matches");
+  PASS([@"http://www.gnustep.org/resources/documentation/index.html" hash]
+    == [[NSMutableString stringWithString:
+    @"http://www.gnustep.org/resources/documentation/index.html"] hash],
+    "constant string hash matches");
+
+  /* Similar keys should not collide much more than random values would.
+   */
+  hashes = [NSMutableSet set];
+  for (i = 0; i < 100000; i++)
+    {
+      NSString	*s;
+
+      s = [NSString stringWithFormat: @"http://example.com/item/%u", i];
+      [hashes addObject: [NSNumber numberWithUnsignedInteger: [s hash]]];
+    }
+  PASS([hashes count] > 99900, "URL-like keys have few hash collisions");
+
+  [arp release]; arp = nil;
+  return 0;
+}
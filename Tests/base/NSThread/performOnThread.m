@@ -0,0 +1,156 @@
+#import "ObjectTesting.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSValue.h>
+
+#define	PRODUCERS	4
+#define	MESSAGES	10000
+
+@interface	Receiver : NSObject
+{
+@public
+  unsigned	count;
+  unsigned	last[PRODUCERS];
+  BOOL		ordered;
+}
+- (void) message: (NSNumber*)n;
+- (void) ping: (id)ignored;
+@end
+
+@implementation	Receiver
+- (void) message: (NSNumber*)n
+{
+  unsigned	v = [n unsignedIntValue];
+  unsigned	p = v / MESSAGES;
+  unsigned	i = v % MESSAGES;
+
+  if (i != last[p])
+    {
+      ordered = NO;
+    }
+  last[p] = i + 1;
+  count++;
+}
+- (void) ping: (id)ignored
+{
+}
+@end
+
+@interface	Producer : NSObject
+{
+@public
+  Receiver	*receiver;
+  NSThread	*target;
+  unsigned	index;
+}
+- (void) run: (id)ignored;
+@end
+
+@implementation	Producer
+- (void) run: (id)ignored
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  unsigned		i;
+
+  for (i = 0; i < MESSAGES; i++)
+    {
+      NSAutoreleasePool	*pool = [NSAutoreleasePool new];
+
+      [receiver performSelector: @selector(message:)
+		       onThread: target
+		     withObject: [NSNumber numberWithUnsignedInt:
+		       index * MESSAGES + i]
+		  waitUntilDone: NO];
+      [pool release];
+    }
+  [arp release];
+}
+@end
+
+@interface	Pinger : NSObject
+{
+@public
+  Receiver	*receiver;
+  NSThread	*target;
+  BOOL		done;
+}
+- (void) run: (id)ignored;
+@end
+
+@implementation	Pinger
+- (void) run: (id)ignored
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  unsigned		i;
+
+  /* Each round trip must complete before the next starts.
+   */
+  for (i = 0; i < 1000; i++)
+    {
+      [receiver performSelector: @selector(ping:)
+		       onThread: target
+		     withObject: nil
+		  waitUntilDone: YES];
+    }
+  done = YES;
+  [arp release];
+}
+@end
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSRunLoop		*loop = [NSRunLoop currentRunLoop];
+  NSThread		*me = [NSThread currentThread];
+  Receiver		*r = [[Receiver new] autorelease];
+  Pinger		*pinger = [[Pinger new] autorelease];
+  NSDate		*limit;
+  unsigned		i;
+
+  r->ordered = YES;
+
+  /* Several threads send bursts of messages to this thread; every
+   * message must be delivered, in the order each thread sent them.
+   */
+  for (i = 0; i < PRODUCERS; i++)
+    {
+      Producer	*p = [[Producer new] autorelease];
+
+      p->receiver = r;
+      p->target = me;
+      p->index = i;
+      [NSThread detachNewThreadSelector: @selector(run:)
+			       toTarget: p
+			     withObject: nil];
+    }
+  limit = [NSDate dateWithTimeIntervalSinceNow: 30.0];
+  while (r->count < PRODUCERS * MESSAGES && [limit timeIntervalSinceNow] > 0.0)
+    {
+      [loop runMode: NSDefaultRunLoopMode
+	 beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+    }
+  PASS(r->count == PRODUCERS * MESSAGES, "all messages were delivered");
+  PASS(r->ordered == YES, "messages from each thread arrive in order");
+
+  /* Round trips with waitUntilDone: must each wake this thread.
+   */
+  pinger->receiver = r;
+  pinger->target = me;
+  [NSThread detachNewThreadSelector: @selector(run:)
+			   toTarget: pinger
+			 withObject: nil];
+  limit = [NSDate dateWithTimeIntervalSinceNow: 30.0];
+  while (NO == pinger->done && [limit timeIntervalSinceNow] > 0.0)
+    {
+      [loop runMode: NSDefaultRunLoopMode
+	 beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+    }
+  PASS(pinger->done == YES, "synchronous performs complete");
+
+  [arp release]; arp = nil;
+  return 0;
+}
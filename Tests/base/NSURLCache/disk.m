@@ -0,0 +1,152 @@
+#import "Testing.h"
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSFileManager.h>
+#import <Foundation/NSPathUtilities.h>
+#import <Foundation/NSProcessInfo.h>
+#import <Foundation/NSURL.h>
+#import <Foundation/NSURLCache.h>
+#import <Foundation/NSURLRequest.h>
+#import <Foundation/NSURLResponse.h>
+
+static NSCachedURLResponse *
+makeResponse(NSURL *u, NSString *body, NSString *control)
+{
+  NSDictionary		*h;
+  NSHTTPURLResponse	*r;
+
+  if (control == nil)
+    {
+      h = [NSDictionary dictionaryWithObjectsAndKeys:
+	@"text/plain", @"Content-Type",
+	@"\"abc\"", @"ETag", nil];
+    }
+  else
+    {
+      h = [NSDictionary dictionaryWithObjectsAndKeys:
+	@"text/plain", @"Content-Type",
+	control, @"Cache-Control", nil];
+    }
+  r = [[[NSHTTPURLResponse alloc] initWithURL: u
+				   statusCode: 200
+				  HTTPVersion: @"HTTP/1.1"
+				 headerFields: h] autorelease];
+  return [[[NSCachedURLResponse alloc]
+    initWithResponse: r
+		data: [body dataUsingEncoding: NSUTF8StringEncoding]]
+    autorelease];
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSFileManager		*mgr = [NSFileManager defaultManager];
+  NSString		*path;
+  NSURLCache		*cache;
+  NSURLRequest		*req;
+  NSURLRequest		*other;
+  NSCachedURLResponse	*c;
+  unsigned		i;
+
+  path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+    [NSString stringWithFormat: @"URLCache%d",
+    [[NSProcessInfo processInfo] processIdentifier]]];
+  [mgr removeFileAtPath: path handler: nil];
+
+  req = [NSURLRequest requestWithURL:
+    [NSURL URLWithString: @"http://www.gnustep.org/a"]];
+  other = [NSURLRequest requestWithURL:
+    [NSURL URLWithString: @"http://www.gnustep.org/b"]];
+
+  cache = [[NSURLCache alloc] initWithMemoryCapacity: 1024 * 1024
+					diskCapacity: 1024 * 1024
+					    diskPath: path];
+  [cache storeCachedResponse: makeResponse([req URL], @"hello", nil)
+		  forRequest: req];
+  [cache storeCachedResponse: makeResponse([other URL], @"secret", @"no-store")
+		  forRequest: other];
+  PASS([cache currentDiskUsage] == 5, "disk usage counts stored body");
+  PASS([cache cachedResponseForRequest: other] == nil,
+    "no-store response is not cached");
+  [cache release];
+
+  /* A new cache using the same directory finds the stored response.
+   */
+  cache = [[NSURLCache alloc] initWithMemoryCapacity: 1024 * 1024
+					diskCapacity: 1024 * 1024
+					    diskPath: path];
+  c = [cache cachedResponseForRequest: req];
+  PASS(c != nil, "response persists on disk");
+  PASS([[c data] isEqual: [@"hello" dataUsingEncoding: NSUTF8StringEncoding]],
+    "body persists on disk");
+  PASS([(NSHTTPURLResponse*)[c response] statusCode] == 200,
+    "status code persists on disk");
+  PASS([[[(NSHTTPURLResponse*)[c response] allHeaderFields]
+    objectForKey: @"ETag"] isEqual: @"\"abc\""], "headers persist on disk");
+
+  /* Only one cache at a time uses a directory.
+   */
+  {
+    NSURLCache	*second;
+
+    second = [[NSURLCache alloc] initWithMemoryCapacity: 1024 * 1024
+					   diskCapacity: 1024 * 1024
+					       diskPath: path];
+    PASS([second cachedResponseForRequest: req] == nil,
+      "a second cache for a directory in use does not read it");
+    [second storeCachedResponse: makeResponse([other URL], @"more", nil)
+		     forRequest: other];
+    PASS([second currentDiskUsage] == 0
+      && [second cachedResponseForRequest: other] != nil,
+      "a second cache for a directory in use keeps responses in memory");
+    [second release];
+  }
+
+  [cache storeCachedResponse: makeResponse([other URL], @"", nil)
+		  forRequest: other];
+  [cache release];
+  cache = [[NSURLCache alloc] initWithMemoryCapacity: 0
+					diskCapacity: 1024 * 1024
+					    diskPath: path];
+  c = [cache cachedResponseForRequest: other];
+  PASS(c != nil && [[c data] length] == 0,
+    "a response with an empty body is read back from disk");
+
+  [cache removeCachedResponseForRequest: req];
+  PASS([cache cachedResponseForRequest: req] == nil, "response removed");
+  PASS([cache currentDiskUsage] == 0, "disk usage is zero after removal");
+  [cache release];
+
+  /* Storing beyond the disk capacity evicts older responses.
+   */
+  cache = [[NSURLCache alloc] initWithMemoryCapacity: 0
+					diskCapacity: 1000
+					    diskPath: path];
+  for (i = 0; i < 100; i++)
+    {
+      NSURLRequest	*r;
+
+      r = [NSURLRequest requestWithURL: [NSURL URLWithString:
+	[NSString stringWithFormat: @"http://www.gnustep.org/%u", i]]];
+      [cache storeCachedResponse: makeResponse([r URL],
+	@"0123456789012345678901234567890123456789", nil)
+		      forRequest: r];
+    }
+  PASS([cache currentDiskUsage] <= 1000, "disk usage is within capacity");
+  req = [NSURLRequest requestWithURL:
+    [NSURL URLWithString: @"http://www.gnustep.org/99"]];
+  PASS([cache cachedResponseForRequest: req] != nil,
+    "most recent response is kept");
+  req = [NSURLRequest requestWithURL:
+    [NSURL URLWithString: @"http://www.gnustep.org/0"]];
+  PASS([cache cachedResponseForRequest: req] == nil,
+    "oldest response is evicted");
+  [cache removeAllCachedResponses];
+  PASS([cache currentDiskUsage] == 0, "all responses removed");
+  [cache release];
+
+  [mgr removeFileAtPath: path handler: nil];
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,270 @@
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define	LOADS	4
+#define	CHUNKED	1000000
+
+/* A minimal HTTP/1.1 server which keeps connections open and answers
+ * requests in order.  The response body is the request path, except for
+ * paths of the form /chunked/N which get N bytes of chunked data.
+ */
+@interface	Server : NSObject
+{
+@public
+  int		listener;
+  unsigned	accepted;
+}
+- (void) serve: (id)arg;
+- (void) session: (NSNumber*)desc;
+@end
+
+@implementation	Server
+- (void) serve: (id)arg
+{
+  for (;;)
+    {
+      int	fd = accept(listener, 0, 0);
+
+      if (fd < 0)
+	{
+	  break;
+	}
+      accepted++;
+      [NSThread detachNewThreadSelector: @selector(session:)
+			       toTarget: self
+			     withObject: [NSNumber numberWithInt: fd]];
+    }
+}
+
+- (void) session: (NSNumber*)desc
+{
+  int		fd = [desc intValue];
+  char		buf[4096];
+  unsigned	used = 0;
+  int		r;
+
+  while ((r = read(fd, buf + used, sizeof(buf) - used - 1)) > 0)
+    {
+      char	*end;
+
+      used += r;
+      buf[used] = '\0';
+      while ((end = strstr(buf, "\r\n\r\n")) != 0)
+	{
+	  unsigned	len = end + 4 - buf;
+	  char		path[256];
+	  char		head[512];
+
+	  if (sscanf(buf, "GET %255s", path) != 1)
+	    {
+	      strcpy(path, "/");
+	    }
+	  if (strncmp(path, "/chunked/", 9) == 0)
+	    {
+	      int	size = atoi(path + 9);
+	      char	chunk[5000];
+
+	      memset(chunk, 'x', sizeof(chunk));
+	      snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n"
+		"Transfer-Encoding: chunked\r\n\r\n");
+	      write(fd, head, strlen(head));
+	      while (size > 0)
+		{
+		  int	n = (size > 4096) ? 4096 : size;
+
+		  snprintf(head, sizeof(head), "%x\r\n", n);
+		  write(fd, head, strlen(head));
+		  write(fd, chunk, n);
+		  write(fd, "\r\n", 2);
+		  size -= n;
+		}
+	      write(fd, "0\r\n\r\n", 5);
+	    }
+	  else
+	    {
+	      snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n"
+		"Content-Length: %u\r\n\r\n%s", (unsigned)strlen(path), path);
+	      write(fd, head, strlen(head));
+	    }
+	  memmove(buf, buf + len, used - len + 1);
+	  used -= len;
+	}
+      if (used == sizeof(buf) - 1)
+	{
+	  break;
+	}
+    }
+  close(fd);
+}
+@end
+
+/* Collects the data for a load and records the largest piece of data
+ * delivered at one time.
+ */
+@interface	Loader : NSObject
+{
+@public
+  NSMutableData	*data;
+  NSUInteger	largest;
+  BOOL		done;
+  BOOL		failed;
+}
+@end
+
+@implementation	Loader
+- (void) dealloc
+{
+  [data release];
+  [super dealloc];
+}
+- (id) init
+{
+  if ((self = [super init]) != nil)
+    {
+      data = [NSMutableData new];
+    }
+  return self;
+}
+- (void) connection: (NSURLConnection*)c didReceiveData: (NSData*)d
+{
+  if ([d length] > largest)
+    {
+      largest = [d length];
+    }
+  [data appendData: d];
+}
+- (void) connection: (NSURLConnection*)c didFailWithError: (NSError*)e
+{
+  failed = YES;
+  done = YES;
+}
+- (void) connectionDidFinishLoading: (NSURLConnection*)c
+{
+  done = YES;
+}
+@end
+
+static NSURLConnection *
+load(NSString *base, NSString *path, Loader *l)
+{
+  NSMutableURLRequest	*r;
+
+  r = [NSMutableURLRequest requestWithURL:
+    [NSURL URLWithString: [base stringByAppendingString: path]]];
+  [r setHTTPShouldUsePipelining: YES];
+  return [NSURLConnection connectionWithRequest: r delegate: l];
+}
+
+static BOOL
+finished(NSArray *loaders)
+{
+  NSDate	*limit = [NSDate dateWithTimeIntervalSinceNow: 10.0];
+  BOOL		all = NO;
+
+  while (NO == all && [limit timeIntervalSinceNow] > 0.0)
+    {
+      NSEnumerator	*e = [loaders objectEnumerator];
+      Loader		*l;
+
+      all = YES;
+      while ((l = [e nextObject]) != nil)
+	{
+	  if (NO == l->done)
+	    {
+	      all = NO;
+	    }
+	}
+      if (NO == all)
+	{
+	  [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+	    beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+	}
+    }
+  return all;
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  Server		*server = [[Server new] autorelease];
+  NSMutableArray	*loaders = [NSMutableArray array];
+  struct sockaddr_in	sin;
+  socklen_t		len = sizeof(sin);
+  NSString		*base;
+  NSUInteger		before;
+  Loader		*l;
+  BOOL			ok;
+  unsigned		i;
+
+  START_SET("pipelining")
+  server->listener = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin.sin_port = 0;
+  if (bind(server->listener, (struct sockaddr*)&sin, sizeof(sin)) < 0
+    || listen(server->listener, 16) < 0
+    || getsockname(server->listener, (struct sockaddr*)&sin, &len) < 0)
+    {
+      SKIP("unable to set up a local server")
+    }
+  [NSThread detachNewThreadSelector: @selector(serve:)
+			   toTarget: server
+			 withObject: nil];
+  base = [NSString stringWithFormat: @"http://127.0.0.1:%d",
+    ntohs(sin.sin_port)];
+
+  /* A large chunked body is delivered as it arrives rather than all at
+   * once when complete.
+   */
+  l = [[Loader new] autorelease];
+  load(base, [NSString stringWithFormat: @"/chunked/%d", CHUNKED], l);
+  PASS(finished([NSArray arrayWithObject: l]) && NO == l->failed,
+    "chunked load completes");
+  PASS([l->data length] == CHUNKED, "chunked body has the right length");
+  PASS(l->largest < CHUNKED, "chunked body is delivered in pieces");
+
+  /* With an idle connection in the pool, concurrent pipelinable loads
+   * share it and each gets its own response.
+   */
+  before = [[[NSURLProtocol connectionPoolStatistics]
+    objectForKey: @"Pipelined"] unsignedIntegerValue];
+  for (i = 0; i < LOADS; i++)
+    {
+      l = [[Loader new] autorelease];
+      [loaders addObject: l];
+      load(base, [NSString stringWithFormat: @"/p%u", i], l);
+    }
+  PASS(finished(loaders), "pipelined loads complete");
+  ok = YES;
+  for (i = 0; i < LOADS; i++)
+    {
+      NSString	*s;
+
+      l = [loaders objectAtIndex: i];
+      s = [[[NSString alloc] initWithData: l->data
+				 encoding: NSASCIIStringEncoding] autorelease];
+      if (YES == l->failed
+	|| NO == [s isEqual: [NSString stringWithFormat: @"/p%u", i]])
+	{
+	  ok = NO;
+	}
+    }
+  PASS(ok, "each pipelined load gets its own response");
+  PASS([[[NSURLProtocol connectionPoolStatistics]
+    objectForKey: @"Pipelined"] unsignedIntegerValue] > before,
+    "requests were pipelined");
+  END_SET("pipelining")
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,149 @@
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+
+#define	REQUESTS	100
+
+/* A minimal HTTP/1.1 server which keeps connections open and answers
+ * every request with a short body, counting the connections accepted.
+ */
+@interface	Server : NSObject
+{
+@public
+  int		listener;
+  unsigned	accepted;
+}
+- (void) serve: (id)arg;
+- (void) session: (NSNumber*)desc;
+@end
+
+@implementation	Server
+- (void) serve: (id)arg
+{
+  for (;;)
+    {
+      int	fd = accept(listener, 0, 0);
+
+      if (fd < 0)
+	{
+	  break;
+	}
+      accepted++;
+      [NSThread detachNewThreadSelector: @selector(session:)
+			       toTarget: self
+			     withObject: [NSNumber numberWithInt: fd]];
+    }
+}
+
+- (void) session: (NSNumber*)desc
+{
+  static const char	*reply
+    = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello";
+  int			fd = [desc intValue];
+  char			buf[4096];
+  unsigned		used = 0;
+  int			r;
+
+  while ((r = read(fd, buf + used, sizeof(buf) - used - 1)) > 0)
+    {
+      char	*end;
+
+      used += r;
+      buf[used] = '\0';
+      while ((end = strstr(buf, "\r\n\r\n")) != 0)
+	{
+	  unsigned	len = end + 4 - buf;
+
+	  write(fd, reply, strlen(reply));
+	  memmove(buf, buf + len, used - len + 1);
+	  used -= len;
+	}
+      if (used == sizeof(buf) - 1)
+	{
+	  break;
+	}
+    }
+  close(fd);
+}
+@end
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  Server		*server = [[Server new] autorelease];
+  struct sockaddr_in	sin;
+  socklen_t		len = sizeof(sin);
+  NSDictionary		*stats;
+  NSURL			*url;
+  unsigned		good = 0;
+  unsigned		i;
+
+  START_SET("connection pool")
+  server->listener = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin.sin_port = 0;
+  if (bind(server->listener, (struct sockaddr*)&sin, sizeof(sin)) < 0
+    || listen(server->listener, 16) < 0
+    || getsockname(server->listener, (struct sockaddr*)&sin, &len) < 0)
+    {
+      SKIP("unable to set up a local server")
+    }
+  [NSThread detachNewThreadSelector: @selector(serve:)
+			   toTarget: server
+			 withObject: nil];
+
+  url = [NSURL URLWithString: [NSString stringWithFormat:
+    @"http://127.0.0.1:%d/pool", ntohs(sin.sin_port)]];
+  for (i = 0; i < REQUESTS; i++)
+    {
+      NSAutoreleasePool	*pool = [NSAutoreleasePool new];
+      NSURLResponse	*response = nil;
+      NSError		*error = nil;
+      NSData		*data;
+
+      data = [NSURLConnection
+	sendSynchronousRequest: [NSURLRequest requestWithURL: url]
+	     returningResponse: &response
+			 error: &error];
+      if ([data isEqual: [NSData dataWithBytes: "hello" length: 5]])
+	{
+	  good++;
+	}
+      [pool release];
+    }
+  PASS(good == REQUESTS, "all requests got a response");
+  PASS(server->accepted < REQUESTS / 10,
+    "connections are reused (%u accepted for %u requests)",
+    server->accepted, REQUESTS);
+
+  stats = [NSURLProtocol connectionPoolStatistics];
+  PASS([[stats objectForKey: @"Hits"] unsignedIntegerValue] > 0,
+    "pool statistics record reuse");
+  PASS([[stats objectForKey: @"Idle"] unsignedIntegerValue] > 0,
+    "idle connection is kept in the pool");
+
+  /* With pooling disabled every request needs a new connection.
+   */
+  [NSURLProtocol setConnectionPoolMaximumIdle: 0 timeout: 120.0];
+  i = server->accepted;
+  [NSURLConnection sendSynchronousRequest: [NSURLRequest requestWithURL: url]
+			returningResponse: 0
+				    error: 0];
+  [NSURLConnection sendSynchronousRequest: [NSURLRequest requestWithURL: url]
+			returningResponse: 0
+				    error: 0];
+  PASS(server->accepted >= i + 1,
+    "a disabled pool does not keep connections");
+  END_SET("connection pool")
+
+  [arp release]; arp = nil;
+  return 0;
+}
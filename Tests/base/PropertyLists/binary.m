@@ -0,0 +1,98 @@
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSPropertyList.h>
+#import <Foundation/NSStream.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+#define	ENTRIES	100000
+
+static id
+roundTrip(NSData *d)
+{
+  return [NSPropertyListSerialization propertyListWithData: d
+    options: NSPropertyListImmutable format: 0 error: 0];
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  unichar		snowman[1] = { 0x2603 };
+  NSMutableDictionary	*plist = [NSMutableDictionary dictionary];
+  NSMutableArray	*shared = [NSMutableArray array];
+  NSArray		*small;
+  NSOutputStream	*stream;
+  NSData		*d;
+  NSData		*s;
+  NSInteger		written;
+  unsigned		i;
+
+  for (i = 0; i < ENTRIES; i++)
+    {
+      /* Every value is one of ten equal strings.
+       */
+      [plist setObject: [NSString stringWithFormat: @"value%u", i % 10]
+		forKey: [NSString stringWithFormat: @"key%u", i]];
+    }
+  [plist setObject: [NSNumber numberWithInt: 1] forKey: @"int"];
+  [plist setObject: [NSNumber numberWithDouble: 1.0] forKey: @"double"];
+  [plist setObject: [NSNumber numberWithBool: YES] forKey: @"bool"];
+  [plist setObject: [NSNumber numberWithLongLong: 1LL << 40] forKey: @"big"];
+  [plist setObject: [NSDate dateWithTimeIntervalSinceReferenceDate: 1.5]
+	    forKey: @"date"];
+  [plist setObject: [[NSString stringWithCharacters: snowman length: 1]
+    stringByPaddingToLength: 20000 withString: @"x" startingAtIndex: 0]
+	    forKey: @"unicode"];
+  [plist setObject: [NSMutableData dataWithLength: 100000] forKey: @"data"];
+  small = [NSArray arrayWithObjects: @"a", @"b", @"a", nil];
+  [shared addObject: small];
+  [shared addObject: small];
+  [plist setObject: shared forKey: @"shared"];
+
+  d = [NSPropertyListSerialization dataWithPropertyList: plist
+    format: NSPropertyListBinaryFormat_v1_0 options: 0 error: 0];
+  PASS(d != nil, "large binary property list is generated");
+  PASS_EQUAL(roundTrip(d), plist, "large binary property list round trips");
+  PASS([d length] < ENTRIES * 25,
+    "equal strings are stored once (%u bytes)", (unsigned)[d length]);
+  PASS(*[[roundTrip(d) objectForKey: @"double"] objCType] == 'd',
+    "a real number equal to an integer is stored separately");
+
+  stream = [NSOutputStream outputStreamToMemory];
+  [stream open];
+  written = [NSPropertyListSerialization writePropertyList: plist
+    toStream: stream format: NSPropertyListBinaryFormat_v1_0
+    options: 0 error: 0];
+  s = [stream propertyForKey: NSStreamDataWrittenToMemoryStreamKey];
+  [stream close];
+  PASS(written == (NSInteger)[d length], "streamed output has the same length");
+  PASS_EQUAL(s, d, "streamed output is the same as the data");
+
+  /* Small numbers may be tagged pointers, which must not be confused
+   * with the collections around them.
+   */
+  [shared removeAllObjects];
+  for (i = 0; i < 1000; i++)
+    {
+      NSNumber	*n = [NSNumber numberWithInt: i];
+
+      [shared addObject: n];
+      [shared addObject: [NSArray arrayWithObject: n]];
+      [shared addObject: [NSDictionary dictionaryWithObject: n forKey: @"n"]];
+    }
+  d = [NSPropertyListSerialization dataWithPropertyList: shared
+    format: NSPropertyListBinaryFormat_v1_0 options: 0 error: 0];
+  PASS_EQUAL(roundTrip(d), shared,
+    "numbers mixed with collections round trip");
+
+  d = [NSPropertyListSerialization dataWithPropertyList: @"lonely"
+    format: NSPropertyListBinaryFormat_v1_0 options: 0 error: 0];
+  PASS_EQUAL(roundTrip(d), @"lonely", "a lone string round trips");
+
+  [arp release]; arp = nil;
+  return 0;
+}
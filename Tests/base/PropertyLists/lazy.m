@@ -0,0 +1,80 @@
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSPropertyList.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+#define	ENTRIES	1000
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  NSMutableDictionary	*plist = [NSMutableDictionary dictionary];
+  NSMutableArray	*list = [NSMutableArray array];
+  NSData		*blob;
+  NSData		*d;
+  NSDictionary		*eager;
+  NSDictionary		*lazy;
+  NSData		*found;
+  const char		*base;
+  const char		*ptr;
+  unsigned		i;
+
+  for (i = 0; i < ENTRIES; i++)
+    {
+      NSString	*k = [NSString stringWithFormat: @"key%u", i];
+
+      [plist setObject: [NSNumber numberWithInt: i] forKey: k];
+      [list addObject: [NSString stringWithFormat: @"item%u", i]];
+    }
+  blob = [NSMutableData dataWithLength: 4096];
+  [plist setObject: blob forKey: @"blob"];
+  [plist setObject: list forKey: @"list"];
+  [plist setObject: [NSArray arrayWithObjects: @"a", @"b", nil]
+	    forKey: @"short"];
+  [plist setObject: [NSDictionary dictionaryWithObject: @"v" forKey: @"k"]
+	    forKey: @"nested"];
+
+  d = [NSPropertyListSerialization dataWithPropertyList: plist
+    format: NSPropertyListBinaryFormat_v1_0 options: 0 error: 0];
+  PASS(d != nil, "binary property list is generated");
+
+  eager = [NSPropertyListSerialization propertyListWithData: d
+    options: NSPropertyListImmutable format: 0 error: 0];
+  lazy = [NSPropertyListSerialization propertyListWithData: d
+    options: NSPropertyListImmutable | GSPropertyListReadLazily
+    format: 0 error: 0];
+  PASS([lazy count] == [plist count], "lazy dictionary has the right count");
+  PASS_EQUAL([lazy objectForKey: @"key42"], [NSNumber numberWithInt: 42],
+    "lazy dictionary finds a value");
+  PASS([lazy objectForKey: @"missing"] == nil,
+    "lazy dictionary does not find a missing key");
+  PASS([lazy objectForKey: @"key7"] == [lazy objectForKey: @"key7"],
+    "lazy dictionary decodes each value once");
+  PASS_EQUAL([[lazy objectForKey: @"list"] objectAtIndex: 999], @"item999",
+    "lazy array finds a member");
+  PASS_EXCEPTION([[lazy objectForKey: @"list"] objectAtIndex: ENTRIES],
+    NSRangeException, "lazy array checks its bounds");
+  PASS_EQUAL(lazy, plist, "lazy property list equals the original");
+  PASS_EQUAL(eager, lazy, "lazy property list equals the eager one");
+
+  found = [lazy objectForKey: @"blob"];
+  base = [d bytes];
+  ptr = [found bytes];
+  PASS_EQUAL(found, blob, "lazy data has the right content");
+  PASS(ptr >= base && ptr + [found length] <= base + [d length],
+    "lazy data refers to the property list bytes");
+
+  lazy = [NSPropertyListSerialization propertyListWithData: d
+    options: NSPropertyListMutableContainers | GSPropertyListReadLazily
+    format: 0 error: 0];
+  PASS([lazy isKindOfClass: [NSMutableDictionary class]],
+    "lazy reading is not used for mutable containers");
+  PASS_EQUAL(lazy, plist, "mutable property list equals the original");
+
+  [arp release]; arp = nil;
+  return 0;
+}
@@ -0,0 +1,67 @@
+#import "Testing.h"
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSPropertyList.h>
+#import <Foundation/NSString.h>
+
+static id
+parse(const char *text, NSPropertyListMutabilityOptions opt)
+{
+  NSData	*d = [NSData dataWithBytes: text length: strlen(text)];
+
+  return [NSPropertyListSerialization propertyListWithData: d
+    options: opt format: 0 error: 0];
+}
+
+int main()
+{
+  NSAutoreleasePool	*arp = [NSAutoreleasePool new];
+  unichar		u[] = { 'c', 'a', 'f', 0xe9, 0x2603 };
+  NSDictionary		*dict;
+  NSString		*str;
+  id			obj;
+
+  dict = parse("{\n"
+    "        /* indented by spaces */\n"
+    "\t\t\t\t\t\t\t\t\t\tkey = value;  // and tabs\n"
+    "        quoted = \"a quoted string which is more than a word long\";\n"
+    "        escaped = \"tab\\there \\\"quoted\\\" \\101\\U00e9\";\n"
+    "        utf8 = \"caf\xc3\xa9 \xe2\x98\x83\";\n"
+    "        list = (one, \"two\", \"\");\n"
+    "}\n", NSPropertyListImmutable);
+  PASS([dict isKindOfClass: [NSDictionary class]], "text is parsed");
+  PASS_EQUAL([dict objectForKey: @"key"], @"value",
+    "unquoted strings are parsed");
+  PASS_EQUAL([dict objectForKey: @"quoted"],
+    @"a quoted string which is more than a word long",
+    "long quoted strings are parsed");
+  str = [NSString stringWithFormat: @"tab\there \"quoted\" A%C", 0xe9];
+  PASS_EQUAL([dict objectForKey: @"escaped"], str,
+    "escapes in quoted strings are parsed");
+  str = [NSString stringWithFormat: @"%@ %C",
+    [NSString stringWithCharacters: u length: 4], u[4]];
+  PASS_EQUAL([dict objectForKey: @"utf8"], str,
+    "non-ASCII quoted strings are parsed");
+  obj = [NSArray arrayWithObjects: @"one", @"two", @"", nil];
+  PASS_EQUAL([dict objectForKey: @"list"], obj, "arrays are parsed");
+
+  obj = parse("\"line one\nline two\" junk", NSPropertyListImmutable);
+  PASS(obj == nil, "extra data after a string is an error");
+  obj = parse("\"no closing quote", NSPropertyListImmutable);
+  PASS(obj == nil, "an unterminated string is an error");
+
+  obj = [parse("(plain, \"quoted and long\")", NSPropertyListImmutable)
+    objectAtIndex: 1];
+  PASS([obj isKindOfClass: [NSMutableString class]] == NO,
+    "immutable strings are made for immutable property lists");
+  obj = parse("(plain, \"quoted and long\")",
+    NSPropertyListMutableContainersAndLeaves);
+  PASS([[obj objectAtIndex: 0] isKindOfClass: [NSMutableString class]]
+    && [[obj objectAtIndex: 1] isKindOfClass: [NSMutableString class]],
+    "mutable strings are made for mutable leaves");
+
+  [arp release]; arp = nil;
+  return 0;
+}